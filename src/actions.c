@@ -863,6 +863,14 @@ action_stop(GSimpleAction *action, GVariant *parameter, I7Story *story)
 	i7_story_stop_running_game(story);
 }
 
+/* Play->Profile Story */
+void
+action_profile_toggled(GSimpleAction *action, GVariant *state, I7Story *story)
+{
+	if(i7_story_set_profiling(story, g_variant_get_boolean(state)))
+		g_simple_action_set_state(action, state);
+}
+
 /* Play->Refresh Index */
 void
 action_refresh_index(GSimpleAction *action, GVariant *parameter, I7Story *story)
@@ -884,6 +892,13 @@ action_play_all_blessed(GSimpleAction *action, GVariant *parameter, I7Story *sto
 	i7_story_compile(story, FALSE, FALSE, (CompileActionFunc)i7_story_run_compiler_output_and_entire_skein, NULL);
 }
 
+/* Replay->Test All Blessed Threads */
+void
+action_test_all_blessed(GSimpleAction *action, GVariant *parameter, I7Story *story)
+{
+	i7_story_compile(story, FALSE, FALSE, (CompileActionFunc)i7_story_test_compiler_output_and_entire_skein, NULL);
+}
+
 /* Replay->Show Last Command */
 void
 action_show_last_command(GSimpleAction *action, GVariant *parameter, I7Story *story)
@@ -76,9 +76,11 @@ void action_enable_elastic_tabstops_toggled(GSimpleAction *action, GVariant *sta
 void action_go(GSimpleAction *action, GVariant *parameter, I7Story *story);
 void action_test_me(GSimpleAction *action, GVariant *parameter, I7Story *story);
 void action_stop(GSimpleAction *action, GVariant *parameter, I7Story *story);
+void action_profile_toggled(GSimpleAction *action, GVariant *state, I7Story *story);
 void action_refresh_index(GSimpleAction *action, GVariant *parameter, I7Story *story);
 void action_replay(GSimpleAction *action, GVariant *parameter, I7Story *story);
 void action_play_all_blessed(GSimpleAction *action, GVariant *parameter, I7Story *story);
+void action_test_all_blessed(GSimpleAction *action, GVariant *parameter, I7Story *story);
 void action_show_last_command(GSimpleAction *action, GVariant *parameter, I7Story *story);
 void action_show_last_command_skein(GSimpleAction *action, GVariant *parameter, I7Story *story);
 void action_previous_changed_command(GSimpleAction *action, GVariant *parameter, I7Story *story);
@@ -27,6 +27,7 @@
 
 void branch_if(int do_branch)
 {
+  CACHE_ZSTATE;
   uint8_t branch;
   uint16_t offset;
 
@@ -60,6 +61,8 @@ void branch_if(int do_branch)
 
 void zjump(void)
 {
+  CACHE_ZSTATE;
+
   /* -= 2 because pc has been advanced past the jump instruction. */
   pc += as_signed(zargs[0]);
   pc -= 2;
@@ -69,11 +72,15 @@ void zjump(void)
 
 void zjz(void)
 {
+  CACHE_ZSTATE;
+
   branch_if(zargs[0] == 0);
 }
 
 void zje(void)
 {
+  CACHE_ZSTATE;
+
   if     (znargs == 1) branch_if(0);
   else if(znargs == 2) branch_if(zargs[0] == zargs[1]);
   else if(znargs == 3) branch_if(zargs[0] == zargs[1] || zargs[0] == zargs[2]);
@@ -82,10 +89,14 @@ void zje(void)
 
 void zjl(void)
 {
+  CACHE_ZSTATE;
+
   branch_if(as_signed(zargs[0]) < as_signed(zargs[1]));
 }
 
 void zjg(void)
 {
+  CACHE_ZSTATE;
+
   branch_if(as_signed(zargs[0]) > as_signed(zargs[1]));
 }
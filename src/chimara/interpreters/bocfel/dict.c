@@ -28,8 +28,31 @@
 #include "util.h"
 #include "zterp.h"
 
-static uint16_t separators;
-static uint8_t num_separators;
+static zthread_local uint16_t separators;
+static zthread_local uint8_t num_separators;
+
+/* Tokenizing looks up every word of a command in the dictionary, which
+ * is a binary search for sorted dictionaries and a linear one for the
+ * unsorted dictionaries that stories can build themselves.  Instead,
+ * the first time a dictionary is used, its entries are put into a hash
+ * table keyed on their encoded text.  Dictionaries in dynamic memory
+ * can be changed by the story, so writes to them (see STORE_BYTE())
+ * cause their indices to be thrown away, to be rebuilt on next use.
+ */
+struct dict_index
+{
+  uint16_t dictionary;
+  uint32_t start, end;  /* bytes that the index was built from */
+  uint16_t base;
+  uint8_t elength;
+  uint32_t mask;
+  uint16_t *slots;      /* entry number + 1, or 0 if unused */
+  struct dict_index *next;
+};
+
+static zthread_local struct dict_index *indices;
+
+zthread_local uint32_t dict_watch_start, dict_watch_end;
 
 static uint16_t GET_WORD(uint8_t *base)
 {
@@ -137,6 +160,118 @@ static int dict_compar(const void *a, const void *b)
 {
   return memcmp(a, b, zversion <= 3 ? 4 : 6);
 }
+
+static uint32_t dict_hash(const uint8_t *encoded)
+{
+  uint32_t hash = 2166136261UL;
+
+  for(int i = 0; i < (zversion <= 3 ? 4 : 6); i++)
+  {
+    hash = (hash ^ encoded[i]) * 16777619UL;
+  }
+
+  return hash;
+}
+
+static void update_dict_watch(void)
+{
+  dict_watch_start = dict_watch_end = 0;
+
+  for(struct dict_index *index = indices; index != NULL; index = index->next)
+  {
+    if(index->start >= header.static_start) continue;
+
+    if(dict_watch_start == dict_watch_end || index->start < dict_watch_start) dict_watch_start = index->start;
+    if(index->end > dict_watch_end) dict_watch_end = index->end;
+  }
+
+  update_watch();
+}
+
+/* Throw away the index of any dictionary that overlaps [start, end). */
+void dict_forget(uint32_t start, uint32_t end)
+{
+  struct dict_index **p = &indices;
+
+  while(*p != NULL)
+  {
+    struct dict_index *index = *p;
+
+    if(index->start < end && start < index->end)
+    {
+      *p = index->next;
+      free(index->slots);
+      free(index);
+    }
+    else
+    {
+      p = &index->next;
+    }
+  }
+
+  update_dict_watch();
+}
+
+/* Build the index for a dictionary.  If there are duplicate entries,
+ * the first one wins, as it would for a linear search.  This returns
+ * NULL if memory cannot be allocated, in which case the dictionary is
+ * searched directly.
+ */
+static struct dict_index *build_index(uint16_t dictionary, uint16_t base, uint8_t elength, long nentries)
+{
+  struct dict_index *index;
+  uint32_t size = 16;
+
+  while(size < 2 * nentries) size *= 2;
+
+  index = malloc(sizeof *index);
+  if(index == NULL) return NULL;
+
+  index->slots = calloc(size, sizeof *index->slots);
+  if(index->slots == NULL)
+  {
+    free(index);
+    return NULL;
+  }
+
+  index->dictionary = dictionary;
+  index->start = dictionary;
+  index->end = base + (nentries * elength);
+  index->base = base;
+  index->elength = elength;
+  index->mask = size - 1;
+
+  for(long i = 0; i < nentries; i++)
+  {
+    const uint8_t *entry = &memory[base + (i * elength)];
+    uint32_t slot = dict_hash(entry) & index->mask;
+
+    while(index->slots[slot] != 0 && dict_compar(entry, &memory[base + ((index->slots[slot] - 1) * elength)]) != 0)
+    {
+      slot = (slot + 1) & index->mask;
+    }
+
+    if(index->slots[slot] == 0) index->slots[slot] = i + 1;
+  }
+
+  index->next = indices;
+  indices = index;
+
+  update_dict_watch();
+
+  return index;
+}
+
+static struct dict_index *find_index(uint16_t dictionary)
+{
+  for(struct dict_index *index = indices; index != NULL; index = index->next)
+  {
+    if(index->dictionary == dictionary) return index;
+  }
+
+  return NULL;
+}
+
 static uint16_t dict_find(const uint8_t *token, size_t len, uint16_t dictionary)
 {
   uint8_t elength;
@@ -154,6 +289,25 @@ static uint16_t dict_find(const uint8_t *token, size_t len, uint16_t dictionary)
   ZASSERT(elength >= (zversion <= 3 ? 4 : 6), "dictionary entry length (%d) too small", elength);
   ZASSERT(base + (labs(nentries) * elength) < memory_size, "reported dictionary length extends beyond memory size");
 
+  if(nentries != 0)
+  {
+    struct dict_index *index = find_index(dictionary);
+
+    if(index == NULL) index = build_index(dictionary, base, elength, labs(nentries));
+
+    if(index != NULL)
+    {
+      for(uint32_t slot = dict_hash(encoded) & index->mask; index->slots[slot] != 0; slot = (slot + 1) & index->mask)
+      {
+        uint16_t entry = base + ((index->slots[slot] - 1) * elength);
+
+        if(dict_compar(encoded, &memory[entry]) == 0) return entry;
+      }
+
+      return 0;
+    }
+  }
+
   if(nentries > 0)
   {
     ret = bsearch(encoded, &memory[base], nentries, elength, dict_compar);
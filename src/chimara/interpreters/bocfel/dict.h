@@ -3,6 +3,12 @@
 
 #include <stdint.h>
 
+#include "util.h"
+
+extern zthread_local uint32_t dict_watch_start, dict_watch_end;
+
+void dict_forget(uint32_t, uint32_t);
+
 void tokenize(uint16_t, uint16_t, uint16_t, int);
 
 void ztokenise(void);
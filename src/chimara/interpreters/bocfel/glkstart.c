@@ -35,6 +35,14 @@ glkunix_argumentlist_t glkunix_arguments[] =
   { NULL, glkunix_arg_End, NULL }
 };
 
+#ifdef GLKUNIX_REENTRANT
+/* All of the interpreter’s state is zthread_local, so several games can
+ * share this copy of Bocfel.
+ */
+zexternally_visible
+const int glkunix_reentrant = 1;
+#endif
+
 zexternally_visible
 int glkunix_startup_code(glkunix_startup_t *data)
 {
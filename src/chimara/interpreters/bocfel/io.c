@@ -35,7 +35,7 @@
 #define MAX_PATH	4096
 #endif
 
-int use_utf8_io;
+zthread_local int use_utf8_io;
 
 /* Generally speaking, UNICODE_LINEFEED (10) is used as a newline.  Glk
  * requires this (Glk API 0.7.0 §2.2), and when Unicode is available, we
@@ -162,7 +162,7 @@ err:
  */
 const zterp_io *zterp_io_stdin(void)
 {
-  static zterp_io io;
+  static zthread_local zterp_io io;
 
   if(io.fp == NULL)
   {
@@ -178,7 +178,7 @@ const zterp_io *zterp_io_stdin(void)
 
 const zterp_io *zterp_io_stdout(void)
 {
-  static zterp_io io;
+  static zthread_local zterp_io io;
 
   if(io.fp == NULL)
   {
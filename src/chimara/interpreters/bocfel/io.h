@@ -1,6 +1,8 @@
 #ifndef ZTERP_IO_H
 #define ZTERP_IO_H
 
+#include "util.h"
+
 #include <stdio.h>
 #include <stdint.h>
 
@@ -19,7 +21,7 @@ typedef struct zterp_io zterp_io;
  * If this is set, transcripts will be written in UTF-8, and if
  * Glk is not being used, screen output will be written in UTF-8.
  */
-extern int use_utf8_io;
+extern zthread_local int use_utf8_io;
 
 zterp_io *zterp_io_open(const char *, int);
 const zterp_io *zterp_io_stdin(void);
@@ -27,21 +27,28 @@
 
 void zinc(void)
 {
+  CACHE_ZSTATE;
+
   store_variable(zargs[0], variable(zargs[0]) + 1);
 }
 
 void zdec(void)
 {
+  CACHE_ZSTATE;
+
   store_variable(zargs[0], variable(zargs[0]) - 1);
 }
 
 void znot(void)
 {
+  CACHE_ZSTATE;
+
   store(~zargs[0]);
 }
 
 void zdec_chk(void)
 {
+  CACHE_ZSTATE;
   int16_t new;
   int16_t val = as_signed(zargs[1]);
 
@@ -56,6 +63,7 @@ void zdec_chk(void)
 
 void zinc_chk(void)
 {
+  CACHE_ZSTATE;
   int16_t new;
   int16_t val = as_signed(zargs[1]);
 
@@ -70,48 +78,65 @@ void zinc_chk(void)
 
 void ztest(void)
 {
+  CACHE_ZSTATE;
+
   branch_if( (zargs[0] & zargs[1]) == zargs[1] );
 }
 
 void zor(void)
 {
+  CACHE_ZSTATE;
+
   store(zargs[0] | zargs[1]);
 }
 
 void zand(void)
 {
+  CACHE_ZSTATE;
+
   store(zargs[0] & zargs[1]);
 }
 
 void zadd(void)
 {
+  CACHE_ZSTATE;
+
   store(zargs[0] + zargs[1]);
 }
 
 void zsub(void)
 {
+  CACHE_ZSTATE;
+
   store(zargs[0] - zargs[1]);
 }
 
 void zmul(void)
 {
+  CACHE_ZSTATE;
+
   store(zargs[0] * zargs[1]);
 }
 
 void zdiv(void)
 {
+  CACHE_ZSTATE;
+
   ZASSERT(zargs[1] != 0, "divide by zero");
   store(as_signed(zargs[0]) / as_signed(zargs[1]));
 }
 
 void zmod(void)
 {
+  CACHE_ZSTATE;
+
   ZASSERT(zargs[1] != 0, "divide by zero");
   store(as_signed(zargs[0]) % as_signed(zargs[1]));
 }
 
 void zlog_shift(void)
 {
+  CACHE_ZSTATE;
   int16_t places = as_signed(zargs[1]);
 
   /* Shifting more than 15 bits is undefined (as of Standard 1.1), but
@@ -129,6 +154,7 @@ void zlog_shift(void)
 
 void zart_shift(void)
 {
+  CACHE_ZSTATE;
   int16_t number = as_signed(zargs[0]), places = as_signed(zargs[1]);
 
   /* Shifting more than 15 bits is undefined (as of Standard 1.1), but
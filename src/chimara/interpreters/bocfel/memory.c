@@ -18,19 +18,159 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "memory.h"
 #include "branch.h"
+#include "dict.h"
 #include "process.h"
 #include "screen.h"
 #include "util.h"
 #include "zterp.h"
 
-uint8_t *memory, *dynamic_memory;
-uint32_t memory_size;
+/* Recompute the watched range from those of the dictionary indices and
+ * the pre-decoded instructions.  Each calls this when its own range
+ * changes.
+ */
+void update_watch(void)
+{
+  CACHE_ZSTATE;
+
+  watch_start = dict_watch_start;
+  watch_end = dict_watch_end;
+
+  if(code_watch_start != code_watch_end)
+  {
+    if(watch_start == watch_end || code_watch_start < watch_start) watch_start = code_watch_start;
+    if(code_watch_end > watch_end) watch_end = code_watch_end;
+  }
+}
+
+/* Memory in [start, end) has been, or is about to be, changed. */
+void memory_written(uint32_t start, uint32_t end)
+{
+  CACHE_ZSTATE;
+
+  if(start < dict_watch_end && end > dict_watch_start) dict_forget(start, end);
+  if(start < code_watch_end && end > code_watch_start) forget_decoded(start, end);
+
+  if(end > 0x10000) end = 0x10000;
+  for(uint32_t i = start >> MEMORY_PAGE_SHIFT; i << MEMORY_PAGE_SHIFT < end; i++) dirty_pages[i] = 1;
+}
+
+/* Snapshots of dynamic memory, used for undo (see push_save()).
+ *
+ * A snapshot is an array of reference-counted pages.  current_pages
+ * holds the pages of the most recent snapshot taken or restored; a page
+ * which has not been marked dirty since then still matches memory, so
+ * the next snapshot shares it rather than copying it.  Likewise,
+ * restoring a snapshot copies back only the pages which differ from
+ * memory.  A game which changes a few hundred bytes a turn thus costs a
+ * few pages per undo state, however large dynamic memory is.
+ */
+struct page
+{
+  unsigned long refs;
+  uint8_t data[MEMORY_PAGE_SIZE];
+};
+
+struct snapshot
+{
+  uint32_t npages;
+  struct page *pages[];
+};
+
+static zthread_local struct page *current_pages[MEMORY_PAGES];
+
+static void unref_page(struct page *page)
+{
+  if(page != NULL && --page->refs == 0) free(page);
+}
+
+static void replace_page(uint32_t i, struct page *page)
+{
+  page->refs++;
+  unref_page(current_pages[i]);
+  current_pages[i] = page;
+}
+
+static uint32_t page_length(uint32_t i)
+{
+  CACHE_ZSTATE;
+  uint32_t start = i << MEMORY_PAGE_SHIFT;
+
+  return header.static_start - start < MEMORY_PAGE_SIZE ? header.static_start - start : MEMORY_PAGE_SIZE;
+}
+
+/* Returns NULL if memory cannot be allocated. */
+struct snapshot *snapshot_take(void)
+{
+  CACHE_ZSTATE;
+  uint32_t npages = (header.static_start + MEMORY_PAGE_SIZE - 1) >> MEMORY_PAGE_SHIFT;
+  struct snapshot *snapshot;
+
+  snapshot = malloc(sizeof *snapshot + npages * sizeof *snapshot->pages);
+  if(snapshot == NULL) return NULL;
+
+  for(snapshot->npages = 0; snapshot->npages < npages; snapshot->npages++)
+  {
+    uint32_t i = snapshot->npages;
+
+    if(dirty_pages[i] || current_pages[i] == NULL)
+    {
+      struct page *page = malloc(sizeof *page);
+
+      if(page == NULL)
+      {
+        snapshot_free(snapshot);
+        return NULL;
+      }
+
+      page->refs = 0;
+      memcpy(page->data, &memory[i << MEMORY_PAGE_SHIFT], page_length(i));
+      replace_page(i, page);
+      dirty_pages[i] = 0;
+    }
+
+    snapshot->pages[i] = current_pages[i];
+    snapshot->pages[i]->refs++;
+  }
+
+  return snapshot;
+}
+
+void snapshot_restore(const struct snapshot *snapshot)
+{
+  CACHE_ZSTATE;
+
+  for(uint32_t i = 0; i < snapshot->npages; i++)
+  {
+    if(dirty_pages[i] || current_pages[i] != snapshot->pages[i])
+    {
+      uint32_t start = i << MEMORY_PAGE_SHIFT;
+
+      memcpy(&memory[start], snapshot->pages[i]->data, page_length(i));
+      memory_written(start, start + page_length(i));
+      replace_page(i, snapshot->pages[i]);
+    }
+  }
+
+  memset(dirty_pages, 0, snapshot->npages);
+}
+
+void snapshot_free(struct snapshot *snapshot)
+{
+  if(snapshot != NULL)
+  {
+    for(uint32_t i = 0; i < snapshot->npages; i++) unref_page(snapshot->pages[i]);
+    free(snapshot);
+  }
+}
 
 void user_store_byte(uint16_t addr, uint8_t v)
 {
+  CACHE_ZSTATE;
+
   /* If safety checks are off, there’s no point in checking these
    * special cases. */
 #ifndef ZTERP_NO_SAFETY_CHECKS
@@ -80,6 +220,7 @@ void user_store_word(uint16_t addr, uint16_t v)
 
 void zcopy_table(void)
 {
+  CACHE_ZSTATE;
   uint16_t first = zargs[0], second = zargs[1], size = zargs[2];
 
   if(second == 0)
@@ -99,6 +240,7 @@ void zcopy_table(void)
 
 void zscan_table(void)
 {
+  CACHE_ZSTATE;
   uint16_t addr = zargs[1];
 
   if(znargs < 4) zargs[3] = 0x82;
@@ -124,20 +266,28 @@ void zscan_table(void)
 
 void zloadw(void)
 {
+  CACHE_ZSTATE;
+
   store(user_word(zargs[0] + (2 * zargs[1])));
 }
 
 void zloadb(void)
 {
+  CACHE_ZSTATE;
+
   store(user_byte(zargs[0] + zargs[1]));
 }
 
 void zstoreb(void)
 {
+  CACHE_ZSTATE;
+
   user_store_byte(zargs[0] + zargs[1], zargs[2]);
 }
 
 void zstorew(void)
 {
+  CACHE_ZSTATE;
+
   user_store_word(zargs[0] + (2 * zargs[1]), zargs[2]);
 }
@@ -1,6 +1,7 @@
 #ifndef ZTERP_MEMORY_H
 #define ZTERP_MEMORY_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "util.h"
@@ -14,36 +15,70 @@
  * the most sensible way to deal with the problem.
  */
 
-extern uint8_t *memory, *dynamic_memory;
-extern uint32_t memory_size;
-
 static inline uint8_t BYTE(uint32_t addr)
 {
+  CACHE_ZSTATE;
   return memory[addr];
 }
 
+/* Dictionary indices (dict.c) and pre-decoded instructions (process.c)
+ * are built from memory, so they must be told when it changes.  Stores
+ * between watch_start and watch_end are passed to memory_written(), as
+ * are bulk changes such as restores.
+ */
+
+void update_watch(void);
+void memory_written(uint32_t, uint32_t);
+
+/* For undo, dynamic memory is split into pages of MEMORY_PAGE_SIZE
+ * bytes which save states can share (see memory.c).  Stores mark the
+ * pages that they change in dirty_pages.  Only the first 64K can be
+ * dynamic; a store beyond that, which does not happen, would just mark
+ * the wrong page.
+ */
+#define DIRTY_PAGE(addr)	(dirty_pages[((addr) >> MEMORY_PAGE_SHIFT) & (MEMORY_PAGES - 1)] = 1)
+
+struct snapshot;
+
+struct snapshot *snapshot_take(void);
+void snapshot_restore(const struct snapshot *);
+void snapshot_free(struct snapshot *);
+
 static inline void STORE_BYTE(uint32_t addr, uint8_t val)
 {
+  CACHE_ZSTATE;
+  if(addr < watch_end && addr >= watch_start) memory_written(addr, addr + 1);
+
+  DIRTY_PAGE(addr);
+
   memory[addr] = val;
 }
 
 static inline uint16_t WORD(uint32_t addr)
 {
+  CACHE_ZSTATE;
 #ifndef ZTERP_NO_CHEAT
   uint16_t cheat_val;
-  if(cheat_find_freezew(addr, &cheat_val)) return cheat_val;
+  if(freezew_cheat != NULL && cheat_find_freezew(addr, &cheat_val)) return cheat_val;
 #endif
   return (memory[addr] << 8) | memory[addr + 1];
 }
 
 static inline void STORE_WORD(uint32_t addr, uint16_t val)
 {
+  CACHE_ZSTATE;
+  if(addr < watch_end && addr + 2 > watch_start) memory_written(addr, addr + 2);
+
+  DIRTY_PAGE(addr);
+  DIRTY_PAGE(addr + 1);
+
   memory[addr + 0] = val >> 8;
   memory[addr + 1] = val & 0xff;
 }
 
 static inline uint8_t user_byte(uint16_t addr)
 {
+  CACHE_ZSTATE;
   ZASSERT(addr < header.static_end, "attempt to read out-of-bounds address 0x%lx", (unsigned long)addr);
 
   return BYTE(addr);
@@ -51,6 +86,7 @@ static inline uint8_t user_byte(uint16_t addr)
 
 static inline uint16_t user_word(uint16_t addr)
 {
+  CACHE_ZSTATE;
   ZASSERT(addr < header.static_end - 1, "attempt to read out-of-bounds address 0x%lx", (unsigned long)addr);
 
   return WORD(addr);
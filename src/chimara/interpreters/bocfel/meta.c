@@ -111,7 +111,7 @@ static int32_t unito32(const uint32_t *s, int base, int *valid)
   return n * neg;
 }
 
-uint32_t read_pc;
+zthread_local uint32_t read_pc;
 
 static void try_user_save(const char *desc)
 {
@@ -164,8 +164,8 @@ static unsigned long addr_to_global(uint16_t addr)
   return (addr - header.globals) / 2;
 }
 
-static uint8_t *debug_change_memory;
-static int debug_change_valid[65536];
+static zthread_local uint8_t *debug_change_memory;
+static zthread_local int debug_change_valid[65536];
 
 static void meta_debug_change_start(void)
 {
@@ -249,7 +249,7 @@ static int meta_debug_change(const uint32_t *string)
 
 static int meta_debug_scan(const uint32_t *string)
 {
-  static int debug_scan_locations[65536];
+  static zthread_local int debug_scan_locations[65536];
 
   if(unicmp(string, "start") == 0)
   {
@@ -348,6 +348,26 @@ static int meta_debug_print(const uint32_t *string)
   return 0;
 }
 
+static int meta_debug_predecode(const uint32_t *string)
+{
+  if(unicmp(string, "on") == 0)
+  {
+    options.disable_predecode = 0;
+    screen_print("[instruction pre-decoding on]");
+  }
+  else if(unicmp(string, "off") == 0)
+  {
+    options.disable_predecode = 1;
+    screen_print("[instruction pre-decoding off]");
+  }
+  else
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
 static int meta_debug_help(void)
 {
   screen_print(
@@ -359,6 +379,7 @@ static int meta_debug_help(void)
       "scan N: update scan list with all words equal to N; if N starts with 0x it is hexadecimal, decimal otherwise\n"
       "scan show: print all locations matching scan criteria\n"
       "print N: print the word at address N; N is hexadecimal\n"
+      "predecode on|off: switch instruction pre-decoding on or off\n"
       );
 
   return 0;
@@ -380,6 +401,10 @@ static void meta_debug(const uint32_t *string)
   {
     result = meta_debug_print(string + 6);
   }
+  else if(unincmp(string, "predecode ", 10) == 0)
+  {
+    result = meta_debug_predecode(string + 10);
+  }
   else if(unicmp(string, "help") == 0)
   {
     result = meta_debug_help();
@@ -1,8 +1,10 @@
 #ifndef ZTERP_META_H
 #define ZTERP_META_H
 
+#include "util.h"
+
 const uint32_t *handle_meta_command(const uint32_t *);
 
-extern uint32_t read_pc;
+extern zthread_local uint32_t read_pc;
 
 #endif
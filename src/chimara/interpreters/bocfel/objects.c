@@ -29,6 +29,8 @@
 
 static uint16_t find_object(uint16_t n)
 {
+  CACHE_ZSTATE;
+
   /* Use 32-bit arithmetic to detect 16-bit overflow. */
   uint32_t base = header.objects, object = n, addr;
   int objsize;
@@ -65,11 +67,15 @@ static uint16_t find_object(uint16_t n)
 
 static uint16_t property_address(uint16_t n)
 {
+  CACHE_ZSTATE;
+
   return WORD(find_object(n) + OFFSET_PROP);
 }
 
 static uint16_t relation(uint16_t object, int offset)
 {
+  CACHE_ZSTATE;
+
   return zversion <= 3 ? BYTE(find_object(object) + offset) : WORD(find_object(object) + offset);
 }
 
@@ -82,6 +88,8 @@ static uint16_t relation(uint16_t object, int offset)
  */
 static void set_relation(uint16_t obj1, uint16_t obj2, int offset)
 {
+  CACHE_ZSTATE;
+
   if(zversion <= 3) STORE_BYTE(find_object(obj1) + offset, obj2);
   else              STORE_WORD(find_object(obj1) + offset, obj2);
 }
@@ -124,6 +132,7 @@ static void remove_object(uint16_t object)
 
 static uint16_t property_length(uint16_t propaddr)
 {
+  CACHE_ZSTATE;
   uint16_t length;
   /* The address is to the data; the size byte is right before. */
   uint8_t byte = user_byte(propaddr - 1);
@@ -150,6 +159,7 @@ static uint16_t property_length(uint16_t propaddr)
 
 static uint8_t property_number(uint16_t propaddr)
 {
+  CACHE_ZSTATE;
   uint8_t propnum;
 
   if(zversion <= 3)
@@ -167,6 +177,7 @@ static uint8_t property_number(uint16_t propaddr)
 
 static uint16_t advance_prop_addr(uint16_t propaddr)
 {
+  CACHE_ZSTATE;
   uint8_t size;
 
   size = user_byte(propaddr++);
@@ -213,6 +224,8 @@ static int find_property(uint16_t object, uint16_t propnum, uint16_t *propaddr,
 
 static void check_attr(uint16_t attr)
 {
+  CACHE_ZSTATE;
+
   ZASSERT(attr <= (zversion <= 3 ? 31 : 47), "invalid attribute: %u", (unsigned)attr);
 }
 
@@ -224,6 +237,8 @@ static void check_attr(uint16_t attr)
 
 static int is_zero(int is_store, int is_jump)
 {
+  CACHE_ZSTATE;
+
   if(zargs[0] == 0)
   {
     if(is_store) store(0);
@@ -239,6 +254,8 @@ static int is_zero(int is_store, int is_jump)
 
 static void check_propnum(uint16_t propnum)
 {
+  CACHE_ZSTATE;
+
   ZASSERT(propnum > 0 && propnum < (zversion <= 3 ? 32 : 64), "invalid property: %u", (unsigned)propnum);
 }
 
@@ -255,6 +272,8 @@ static void check_propnum(uint16_t propnum)
 #define ATTR_BIT(num)		(0x80U >> ((num) % 8))
 void ztest_attr(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(0, 1);
   check_attr(zargs[1]);
 
@@ -265,6 +284,8 @@ void ztest_attr(void)
 
 void zset_attr(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(0, 0);
   sherlock_attr(zargs[1]);
   check_attr(zargs[1]);
@@ -276,6 +297,8 @@ void zset_attr(void)
 
 void zclear_attr(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(0, 0);
   sherlock_attr(zargs[1]);
   check_attr(zargs[1]);
@@ -288,6 +311,8 @@ void zclear_attr(void)
 
 void zremove_obj(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(0, 0);
 
   remove_object(zargs[0]);
@@ -295,6 +320,8 @@ void zremove_obj(void)
 
 void zinsert_obj(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(0, 0);
 
   remove_object(zargs[0]);
@@ -306,6 +333,8 @@ void zinsert_obj(void)
 
 void zget_sibling(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(1, 1);
 
   uint16_t sibling = sibling_of(zargs[0]);
@@ -316,6 +345,8 @@ void zget_sibling(void)
 
 void zget_child(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(1, 1);
 
   uint16_t child = child_of(zargs[0]);
@@ -326,6 +357,8 @@ void zget_child(void)
 
 void zget_parent(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(1, 0);
 
   store(parent_of(zargs[0]));
@@ -333,6 +366,8 @@ void zget_parent(void)
 
 void zput_prop(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(0, 0);
   check_propnum(zargs[1]);
 
@@ -350,6 +385,8 @@ void zput_prop(void)
 
 void zget_prop(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(1, 0);
   check_propnum(zargs[1]);
 
@@ -377,6 +414,8 @@ void zget_prop(void)
 
 void zget_prop_len(void)
 {
+  CACHE_ZSTATE;
+
   /* Z-spec 1.1 says @get_prop_len 0 must yield 0. */
   if(zargs[0] == 0) store(0);
   else              store(property_length(zargs[0]));
@@ -384,6 +423,8 @@ void zget_prop_len(void)
 
 void zget_prop_addr(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(1, 0);
   /* Theoretically this should check whether the requested property is
    * valid (i.e. is within the proper range for the current story type).
@@ -401,6 +442,8 @@ void zget_prop_addr(void)
 
 void zget_next_prop(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(1, 0);
 
   uint16_t object = zargs[0], propnum = zargs[1], found_propnum = 0;
@@ -424,6 +467,8 @@ void zget_next_prop(void)
 
 void zjin(void)
 {
+  CACHE_ZSTATE;
+
   /* @jin 0 0 is not defined, since @jin requires an object (§15) and
    * object 0 is not actually an object (§12.3).  However, many
    * interpreters yield a true value for this, and Torbjorn Andersson’s
@@ -449,6 +494,8 @@ void print_object(uint16_t obj, void (*outc)(uint8_t))
 
 void zprint_obj(void)
 {
+  CACHE_ZSTATE;
+
   check_zero(0, 0);
 
   print_object(zargs[0], NULL);
@@ -40,11 +40,14 @@
 #include "zoom.h"
 #include "zterp.h"
 
-uint16_t zargs[8];
-int znargs;
+/* Pre-decoding is described below, above run_decoded(). */
+#if defined(__GNUC__) && !defined(ZTERP_NO_PREDECODE)
+#define ZTERP_PREDECODE
+static void flush_decoded(void);
+#endif
 
-static jmp_buf *jumps;
-static size_t njumps;
+static zthread_local jmp_buf *jumps;
+static zthread_local size_t njumps;
 
 /* Each time an interrupt happens, process_instructions() is called
  * (effectively starting a whole new round of interpreting).  This
@@ -52,7 +55,7 @@ static size_t njumps;
  * interrupts, 1 if one interrupt has been called, 2 if an interrupt was
  * called inside of an interrupt, and so on.
  */
-static size_t ilevel = -1;
+static zthread_local size_t ilevel = -1;
 
 int in_interrupt(void)
 {
@@ -90,6 +93,8 @@ void interrupt_quit(void)
 /* Returns 1 if decoded, 0 otherwise (omitted) */
 static int decode_base(uint8_t type, uint16_t *loc)
 {
+  CACHE_ZSTATE;
+
   switch(type)
   {
     case 0: /* Large constant. */
@@ -111,6 +116,7 @@ static int decode_base(uint8_t type, uint16_t *loc)
 
 static void decode_var(uint8_t types)
 {
+  CACHE_ZSTATE;
   uint16_t ret;
 
   for(int i = 6; i >= 0; i -= 2)
@@ -120,8 +126,8 @@ static void decode_var(uint8_t types)
   }
 }
 
-static void (*opcodes[256])(void);
-static void (*ext_opcodes[256])(void);
+#define opcodes		(zstate->opcodes)	/* kept in struct zstate (see zterp.h) */
+static zthread_local void (*ext_opcodes[256])(void);
 enum opcount { ZERO, ONE, TWO, VAR, EXT };
 
 #define op_call(opcode)		opcodes[opcode]()
@@ -130,6 +136,7 @@ enum opcount { ZERO, ONE, TWO, VAR, EXT };
 /* This nifty trick is from Frotz. */
 static void zextended(void)
 {
+  CACHE_ZSTATE;
   uint8_t opnumber = BYTE(pc++);
 
   decode_var(BYTE(pc++));
@@ -140,6 +147,8 @@ static void zextended(void)
 znoreturn
 static void illegal_opcode(void)
 {
+  CACHE_ZSTATE;
+
 #ifndef ZTERP_NO_SAFETY_CHECKS
   die("illegal opcode (pc = 0x%lx)", zassert_pc);
 #else
@@ -149,6 +158,8 @@ static void illegal_opcode(void)
 
 static void setup_single_opcode(int minver, int maxver, enum opcount opcount, int opcode, void (*fn)(void))
 {
+  CACHE_ZSTATE;
+
   if(zversion < minver || zversion > maxver) return;
 
   switch(opcount)
@@ -179,6 +190,8 @@ static void setup_single_opcode(int minver, int maxver, enum opcount opcount, in
 
 void setup_opcodes(void)
 {
+  CACHE_ZSTATE;
+
   for(int opcode = 0; opcode < 256; opcode++)
   {
     opcodes[opcode] = illegal_opcode;
@@ -320,105 +333,697 @@ void setup_opcodes(void)
   setup_single_opcode(5, 6, EXT, 0x81, zstop_timer);
   setup_single_opcode(5, 6, EXT, 0x82, zread_timer);
   setup_single_opcode(5, 6, EXT, 0x83, zprint_timer);
+
+#ifdef ZTERP_PREDECODE
+  flush_decoded();
+#endif
 }
 
-void process_instructions(void)
+/* Decode and execute the instruction at pc.  This is the reference
+ * implementation, used when pre-decoding is off.
+ */
+static void process_instruction(void)
 {
-  if(njumps <= ++ilevel)
+  CACHE_ZSTATE;
+  uint8_t opcode;
+
+  ZPC(pc);
+
+  opcode = BYTE(pc++);
+
+  /* long 2OP */
+  if(opcode < 0x80)
   {
-    jumps = realloc(jumps, ++njumps * sizeof *jumps);
-    if(jumps == NULL) die("unable to allocate memory for jump buffer");
+    znargs = 2;
+
+    if(opcode & 0x40) zargs[0] = variable(BYTE(pc++));
+    else              zargs[0] = BYTE(pc++);
+
+    if(opcode & 0x20) zargs[1] = variable(BYTE(pc++));
+    else              zargs[1] = BYTE(pc++);
   }
 
-  switch(setjmp(jumps[ilevel]))
+  /* short 1OP */
+  else if(opcode < 0xb0)
   {
-    case 1: /* Normal break from interrupt. */
-      return;
-    case 2: /* Special break: interrupt_reset() called, so keep interpreting. */
+    znargs = 1;
+
+    if(opcode & 0x20) /* variable */
+    {
+      zargs[0] = variable(BYTE(pc++));
+    }
+    else if(opcode & 0x10) /* small constant */
+    {
+      zargs[0] = BYTE(pc++);
+    }
+    else /* large constant */
+    {
+      zargs[0] = WORD(pc);
+      pc += 2;
+    }
+  }
+
+  /* short 0OP (plus EXT) */
+  else if(opcode < 0xc0)
+  {
+    znargs = 0;
+  }
+
+  /* variable 2OP */
+  else if(opcode < 0xe0)
+  {
+    znargs = 0;
+
+    decode_var(BYTE(pc++));
+  }
+
+  /* Double variable VAR */
+  else if(opcode == 0xec || opcode == 0xfa)
+  {
+    uint8_t types1, types2;
+
+    znargs = 0;
+
+    types1 = BYTE(pc++);
+    types2 = BYTE(pc++);
+    decode_var(types1);
+    decode_var(types2);
+  }
+
+  /* variable VAR */
+  else
+  {
+    znargs = 0;
+
+    read_pc = pc - 1;
+
+    decode_var(BYTE(pc++));
+  }
+
+  op_call(opcode);
+}
+
+/* The pre-decoding engine.
+ *
+ * Working out an instruction’s form, operand types and handler costs
+ * about as much as running most instructions, so the first time an
+ * instruction is reached it is translated into a struct insn, found
+ * afterward through insn_map by address.  Executing it is then just a
+ * matter of fetching operands and dispatching.  The commonest branches,
+ * arithmetic and loads also have their store variable and branch
+ * pre-decoded, and are run directly by run_decoded() rather than
+ * through opcodes[]; everything else calls the usual handler with pc
+ * pointing past the operands.
+ *
+ * Inform often stores a result on the stack only for the very next
+ * instruction to pop it, as in “@loadw a b -> sp; @jz sp ?label”.  When
+ * one of the arithmetic or load instructions above is followed by a
+ * branch or return which pops what it stores, the two are fused: the
+ * value is handed straight to the second instruction, which never goes
+ * through the stack.  Only the first instruction is changed, so a jump
+ * directly to the second still finds it on its own.
+ *
+ * Code in dynamic memory can be changed by the story.  The range of
+ * dynamic memory that decoded instructions came from is watched (see
+ * memory.h), and a write to it throws away everything that has been
+ * decoded.  Stories almost never run code from dynamic memory, so this
+ * does not need to be any finer-grained.
+ *
+ * Pre-decoding uses computed gotos, so needs GCC or a compatible
+ * compiler.  It can be turned off with -P or, for comparison against
+ * the reference path, with “/debug predecode off” while running.
+ */
+
+zthread_local uint32_t code_watch_start, code_watch_end;
+
+#ifdef ZTERP_PREDECODE
+/* The longest possible instruction: an opcode, two type bytes, eight
+ * large constants, a store and a two-byte branch.  (EXT instructions
+ * have one type byte and an extra opcode byte, so are no longer.)
+ */
+#define MAX_INSN_LENGTH	23
+
+enum
+{
+  RUN_CALL,	/* call the handler */
+  RUN_JE, RUN_JL, RUN_JG, RUN_JZ,
+  RUN_ADD, RUN_SUB, RUN_AND, RUN_OR,
+  RUN_LOADW, RUN_LOADB,
+  RUN_JUMP, RUN_RTRUE, RUN_RFALSE, RUN_RET,
+};
+
+struct insn
+{
+  void (*fn)(void);
+  uint8_t run;		/* RUN_* */
+  uint8_t nargs;
+  uint8_t variables;	/* bit n is set if operand n is a variable */
+  uint8_t set_read_pc;	/* VAR opcodes set read_pc (for zread()) */
+  uint8_t store;	/* store variable */
+  uint8_t fused;	/* RUN_* of a following branch or return fused onto this, or 0 */
+  uint8_t branch_on;	/* branch if the condition is this (0 or 1) */
+  int8_t branch_return;	/* -1 to branch to target, else the value to return */
+  uint16_t args[8];	/* constants, or variable numbers; see also predecode_fuse() */
+  uint32_t next;	/* the address just past the operands */
+  uint32_t after;	/* the address just past the entire instruction */
+  uint32_t target;	/* branch or jump target */
+};
+
+/* insn_map and insns are kept in struct zstate (see zterp.h). */
+#define insn_map	(zstate->insn_map)	/* instruction number + 1, or 0 */
+#define insns		(zstate->insns)
+static zthread_local uint32_t ninsns, insns_size;
+
+static void flush_decoded(void)
+{
+  CACHE_ZSTATE;
+
+  free(insn_map);
+  insn_map = NULL;
+  ninsns = 0;
+
+  code_watch_start = code_watch_end = 0;
+  update_watch();
+}
+
+/* Throw away all decoded instructions if any came from [start, end). */
+void forget_decoded(uint32_t start, uint32_t end)
+{
+  if(start < code_watch_end && end > code_watch_start) flush_decoded();
+}
+
+static int predecode_operand(struct insn *insn, uint8_t type, uint32_t *addr)
+{
+
+  switch(type)
+  {
+    case 0: /* Large constant. */
+      insn->args[insn->nargs] = WORD(*addr);
+      *addr += 2;
       break;
+    case 1: /* Small constant. */
+      insn->args[insn->nargs] = BYTE((*addr)++);
+      break;
+    case 2: /* Variable. */
+      insn->variables |= 1U << insn->nargs;
+      insn->args[insn->nargs] = BYTE((*addr)++);
+      break;
+    default: /* Omitted. */
+      return 0;
   }
 
-  while(1)
+  insn->nargs++;
+
+  return 1;
+}
+
+static void predecode_var(struct insn *insn, uint8_t types, uint32_t *addr)
+{
+  for(int i = 6; i >= 0; i -= 2)
   {
-    uint8_t opcode;
+    if(!predecode_operand(insn, (types >> i) & 0x03, addr)) return;
+  }
+}
 
-#if defined(ZTERP_GLK) && defined(ZTERP_GLK_TICK)
-    glk_tick();
-#endif
+/* Decode the branch following insn’s operands.  A branch to an invalid
+ * address is not pre-decoded, so that the handler can report it when
+ * (and if) the branch is taken.
+ */
+static int predecode_branch(struct insn *insn)
+{
+  CACHE_ZSTATE;
+  uint32_t addr = insn->next;
+  uint8_t branch;
+  uint16_t offset;
 
-    ZPC(pc);
+  branch = BYTE(addr++);
+  offset = branch & 0x3f;
 
-    opcode = BYTE(pc++);
+  if((branch & 0x40) == 0)
+  {
+    offset = (offset << 8) | BYTE(addr++);
 
-    /* long 2OP */
-    if(opcode < 0x80)
-    {
-      znargs = 2;
+    /* Get the sign right. */
+    if(offset & 0x2000) offset |= 0xc000;
+  }
 
-      if(opcode & 0x40) zargs[0] = variable(BYTE(pc++));
-      else              zargs[0] = BYTE(pc++);
+  insn->branch_on = (branch & 0x80) != 0;
+  insn->after = addr;
 
-      if(opcode & 0x20) zargs[1] = variable(BYTE(pc++));
-      else              zargs[1] = BYTE(pc++);
-    }
+  if(offset > 1)
+  {
+    insn->branch_return = -1;
+    insn->target = addr + as_signed(offset) - 2;
 
-    /* short 1OP */
-    else if(opcode < 0xb0)
-    {
-      znargs = 1;
+    return insn->target < memory_size;
+  }
 
-      if(opcode & 0x20) /* variable */
-      {
-        zargs[0] = variable(BYTE(pc++));
-      }
-      else if(opcode & 0x10) /* small constant */
-      {
-        zargs[0] = BYTE(pc++);
-      }
-      else /* large constant */
-      {
-        zargs[0] = WORD(pc);
-        pc += 2;
-      }
-    }
+  insn->branch_return = offset;
+
+  return 1;
+}
+
+/* Pick the instructions which run_decoded() can execute itself. */
+static void predecode_run(struct insn *insn)
+{
+  CACHE_ZSTATE;
+  void (*fn)(void) = insn->fn;
+
+  if(insn->set_read_pc) return;
+
+  if(insn->nargs == 2)
+  {
+    if     (fn == zje && predecode_branch(insn)) insn->run = RUN_JE;
+    else if(fn == zjl && predecode_branch(insn)) insn->run = RUN_JL;
+    else if(fn == zjg && predecode_branch(insn)) insn->run = RUN_JG;
+    else if(fn == zadd)   insn->run = RUN_ADD;
+    else if(fn == zsub)   insn->run = RUN_SUB;
+    else if(fn == zand)   insn->run = RUN_AND;
+    else if(fn == zor)    insn->run = RUN_OR;
+    else if(fn == zloadw) insn->run = RUN_LOADW;
+    else if(fn == zloadb) insn->run = RUN_LOADB;
 
-    /* short 0OP (plus EXT) */
-    else if(opcode < 0xc0)
+    if(insn->run >= RUN_ADD && insn->run <= RUN_LOADB)
     {
-      znargs = 0;
+      insn->store = BYTE(insn->next);
+      insn->after = insn->next + 1;
     }
-
-    /* variable 2OP */
-    else if(opcode < 0xe0)
+  }
+  else if(insn->nargs == 1)
+  {
+    if(fn == zjz && predecode_branch(insn))
     {
-      znargs = 0;
-
-      decode_var(BYTE(pc++));
+      insn->run = RUN_JZ;
     }
-
-    /* Double variable VAR */
-    else if(opcode == 0xec || opcode == 0xfa)
+    else if(fn == zjump && insn->variables == 0)
     {
-      uint8_t types1, types2;
+      /* -2 because the offset is from the end of the instruction. */
+      insn->target = insn->next + as_signed(insn->args[0]) - 2;
+      if(insn->target < memory_size) insn->run = RUN_JUMP;
+    }
+    else if(fn == zret)
+    {
+      insn->run = RUN_RET;
+    }
+  }
+  else if(insn->nargs == 0)
+  {
+    if     (fn == zrtrue)  insn->run = RUN_RTRUE;
+    else if(fn == zrfalse) insn->run = RUN_RFALSE;
+  }
+}
+
+/* Decode the instruction at addr into insn, following
+ * process_instruction().  There must be at least MAX_INSN_LENGTH bytes
+ * of memory from addr on.
+ */
+static void predecode_insn(struct insn *insn, uint32_t addr)
+{
+  CACHE_ZSTATE;
+  uint32_t p = addr;
+  uint8_t opcode;
+
+  opcode = BYTE(p++);
+  insn->fn = opcodes[opcode];
+
+  /* long 2OP */
+  if(opcode < 0x80)
+  {
+    predecode_operand(insn, (opcode & 0x40) ? 2 : 1, &p);
+    predecode_operand(insn, (opcode & 0x20) ? 2 : 1, &p);
+  }
 
-      znargs = 0;
+  /* short 1OP */
+  else if(opcode < 0xb0)
+  {
+    predecode_operand(insn, (opcode >> 4) & 0x03, &p);
+  }
 
-      types1 = BYTE(pc++);
-      types2 = BYTE(pc++);
-      decode_var(types1);
-      decode_var(types2);
+  /* short 0OP (plus EXT) */
+  else if(opcode < 0xc0)
+  {
+    if(insn->fn == zextended)
+    {
+      insn->fn = ext_opcodes[BYTE(p++)];
+      predecode_var(insn, BYTE(p++), &p);
     }
+  }
+
+  /* variable 2OP */
+  else if(opcode < 0xe0)
+  {
+    predecode_var(insn, BYTE(p++), &p);
+  }
+
+  /* Double variable VAR */
+  else if(opcode == 0xec || opcode == 0xfa)
+  {
+    uint8_t types1, types2;
+
+    types1 = BYTE(p++);
+    types2 = BYTE(p++);
+    predecode_var(insn, types1, &p);
+    predecode_var(insn, types2, &p);
+  }
+
+  /* variable VAR */
+  else
+  {
+    insn->set_read_pc = 1;
+
+    predecode_var(insn, BYTE(p++), &p);
+  }
+
+  insn->next = insn->after = p;
+
+  predecode_run(insn);
+}
+
+/* If insn stores to the stack and the instruction after it is a branch
+ * or return which pops that value as its first operand, fuse the two.
+ */
+static void predecode_fuse(struct insn *insn)
+{
+  CACHE_ZSTATE;
+  struct insn next = { .fn = NULL };
+
+  if(insn->run < RUN_ADD || insn->run > RUN_LOADB || insn->store != 0) return;
+  if(memory_size - insn->after < MAX_INSN_LENGTH) return;
+
+  predecode_insn(&next, insn->after);
+
+  if(next.fn == zret_popped)
+  {
+    next.run = RUN_RET;
+  }
+  else
+  {
+    if(!(next.variables & 1) || next.args[0] != 0) return;
+    if(next.run < RUN_JE || (next.run > RUN_JZ && next.run != RUN_RET)) return;
+  }
+
+  if(next.run != RUN_JZ && next.run != RUN_RET)
+  {
+    insn->args[2] = next.args[1];
+    if(next.variables & 2) insn->variables |= 1U << 2;
+  }
+
+  insn->fused = next.run;
+  insn->branch_on = next.branch_on;
+  insn->branch_return = next.branch_return;
+  insn->target = next.target;
+  insn->after = next.after;
+}
+
+/* Decode the instruction at addr and add it to insn_map.  NULL is
+ * returned if it is too close to the end of memory to be decoded
+ * safely, or memory is exhausted; it should then be run with
+ * process_instruction().
+ */
+static const struct insn *predecode(uint32_t addr)
+{
+  CACHE_ZSTATE;
+  struct insn insn = { .fn = NULL };
+
+  if(addr >= memory_size || memory_size - addr < MAX_INSN_LENGTH) return NULL;
+
+  if(insn_map == NULL)
+  {
+    insn_map = calloc(memory_size, sizeof *insn_map);
+    if(insn_map == NULL) return NULL;
+  }
+
+  if(ninsns == insns_size)
+  {
+    uint32_t new_size = insns_size == 0 ? 4096 : insns_size * 2;
+    struct insn *new_insns = realloc(insns, new_size * sizeof *insns);
+
+    if(new_insns == NULL) return NULL;
+
+    insns = new_insns;
+    insns_size = new_size;
+  }
+
+  predecode_insn(&insn, addr);
+  predecode_fuse(&insn);
+
+  if(addr < header.static_start)
+  {
+    if(code_watch_start == code_watch_end || addr < code_watch_start) code_watch_start = addr;
+    if(insn.after > code_watch_end) code_watch_end = insn.after;
+    update_watch();
+  }
+
+  insns[ninsns] = insn;
+  insn_map[addr] = ++ninsns;
+
+  return &insns[ninsns - 1];
+}
+
+static inline uint16_t operand(const struct insn *insn, int n)
+{
+  CACHE_ZSTATE;
+  uint16_t var = insn->args[n];
+
+  if(!(insn->variables & (1U << n))) return var;
+
+  if(var >= 0x10) return WORD(header.globals + ((var - 0x10) * 2));
+
+  return variable(var);
+}
+
+/* Run pre-decoded instructions until pre-decoding is turned off.
+ *
+ * Nothing which was decoded may be used once a handler has been called
+ * or a variable has been stored to: either can cause the instructions
+ * to be thrown away.
+ */
+static void run_decoded(void)
+{
+  CACHE_ZSTATE;
+  const struct options *const opts = &options;
+  static void *const dispatch[] =
+  {
+    [RUN_CALL] = &&call,
+    [RUN_JE] = &&je, [RUN_JL] = &&jl, [RUN_JG] = &&jg, [RUN_JZ] = &&jz,
+    [RUN_ADD] = &&add, [RUN_SUB] = &&sub, [RUN_AND] = &&and, [RUN_OR] = &&or,
+    [RUN_LOADW] = &&loadw, [RUN_LOADB] = &&loadb,
+    [RUN_JUMP] = &&jump, [RUN_RTRUE] = &&rtrue, [RUN_RFALSE] = &&rfalse, [RUN_RET] = &&ret,
+  };
+  static void *const fused[] =
+  {
+    [RUN_JE] = &&fused_je, [RUN_JL] = &&fused_jl, [RUN_JG] = &&fused_jg, [RUN_JZ] = &&fused_jz,
+    [RUN_RET] = &&fused_ret,
+  };
+
+#define BRANCH(cond)	do { \
+  pc = insn->after; \
+  if((cond) == insn->branch_on) \
+  { \
+    if(insn->branch_return == -1) pc = insn->target; \
+    else                          do_return(insn->branch_return); \
+  } \
+} while(0)
+
+#define STORE(v)	do { \
+  uint16_t v_ = (v); \
+  if(insn->fused != 0) \
+  { \
+    a = v_; \
+    goto *fused[insn->fused]; \
+  } \
+  pc = insn->after; \
+  store_variable(insn->store, v_); \
+} while(0)
 
-    /* variable VAR */
+  /* a is set before the fused labels are reached, but the compiler
+   * cannot tell through computed gotos.
+   */
+  uint16_t a = 0, b;
+
+  while(1)
+  {
+    const struct insn *insn;
+
+#if defined(ZTERP_GLK) && defined(ZTERP_GLK_TICK)
+    glk_tick();
+#endif
+
+    if(insn_map != NULL && pc < memory_size && insn_map[pc] != 0)
+    {
+      insn = &insns[insn_map[pc] - 1];
+    }
     else
     {
-      znargs = 0;
+      insn = predecode(pc);
+      if(insn == NULL)
+      {
+        process_instruction();
+        if(opts->disable_predecode) return;
+        continue;
+      }
+    }
 
-      read_pc = pc - 1;
+    ZPC(pc);
 
-      decode_var(BYTE(pc++));
-    }
+    goto *dispatch[insn->run];
+
+call:
+    if(insn->set_read_pc) read_pc = pc;
+    pc = insn->next;
+    znargs = insn->nargs;
+    for(int i = 0; i < insn->nargs; i++) zargs[i] = operand(insn, i);
+    insn->fn();
+    if(opts->disable_predecode) return;
+    continue;
+
+je:
+    a = operand(insn, 0);
+    b = operand(insn, 1);
+    BRANCH(a == b);
+    continue;
+
+jl:
+    a = operand(insn, 0);
+    b = operand(insn, 1);
+    BRANCH(as_signed(a) < as_signed(b));
+    continue;
+
+jg:
+    a = operand(insn, 0);
+    b = operand(insn, 1);
+    BRANCH(as_signed(a) > as_signed(b));
+    continue;
+
+jz:
+    a = operand(insn, 0);
+    BRANCH(a == 0);
+    continue;
+
+add:
+    a = operand(insn, 0);
+    b = operand(insn, 1);
+    STORE(a + b);
+    continue;
+
+sub:
+    a = operand(insn, 0);
+    b = operand(insn, 1);
+    STORE(a - b);
+    continue;
+
+and:
+    a = operand(insn, 0);
+    b = operand(insn, 1);
+    STORE(a & b);
+    continue;
+
+or:
+    a = operand(insn, 0);
+    b = operand(insn, 1);
+    STORE(a | b);
+    continue;
+
+loadw:
+    a = operand(insn, 0);
+    b = operand(insn, 1);
+    STORE(user_word(a + (2 * b)));
+    continue;
+
+loadb:
+    a = operand(insn, 0);
+    b = operand(insn, 1);
+    STORE(user_byte(a + b));
+    continue;
+
+jump:
+    pc = insn->target;
+    continue;
+
+rtrue:
+    pc = insn->next;
+    do_return(1);
+    continue;
+
+rfalse:
+    pc = insn->next;
+    do_return(0);
+    continue;
+
+ret:
+    a = operand(insn, 0);
+    pc = insn->next;
+    do_return(a);
+    continue;
+
+    /* The second half of a fused pair; a holds the first half’s result. */
+fused_je:
+    b = operand(insn, 2);
+    BRANCH(a == b);
+    continue;
+
+fused_jl:
+    b = operand(insn, 2);
+    BRANCH(as_signed(a) < as_signed(b));
+    continue;
+
+fused_jg:
+    b = operand(insn, 2);
+    BRANCH(as_signed(a) > as_signed(b));
+    continue;
+
+fused_jz:
+    BRANCH(a == 0);
+    continue;
+
+fused_ret:
+    pc = insn->after;
+    do_return(a);
+    continue;
+  }
+
+#undef BRANCH
+#undef STORE
+}
+#else
+void forget_decoded(uint32_t start, uint32_t end)
+{
+}
+#endif
+
+void process_instructions(void)
+{
+#ifdef ZTERP_PREDECODE
+  /* The address of options is looked up here rather than once per
+   * instruction (see zterp.h).
+   */
+  const struct options *const opts = &options;
+#endif
+
+  if(njumps <= ++ilevel)
+  {
+    jumps = realloc(jumps, ++njumps * sizeof *jumps);
+    if(jumps == NULL) die("unable to allocate memory for jump buffer");
+  }
+
+  switch(setjmp(jumps[ilevel]))
+  {
+    case 1: /* Normal break from interrupt. */
+      return;
+    case 2: /* Special break: interrupt_reset() called, so keep interpreting. */
+      break;
+  }
+
+  while(1)
+  {
+#ifdef ZTERP_PREDECODE
+    if(!opts->disable_predecode) run_decoded();
+#endif
+
+#if defined(ZTERP_GLK) && defined(ZTERP_GLK_TICK)
+    glk_tick();
+#endif
 
-    op_call(opcode);
+    process_instruction();
   }
 }
@@ -1,10 +1,13 @@
 #ifndef ZTERP_PROCESS_H
 #define ZTERP_PROCESS_H
 
+#include "util.h"
+
 #include <stdint.h>
 
-extern uint16_t zargs[];
-extern int znargs;
+extern zthread_local uint32_t code_watch_start, code_watch_end;
+
+void forget_decoded(uint32_t, uint32_t);
 
 int in_interrupt(void);
 void interrupt_return(void);
@@ -28,8 +28,8 @@
 #include "zterp.h"
 
 /* Mersenne Twister. */
-static uint32_t mt[624];
-static uint32_t mt_idx = 0;
+static zthread_local uint32_t mt[624];
+static zthread_local uint32_t mt_idx = 0;
 
 static void zterp_srand(uint32_t s)
 {
@@ -73,8 +73,8 @@ static uint32_t zterp_rand(void)
   return y;
 }
 
-static int rng_interval = 0;
-static int rng_counter  = 0;
+static zthread_local int rng_interval = 0;
+static zthread_local int rng_counter  = 0;
 
 /* Called with 0, seed the PRNG with either
  * a) a user-provided seed (via -z) if available, or
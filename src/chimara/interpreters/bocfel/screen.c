@@ -41,7 +41,7 @@
 #include "util.h"
 #include "zterp.h"
 
-static struct window
+static zthread_local struct window
 {
   unsigned style;
 
@@ -59,13 +59,19 @@ static struct window
   } *line;
   int has_echo;
 #endif
-} windows[8], *mainwin = &windows[0], *curwin = &windows[0];
+} windows[8], *curwin;
+
+/* A thread-local pointer cannot be initialized with the address of
+ * another thread-local variable, so the windows that never move are
+ * macros, and curwin is set in create_mainwin().
+ */
+#define mainwin		(&windows[0])
 #ifdef ZTERP_GLK
-static struct window *upperwin = &windows[1];
-static struct window statuswin;
-static long upper_window_height = 0;
-static long upper_window_width = 0;
-static winid_t errorwin;
+#define upperwin	(&windows[1])
+static zthread_local struct window statuswin;
+static zthread_local long upper_window_height = 0;
+static zthread_local long upper_window_width = 0;
+static zthread_local winid_t errorwin;
 #endif
 
 /* In all versions but 6, styles are global and stored in mainwin.  For
@@ -94,18 +100,18 @@ static winid_t errorwin;
 #define STREAM_MEMORY		(1U << 3)
 #define STREAM_SCRIPT		(1U << 4)
 
-static unsigned int streams = STREAM_SCREEN;
-static zterp_io *transio, *scriptio;
+static zthread_local unsigned int streams = STREAM_SCREEN;
+static zthread_local zterp_io *transio, *scriptio;
 
-static struct
+static zthread_local struct
 {
   uint16_t table;
   uint16_t i;
 } stables[16];
-static int stablei = -1;
+static zthread_local int stablei = -1;
 
-static int istream = ISTREAM_KEYBOARD;
-static zterp_io *istreamio;
+static zthread_local int istream = ISTREAM_KEYBOARD;
+static zthread_local zterp_io *istreamio;
 
 struct input
 {
@@ -129,7 +135,7 @@ struct input
 };
 
 #ifndef ZTERP_GLK
-static int16_t fg_color = 1, bg_color = 1;
+static zthread_local int16_t fg_color = 1, bg_color = 1;
 #elif defined(GARGLK)
 static glui32 zcolor_map[] = {
   zcolor_Default,
@@ -146,7 +152,7 @@ static glui32 zcolor_map[] = {
   0x8c8c8c,	/* Medium grey */
   0x5a5a5a,	/* Dark grey */
 };
-static glui32 fg_color = zcolor_Default, bg_color = zcolor_Default;
+static zthread_local glui32 fg_color = zcolor_Default, bg_color = zcolor_Default;
 
 void update_color(int which, unsigned long color)
 {
@@ -467,7 +473,7 @@ void show_message(const char *fmt, ...)
   va_end(ap);
 
 #ifdef ZTERP_GLK
-  static glui32 error_lines = 0;
+  static zthread_local glui32 error_lines = 0;
 
   if(errorwin != NULL)
   {
@@ -666,8 +672,8 @@ static struct window *find_window(uint16_t window)
  * request.  If there has not been user input, the request is delayed
  * until after the next user input is read.
  */
-static long delayed_window_shrink = -1;
-static int saw_input;
+static zthread_local long delayed_window_shrink = -1;
+static zthread_local int saw_input;
 
 static void update_delayed(void)
 {
@@ -803,7 +809,7 @@ void get_screen_size(unsigned int *width, unsigned int *height)
 }
 
 #ifdef GLK_MODULE_LINE_TERMINATORS
-static uint32_t *term_keys, term_size, term_nkeys;
+static zthread_local uint32_t *term_keys, term_size, term_nkeys;
 
 void term_keys_reset(void)
 {
@@ -1158,7 +1164,7 @@ void zset_true_colour(void)
 #endif
 }
 
-int header_fixed_font;
+zthread_local int header_fixed_font;
 
 /* V6 has per-window styles, but all others have a global style; in this
  * case, track styles via the main window.
@@ -1379,7 +1385,7 @@ static void window_change(void)
 #endif
 
 #ifdef ZTERP_GLK
-static int timer_running;
+static zthread_local int timer_running;
 
 static void start_timer(uint16_t n)
 {
@@ -2239,6 +2245,8 @@ static void set_default_styles(void)
 
 int create_mainwin(void)
 {
+  curwin = mainwin;
+
 #ifdef ZTERP_GLK
 
 #ifdef GARGLK
@@ -1,6 +1,8 @@
 #ifndef ZTERP_SCREEN_H
 #define ZTERP_SCREEN_H
 
+#include "util.h"
+
 #include <stdint.h>
 
 #ifdef ZTERP_GLK
@@ -8,7 +10,7 @@
 #endif
 
 /* Boolean flag describing whether the header bit meaning “fixed font” is set. */
-extern int header_fixed_font;
+extern zthread_local int header_fixed_font;
 
 void init_screen(void);
 
@@ -33,39 +33,27 @@
 #include "util.h"
 #include "zterp.h"
 
-struct call_frame
-{
-  uint32_t pc;
-  uint16_t *sp;
-  uint8_t nlocals;
-  uint8_t nargs;
-  uint16_t where;
-  uint16_t locals[15];
-};
-
-static struct call_frame *frames;
-static struct call_frame *fp;
+static zthread_local struct call_frame *frames;
 
 #define BASE_OF_FRAMES	frames
-static struct call_frame *TOP_OF_FRAMES;
-#define CURRENT_FRAME	(fp - 1)
-#define NFRAMES		((long)(fp - frames))
+#define TOP_OF_FRAMES	(zstate->top_of_frames)
+#define NFRAMES		((long)(zstate->fp - frames))
 
-static uint16_t *stack;
-static uint16_t *sp;
+static zthread_local uint16_t *stack;
 
 #define BASE_OF_STACK	stack
-static uint16_t *TOP_OF_STACK;
-
-static void PUSH_STACK(uint16_t n) { ZASSERT(sp != TOP_OF_STACK, "stack overflow"); *sp++ = n; }
-static uint16_t POP_STACK(void) { ZASSERT(sp > CURRENT_FRAME->sp, "stack underflow"); return *--sp; }
+#define TOP_OF_STACK	(zstate->top_of_stack)
 
 struct save_state
 {
-  uint32_t pc;
+  uint32_t saved_pc;
 
-  uint32_t memsize;
-  uint8_t *memory;
+  /* Dynamic memory is shared page by page with other save states,
+   * unless undo compression is disabled, in which case all of it is
+   * copied to “saved_memory”.
+   */
+  struct snapshot *snapshot;
+  uint8_t *saved_memory;
 
   uint32_t stack_size;
   uint16_t *stack;
@@ -79,7 +67,7 @@ struct save_state
   struct save_state *prev, *next;
 };
 
-static struct save_stack
+static zthread_local struct save_stack
 {
   struct save_state *head;
   struct save_state *tail;
@@ -88,19 +76,21 @@ static struct save_stack
   long count;
 } save_stacks[2];
 
-int seen_save_undo = 0;
+zthread_local int seen_save_undo = 0;
 
 static void add_frame(uint32_t pc_, uint16_t *sp_, uint8_t nlocals, uint8_t nargs, uint16_t where)
 {
-  ZASSERT(fp != TOP_OF_FRAMES, "call stack too deep: %ld", NFRAMES + 1);
+  CACHE_ZSTATE;
+
+  ZASSERT(zstate->fp != TOP_OF_FRAMES, "call stack too deep: %ld", NFRAMES + 1);
 
-  fp->pc = pc_;
-  fp->sp = sp_;
-  fp->nlocals = nlocals;
-  fp->nargs = nargs;
-  fp->where = where;
+  zstate->fp->return_pc = pc_;
+  zstate->fp->sp = sp_;
+  zstate->fp->nlocals = nlocals;
+  zstate->fp->nargs = nargs;
+  zstate->fp->where = where;
 
-  fp++;
+  zstate->fp++;
 }
 
 static struct save_state *new_save_state(void)
@@ -110,7 +100,8 @@ static struct save_state *new_save_state(void)
   new = malloc(sizeof *new);
   if(new != NULL)
   {
-    new->memory = NULL;
+    new->snapshot = NULL;
+    new->saved_memory = NULL;
     new->stack = NULL;
     new->frames = NULL;
     new->desc = NULL;
@@ -124,7 +115,8 @@ static void free_save_state(struct save_state *s)
 {
   if(s != NULL)
   {
-    free(s->memory);
+    snapshot_free(s->snapshot);
+    free(s->saved_memory);
     free(s->stack);
     free(s->frames);
     free(s->desc);
@@ -146,6 +138,8 @@ static void clear_save_stack(struct save_stack *s)
 
 void init_stack(void)
 {
+  CACHE_ZSTATE;
+
   /* Allocate space for the evaluation and call stacks.
    * Clamp the size between 1 and the largest value that will not
    * produce an overflow of size_t when multiplied by the size of the
@@ -171,11 +165,11 @@ void init_stack(void)
 #undef CLAMP
   }
 
-  sp = BASE_OF_STACK;
-  fp = BASE_OF_FRAMES;
+  zstate->sp = BASE_OF_STACK;
+  zstate->fp = BASE_OF_FRAMES;
 
   /* Quetzal requires a dummy frame in non-V6 games, so do that here. */
-  if(zversion != 6) add_frame(0, sp, 0, 0, 0);
+  if(zversion != 6) add_frame(0, zstate->sp, 0, 0, 0);
 
   /* Free all @save_undo save states. */
   clear_save_stack(&save_stacks[SAVE_GAME]);
@@ -187,76 +181,25 @@ void init_stack(void)
   save_stacks[SAVE_USER].max = 25;
 }
 
-uint16_t variable(uint16_t var)
-{
-  ZASSERT(var < 0x100, "unable to decode variable %u", (unsigned)var);
-
-  /* Stack */
-  if(var == 0)
-  {
-    return POP_STACK();
-  }
-
-  /* Locals */
-  else if(var <= 0x0f)
-  {
-    ZASSERT(var <= CURRENT_FRAME->nlocals, "attempting to read from nonexistent local variable %d: routine has %d", (int)var, CURRENT_FRAME->nlocals);
-    return CURRENT_FRAME->locals[var - 1];
-  }
-
-  /* Globals */
-  else if(var <= 0xff)
-  {
-    var -= 0x10;
-    return WORD(header.globals + (var * 2));
-  }
-
-  /* This is an “impossible” situation (ie, the game did something wrong).
-   * It will be caught above if safety checks are turned on, but if they
-   * are not, do what we can: lie.
-   */
-  return -1;
-}
-
-void store_variable(uint16_t var, uint16_t n)
-{
-  ZASSERT(var < 0x100, "unable to decode variable %u", (unsigned)var);
-
-  /* Stack. */
-  if(var == 0)
-  {
-    PUSH_STACK(n);
-  }
-
-  /* Local variables. */
-  else if(var <= 0x0f)
-  {
-    ZASSERT(var <= CURRENT_FRAME->nlocals, "attempting to store to nonexistent local variable %d: routine has %d", (int)var, CURRENT_FRAME->nlocals);
-    CURRENT_FRAME->locals[var - 1] = n;
-  }
-
-  /* Global variables. */
-  else if(var <= 0xff)
-  {
-    var -= 0x10;
-    STORE_WORD(header.globals + (var * 2), n);
-  }
-}
-
 uint16_t *stack_top_element(void)
 {
-  ZASSERT(sp > CURRENT_FRAME->sp, "stack underflow");
+  CACHE_ZSTATE;
 
-  return sp - 1;
+  ZASSERT(zstate->sp > CURRENT_FRAME->sp, "stack underflow");
+
+  return zstate->sp - 1;
 }
 
 void zpush(void)
 {
+  CACHE_ZSTATE;
+
   PUSH_STACK(zargs[0]);
 }
 
 void zpull(void)
 {
+  CACHE_ZSTATE;
   uint16_t v;
 
   if(zversion != 6)
@@ -288,6 +231,8 @@ void zpull(void)
 
 void zload(void)
 {
+  CACHE_ZSTATE;
+
   /* The z-spec 1.1 requires indirect variable references to the stack not to push/pop */
   if(zargs[0] == 0) store(*stack_top_element());
   else              store(variable(zargs[0]));
@@ -295,6 +240,8 @@ void zload(void)
 
 void zstore(void)
 {
+  CACHE_ZSTATE;
+
   /* The z-spec 1.1 requires indirect variable references to the stack not to push/pop */
   if(zargs[0] == 0) *stack_top_element() = zargs[1];
   else              store_variable(zargs[0], zargs[1]);
@@ -302,6 +249,7 @@ void zstore(void)
 
 void call(int do_store)
 {
+  CACHE_ZSTATE;
   uint32_t jmp_to;
   uint8_t nlocals;
   uint16_t where;
@@ -328,7 +276,7 @@ void call(int do_store)
     default: where = 0xff + 2;   break; /* Or a tag meaning push the return value */
   }
 
-  add_frame(pc, sp, nlocals, znargs - 1, where);
+  add_frame(pc, zstate->sp, nlocals, znargs - 1, where);
 
   for(int i = 0; i < nlocals; i++)
   {
@@ -352,6 +300,7 @@ void call(int do_store)
 #ifdef ZTERP_GLK
 uint16_t direct_call(uint16_t routine)
 {
+  CACHE_ZSTATE;
   uint16_t saved_args[znargs];
   uint16_t saved_nargs;
 
@@ -382,14 +331,15 @@ void zcall_nostore(void)
 
 void do_return(uint16_t retval)
 {
+  CACHE_ZSTATE;
   uint16_t where;
 
   ZASSERT(NFRAMES > 1, "return attempted outside of a function");
 
-  pc = CURRENT_FRAME->pc;
-  sp = CURRENT_FRAME->sp;
+  pc = CURRENT_FRAME->return_pc;
+  zstate->sp = CURRENT_FRAME->sp;
   where = CURRENT_FRAME->where;
-  fp--;
+  zstate->fp--;
 
   if(where <= 0xff)
   {
@@ -404,16 +354,20 @@ void do_return(uint16_t retval)
 
 void zret_popped(void)
 {
+
   do_return(POP_STACK());
 }
 
 void zpop(void)
 {
+
   POP_STACK();
 }
 
 void zcatch(void)
 {
+  CACHE_ZSTATE;
+
   ZASSERT(zversion == 6 || NFRAMES > 1, "@catch called outside of a function");
 
   /* Must account for the dummy frame in non-V6 stories. */
@@ -422,19 +376,23 @@ void zcatch(void)
 
 void zthrow(void)
 {
+  CACHE_ZSTATE;
+
   /* As with @catch, account for the dummy frame. */
   if(zversion != 6) zargs[1]++;
 
   ZASSERT(zversion == 6 || NFRAMES > 1, "@throw called outside of a function");
   ZASSERT(zargs[1] <= NFRAMES, "unwinding too far");
 
-  fp = BASE_OF_FRAMES + zargs[1];
+  zstate->fp = BASE_OF_FRAMES + zargs[1];
 
   do_return(zargs[0]);
 }
 
 void zret(void)
 {
+  CACHE_ZSTATE;
+
   do_return(zargs[0]);
 }
 
@@ -450,6 +408,8 @@ void zrfalse(void)
 
 void zcheck_arg_count(void)
 {
+  CACHE_ZSTATE;
+
   ZASSERT(zversion == 6 || NFRAMES > 1, "@check_arg_count called outside of a function");
 
   branch_if(zargs[0] <= CURRENT_FRAME->nargs);
@@ -457,6 +417,8 @@ void zcheck_arg_count(void)
 
 void zpop_stack(void)
 {
+  CACHE_ZSTATE;
+
   if(znargs == 1)
   {
     for(uint16_t i = 0; i < zargs[0]; i++) POP_STACK();
@@ -469,6 +431,7 @@ void zpop_stack(void)
 
 void zpush_stack(void)
 {
+  CACHE_ZSTATE;
   uint16_t slots = user_word(zargs[1]);
 
   if(slots == 0)
@@ -489,6 +452,7 @@ void zpush_stack(void)
  */
 static uint32_t compress_memory(uint8_t **compressed)
 {
+  CACHE_ZSTATE;
   uint32_t ret = 0;
   long i = 0;
   uint8_t *tmp;
@@ -548,9 +512,11 @@ static uint32_t compress_memory(uint8_t **compressed)
 /* Reverse of the above function. */
 static int uncompress_memory(const uint8_t *compressed, uint32_t size)
 {
+  CACHE_ZSTATE;
   uint32_t memory_index = 0;
 
   memcpy(memory, dynamic_memory, header.static_start);
+  memory_written(0, header.static_start);
 
   for(uint32_t i = 0; i < size; i++)
   {
@@ -575,6 +541,7 @@ static int uncompress_memory(const uint8_t *compressed, uint32_t size)
 /* Push the current state onto the specified save stack. */
 int push_save(enum save_type type, uint32_t whichpc, const char *desc)
 {
+  CACHE_ZSTATE;
   struct save_stack *s = &save_stacks[type];
   struct save_state *new;
 
@@ -593,9 +560,9 @@ int push_save(enum save_type type, uint32_t whichpc, const char *desc)
     new->desc = NULL;
   }
 
-  new->pc = whichpc;
+  new->saved_pc = whichpc;
 
-  new->stack_size = sp - BASE_OF_STACK;
+  new->stack_size = zstate->sp - BASE_OF_STACK;
   new->stack = malloc(new->stack_size * sizeof *new->stack);
   if(new->stack == NULL) goto err;
   memcpy(new->stack, BASE_OF_STACK, new->stack_size * sizeof *new->stack);
@@ -607,14 +574,14 @@ int push_save(enum save_type type, uint32_t whichpc, const char *desc)
 
   if(options.disable_undo_compression)
   {
-    new->memory = malloc(header.static_start);
-    if(new->memory == NULL) goto err;
-    memcpy(new->memory, memory, header.static_start);
+    new->saved_memory = malloc(header.static_start);
+    if(new->saved_memory == NULL) goto err;
+    memcpy(new->saved_memory, memory, header.static_start);
   }
   else
   {
-    new->memsize = compress_memory(&new->memory);
-    if(new->memsize == 0) goto err;
+    new->snapshot = snapshot_take();
+    if(new->snapshot == NULL) goto err;
   }
 
   /* If the maximum number has been reached, drop the last element.
@@ -679,6 +646,7 @@ static void trim_saves(enum save_type type, long n)
  */
 int pop_save(enum save_type type, long i)
 {
+  CACHE_ZSTATE;
   struct save_stack *s = &save_stacks[type];
   struct save_state *p;
   uint16_t flags2;
@@ -695,25 +663,22 @@ int pop_save(enum save_type type, long i)
 
   p = s->head;
 
-  pc = p->pc;
+  pc = p->saved_pc;
 
   if(options.disable_undo_compression)
   {
-    memcpy(memory, p->memory, header.static_start);
+    memcpy(memory, p->saved_memory, header.static_start);
+    memory_written(0, header.static_start);
   }
   else
   {
-    /* If this fails it’s a bug: unlike Quetzal files, the contents of
-     * p->memory are known to be good, because the compression was done
-     * by us with no chance for corruption (apart, again, from bugs).
-     */
-    if(uncompress_memory(p->memory, p->memsize) == -1) die("error uncompressing memory: unable to continue");
+    snapshot_restore(p->snapshot);
   }
 
-  sp = BASE_OF_STACK + p->stack_size;
-  memcpy(BASE_OF_STACK, p->stack, sizeof *sp * p->stack_size);
+  zstate->sp = BASE_OF_STACK + p->stack_size;
+  memcpy(BASE_OF_STACK, p->stack, sizeof *zstate->sp * p->stack_size);
 
-  fp = BASE_OF_FRAMES + p->nframes;
+  zstate->fp = BASE_OF_FRAMES + p->nframes;
   memcpy(BASE_OF_FRAMES, p->frames, sizeof *p->frames * p->nframes);
 
   trim_saves(type, 1);
@@ -771,6 +736,8 @@ void list_saves(enum save_type type, void (*printer)(const char *))
 
 void zsave_undo(void)
 {
+  CACHE_ZSTATE;
+
   if(in_interrupt()) die("@save_undo called inside of an interrupt");
 
   /* If override undo is set, all calls to @save_undo are reported as
@@ -817,7 +784,7 @@ void zrestore_undo(void)
 }
 
 /* Quetzal save/restore functions. */
-static jmp_buf exception;
+static zthread_local jmp_buf exception;
 #define WRITE8(v)  do { uint8_t  v_ = (v); if(zterp_io_write(savefile, &v_, sizeof v_) != sizeof v_) longjmp(exception, 1); local_written += 1; } while(0)
 #define WRITE16(v) do { uint16_t w_ = (v); WRITE8(w_ >>  8); WRITE8(w_ & 0xff); } while(0)
 #define WRITE32(v) do { uint32_t x_ = (v); WRITE8(x_ >> 24); WRITE8((x_ >> 16) & 0xff); WRITE8((x_ >> 8) & 0xff); WRITE8(x_ & 0xff); } while(0)
@@ -825,19 +792,20 @@ static jmp_buf exception;
 
 static size_t quetzal_write_stack(zterp_io *savefile)
 {
+  CACHE_ZSTATE;
   size_t local_written = 0;
 
   /* Add one more “fake” call frame with just enough information to
    * calculate the evaluation stack used by the current routine.
    */
-  fp->sp = sp;
-  for(struct call_frame *p = BASE_OF_FRAMES; p != fp; p++)
+  zstate->fp->sp = zstate->sp;
+  for(struct call_frame *p = BASE_OF_FRAMES; p != zstate->fp; p++)
   {
     uint8_t temp;
 
-    WRITE8((p->pc >> 16) & 0xff);
-    WRITE8((p->pc >>  8) & 0xff);
-    WRITE8((p->pc >>  0) & 0xff);
+    WRITE8((p->return_pc >> 16) & 0xff);
+    WRITE8((p->return_pc >>  8) & 0xff);
+    WRITE8((p->return_pc >>  0) & 0xff);
 
     temp = p->nlocals;
     if(p->where > 0xff) temp |= 0x10;
@@ -863,6 +831,8 @@ static size_t quetzal_write_stack(zterp_io *savefile)
 
 int save_quetzal(zterp_io *savefile, int is_meta)
 {
+  CACHE_ZSTATE;
+
   if(setjmp(exception) != 0) return 0;
 
   size_t local_written = 0;
@@ -944,11 +914,11 @@ int save_quetzal(zterp_io *savefile, int is_meta)
  * takes a snapshot of the current state of dynamic memory and the
  * stacks so they can be restored on failure.
  */
-static uint8_t *memory_backup;
-static uint16_t *stack_backup;
-static int stack_backup_size;
-static struct call_frame *frames_backup;
-static int frames_backup_size;
+static zthread_local uint8_t *memory_backup;
+static zthread_local uint16_t *stack_backup;
+static zthread_local int stack_backup_size;
+static zthread_local struct call_frame *frames_backup;
+static zthread_local int frames_backup_size;
 
 static void memory_snapshot_free(void)
 {
@@ -963,6 +933,8 @@ static void memory_snapshot_free(void)
 
 static void memory_snapshot(void)
 {
+  CACHE_ZSTATE;
+
   memory_snapshot_free();
 
   memory_backup = malloc(header.static_start);
@@ -970,7 +942,7 @@ static void memory_snapshot(void)
 
   memcpy(memory_backup, memory, header.static_start);
 
-  stack_backup_size = sp - stack;
+  stack_backup_size = zstate->sp - stack;
   if(stack_backup_size != 0)
   {
     stack_backup = malloc(stack_backup_size * sizeof *stack);
@@ -978,7 +950,7 @@ static void memory_snapshot(void)
     memcpy(stack_backup, stack, stack_backup_size * sizeof *stack);
   }
 
-  frames_backup_size = fp - frames;
+  frames_backup_size = zstate->fp - frames;
   if(frames_backup_size != 0)
   {
     frames_backup = malloc(frames_backup_size * sizeof *frames);
@@ -996,6 +968,8 @@ err:
 
 static int memory_restore(void)
 {
+  CACHE_ZSTATE;
+
   /* stack_backup and frames_backup will be NULL if the stacks were
    * empty, so use memory_backup to determine if a snapshot has been
    * taken.
@@ -1003,10 +977,11 @@ static int memory_restore(void)
   if(memory_backup == NULL) return 0;
 
   memcpy(memory, memory_backup, header.static_start);
+  memory_written(0, header.static_start);
   if(stack_backup != NULL) memcpy(stack, stack_backup, stack_backup_size * sizeof *stack);
-  sp = stack + stack_backup_size;
+  zstate->sp = stack + stack_backup_size;
   if(frames_backup != NULL) memcpy(frames, frames_backup, frames_backup_size * sizeof *frames);
-  fp = frames + frames_backup_size;
+  zstate->fp = frames + frames_backup_size;
 
   memory_snapshot_free();
 
@@ -1018,6 +993,8 @@ static int memory_restore(void)
 
 int restore_quetzal(zterp_io *savefile, int is_meta)
 {
+  CACHE_ZSTATE;
+
   zterp_iff *iff;
   uint32_t size;
   uint32_t n = 0;
@@ -1070,6 +1047,7 @@ int restore_quetzal(zterp_io *savefile, int is_meta)
   else if(zterp_iff_find(iff, "UMem", &size))
   {
     if(size != header.static_start) goto_err("memory size mismatch");
+    memory_written(0, header.static_start);
     if(zterp_io_read(savefile, memory, header.static_start) != header.static_start) goto_death("unexpected eof reading memory");
   }
   else
@@ -1079,8 +1057,8 @@ int restore_quetzal(zterp_io *savefile, int is_meta)
 
   if(!zterp_iff_find(iff, "Stks", &size)) goto_death("no stacks chunk found");
 
-  sp = BASE_OF_STACK;
-  fp = BASE_OF_FRAMES;
+  zstate->sp = BASE_OF_STACK;
+  zstate->fp = BASE_OF_FRAMES;
 
   while(n < size)
   {
@@ -1097,7 +1075,7 @@ int restore_quetzal(zterp_io *savefile, int is_meta)
     frame[5]++;
     while(frame[5] >>= 1) nargs++;
 
-    add_frame((frame[0] << 16) | (frame[1] << 8) | frame[2], sp, nlocals, nargs, (frame[3] & 0x10) ? 0xff + 1 : frame[4]);
+    add_frame((frame[0] << 16) | (frame[1] << 8) | frame[2], zstate->sp, nlocals, nargs, (frame[3] & 0x10) ? 0xff + 1 : frame[4]);
 
     for(int i = 0; i < nlocals; i++)
     {
@@ -1177,6 +1155,8 @@ int do_save(int is_meta)
  */
 void zsave(void)
 {
+  CACHE_ZSTATE;
+
   if(in_interrupt()) die("@save called inside of an interrupt");
 
   int success = do_save(0);
@@ -1192,6 +1172,7 @@ void zsave(void)
  */
 int do_restore(int is_meta)
 {
+  CACHE_ZSTATE;
   zterp_io *savefile;
   uint16_t flags2;
   int success;
@@ -1235,6 +1216,7 @@ int do_restore(int is_meta)
 
 void zrestore(void)
 {
+  CACHE_ZSTATE;
   int success = do_restore(0);
 
   if(zversion <= 3) branch_if(success);
@@ -4,16 +4,105 @@
 #include <stdint.h>
 
 #include "io.h"
+#include "memory.h"
+#include "util.h"
+#include "zterp.h"
 
 #define DEFAULT_STACK_SIZE	0x4000
 #define DEFAULT_CALL_DEPTH	0x400
 
-extern int seen_save_undo;
+extern zthread_local int seen_save_undo;
+
+/* The evaluation stack pointer (sp) and the call stack pointer (fp),
+ * which points just past the current frame, are kept in struct zstate,
+ * so that variables can be read and written in line.
+ */
+struct call_frame
+{
+  uint32_t return_pc;
+  uint16_t *sp;
+  uint8_t nlocals;
+  uint8_t nargs;
+  uint16_t where;
+  uint16_t locals[15];
+};
+
+#define CURRENT_FRAME	(zstate->fp - 1)
+
+static inline void PUSH_STACK(uint16_t n)
+{
+  CACHE_ZSTATE;
+  ZASSERT(zstate->sp != zstate->top_of_stack, "stack overflow");
+  *zstate->sp++ = n;
+}
+
+static inline uint16_t POP_STACK(void)
+{
+  CACHE_ZSTATE;
+  ZASSERT(zstate->sp > CURRENT_FRAME->sp, "stack underflow");
+  return *--zstate->sp;
+}
 
 void init_stack(void);
 
-uint16_t variable(uint16_t);
-void store_variable(uint16_t, uint16_t);
+static inline uint16_t variable(uint16_t var)
+{
+  CACHE_ZSTATE;
+  ZASSERT(var < 0x100, "unable to decode variable %u", (unsigned)var);
+
+  /* Stack */
+  if(var == 0)
+  {
+    return POP_STACK();
+  }
+
+  /* Locals */
+  else if(var <= 0x0f)
+  {
+    ZASSERT(var <= CURRENT_FRAME->nlocals, "attempting to read from nonexistent local variable %d: routine has %d", (int)var, CURRENT_FRAME->nlocals);
+    return CURRENT_FRAME->locals[var - 1];
+  }
+
+  /* Globals */
+  else if(var <= 0xff)
+  {
+    var -= 0x10;
+    return WORD(header.globals + (var * 2));
+  }
+
+  /* This is an “impossible” situation (ie, the game did something wrong).
+   * It will be caught above if safety checks are turned on, but if they
+   * are not, do what we can: lie.
+   */
+  return -1;
+}
+
+static inline void store_variable(uint16_t var, uint16_t n)
+{
+  CACHE_ZSTATE;
+  ZASSERT(var < 0x100, "unable to decode variable %u", (unsigned)var);
+
+  /* Stack. */
+  if(var == 0)
+  {
+    PUSH_STACK(n);
+  }
+
+  /* Local variables. */
+  else if(var <= 0x0f)
+  {
+    ZASSERT(var <= CURRENT_FRAME->nlocals, "attempting to store to nonexistent local variable %d: routine has %d", (int)var, CURRENT_FRAME->nlocals);
+    CURRENT_FRAME->locals[var - 1] = n;
+  }
+
+  /* Global variables. */
+  else if(var <= 0xff)
+  {
+    var -= 0x10;
+    STORE_WORD(header.globals + (var * 2), n);
+  }
+}
+
 uint16_t *stack_top_element(void);
 
 void call(int);
@@ -24,7 +24,7 @@
 #include "util.h"
 #include "zterp.h"
 
-int have_unicode;
+zthread_local int have_unicode;
 
 /*
  * The index is the ZSCII value, minus 155 (so entry 0 refers to ZSCII
@@ -36,8 +36,8 @@ int have_unicode;
  * setup_tables() where appropriate.
  */
 #define UNICODE_TABLE_SIZE	97
-static int unicode_entries = 69;
-static uint16_t unicode_table[UNICODE_TABLE_SIZE] = {
+static zthread_local int unicode_entries = 69;
+static zthread_local uint16_t unicode_table[UNICODE_TABLE_SIZE] = {
 0x00e4, 0x00f6, 0x00fc, 0x00c4, 0x00d6, 0x00dc, 0x00df, 0x00bb, 0x00ab,
 0x00eb, 0x00ef, 0x00ff, 0x00cb, 0x00cf, 0x00e1, 0x00e9, 0x00ed, 0x00f3,
 0x00fa, 0x00fd, 0x00c1, 0x00c9, 0x00cd, 0x00d3, 0x00da, 0x00dd, 0x00e0,
@@ -70,7 +70,7 @@ void parse_unicode_table(uint16_t utable)
  * only used for output, non-output values will be returned as a
  * question mark.
  */
-uint16_t zscii_to_unicode[UINT8_MAX + 1];
+zthread_local uint16_t zscii_to_unicode[UINT8_MAX + 1];
 
 /* These tables translate a Unicode or (Latin-1) character into its
  * ZSCII equivalent.  Only valid Unicode characters are translated (that
@@ -79,20 +79,20 @@ uint16_t zscii_to_unicode[UINT8_MAX + 1];
  * The first table will translate invalid Unicode characters to zero;
  * the second, to a question mark.
  */
-uint8_t unicode_to_zscii  [UINT16_MAX + 1];
-uint8_t unicode_to_zscii_q[UINT16_MAX + 1];
+zthread_local uint8_t unicode_to_zscii  [UINT16_MAX + 1];
+zthread_local uint8_t unicode_to_zscii_q[UINT16_MAX + 1];
 
 /* Convenience table: pass through all values 0–255, but yield a question mark
  * for others. */
-uint8_t unicode_to_latin1[UINT16_MAX + 1];
+zthread_local uint8_t unicode_to_latin1[UINT16_MAX + 1];
 
 /* Convert ZSCII to Unicode line-drawing/rune characters. */
-uint16_t zscii_to_font3[UINT8_MAX + 1];
+zthread_local uint16_t zscii_to_font3[UINT8_MAX + 1];
 
 /* Lookup table to see if a character is in the alphabet table.  Key is
  * the character, value is the index in the alphabet table, or -1.
  */
-int atable_pos[UINT8_MAX + 1];
+zthread_local int atable_pos[UINT8_MAX + 1];
 
 /* Not all fonts provide all characters, so there
  * may well be a lot of question marks.
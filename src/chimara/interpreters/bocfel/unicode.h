@@ -1,6 +1,8 @@
 #ifndef ZTERP_TABLES_H
 #define ZTERP_TABLES_H
 
+#include "util.h"
+
 #include <stdint.h>
 
 #ifdef ZTERP_GLK
@@ -24,14 +26,14 @@
  * gestalt), and determines whether Unicode IO functions should
  * be used; otherwise, it is kept in parallel with use_utf8_io.
  */
-extern int have_unicode;
-
-extern uint16_t zscii_to_unicode[];
-extern uint8_t unicode_to_zscii[];
-extern uint8_t unicode_to_zscii_q[];
-extern uint8_t unicode_to_latin1[];
-extern uint16_t zscii_to_font3[];
-extern int atable_pos[];
+extern zthread_local int have_unicode;
+
+extern zthread_local uint16_t zscii_to_unicode[];
+extern zthread_local uint8_t unicode_to_zscii[];
+extern zthread_local uint8_t unicode_to_zscii_q[];
+extern zthread_local uint8_t unicode_to_latin1[];
+extern zthread_local uint16_t zscii_to_font3[];
+extern zthread_local int atable_pos[];
 
 void parse_unicode_table(uint16_t);
 void setup_tables(void);
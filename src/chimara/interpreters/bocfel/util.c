@@ -31,8 +31,6 @@
 #endif
 
 #ifndef ZTERP_NO_SAFETY_CHECKS
-unsigned long zassert_pc;
-
 void assert_fail(const char *fmt, ...)
 {
   va_list ap;
@@ -115,11 +113,11 @@ void help(void)
 /* This is not POSIX compliant, but it gets the job done.
  * It should not be called more than once.
  */
-static int zoptind = 0;
-static const char *zoptarg;
+static zthread_local int zoptind = 0;
+static zthread_local const char *zoptarg;
 static int zgetopt(int argc, char **argv, const char *optstring)
 {
-  static const char *p = "";
+  static zthread_local const char *p = "";
   const char *optp;
   int c;
 
@@ -171,12 +169,12 @@ char *xstrdup(const char *s)
   return r;
 }
 
-enum arg_status arg_status = ARG_OK;
+zthread_local enum arg_status arg_status = ARG_OK;
 void process_arguments(int argc, char **argv)
 {
   int c;
 
-  while( (c = zgetopt(argc, argv, "a:A:cCdDeE:fFgGhiklLmn:N:rR:sS:tT:u:UvxXyYz:Z:")) != -1 )
+  while( (c = zgetopt(argc, argv, "a:A:cCdDeE:fFgGhiklLmn:N:PrR:sS:tT:u:UvxXyYz:Z:")) != -1 )
   {
     switch(c)
     {
@@ -240,6 +238,9 @@ void process_arguments(int argc, char **argv)
       case 'N':
         options.int_version = zoptarg[0];
         break;
+      case 'P':
+        options.disable_predecode = 1;
+        break;
       case 'r':
         options.replay_on = 1;
         break;
@@ -21,6 +21,24 @@
 #define zexternally_visible
 #endif
 
+#if defined(__GNUC__) && (__GNUC__ > 2 || (__GNUC__ == 2 && __GNUC_MINOR__ >= 5))
+#define zconst			__attribute__((__const__))
+#define zunused			__attribute__((__unused__))
+#else
+#define zconst
+#define zunused
+#endif
+
+/* Each game runs in a Glk thread of its own, and all of the
+ * interpreter’s state is thread-local, so that one loaded copy of
+ * Bocfel can run several games at once.
+ */
+#if defined(__GNUC__)
+#define zthread_local		__thread
+#else
+#define zthread_local		_Thread_local
+#endif
+
 /* Values are usually stored in a uint16_t because most parts of the
  * Z-machine make use of 16-bit unsigned integers.  However, in a few
  * places the unsigned value must be treated as signed.  The “obvious”
@@ -39,7 +57,7 @@ static inline int16_t as_signed(uint16_t n) { return n; }
 #endif
 
 #ifndef ZTERP_NO_SAFETY_CHECKS
-extern unsigned long zassert_pc;
+/* zassert_pc is kept with the rest of the busy state (see zterp.h). */
 #define ZPC(pc)		do { zassert_pc = pc; } while(0)
 
 zprintflike(1, 2)
@@ -61,7 +79,7 @@ void help(void);
 
 char *xstrdup(const char *);
 
-extern enum arg_status { ARG_OK, ARG_HELP, ARG_FAIL } arg_status;
+extern zthread_local enum arg_status { ARG_OK, ARG_HELP, ARG_FAIL } arg_status;
 void process_arguments(int, char **);
 
 /* Somewhat ugly hack to get around the fact that some Glk functions may
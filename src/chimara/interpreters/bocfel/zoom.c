@@ -23,7 +23,7 @@
 #include "screen.h"
 #include "zterp.h"
 
-static clock_t start_clock, end_clock;
+static zthread_local clock_t start_clock, end_clock;
 
 void zstart_timer(void)
 {
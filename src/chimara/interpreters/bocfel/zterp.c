@@ -47,8 +47,8 @@
 
 #define ZTERP_VERSION	"0.6.3.2"
 
-const char *game_file;
-struct options options = {
+zthread_local const char *game_file;
+zthread_local struct options options = {
   .eval_stack_size = DEFAULT_STACK_SIZE,
   .call_stack_size = DEFAULT_CALL_DEPTH,
   .disable_color = 0,
@@ -81,13 +81,22 @@ struct options options = {
   .enable_censorship = 0,
   .overwrite_transcript = 0,
   .override_undo = 0,
+  .disable_predecode = 0,
   .random_seed = -1,
   .random_device = NULL,
 };
 
-static char story_id[64];
+static zthread_local char story_id[64];
 
-uint32_t pc;
+zthread_local struct zstate zstate[1];
+
+/* Not inline, so that callers keep the address rather than looking up
+ * the thread-local structure each time (see zterp.h).
+ */
+struct zstate *zstate_address(void)
+{
+  return zstate;
+}
 
 /* zversion stores the Z-machine version of the story: 1–6.
  *
@@ -97,12 +106,9 @@ uint32_t pc;
  * zwhich stores the actual version (1–8) for the few rare times where
  * this knowledge is necessary.
  */
-int zversion;
-static int zwhich;
+static zthread_local int zwhich;
 
-struct header header;
-
-static struct
+static zthread_local struct
 {
   zterp_io *io;
   long offset;
@@ -115,7 +121,7 @@ static struct
  * when necessary, so it’s safe to use a null character here to mean
  * “nothing”.
  */
-uint8_t atable[26 * 3] =
+zthread_local uint8_t atable[26 * 3] =
 {
   /* A0 */
   'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
@@ -132,6 +138,8 @@ uint8_t atable[26 * 3] =
 
 uint32_t unpack(uint16_t addr, int string)
 {
+  CACHE_ZSTATE;
+
   switch(zwhich)
   {
     case 1: case 2: case 3:
@@ -149,6 +157,8 @@ uint32_t unpack(uint16_t addr, int string)
 
 void store(uint16_t v)
 {
+  CACHE_ZSTATE;
+
   store_variable(BYTE(pc++), v);
 }
 
@@ -204,7 +214,7 @@ int is_sherlock(void)
   return is_story("97-871026") || is_story("21-871214") || is_story("22-880112") || is_story("26-880127");
 }
 
-int is_infocom_v1234;
+zthread_local int is_infocom_v1234;
 static void check_infocom(void)
 {
   /* All V1234 games from the Infocom fact sheet for which both a
@@ -249,12 +259,11 @@ static void check_infocom(void)
 }
 
 #ifndef ZTERP_NO_CHEAT
-/* The index into these arrays is the address to freeze.
- * The first array tracks whether the address is frozen, while the
- * second holds the frozen value.
+/* The index into freezew_cheat and freezew_val (see zterp.h) is the
+ * address to freeze.  The first array tracks whether the address is
+ * frozen, while the second holds the frozen value.  They are allocated
+ * when the first address is frozen.
  */
-static char     freezew_cheat[UINT16_MAX + 1];
-static uint16_t freezew_val  [UINT16_MAX + 1];
 
 static void cheat(char *how)
 {
@@ -285,6 +294,20 @@ static void cheat(char *how)
     p = strtok(NULL, ":");
     if(p == NULL) return;
 
+    if(freezew_cheat == NULL)
+    {
+      freezew_cheat = calloc(UINT16_MAX + 1, sizeof *freezew_cheat);
+      freezew_val = calloc(UINT16_MAX + 1, sizeof *freezew_val);
+      if(freezew_cheat == NULL || freezew_val == NULL)
+      {
+        free(freezew_cheat);
+        free(freezew_val);
+        freezew_cheat = NULL;
+        freezew_val = NULL;
+        return;
+      }
+    }
+
     freezew_cheat[addr] = 1;
     freezew_val  [addr] = strtoul(p, NULL, 0);
   }
@@ -292,7 +315,7 @@ static void cheat(char *how)
 
 int cheat_find_freezew(uint32_t addr, uint16_t *val)
 {
-  if(addr > UINT16_MAX || !freezew_cheat[addr]) return 0;
+  if(freezew_cheat == NULL || addr > UINT16_MAX || !freezew_cheat[addr]) return 0;
 
   *val = freezew_val[addr];
 
@@ -392,6 +415,7 @@ static void read_config(void)
     BOOL  (enable_censorship);
     BOOL  (overwrite_transcript);
     BOOL  (override_undo);
+    BOOL  (disable_predecode);
     NUMBER(random_seed);
     STRING(random_device);
 
@@ -418,8 +442,8 @@ static void read_config(void)
   fclose(fp);
 }
 
-static int have_statuswin = 0;
-static int have_upperwin  = 0;
+static zthread_local int have_statuswin = 0;
+static zthread_local int have_upperwin  = 0;
 
 /* Various parts of the header (those marked “Rst” in §11) should be
  * updated by the interpreter.  This function does that.  This is also
@@ -535,6 +559,7 @@ static void process_story(void)
   if(zterp_io_seek(story.io, story.offset, SEEK_SET) == -1) die("unable to rewind story");
 
   if(zterp_io_read(story.io, memory, memory_size) != memory_size) die("unable to read from story file");
+  memory_written(0, memory_size);
 
   zversion =		BYTE(0x00);
   if(zversion < 1 || zversion > 8) die("only z-code versions 1-8 are supported");
@@ -890,6 +915,7 @@ int main(int argc, char **argv)
   have_unicode = glk_gestalt(gestalt_Unicode, 0);
 #endif
 #else
+  create_mainwin();
   have_unicode = zterp_os_have_unicode();
 #endif
 
@@ -936,6 +962,11 @@ int main(int argc, char **argv)
 #else
     screen_puts("Cheat support enabled");
 #endif
+#if defined(__GNUC__) && !defined(ZTERP_NO_PREDECODE)
+    screen_puts("Instruction pre-decoding available");
+#else
+    screen_puts("Instruction pre-decoding unavailable");
+#endif
 #ifdef ZTERP_TANDY
     screen_puts("The Tandy bit can be set");
 #else
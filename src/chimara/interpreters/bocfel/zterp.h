@@ -1,6 +1,8 @@
 #ifndef ZTERP_ZTERP_H
 #define ZTERP_ZTERP_H
 
+#include "util.h"
+
 #include <stdint.h>
 
 struct options
@@ -37,12 +39,13 @@ struct options
   int enable_censorship;
   int overwrite_transcript;
   int override_undo;
+  int disable_predecode;
   long random_seed;
   char *random_device;
 };
 
-extern const char *game_file;
-extern struct options options;
+extern zthread_local const char *game_file;
+extern zthread_local struct options options;
 
 /* v3 */
 #define FLAGS1_STATUSTYPE	(1U << 1)
@@ -90,11 +93,75 @@ struct header
   uint32_t S_O;
 };
 
-extern uint32_t pc;
-extern int zversion;
-extern struct header header;
-extern uint8_t atable[];
-extern int is_infocom_v1234;
+/* Dynamic memory is tracked in pages for undo; see memory.h. */
+#define MEMORY_PAGE_SHIFT	8
+#define MEMORY_PAGE_SIZE	(1UL << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGES		(0x10000UL >> MEMORY_PAGE_SHIFT)
+
+struct call_frame;
+struct insn;
+
+/* The state which nearly every instruction touches.  When Bocfel is
+ * loaded as a plugin, reading a thread-local variable can cost a call
+ * to __tls_get_addr(), so rather than each of these being thread-local
+ * on its own, they are gathered into one thread-local structure.  Busy
+ * functions start with CACHE_ZSTATE, which looks its address up once
+ * and keeps it in a local variable called zstate; the names below are
+ * macros for the fields, so they work with or without it.
+ *
+ * zstate_address() always returns the same thing within a thread, so
+ * it is declared const: inline functions can use CACHE_ZSTATE too, and
+ * the compiler merges their lookups with their caller’s.
+ */
+struct zstate
+{
+  uint32_t pc;
+  unsigned long zassert_pc;		/* util.h */
+  int zversion;
+  struct header header;
+
+  uint8_t *memory, *dynamic_memory;	/* memory.h */
+  uint32_t memory_size;
+  uint32_t watch_start, watch_end;
+  uint8_t dirty_pages[MEMORY_PAGES];
+#ifndef ZTERP_NO_CHEAT
+  char *freezew_cheat;			/* zterp.c; NULL until used */
+  uint16_t *freezew_val;
+#endif
+
+  uint16_t zargs[8];			/* process.h */
+  int znargs;
+  void (*opcodes[256])(void);		/* process.c */
+  uint32_t *insn_map;
+  struct insn *insns;
+
+  uint16_t *sp, *top_of_stack;		/* stack.h */
+  struct call_frame *fp, *top_of_frames;
+};
+
+extern zthread_local struct zstate zstate[1];
+zconst struct zstate *zstate_address(void);
+#define CACHE_ZSTATE	struct zstate *const zstate zunused = zstate_address()
+
+#define pc		(zstate->pc)
+#define zassert_pc	(zstate->zassert_pc)
+#define zversion	(zstate->zversion)
+#define header		(zstate->header)
+#define memory		(zstate->memory)
+#define dynamic_memory	(zstate->dynamic_memory)
+#define memory_size	(zstate->memory_size)
+#define watch_start	(zstate->watch_start)
+#define watch_end	(zstate->watch_end)
+#define dirty_pages	(zstate->dirty_pages)
+#ifndef ZTERP_NO_CHEAT
+#define freezew_cheat	(zstate->freezew_cheat)
+#define freezew_val	(zstate->freezew_val)
+#endif
+#define zargs		(zstate->zargs)
+#define znargs		(zstate->znargs)
+
+extern zthread_local uint8_t atable[];
+extern zthread_local int is_infocom_v1234;
 
 int is_beyond_zork(void);
 int is_journey(void);
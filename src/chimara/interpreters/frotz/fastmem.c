@@ -566,6 +566,8 @@ void z_restart (void)
 		if (fread (zmp, 1, h_dynamic_size, story_fp) != h_dynamic_size)
 			os_fatal ("Story file read error");
 
+		forget_dictionaries (0, h_dynamic_size);
+
 	} else first_restart = FALSE;
 
 	restart_header ();
@@ -613,6 +615,8 @@ void z_restore (void)
 
 		success = fread (zmp + zargs[0], 1, zargs[1], gfp);
 
+		forget_dictionaries (zargs[0], (long) zargs[0] + zargs[1]);
+
 		/* Close auxilary file */
 
 		fclose (gfp);
@@ -629,6 +633,10 @@ void z_restore (void)
 		if ((gfp = frotzopenprompt(FILE_RESTORE)) == NULL)
 			goto finished;
 
+		/* The game's memory is about to be overwritten */
+
+		forget_dictionaries (0, h_dynamic_size);
+
 		if (option_save_quetzal) {
 			success = restore_quetzal (gfp, story_fp, blorb_ofs);
 
@@ -830,6 +838,7 @@ int restore_undo (void)
 
 	memcpy (zmp, prev_zmp, h_dynamic_size);
 	SET_PC (curr_undo->pc);
+	forget_dictionaries (0, h_dynamic_size);
 	sp = stack + STACK_SIZE - curr_undo->stack_size;
 	fp = stack + curr_undo->frame_offset;
 	frame_count = curr_undo->frame_count;
@@ -269,7 +269,17 @@ enum story
 
 /*** Data access macros ***/
 
-#define SET_BYTE(addr,v)  { zmp[addr] = v; }
+/* Stores can change a dictionary that has been indexed; see text.c */
+
+extern long dict_watch_start, dict_watch_end;
+
+void	forget_dictionaries (long, long);
+
+#define DICT_WATCH(addr,n) \
+    if ((long) (addr) < dict_watch_end && (long) (addr) + (n) > dict_watch_start) \
+	forget_dictionaries ((long) (addr), (long) (addr) + (n));
+
+#define SET_BYTE(addr,v)  { DICT_WATCH (addr, 1) zmp[addr] = v; }
 #define LOW_BYTE(addr,v)  { v = zmp[addr]; }
 #define CODE_BYTE(v)	  { v = *pcp++;    }
 
@@ -281,7 +291,7 @@ extern zbyte *zmp;
 #define lo(v)		((zbyte *)&v)[1]
 #define hi(v)		((zbyte *)&v)[0]
 
-#define SET_WORD(addr,v)  { zmp[addr] = hi(v); zmp[addr+1] = lo(v); }
+#define SET_WORD(addr,v)  { DICT_WATCH (addr, 2) zmp[addr] = hi(v); zmp[addr+1] = lo(v); }
 #define LOW_WORD(addr,v)  { hi(v) = zmp[addr]; lo(v) = zmp[addr+1]; }
 #define HIGH_WORD(addr,v) { hi(v) = zmp[addr]; lo(v) = zmp[addr+1]; }
 #define CODE_WORD(v)      { hi(v) = *pcp++; lo(v) = *pcp++; }
@@ -300,7 +310,7 @@ extern zbyte *zmp;
 #define lo(v)	(v & 0xff)
 #define hi(v)	(v >> 8)
 
-#define SET_WORD(addr,v)  { zmp[addr] = hi(v); zmp[addr+1] = lo(v); }
+#define SET_WORD(addr,v)  { DICT_WATCH (addr, 2) zmp[addr] = hi(v); zmp[addr+1] = lo(v); }
 #define LOW_WORD(addr,v)  { v = ((zword) zmp[addr] << 8) | zmp[addr+1]; }
 #define HIGH_WORD(addr,v) { v = ((zword) zmp[addr] << 8) | zmp[addr+1]; }
 #define HIGH_LONG(addr,v) { v = ((zword) zmp[addr]   << 24) | \
@@ -31,6 +31,31 @@ zchar* decoded;
 zchar* encoded;
 static int resolution;
 
+/*
+ * Tokenising looks up every word in the dictionary, with a binary
+ * search, or a linear one for the unsorted dictionaries that games can
+ * build for themselves. Instead, the first time a dictionary is used
+ * for an exact lookup, its entries are put into a hash table keyed on
+ * their encoded text. Stores to a dictionary throw its index away
+ * (see SET_BYTE in frotz.h), so it's rebuilt on next use.
+ *
+ */
+
+typedef struct dict_index {
+    zword dct;
+    long start, end;		/* bytes the index was built from */
+    zword base;
+    zbyte entry_len;
+    long mask;
+    zword *slots;		/* entry number + 1, or 0 if unused */
+    struct dict_index *next;
+} dict_index_t;
+
+static dict_index_t *dict_indices = NULL;
+
+long dict_watch_start = 0;
+long dict_watch_end = 0;
+
 /* 
  * According to Matteo De Luigi <matteo.de.luigi@libero.it>, 
  * 0xab and 0xbb were in each other's proper positions.
@@ -61,6 +86,8 @@ void init_text (void)
     encoded = NULL;
 
     resolution = 0;
+
+    forget_dictionaries (0, 0x10000);
 }
 
 /*
@@ -911,6 +938,171 @@ void z_print_unicode (void)
 
 }/* z_print_unicode */
 
+/*
+ * forget_dictionaries
+ *
+ * Throw away the index of every dictionary that overlaps the given
+ * range of memory.
+ *
+ */
+
+void forget_dictionaries (long start, long end)
+{
+    dict_index_t **p = &dict_indices;
+    dict_index_t *index;
+
+    while ((index = *p) != NULL) {
+
+	if (index->start < end && start < index->end) {
+	    *p = index->next;
+	    free (index->slots);
+	    free (index);
+	} else p = &index->next;
+
+    }
+
+    dict_watch_start = dict_watch_end = 0;
+
+    for (index = dict_indices; index != NULL; index = index->next) {
+
+	if (dict_watch_start == dict_watch_end || index->start < dict_watch_start)
+	    dict_watch_start = index->start;
+	if (index->end > dict_watch_end)
+	    dict_watch_end = index->end;
+
+    }
+
+}/* forget_dictionaries */
+
+/*
+ * hash_entry
+ *
+ * Hash the encoded text of a dictionary entry, or of the global
+ * "encoded" string if addr is 0.
+ *
+ */
+
+static long hash_entry (zword addr)
+{
+    unsigned long hash = 2166136261UL;
+    zword w;
+    int i;
+
+    for (i = 0; i < resolution; i++) {
+
+	if (addr != 0)
+	    LOW_WORD (addr + 2 * i, w)
+	else
+	    w = encoded[i];
+
+	hash = ((hash ^ hi (w)) * 16777619UL) & 0xffffffffUL;
+	hash = ((hash ^ lo (w)) * 16777619UL) & 0xffffffffUL;
+
+    }
+
+    return (long) hash;
+
+}/* hash_entry */
+
+/*
+ * same_entry
+ *
+ * Compare the encoded text of two dictionary entries, or of an entry
+ * and the global "encoded" string if addr1 is 0.
+ *
+ */
+
+static bool same_entry (zword addr1, zword addr2)
+{
+    zword w1, w2;
+    int i;
+
+    for (i = 0; i < resolution; i++) {
+
+	if (addr1 != 0)
+	    LOW_WORD (addr1 + 2 * i, w1)
+	else
+	    w1 = encoded[i];
+	LOW_WORD (addr2 + 2 * i, w2)
+
+	if (w1 != w2)
+	    return FALSE;
+
+    }
+
+    return TRUE;
+
+}/* same_entry */
+
+/*
+ * index_dictionary
+ *
+ * Find or build the index of the dictionary at dct, whose entries
+ * start at base. If there are duplicate entries the first one wins, as
+ * in a linear search. Returns NULL if memory runs out, in which case
+ * the dictionary is searched directly.
+ *
+ */
+
+static dict_index_t *index_dictionary (zword dct, zword base, zbyte entry_len, int entry_count)
+{
+    dict_index_t *index;
+    long size = 16;
+    long slot;
+    int i;
+
+    for (index = dict_indices; index != NULL; index = index->next)
+	if (index->dct == dct)
+	    return index;
+
+    while (size < 2L * entry_count)
+	size *= 2;
+
+    if ((index = (dict_index_t *) malloc (sizeof (dict_index_t))) == NULL)
+	return NULL;
+    if ((index->slots = (zword *) calloc (size, sizeof (zword))) == NULL) {
+	free (index);
+	return NULL;
+    }
+
+    index->dct = dct;
+    index->start = dct;
+    index->end = base + (long) entry_count * entry_len;
+    index->base = base;
+    index->entry_len = entry_len;
+    index->mask = size - 1;
+
+    for (i = 0; i < entry_count; i++) {
+
+	zword entry_addr = base + i * entry_len;
+
+	slot = hash_entry (entry_addr) & index->mask;
+
+	while (index->slots[slot] != 0 &&
+	       !same_entry (entry_addr, base + (index->slots[slot] - 1) * entry_len))
+	    slot = (slot + 1) & index->mask;
+
+	if (index->slots[slot] == 0)
+	    index->slots[slot] = i + 1;
+
+    }
+
+    index->next = dict_indices;
+    dict_indices = index;
+
+    /* Only dictionaries in dynamic memory can be written to */
+
+    if (index->start < h_dynamic_size) {
+	if (dict_watch_start == dict_watch_end || index->start < dict_watch_start)
+	    dict_watch_start = index->start;
+	if (index->end > dict_watch_end)
+	    dict_watch_end = index->end;
+    }
+
+    return index;
+
+}/* index_dictionary */
+
 /*
  * lookup_text
  *
@@ -927,6 +1119,9 @@ void z_print_unicode (void)
 
 static zword lookup_text (int padding, zword dct)
 {
+    dict_index_t *index;
+    zword dict_addr = dct;
+    long slot;
     zword entry_addr;
     zword entry_count;
     zword entry;
@@ -956,6 +1151,26 @@ static zword lookup_text (int padding, zword dct)
 
     } else sorted = TRUE;		/* entries are sorted */
 
+    /* Exact matches can use the dictionary's index */
+
+    if (padding == 0x05 && entry_count != 0 &&
+	(index = index_dictionary (dict_addr, dct, entry_len, entry_count)) != NULL) {
+
+	for (slot = hash_entry (0) & index->mask;
+	     index->slots[slot] != 0;
+	     slot = (slot + 1) & index->mask) {
+
+	    entry_addr = dct + (index->slots[slot] - 1) * entry_len;
+
+	    if (same_entry (0, entry_addr))
+		return entry_addr;
+
+	}
+
+	return 0;
+
+    }
+
     lower = 0;
     upper = entry_count - 1;
 
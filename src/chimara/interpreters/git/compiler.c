@@ -5,6 +5,10 @@
 #include <stdlib.h>
 #include <setjmp.h>
 #include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // -------------------------------------------------------------
 // Constants
@@ -16,14 +20,30 @@ enum
     LONGJMP_BAD_OPCODE = 2
 };
 
+// The code cache starts out at the size the caller asks for, and
+// doubles whenever the code that's actually being reused no longer
+// fits into half of it -- up to this limit, in bytes.
+#define MAX_CACHE_SIZE (32 * 1024 * 1024L)
+
+// Bump this whenever the layout of compiled code changes, so that
+// old files in gCacheDir are ignored.
+#define CACHE_FILE_VERSION 3
+
+// Each build of a game has a checksum of its own, so a game that's
+// being developed leaves a new file in gCacheDir every time it's
+// rebuilt. Once the files there add up to more than this many bytes,
+// the least recently used ones are removed.
+#define MAX_CACHE_DIR_SIZE (64 * 1024 * 1024L)
+
 // -------------------------------------------------------------
 // Globals
 
-int gPeephole = 1;
-int gDebug = 0;
-int gCacheRAM = 0;
+git_thread_local int gPeephole = 1;
+git_thread_local int gDebug = 0;
+git_thread_local int gCacheRAM = 0;
+git_thread_local const char * gCacheDir = NULL;
 
-BlockHeader * gBlockHeader;
+git_thread_local CodeState gCodeState [1];
 
 const char * gLabelNames [] = {
 #define LABEL(label) #label,
@@ -31,8 +51,12 @@ const char * gLabelNames [] = {
     NULL
 };
 
-HashNode ** gHashTable; // Hash table of glulx address -> code.
-git_uint32 gHashSize;   // Number of slots in the hash table.
+// This is deliberately not inline, for the same reason as
+// memoryStateAddress() in memory.c.
+CodeState * codeStateAddress ()
+{
+    return gCodeState;
+}
 
 // -------------------------------------------------------------
 // Types.
@@ -49,48 +73,56 @@ typedef struct PatchNode
 }
 PatchNode;
 
+// Header of a file in gCacheDir. The file holds compiled ROM blocks
+// exactly as they're laid out in the code cache, so it's only valid
+// for the same game, the same build of Git and the same machine.
+typedef struct CacheFileHeader
+{
+    char       magic [4];    // "GitC"
+    git_uint32 version;      // CACHE_FILE_VERSION
+    git_uint32 gitVersion;   // GIT_MAJOR, GIT_MINOR and GIT_PATCH
+    git_uint32 byteOrder;    // 0x01020304, in the machine's byte order
+    git_uint32 layout;       // Label count and struct sizes
+    git_uint32 options;      // gPeephole and gDebug
+    git_uint32 checksum;     // Checksum from the game's header
+    git_uint32 ramStart;     // Start of RAM in the game
+    git_uint32 bufferSize;   // Size of the code cache when it was saved, in bytes
+    git_uint32 codeSize;     // Number of 4-byte words of code that follow
+    git_uint32 codeChecksum; // checksumWords() of the code that follows
+}
+CacheFileHeader;
+
 // -------------------------------------------------------------
 // Static variables.
 
-static git_uint32 * sBuffer;   // The buffer where everything is stored.
-static git_uint32 sBufferSize; // Size of the buffer, in 4-byte words.
+static git_thread_local git_uint32 * sBuffer;   // The buffer where everything is stored.
+static git_thread_local git_uint32 sBufferSize; // Size of the buffer, in 4-byte words.
 
-static Block       sCodeStart; // Start of code cache.
-static Block       sCodeTop;   // Next free space in code cache.
-static PatchNode*  sTempStart; // Start of temporary storage.
-static PatchNode*  sTempEnd;   // End of temporary storage.
+static git_thread_local Block       sCodeStart; // Start of code cache.
+static git_thread_local Block       sCodeTop;   // Next free space in code cache.
+static git_thread_local PatchNode*  sTempStart; // Start of temporary storage.
+static git_thread_local PatchNode*  sTempEnd;   // End of temporary storage.
 
-static jmp_buf sJumpBuf; // setjmp buffer, used to abort compilation when the buffer is full.
+static git_thread_local jmp_buf sJumpBuf; // setjmp buffer, used to abort compilation when the buffer is full.
 
 // This is the patch node for the opcode currently being compiled.
 // The 'address' and 'code' fields will be filled in. The other
 // fields can be updated during compilation as necessary.
-static PatchNode * sPatch;
+static git_thread_local PatchNode * sPatch;
 
-static int sNextInstructionIsReferenced;
-static git_uint32 sLastAddr;
+static git_thread_local int sNextInstructionIsReferenced;
+static git_thread_local git_uint32 sLastAddr;
 
 // -------------------------------------------------------------
 // Functions
 
-void initCompiler (size_t size)
-{
-    static BlockHeader dummyHeader;
-    gBlockHeader = &dummyHeader;
-
-    // Make sure various assumptions we're making are correct.
-
-    assert (sizeof(HashNode) <= sizeof(PatchNode));
+static void loadCodeCache (void);
+static void saveCodeCache (void);
+static void rebuildHashTable ();
 
-    // Allocate the buffer. As far as possible, we're going to 
-    // use this buffer for everything compiler-related, and
-    // avoid further dynamic allocation.
-
-    sBuffer = malloc (size);
-    if (sBuffer == NULL)
-        fatalError ("Couldn't allocate code cache");
-    
-    memset (sBuffer, 0, size);
+static void setBuffer (git_uint32 * buffer, size_t size)
+{
+    sBuffer = buffer;
     sBufferSize = size / 4;
 
     // Pick a reasonable size for the hash table. This should be
@@ -111,8 +143,39 @@ void initCompiler (size_t size)
     sTempStart = sTempEnd = (PatchNode*) (sBuffer + sBufferSize);
 }
 
+void initCompiler (size_t size)
+{
+    static git_thread_local BlockHeader dummyHeader;
+    git_uint32 * buffer;
+    gBlockHeader = &dummyHeader;
+
+    // Make sure various assumptions we're making are correct.
+
+    assert (sizeof(HashNode) <= sizeof(PatchNode));
+
+    // Allocate the buffer. As far as possible, we're going to 
+    // use this buffer for everything compiler-related, and
+    // avoid further dynamic allocation.
+
+    buffer = malloc (size);
+    if (buffer == NULL)
+        fatalError ("Couldn't allocate code cache");
+    
+    memset (buffer, 0, size);
+    setBuffer (buffer, size);
+
+    // Start with the code we compiled the last time this game
+    // was run, if there is any.
+
+    if (gCacheDir != NULL)
+        loadCodeCache ();
+}
+
 void shutdownCompiler ()
 {
+    if (gCacheDir != NULL)
+        saveCodeCache ();
+
     free (sBuffer);
 
     sBuffer = NULL;
@@ -287,7 +350,10 @@ Block compile (git_uint32 pc)
                 git_uint32 * by = constBranch + 1;
 
                 // Change the 'const' branch to a 'by' branch.
-                *op = *op - label_jump_const + label_jump_by;
+                if (*op >= label_jz_local_const && *op <= label_jle_local_const_const)
+                    *op = *op - label_jz_local_const + label_jz_local_by;
+                else
+                    *op = *op - label_jump_const + label_jump_by;
 
                 // Turn the address into a relative offset.
                 *by = ((git_uint32*)gBlockHeader + p2->codeOffset) - (constBranch + 2);
@@ -362,32 +428,58 @@ Block compile (git_uint32 pc)
 
 #define END_OF_BLOCK(header) ((void*) (((git_uint32*)header) + header->compiledSize))
 
+// Blocks are sorted into "heat" classes by the magnitude of their
+// run counters: class 0 holds blocks that were never looked up again
+// after being compiled, and class n holds run counts from 2^(n-1)
+// up to 2^n - 1.
+
+#define NUM_HEAT_CLASSES 33
+
+static int heatClass (git_uint32 runCounter)
+{
+    int n = 0;
+    while (runCounter != 0)
+    {
+        runCounter >>= 1;
+        ++n;
+    }
+    return n;
+}
+
 static git_uint32 findCutoffPoint ()
 {
     BlockHeader * start = (BlockHeader*) sCodeStart;
     BlockHeader * top = (BlockHeader*) sCodeTop;
     BlockHeader * h;
 
-    git_uint32 blockCount = 0;
-    git_uint32 runCount = 0;
+    git_uint32 sizeByHeat [NUM_HEAT_CLASSES];
+    git_uint32 budget = (sBufferSize - gHashSize) / 2;
+    git_uint32 kept = 0;
+    int n;
+
+    memset (sizeByHeat, 0, sizeof(sizeByHeat));
 
     for (h = start ; h < top ; h = END_OF_BLOCK(h))
     {
         if (h->glulxSize > 0)
-        {
-            ++blockCount;
-        }
+            sizeByHeat [heatClass (h->runCounter)] += h->compiledSize;
     }
 
-    for (h = start ; h < top ; h = END_OF_BLOCK(h))
+    // Keep the hottest classes that fit into half of the code area.
+    // Blocks that were never reused are always thrown out.
+
+    for (n = NUM_HEAT_CLASSES - 1 ; n > 0 ; --n)
     {
-        if (h->glulxSize > 0)
-        {
-            runCount += (h->runCounter + blockCount + 1) / blockCount;
-        }
+        if (kept + sizeByHeat [n] > budget)
+            break;
+        kept += sizeByHeat [n];
     }
 
-    return runCount / 2;
+    // Return the lowest run count that survives.
+
+    if (n >= NUM_HEAT_CLASSES - 1)
+        return 0xFFFFFFFF;
+    return (git_uint32) 1 << n;
 }
 
 static void compressWithCutoff (git_uint32 cutoff)
@@ -511,12 +603,49 @@ void pruneCodeCache (git_uint32 address, git_uint32 size)
     }
 }
 
+static int growCodeCache (void)
+{
+    git_uint32 * oldBuffer = sBuffer;
+    Block oldCodeStart = sCodeStart;
+    git_uint32 codeSize = sCodeTop - sCodeStart;
+    size_t size = sBufferSize * 8; // Twice the current size, in bytes.
+    git_uint32 * buffer;
+
+    if (size > MAX_CACHE_SIZE)
+        return 0;
+
+    buffer = malloc (size);
+    if (buffer == NULL)
+        return 0;
+
+    // Blocks only refer to themselves through relative offsets,
+    // so they can be copied as they are. Only the hash table has
+    // to be built again, since it's changed size.
+
+    memset (buffer, 0, size);
+    setBuffer (buffer, size);
+    memcpy (sCodeStart, oldCodeStart, codeSize * sizeof(git_uint32));
+    sCodeTop = sCodeStart + codeSize;
+    free (oldBuffer);
+
+    rebuildHashTable ();
+    return 1;
+}
+
 void compressCodeCache ()
 {
     git_uint32 n;
     git_uint32 spaceUsed, spaceFree;
     
     n = findCutoffPoint();
+
+    // If we'd have to throw out code that's been reused since the
+    // last cleanup, the game's working set doesn't fit in the cache.
+    // Make the cache bigger instead, if we can.
+
+    if (n > 1 && growCodeCache())
+        return;
+
     compressWithCutoff (n);
     rebuildHashTable ();
 
@@ -546,6 +675,334 @@ void resetCodeCache ()
     sTempStart = sTempEnd = (PatchNode*) (sBuffer + sBufferSize);
 }
 
+#ifndef USE_DIRECT_THREADING
+
+static void fillCacheFileHeader (CacheFileHeader * header)
+{
+    memset (header, 0, sizeof(CacheFileHeader));
+    memcpy (header->magic, "GitC", 4);
+    header->version = CACHE_FILE_VERSION;
+    header->gitVersion = (GIT_MAJOR << 16) | (GIT_MINOR << 8) | GIT_PATCH;
+    header->byteOrder = 0x01020304;
+    header->layout = (git_uint32) (MAX_LABEL ^ (sizeof(HashNode) << 16) ^ (sizeof(BlockHeader) << 24));
+    header->options = (gPeephole ? 1 : 0) | (gDebug ? 2 : 0);
+    header->checksum = memRead32 (32);
+    header->ramStart = gRamStart;
+}
+
+// A word-at-a-time FNV-1a hash, to catch cache files that were damaged
+// on disk. The hash nodes are checked separately, in hashNodesAreValid().
+static git_uint32 checksumWords (git_uint32 sum, const git_uint32 * words, git_uint32 count)
+{
+    while (count-- > 0)
+        sum = (sum ^ *words++) * 0x01000193;
+    return sum;
+}
+
+static char * cacheFilePath (const char * suffix)
+{
+    // Name the file after the game's checksum, so that one directory
+    // can hold the code for many games.
+    
+    size_t length = strlen (gCacheDir) + 32;
+    char * path = malloc (length);
+    if (path != NULL)
+        sprintf (path, "%s/%08lx.cache%s", gCacheDir, (unsigned long) memRead32 (32), suffix);
+    return path;
+}
+
+static int isCacheableBlock (BlockHeader * h)
+{
+    // The start address of the block is in its final hash node.
+    // Only code in ROM always compiles to the same thing.
+
+    HashNode * node = END_OF_BLOCK(h);
+    if (h->glulxSize == 0 || h->numHashNodes == 0)
+        return 0;
+    return node[-1].address + h->glulxSize <= gRamStart;
+}
+
+// Checks that every hash node in a block read from a cache file points
+// back at the block's header and into the block's code, so that
+// rebuildHashTable() and getCode() never follow a pointer out of it.
+static int hashNodesAreValid (BlockHeader * h)
+{
+    git_uint32 * code = (git_uint32*) (h + 1);
+    HashNode * end = END_OF_BLOCK(h);
+    HashNode * first = end - h->numHashNodes;
+    HashNode * node;
+
+    for (node = first ; node < end ; ++node)
+    {
+        git_uint32 * target = (git_uint32*) node + node->codeOffset;
+        if ((git_uint32*) node + node->headerOffset != (git_uint32*) h
+            || target < code || target >= (git_uint32*) first
+            || node->address >= gRamStart)
+            return 0;
+    }
+    return 1;
+}
+
+static void loadCodeCache (void)
+{
+    CacheFileHeader header, expected;
+    BlockHeader * h;
+    git_uint32 codeSize, rest, n, sum;
+    char * path;
+    FILE * file;
+
+    path = cacheFilePath ("");
+    if (path == NULL)
+        return;
+    file = fopen (path, "rb");
+    free (path);
+    if (file == NULL)
+        return;
+
+    fillCacheFileHeader (&expected);
+    if (fread (&header, sizeof(header), 1, file) != 1)
+        goto done;
+
+    expected.bufferSize = header.bufferSize;
+    expected.codeSize = header.codeSize;
+    expected.codeChecksum = header.codeChecksum;
+    if (memcmp (&header, &expected, sizeof(header)) != 0)
+        goto done;
+
+    // Start with a cache as big as the game needed last time.
+
+    if (header.bufferSize > sBufferSize * 4 && header.bufferSize <= MAX_CACHE_SIZE)
+    {
+        git_uint32 * buffer = malloc (header.bufferSize);
+        if (buffer != NULL)
+        {
+            memset (buffer, 0, header.bufferSize);
+            free (sBuffer);
+            setBuffer (buffer, header.bufferSize);
+        }
+    }
+
+    // Leave a quarter of the code area free for new code. If the
+    // file holds more than that, the blocks at the end are dropped.
+
+    codeSize = (sBufferSize - gHashSize) / 4 * 3;
+    if (codeSize > header.codeSize)
+        codeSize = header.codeSize;
+    if (fread (sCodeStart, sizeof(git_uint32), codeSize, file) != codeSize)
+    {
+        resetCodeCache ();
+        goto done;
+    }
+    sCodeTop = sCodeStart + codeSize;
+
+    // The checksum covers the whole file, so read past the blocks
+    // we're dropping too.
+
+    sum = checksumWords (0x811C9DC5, sCodeStart, codeSize);
+    for (rest = header.codeSize - codeSize ; rest > 0 ; rest -= n)
+    {
+        git_uint32 chunk [256];
+        n = (rest < 256) ? rest : 256;
+        if (fread (chunk, sizeof(git_uint32), n, file) != n)
+            break;
+        sum = checksumWords (sum, chunk, n);
+    }
+    if (rest > 0 || sum != header.codeChecksum)
+    {
+        resetCodeCache ();
+        goto done;
+    }
+
+    // Check that the blocks all make sense before we trust them.
+
+    for (h = (BlockHeader*) sCodeStart ; h < (BlockHeader*) sCodeTop ; h = END_OF_BLOCK(h))
+    {
+        git_uint32 minSize = (sizeof(BlockHeader) + h->numHashNodes * sizeof(HashNode)) / 4;
+        if ((git_uint32*) h + minSize >= sCodeTop
+            || (git_uint32*) h + h->compiledSize > sCodeTop)
+        {
+            // This block was cut off.
+            sCodeTop = (Block) h;
+            break;
+        }
+        if (h->compiledSize <= minSize || !isCacheableBlock (h) || !hashNodesAreValid (h))
+        {
+            resetCodeCache ();
+            goto done;
+        }
+    }
+
+    rebuildHashTable ();
+
+done:
+    fclose (file);
+}
+
+// Only files that saveCodeCache() writes are ever removed.
+static int isCacheFileName (const char * name)
+{
+    int i;
+    if (strlen (name) != 14 || strcmp (name + 8, ".cache") != 0)
+        return 0;
+    for (i = 0 ; i < 8 ; ++i)
+        if (!isxdigit ((unsigned char) name[i]))
+            return 0;
+    return 1;
+}
+
+typedef struct
+{
+    char * path;
+    time_t mtime;
+    off_t size;
+} CacheDirEntry;
+
+static int compareCacheDirEntries (const void * a, const void * b)
+{
+    time_t ta = ((const CacheDirEntry*) a)->mtime;
+    time_t tb = ((const CacheDirEntry*) b)->mtime;
+    return (ta > tb) - (ta < tb);
+}
+
+// Removes the least recently used files from gCacheDir until they
+// fit in MAX_CACHE_DIR_SIZE, but never the file at keepPath. Every
+// game rewrites its file when it stops, so the file that was used
+// least recently is the one that was modified longest ago.
+static void pruneCacheDir (const char * keepPath)
+{
+    CacheDirEntry * entries = NULL;
+    size_t count = 0, capacity = 0, i;
+    unsigned long long total = 0;
+    struct dirent * d;
+    struct stat info;
+    DIR * dir;
+
+    dir = opendir (gCacheDir);
+    if (dir == NULL)
+        return;
+
+    while ((d = readdir (dir)) != NULL)
+    {
+        char * path;
+        if (!isCacheFileName (d->d_name))
+            continue;
+        path = malloc (strlen (gCacheDir) + strlen (d->d_name) + 2);
+        if (path == NULL)
+            break;
+        sprintf (path, "%s/%s", gCacheDir, d->d_name);
+        if (stat (path, &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            free (path);
+            continue;
+        }
+        total += info.st_size;
+        if (strcmp (path, keepPath) == 0)
+        {
+            free (path);
+            continue;
+        }
+        if (count == capacity)
+        {
+            CacheDirEntry * grown;
+            capacity = capacity ? capacity * 2 : 16;
+            grown = realloc (entries, capacity * sizeof(CacheDirEntry));
+            if (grown == NULL)
+            {
+                free (path);
+                break;
+            }
+            entries = grown;
+        }
+        entries[count].path = path;
+        entries[count].mtime = info.st_mtime;
+        entries[count].size = info.st_size;
+        ++count;
+    }
+    closedir (dir);
+
+    if (count > 0)
+        qsort (entries, count, sizeof(CacheDirEntry), compareCacheDirEntries);
+    for (i = 0 ; i < count ; ++i)
+    {
+        if (total > MAX_CACHE_DIR_SIZE && remove (entries[i].path) == 0)
+            total -= entries[i].size;
+        free (entries[i].path);
+    }
+    free (entries);
+}
+
+static void saveCodeCache (void)
+{
+    CacheFileHeader header;
+    BlockHeader * h;
+    char * path, * tempPath;
+    FILE * file;
+    int fd, ok = 1;
+
+    path = cacheFilePath ("");
+    tempPath = cacheFilePath (".XXXXXX");
+    if (path == NULL || tempPath == NULL)
+        goto done;
+
+    // Write to a temporary file first, so that a reader never
+    // sees a half-written cache. It gets a name of its own, so
+    // that two games saving the same cache can't write into
+    // each other's file.
+
+    fd = mkstemp (tempPath);
+    if (fd < 0)
+        goto done;
+    file = fdopen (fd, "wb");
+    if (file == NULL)
+    {
+        close (fd);
+        remove (tempPath);
+        goto done;
+    }
+
+    fillCacheFileHeader (&header);
+    header.bufferSize = sBufferSize * 4;
+    header.codeChecksum = 0x811C9DC5;
+    for (h = (BlockHeader*) sCodeStart ; h < (BlockHeader*) sCodeTop ; h = END_OF_BLOCK(h))
+    {
+        if (isCacheableBlock (h))
+        {
+            header.codeSize += h->compiledSize;
+            header.codeChecksum = checksumWords (header.codeChecksum, (git_uint32*) h, h->compiledSize);
+        }
+    }
+
+    ok = (fwrite (&header, sizeof(header), 1, file) == 1);
+    for (h = (BlockHeader*) sCodeStart ; ok && h < (BlockHeader*) sCodeTop ; h = END_OF_BLOCK(h))
+    {
+        if (isCacheableBlock (h))
+            ok = (fwrite (h, sizeof(git_uint32), h->compiledSize, file) == h->compiledSize);
+    }
+
+    if (fclose (file) != 0)
+        ok = 0;
+    if (ok)
+        ok = (rename (tempPath, path) == 0);
+    if (!ok)
+        remove (tempPath);
+    else
+        pruneCacheDir (path);
+
+done:
+    free (path);
+    free (tempPath);
+}
+
+#else // USE_DIRECT_THREADING
+
+// Compiled code holds the addresses of labels in exec(),
+// which won't be the same the next time we run.
+
+static void loadCodeCache (void) {}
+static void saveCodeCache (void) {}
+
+#endif // USE_DIRECT_THREADING
+
 Block peekAtEmittedStuff (int numOpcodes)
 {
     return sCodeTop - numOpcodes;
@@ -553,9 +1010,20 @@ Block peekAtEmittedStuff (int numOpcodes)
 
 void emitConstBranch (Label op, git_uint32 address)
 {
+    git_uint32 operands [2];
+    int i, numOperands;
+
+    // The peephole optimiser may fold the loads for the condition
+    // into the branch. Their operands go after the address, so that
+    // the address can still be patched as usual.
+
+    op = peepholeConstBranch (op, operands, &numOperands);
+
     sPatch->branchOffset = sCodeTop - (git_uint32*)gBlockHeader;
     emitData (op);
     emitData (address);
+    for (i = 0 ; i < numOperands ; ++i)
+        emitData (operands [i]);
 
     if (sLastAddr < address)
         sLastAddr = address;
@@ -26,9 +26,10 @@ typedef git_uint32* Block; // Generated code block: array of labels.
 // -------------------------------------------------------------
 // Settings
 
-extern int gPeephole; // Peephole optimisation of generated code?
-extern int gDebug;    // Insert debug statements into generated code?
-extern int gCacheRAM; // Keep RAM-based code in the JIT cache?
+extern git_thread_local int gPeephole; // Peephole optimisation of generated code?
+extern git_thread_local int gDebug;    // Insert debug statements into generated code?
+extern git_thread_local int gCacheRAM; // Keep RAM-based code in the JIT cache?
+extern git_thread_local const char* gCacheDir; // Directory to keep compiled code in between runs, or NULL.
 
 // -------------------------------------------------------------
 // Compiling code
@@ -80,17 +81,34 @@ typedef struct BlockHeader
 }                            // (used to determine which blocks stay in the cache)
 BlockHeader;
 
-// This is the header for the block currently being executed --
-// that is, the one containing the return value of the last call
-// to getCode().
-extern BlockHeader * gBlockHeader;
+// The state that getCode() needs lives in one per-thread structure,
+// which startProgram() looks up once with CACHE_CODE_STATE, in the
+// same way as MemoryState in memory.h.
 
-// Hash table for code lookup -- inlined for speed
+typedef struct CodeState
+{
+    // This is the header for the block currently being executed --
+    // that is, the one containing the return value of the last call
+    // to getCode().
+    BlockHeader * blockHeader;
+
+    // Hash table for code lookup -- inlined for speed
+    HashNode ** hashTable; // Hash table of glulx address -> code.
+    git_uint32 hashSize;   // Number of slots in the hash table.
+} CodeState;
+
+extern git_thread_local CodeState gCodeState [1];
+extern CodeState * codeStateAddress ();
 
-extern HashNode ** gHashTable; // Hash table of glulx address -> code.
-extern git_uint32 gHashSize;   // Number of slots in the hash table.
+#define CACHE_CODE_STATE CodeState * const gCodeState = codeStateAddress()
 
-GIT_INLINE Block getCode (git_uint32 pc)
+#define gBlockHeader (gCodeState->blockHeader)
+#define gHashTable   (gCodeState->hashTable)
+#define gHashSize    (gCodeState->hashSize)
+
+// The state parameter is named gCodeState so that the macros above find
+// it; the getCode macro passes along whichever gCodeState is in scope.
+GIT_INLINE Block codeStateGetCode (CodeState * gCodeState, git_uint32 pc)
 {
     HashNode * n = gHashTable [pc & (gHashSize-1)];
     while (n)
@@ -106,4 +124,6 @@ GIT_INLINE Block getCode (git_uint32 pc)
     return compile (pc);
 }
 
+#define getCode(pc) codeStateGetCode (gCodeState, pc)
+
 #endif // GIT_COMPILER_H
@@ -87,13 +87,20 @@ typedef float git_float;
 // GCC and compatible compilers such as clang
 #  define maybe_unused  __attribute__((__unused__))
 #  define git_noreturn  __attribute__((__noreturn__))
+#  define git_thread_local  __thread
 #elif defined(_MSC_VER)
 // Microsoft Visual Studio
 #  define maybe_unused
 #  define git_noreturn  __declspec(noreturn)
+#  define git_thread_local  __declspec(thread)
 #else
 #  define maybe_unused
 #  define git_noreturn
+#  define git_thread_local  _Thread_local
 #endif
 
+// Each game runs in a thread of its own, and all of the interpreter's
+// state is declared git_thread_local, so that one loaded copy of Git
+// can run several games at once.
+
 #endif // GIT_CONFIG_H
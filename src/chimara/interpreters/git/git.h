@@ -100,17 +100,18 @@ extern void parseCatchStub (git_uint32 * pc, int * modes);
 
 extern void resetPeepholeOptimiser();
 extern void emitCode (Label);
+extern Label peepholeConstBranch (Label op, git_uint32 * operands, int * numOperands);
 
 // terp.c
 
 #ifdef USE_DIRECT_THREADING
-    extern Opcode* gOpcodeTable;
+    extern git_thread_local Opcode* gOpcodeTable;
 #   define labelToOpcode(label) (gOpcodeTable[label])
 #else
 #   define labelToOpcode(label) label
 #endif
 
-extern git_sint32* gStackPointer;
+extern git_thread_local git_sint32* gStackPointer;
 
 extern void startProgram (size_t cacheSize, enum IOMode ioMode);
 
@@ -168,5 +169,10 @@ extern acceleration_func accel_find_func (glui32 index);
 extern acceleration_func accel_get_func (glui32 addr);
 extern void accel_set_func (glui32 index, glui32 addr);
 extern void accel_set_param (glui32 index, glui32 val);
+extern int accel_signature (glui32 addr, glui32 *hashptr, glui32 *numopsptr);
+extern git_thread_local int accel_verifying;
+extern void accel_verify_call (glui32 addr, glui32 frame, glui32 expected);
+extern void accel_verify_return (glui32 frame, glui32 val);
+extern void accel_verify_unwind (glui32 frame);
 
 #endif // GIT_H
@@ -15,22 +15,64 @@
 #include <errno.h>
 #endif
 
-// The only command-line argument is the filename.
+// The command-line arguments are the filename, optionally a directory
+// in which to keep compiled code between runs, and a switch to check
+// accelerated functions against the game's own code.
 glkunix_argumentlist_t glkunix_arguments[] =
 {
+    { "-cache", glkunix_arg_ValueFollows, "-cache DIR: Keep compiled code in DIR between runs." },
+    { "-verify-accel", glkunix_arg_NoValue, "-verify-accel: Check accelerated functions against the game's own code." },
     { "", glkunix_arg_ValueFollows, "filename: The game file to load." },
     { NULL, glkunix_arg_End, NULL }
 };
 
+#ifdef GLKUNIX_REENTRANT
+// All of the interpreter's state is git_thread_local, so several games
+// can share this copy of Git.
+const int glkunix_reentrant = 1;
+#endif
+
 #define CACHE_SIZE (256 * 1024L)
 #define UNDO_SIZE (2 * 1024 * 1024L)
 
-#ifdef GARGLK
-
 #include <string.h>
 
-int gHasInited = 0;
-char * gStartupError = 0;
+// Picks out the -cache and -verify-accel options, and returns the game
+// file name.
+static const char * parseArguments (glkunix_startup_t *data)
+{
+    const char * filename = NULL;
+    int i;
+
+    for (i = 1 ; i < data->argc ; ++i)
+    {
+        if (strcmp (data->argv[i], "-cache") == 0 && i + 1 < data->argc)
+        {
+            // The arguments may be freed before glk_main() is called.
+            char * dir = malloc (strlen (data->argv[++i]) + 1);
+            if (dir != NULL)
+                gCacheDir = strcpy (dir, data->argv[i]);
+        }
+        else if (strcmp (data->argv[i], "-verify-accel") == 0)
+            accel_verifying = 1;
+        else
+            filename = data->argv[i];
+    }
+
+    return filename;
+}
+
+// Frees what parseArguments() copied, once the game has finished.
+static void freeArguments ()
+{
+    free ((char*) gCacheDir);
+    gCacheDir = NULL;
+}
+
+#ifdef GARGLK
+
+git_thread_local int gHasInited = 0;
+git_thread_local char * gStartupError = 0;
 
 void fatalError (const char * s)
 {
@@ -60,10 +102,12 @@ void fatalError (const char * s)
 #ifdef USE_MMAP
 // Fast loader that uses some fancy Unix features.
 
-const char * gFilename = 0;
+git_thread_local const char * gFilename = 0;
 
 int glkunix_startup_code(glkunix_startup_t *data)
 {
+    const char * filename;
+
 #ifdef GARGLK
 	{
 		char buf[255];
@@ -75,7 +119,9 @@ int glkunix_startup_code(glkunix_startup_t *data)
 	}
 #endif /* GARGLK */
 
-    if (data->argc <= 1)
+    filename = parseArguments (data);
+
+    if (filename == NULL)
     {
 #ifdef GARGLK
         gStartupError = "No file given";
@@ -89,14 +135,14 @@ int glkunix_startup_code(glkunix_startup_t *data)
 #ifdef GARGLK
 	{
 		char *s;
-		s = strrchr(data->argv[1], '\\');
+		s = strrchr(filename, '\\');
 		if (s) garglk_set_story_name(s+1);
-		s = strrchr(data->argv[1], '/');
+		s = strrchr(filename, '/');
 		if (s) garglk_set_story_name(s+1);
 	}
 #endif /* GARGLK */
 
-    gFilename = data->argv[1];
+    gFilename = filename;
     return 1;
 }
 
@@ -138,6 +184,7 @@ void glk_main ()
         
     git (ptr, info.st_size, CACHE_SIZE, UNDO_SIZE);
     munmap ((void*) ptr, info.st_size);
+    freeArguments ();
     return;
     
 error:
@@ -153,10 +200,12 @@ error:
 #else
 // Generic loader that should work anywhere.
 
-strid_t gStream = 0;
+git_thread_local strid_t gStream = 0;
 
 int glkunix_startup_code(glkunix_startup_t *data)
 {
+    const char * filename;
+
 #ifdef GARGLK
 	{
 		char buf[255];
@@ -168,7 +217,9 @@ int glkunix_startup_code(glkunix_startup_t *data)
 	}
 #endif /* GARGLK */
 
-    if (data->argc <= 1)
+    filename = parseArguments (data);
+
+    if (filename == NULL)
     {
 #ifdef GARGLK
         gStartupError = "No file given";
@@ -182,14 +233,14 @@ int glkunix_startup_code(glkunix_startup_t *data)
 #ifdef GARGLK
 	{
 		char *s;
-		s = strrchr(data->argv[1], '\\');
+		s = strrchr(filename, '\\');
 		if (s) garglk_set_story_name(s+1);
-		s = strrchr(data->argv[1], '/');
+		s = strrchr(filename, '/');
 		if (s) garglk_set_story_name(s+1);
 	}
 #endif /* GARGLK */
 
-    gStream = glkunix_stream_open_pathname ((char*) data->argv[1], 0, 0);
+    gStream = glkunix_stream_open_pathname ((char*) filename, 0, 0);
     return 1;
 }
 
@@ -208,6 +259,7 @@ void glk_main ()
 #endif
 
     gitWithStream (gStream, CACHE_SIZE, UNDO_SIZE);
+    freeArguments ();
 }
 
 #endif // USE_MMAP
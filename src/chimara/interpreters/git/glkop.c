@@ -208,7 +208,7 @@ struct arrayref_struct {
   arrayref_t *next;
 };
 
-static arrayref_t *arrays = NULL;
+static git_thread_local arrayref_t *arrays = NULL;
 
 /* We maintain a hash table for each opaque Glk class. classref_t are the
     nodes of the table, and classtable_t are the tables themselves. */
@@ -228,8 +228,8 @@ typedef struct classtable_struct {
 } classtable_t;
 
 /* The list of hash tables, for the git_classes. */
-static int num_classes = 0;
-classtable_t **git_classes = NULL;
+static git_thread_local int num_classes = 0;
+git_thread_local classtable_t **git_classes = NULL;
 
 static classtable_t *new_classtable(glui32 firstid);
 static void *classes_get(int classid, glui32 objid);
@@ -247,7 +247,7 @@ static void glulxe_retained_unregister(void *array, glui32 len,
 
 /* The library_select_hook is called every time the VM blocks for input.
    The app might take this opportunity to autosave, for example. */
-static void (*library_select_hook)(glui32) = NULL;
+static git_thread_local void (*library_select_hook)(glui32) = NULL;
 
 static char *grab_temp_c_array(glui32 addr, glui32 len, int passin);
 static void release_temp_c_array(char *arr, glui32 addr, glui32 len, int passout);
@@ -475,8 +475,8 @@ static char *read_prefix(char *cx, int *isref, int *isarray,
 */
 static void prepare_glk_args(char *proto, dispatch_splot_t *splot)
 {
-  static gluniversal_t *garglist = NULL;
-  static int garglist_size = 0;
+  static git_thread_local gluniversal_t *garglist = NULL;
+  static git_thread_local int garglist_size = 0;
 
   int ix;
   int numwanted, numvargswanted, maxargs;
@@ -1484,7 +1484,7 @@ static char *get_game_id()
 {
   /* This buffer gets rewritten on every call, but that's okay -- the caller
      is supposed to copy out the result. */
-  static char buf[2*64+2];
+  static git_thread_local char buf[2*64+2];
   int ix, jx;
 
   if (!gInitMem)
@@ -4,13 +4,14 @@
 #include <stdlib.h>
 #include <string.h>
 
-const git_uint8 * gInitMem;
-git_uint8 * gMem;
+git_thread_local MemoryState gMemoryState [1];
 
-git_uint32 gRamStart;
-git_uint32 gExtStart;
-git_uint32 gEndMem;
-git_uint32 gOriginalEndMem;
+// This is deliberately not inline: it gives CACHE_MEMORY_STATE a single
+// __tls_get_addr call whose result the caller can keep in a register.
+MemoryState * memoryStateAddress ()
+{
+    return gMemoryState;
+}
 
 void initMemory (const git_uint8 * gamefile, git_uint32 size)
 {
@@ -58,20 +58,42 @@ GIT_INLINE git_uint32 readtag (const char *ptr) {
 // --------------------------------------------------------------
 // Globals
 
-extern git_uint32 gRamStart; // The start of RAM.
-extern git_uint32 gExtStart; // The start of extended memory (initialised to zero).
-extern git_uint32 gEndMem;   // The current end of memory.
-extern git_uint32 gOriginalEndMem; // The value of EndMem when the game was first loaded.
+// The memory globals live together in one per-thread structure. Each
+// reference to a git_thread_local variable in a plugin costs a call to
+// __tls_get_addr, and the compiler won't hoist that call out of a loop,
+// so hot code such as startProgram() uses CACHE_MEMORY_STATE to look up
+// the structure once. The names below then refer to that local copy of
+// the pointer instead of to the thread-local variable.
+
+typedef struct MemoryState
+{
+    git_uint32 ramStart;       // The start of RAM.
+    git_uint32 extStart;       // The start of extended memory (initialised to zero).
+    git_uint32 endMem;         // The current end of memory.
+    git_uint32 originalEndMem; // The value of EndMem when the game was first loaded.
+
+    // This is the entire gamefile, as read-only memory. It contains
+    // both the ROM, which is constant for the entire run of the program,
+    // and the original RAM, which is useful for checking what's changed
+    // when saving to disk or remembering a position for UNDO.
+    const git_uint8 * initMem;
+
+    // This is the current contents of memory. This buffer includes
+    // both the ROM and the current contents of RAM.
+    git_uint8 * mem;
+} MemoryState;
 
-// This is the entire gamefile, as read-only memory. It contains
-// both the ROM, which is constant for the entire run of the program,
-// and the original RAM, which is useful for checking what's changed
-// when saving to disk or remembering a position for UNDO.
-extern const git_uint8 * gInitMem;
+extern git_thread_local MemoryState gMemoryState [1];
+extern MemoryState * memoryStateAddress ();
 
-// This is the current contents of memory. This buffer includes
-// both the ROM and the current contents of RAM.
-extern git_uint8 * gMem;
+#define CACHE_MEMORY_STATE MemoryState * const gMemoryState = memoryStateAddress()
+
+#define gRamStart       (gMemoryState->ramStart)
+#define gExtStart       (gMemoryState->extStart)
+#define gEndMem         (gMemoryState->endMem)
+#define gOriginalEndMem (gMemoryState->originalEndMem)
+#define gInitMem        (gMemoryState->initMem)
+#define gMem            (gMemoryState->mem)
 
 
 // --------------------------------------------------------------
@@ -105,9 +127,11 @@ extern void shutdownMemory ();
 extern git_noreturn void memReadError (git_uint32 address);
 extern git_noreturn void memWriteError (git_uint32 address);
 
-// Functions for reading and writing game memory.
+// Functions for reading and writing game memory. The state parameter
+// is named gMemoryState so that the macros above find it; the memRead
+// and memWrite macros pass along whichever gMemoryState is in scope.
 
-GIT_INLINE git_uint32 memRead32 (git_uint32 address)
+GIT_INLINE git_uint32 memStateRead32 (MemoryState * gMemoryState, git_uint32 address)
 {
     if (address <= gEndMem - 4)
         return read32 (gMem + address);
@@ -115,7 +139,7 @@ GIT_INLINE git_uint32 memRead32 (git_uint32 address)
         return memReadError (address), 0;
 }
 
-GIT_INLINE git_uint32 memRead16 (git_uint32 address)
+GIT_INLINE git_uint32 memStateRead16 (MemoryState * gMemoryState, git_uint32 address)
 {
     if (address <= gEndMem - 2)
         return read16 (gMem + address);
@@ -123,7 +147,7 @@ GIT_INLINE git_uint32 memRead16 (git_uint32 address)
         return memReadError (address), 0;
 }
 
-GIT_INLINE git_uint32 memRead8 (git_uint32 address)
+GIT_INLINE git_uint32 memStateRead8 (MemoryState * gMemoryState, git_uint32 address)
 {
     if (address < gEndMem)
         return read8 (gMem + address);
@@ -131,7 +155,7 @@ GIT_INLINE git_uint32 memRead8 (git_uint32 address)
         return memReadError (address), 0;
 }
 
-GIT_INLINE void memWrite32 (git_uint32 address, git_uint32 val)
+GIT_INLINE void memStateWrite32 (MemoryState * gMemoryState, git_uint32 address, git_uint32 val)
 {
     if (address >= gRamStart && address <= (gEndMem - 4))
         write32 (gMem + address, val);
@@ -139,7 +163,7 @@ GIT_INLINE void memWrite32 (git_uint32 address, git_uint32 val)
         memWriteError (address);
 }
 
-GIT_INLINE void memWrite16 (git_uint32 address, git_uint32 val)
+GIT_INLINE void memStateWrite16 (MemoryState * gMemoryState, git_uint32 address, git_uint32 val)
 {
     if (address >= gRamStart && address <= (gEndMem - 2))
         write16 (gMem + address, val);
@@ -147,7 +171,7 @@ GIT_INLINE void memWrite16 (git_uint32 address, git_uint32 val)
         memWriteError (address);
 }
 
-GIT_INLINE void memWrite8 (git_uint32 address, git_uint32 val)
+GIT_INLINE void memStateWrite8 (MemoryState * gMemoryState, git_uint32 address, git_uint32 val)
 {
     if (address >= gRamStart && address < gEndMem)
         write8 (gMem + address, val);
@@ -155,4 +179,11 @@ GIT_INLINE void memWrite8 (git_uint32 address, git_uint32 val)
         memWriteError (address);
 }
 
+#define memRead32(address)      memStateRead32 (gMemoryState, address)
+#define memRead16(address)      memStateRead16 (gMemoryState, address)
+#define memRead8(address)       memStateRead8 (gMemoryState, address)
+#define memWrite32(address,val) memStateWrite32 (gMemoryState, address, val)
+#define memWrite16(address,val) memStateWrite16 (gMemoryState, address, val)
+#define memWrite8(address,val)  memStateWrite8 (gMemoryState, address, val)
+
 #endif // GIT_MEMORY_H
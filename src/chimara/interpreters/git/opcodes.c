@@ -179,7 +179,7 @@ void parseInstruction (git_uint32* pc, int * done)
     int modes [8];
     git_uint32 opcode;
     
-    static int ops = 0;
+    static git_thread_local int ops = 0;
     ++ops;
     
     // Fetch the opcode.
@@ -3,28 +3,45 @@
 
 #include "git.h"
 
-static Label sLastOp;
+static git_thread_local Label sLastOp;
 
 extern void resetPeepholeOptimiser ()
 {
     sLastOp = label_nop;
 }
 
-#define REPLACE_SINGLE(lastOp,thisOp,newOp) \
-    case label_ ## thisOp:                  \
-        if (sLastOp == label_ ## lastOp)    \
-        {                                   \
-            op = label_ ## newOp;           \
-            goto replaceNoOperands;         \
-        }                                   \
-        break
-
 #define CASE_NO_OPERANDS(lastOp,newOp) \
     case label_ ## lastOp: op = label_ ## newOp; goto replaceNoOperands
 
 #define CASE_ONE_OPERAND(lastOp,newOp) \
     case label_ ## lastOp: op = label_ ## newOp; goto replaceOneOperand
 
+#define CASE_TWO_OPERANDS(lastOp,newOp) \
+    case label_ ## lastOp: op = label_ ## newOp; goto replaceTwoOperands
+
+#define REPLACE_CALL_STUB(stub) \
+    case label_call_stub_ ## stub:                                          \
+        switch(sLastOp)                                                     \
+        {                                                                   \
+            CASE_NO_OPERANDS (args_stack, args_stack_call_stub_ ## stub);   \
+            CASE_NO_OPERANDS (args_0,     args_0_call_stub_ ## stub);       \
+            CASE_NO_OPERANDS (args_1,     args_1_call_stub_ ## stub);       \
+            CASE_NO_OPERANDS (args_2,     args_2_call_stub_ ## stub);       \
+            CASE_NO_OPERANDS (args_3,     args_3_call_stub_ ## stub);       \
+            default: break;                                                 \
+        }                                                                   \
+        break
+
+// Fold "load a local and a constant" into the operation that uses them.
+#define REPLACE_FUSED_OP(thisOp)                                            \
+    case label_ ## thisOp ## _discard:                                      \
+        if (sLastOp == label_L1_local_L2_const)                             \
+        {                                                                   \
+            op = label_ ## thisOp ## _local_const_discard;                  \
+            goto replaceTwoOperands;                                        \
+        }                                                                   \
+        break
+
 #define REPLACE_STORE(storeOp) \
     case label_ ## storeOp:                                             \
         switch(sLastOp)                                                 \
@@ -54,6 +71,10 @@ extern void resetPeepholeOptimiser ()
             CASE_NO_OPERANDS (fsub_discard,     fsub_ ## storeOp);      \
             CASE_NO_OPERANDS (fmul_discard,     fmul_ ## storeOp);      \
             CASE_NO_OPERANDS (fdiv_discard,     fdiv_ ## storeOp);      \
+            CASE_TWO_OPERANDS (add_local_const_discard,    add_local_const_ ## storeOp);    \
+            CASE_TWO_OPERANDS (sub_local_const_discard,    sub_local_const_ ## storeOp);    \
+            CASE_TWO_OPERANDS (aload_local_const_discard,  aload_local_const_ ## storeOp);  \
+            CASE_TWO_OPERANDS (aloadb_local_const_discard, aloadb_local_const_ ## storeOp); \
             default: break;                                             \
         }                                                               \
         break
@@ -84,16 +105,21 @@ extern void resetPeepholeOptimiser ()
 
 extern void emitCode (Label op)
 {
-    git_uint32 temp;
+    git_uint32 temp, temp2;
 
     if (gPeephole)
     {
         switch (op)
         {
-            REPLACE_SINGLE (args_stack, call_stub_discard, args_stack_call_stub_discard);
-            REPLACE_SINGLE (args_stack, call_stub_addr,    args_stack_call_stub_addr);
-            REPLACE_SINGLE (args_stack, call_stub_local,   args_stack_call_stub_local);
-            REPLACE_SINGLE (args_stack, call_stub_stack,   args_stack_call_stub_stack);
+            REPLACE_CALL_STUB (discard);
+            REPLACE_CALL_STUB (addr);
+            REPLACE_CALL_STUB (local);
+            REPLACE_CALL_STUB (stack);
+
+            REPLACE_FUSED_OP (add);
+            REPLACE_FUSED_OP (sub);
+            REPLACE_FUSED_OP (aload);
+            REPLACE_FUSED_OP (aloadb);
 
             REPLACE_STORE (S1_stack);
             REPLACE_STORE (S1_local);
@@ -115,6 +141,16 @@ extern void emitCode (Label op)
     }
     goto noPeephole;
 
+replaceTwoOperands:
+    // The previous opcode has two operands.
+    temp2 = undoEmit();
+    temp = undoEmit();
+    undoEmit();
+    emitFinalCode (op);
+    emitData (temp);
+    emitData (temp2);
+    goto done;
+
 replaceOneOperand:
     // The previous opcode has one operand, so
     // we have to go back two steps to update it.
@@ -133,3 +169,34 @@ noPeephole:
 done:
     sLastOp = op;
 }
+
+extern Label peepholeConstBranch (Label op, git_uint32 * operands, int * numOperands)
+{
+    // If the branch's condition was just loaded from a local (and
+    // compared with a constant), remove the load and return its
+    // operands, so that the caller can emit them after the branch.
+
+    *numOperands = 0;
+
+    if (gPeephole)
+    {
+        if (sLastOp == label_L1_local && (op == label_jz_const || op == label_jnz_const))
+        {
+            operands [0] = undoEmit();
+            undoEmit();
+            *numOperands = 1;
+            op = op - label_jz_const + label_jz_local_const;
+        }
+        else if (sLastOp == label_L1_local_L2_const && op >= label_jeq_const && op <= label_jle_const)
+        {
+            operands [1] = undoEmit();
+            operands [0] = undoEmit();
+            undoEmit();
+            *numOperands = 2;
+            op = op - label_jz_const + label_jz_local_const;
+        }
+    }
+
+    sLastOp = op;
+    return op;
+}
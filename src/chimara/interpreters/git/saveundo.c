@@ -22,9 +22,9 @@ struct UndoRecord
     UndoRecord * next;
 };
 
-static UndoRecord * gUndo = NULL;
-static git_uint32 gUndoSize = 0;
-static git_uint32 gMaxUndoSize = 256 * 1024;
+static git_thread_local UndoRecord * gUndo = NULL;
+static git_thread_local git_uint32 gUndoSize = 0;
+static git_thread_local git_uint32 gMaxUndoSize = 256 * 1024;
 
 static void reserveSpace (git_uint32);
 static void deleteRecord (UndoRecord * u);
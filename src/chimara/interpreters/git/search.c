@@ -8,6 +8,10 @@
 #include "git.h"
 #include "opcodes.h"
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
+
 #ifndef TRUE
 #define TRUE 1
 #endif
@@ -49,6 +53,18 @@
 static void fetchkey(unsigned char *keybuf, glui32 key, glui32 keysize, 
   glui32 options);
 
+// Keys of one, two or four bytes which lie wholly inside memory are
+// read with a single load and compared as numbers. Anything else falls
+// through to the bytewise loop, so that errors are raised as before.
+#define FIXED_KEY_SIZE(size) ((size) == 1 || (size) == 2 || (size) == 4)
+#define KEY_IN_MEMORY(addr, size) ((addr) < gEndMem && gEndMem - (addr) >= (size))
+#define READ_KEY(ptr, size) \
+  ((size) == 4 ? read32(ptr) : ((size) == 2 ? read16(ptr) : read8(ptr)))
+
+static glui32 linear_scan_fixed(glui32 keyval, glui32 keysize,
+  unsigned char *keybuf, glui32 *startptr, glui32 structsize,
+  glui32 numstructs, glui32 keyoffset, int zeroterm, int *result);
+
 /* linear_search():
    An array of data structures is stored in memory, beginning at start,
    each structure being structsize bytes. Within each struct, there is
@@ -76,7 +92,22 @@ glui32 git_linear_search(glui32 key, glui32 keysize,
 
   fetchkey(keybuf, key, keysize, options);
 
-  for (count=0; count<numstructs; count++, start+=structsize) {
+  count = 0;
+  if (FIXED_KEY_SIZE(keysize)) {
+    int result = 0;
+    count = linear_scan_fixed(READ_KEY(keybuf, keysize), keysize, keybuf,
+      &start, structsize, numstructs, keyoffset, zeroterm, &result);
+    if (result > 0) {
+      if (retindex)
+	return count;
+      else
+	return start;
+    }
+    if (result < 0)
+      count = numstructs;
+  }
+
+  for (; count<numstructs; count++, start+=structsize) {
     int match = TRUE;
     if (keysize <= 4) {
       for (ix=0; match && ix<keysize; ix++) {
@@ -187,12 +218,15 @@ static glui32 binary_search_generic(glui32 key, glui32 keysize,
     return 0;
 }
 
-static glui32 binary_search_16bit(git_uint16 key, glui32 start,
-  glui32 structsize, glui32 numstructs,
+// Keys of one, two or four bytes are read with a single load and
+// compared as numbers. Each caller passes a constant keysize, so the
+// compiler can drop the size tests from the loop.
+GIT_INLINE glui32 binary_search_fixed(glui32 keyval, glui32 keysize,
+  glui32 start, glui32 structsize, glui32 numstructs,
   glui32 keyoffset, glui32 options)
 {
-  glui32 addr, top, bot, val;
-  git_uint16 m;
+  CACHE_MEMORY_STATE; // See memory.h.
+  glui32 addr, top, bot, val, here;
   int retindex = ((options & serop_ReturnIndex) != 0);
 
   bot = 0;
@@ -201,45 +235,19 @@ static glui32 binary_search_16bit(git_uint16 key, glui32 start,
     val = (top+bot) / 2;
     addr = start + val * structsize;
 
-    m = memRead16(addr + keyoffset);
-    if (m == key) {
-      if (retindex)
-	return val;
-      else
-	return addr;
-    } else if (m < key) {
-      bot = val + 1;
-    } else {
-      top = val;
-    }
-  }
-
-  if (retindex)
-    return -1;
-  else
-    return 0;
-}
-
-static glui32 binary_search_32bit(git_uint32 key, glui32 start,
-  glui32 structsize, glui32 numstructs,
-  glui32 keyoffset, glui32 options)
-{
-  glui32 addr, top, bot, val, m;
-  int retindex = ((options & serop_ReturnIndex) != 0);
-
-  bot = 0;
-  top = numstructs;
-  while (bot < top) {
-    val = (top+bot) / 2;
-    addr = start + val * structsize;
+    if (keysize == 4)
+      here = memRead32(addr + keyoffset);
+    else if (keysize == 2)
+      here = memRead16(addr + keyoffset);
+    else
+      here = memRead8(addr + keyoffset);
 
-    m = memRead32(addr + keyoffset);
-    if (m == key) {
+    if (here == keyval) {
       if (retindex)
 	return val;
       else
 	return addr;
-    } else if (m < key) {
+    } else if (here < keyval) {
       bot = val + 1;
     } else {
       top = val;
@@ -256,25 +264,20 @@ glui32 git_binary_search(glui32 key, glui32 keysize,
   glui32 start, glui32 structsize, glui32 numstructs,
   glui32 keyoffset, glui32 options)
 {
-  if (keysize == 2) {
-    git_uint16 key16;
-    if ((options & serop_KeyIndirect) != 0) {
-      key16 = memRead16(key);
-    } else {
-      key16 = key;
-    }
-    return binary_search_16bit(key16, start, structsize, numstructs, keyoffset, options);
-  }
-  if (keysize == 4) {
-    git_uint32 key32;
-    if ((options & serop_KeyIndirect) != 0) {
-      key32 = memRead32(key);
-    } else {
-      key32 = key;
-    }
-    return binary_search_32bit(key32, start, structsize, numstructs, keyoffset, options);
-  }
-  return binary_search_generic(key, keysize, start, structsize, numstructs, keyoffset, options);
+  unsigned char keybuf[4];
+  glui32 keyval;
+
+  if (!FIXED_KEY_SIZE(keysize))
+    return binary_search_generic(key, keysize, start, structsize, numstructs, keyoffset, options);
+
+  fetchkey(keybuf, key, keysize, options);
+  keyval = READ_KEY(keybuf, keysize);
+
+  if (keysize == 4)
+    return binary_search_fixed(keyval, 4, start, structsize, numstructs, keyoffset, options);
+  if (keysize == 2)
+    return binary_search_fixed(keyval, 2, start, structsize, numstructs, keyoffset, options);
+  return binary_search_fixed(keyval, 1, start, structsize, numstructs, keyoffset, options);
 }
 
 /* linked_search():
@@ -332,6 +335,90 @@ glui32 git_linked_search(glui32 key, glui32 keysize,
   return 0;
 }
 
+/* linear_scan_fixed():
+   The inner loop of linear_search() for keys of one, two or four bytes,
+   whose value (as a big-endian number) is keyval and whose bytes are in
+   keybuf. This searches from *startptr until it finds a match (setting
+   *result to 1), a zero key when zeroterm is set (setting *result to -1),
+   numstructs structs, or a key it can't load directly (leaving *result
+   zero.) It returns the number of structs it passed over, and leaves
+   *startptr at the first one it didn't.
+*/
+static glui32 linear_scan_fixed(glui32 keyval, glui32 keysize,
+  unsigned char *keybuf, glui32 *startptr, glui32 structsize,
+  glui32 numstructs, glui32 keyoffset, int zeroterm, int *result)
+{
+  glui32 count = 0;
+  glui32 start = *startptr;
+  glui32 addr, here;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+  // A packed array of keys is compared sixteen bytes at a time, bytewise
+  // in memory order; a key matches when all of its bytes do.
+  if (structsize == keysize && gEndMem >= 16) {
+    glui32 lanes = 16 / keysize;
+    glui32 lanebits = (keysize == 4 ? 0x1111 : (keysize == 2 ? 0x5555 : 0xFFFF));
+    unsigned char pattern[16];
+    __m128i keyvec, zerovec;
+    int ix;
+
+    for (ix=0; ix<16; ix++)
+      pattern[ix] = keybuf[ix % keysize];
+    keyvec = _mm_loadu_si128((__m128i *)pattern);
+    zerovec = _mm_setzero_si128();
+
+    while (numstructs - count >= lanes) {
+      __m128i block;
+      unsigned int matches, zeroes, hits;
+      addr = start + keyoffset;
+      if (addr > gEndMem - 16)
+	break;
+      block = _mm_loadu_si128((__m128i *)(gMem + addr));
+      matches = _mm_movemask_epi8(_mm_cmpeq_epi8(block, keyvec));
+      zeroes = (zeroterm ? _mm_movemask_epi8(_mm_cmpeq_epi8(block, zerovec)) : 0);
+      if (keysize == 4) {
+	matches &= (matches >> 1) & (matches >> 2) & (matches >> 3);
+	zeroes &= (zeroes >> 1) & (zeroes >> 2) & (zeroes >> 3);
+      }
+      else if (keysize == 2) {
+	matches &= (matches >> 1);
+	zeroes &= (zeroes >> 1);
+      }
+      matches &= lanebits;
+      zeroes &= lanebits;
+      hits = matches | zeroes;
+      if (hits) {
+	glui32 lane = __builtin_ctz(hits) / keysize;
+	count += lane;
+	*startptr = start + lane * structsize;
+	*result = ((matches & (1U << (lane * keysize))) ? 1 : -1);
+	return count;
+      }
+      count += lanes;
+      start += 16;
+    }
+  }
+#endif
+
+  for (; count<numstructs; count++, start+=structsize) {
+    addr = start + keyoffset;
+    if (!KEY_IN_MEMORY(addr, keysize))
+      break;
+    here = READ_KEY(gMem + addr, keysize);
+    if (here == keyval) {
+      *result = 1;
+      break;
+    }
+    if (zeroterm && here == 0) {
+      *result = -1;
+      break;
+    }
+  }
+
+  *startptr = start;
+  return count;
+}
+
 /* fetchkey():
    This massages the key into a form that's easier to handle. When it
    returns, the key will be stored in keybuf if keysize <= 4; otherwise,
@@ -12,10 +12,10 @@
 // -------------------------------------------------------------
 // Global variables
 
-git_sint32* gStackPointer;
+git_thread_local git_sint32* gStackPointer;
 
 #ifdef USE_DIRECT_THREADING
-Opcode* gOpcodeTable;
+git_thread_local Opcode* gOpcodeTable;
 #endif
 
 // -------------------------------------------------------------
@@ -83,6 +83,9 @@ float git_powf(float x, float y)
 
 void startProgram (size_t cacheSize, enum IOMode ioMode)
 {
+    CACHE_MEMORY_STATE; // See memory.h.
+    CACHE_CODE_STATE;   // See compiler.h.
+
     Block pc; // Program counter (pointer into dynamically generated code)
 
     git_sint32 L1=0, L2=0, L3=0, L4=0, L5=0, L6=0, L7=0;
@@ -225,7 +228,11 @@ do_enter_function_L1: // Arg count is in L2.
 
     // Check for an accelerated function
     accelfunc = accel_get_func(L1);
-    if (accelfunc) {
+    if (accelfunc && accel_verifying) {
+        // Check the native result against the game's own code when
+        // this frame returns.
+        accel_verify_call(L1, (sp - base) * 4, accelfunc(L2, (glui32 *) args));
+    } else if (accelfunc) {
         S1 = accelfunc(L2, (glui32 *) args);
         goto do_pop_call_stub;
     }
@@ -346,6 +353,15 @@ do_enter_function_L1: // Arg count is in L2.
     PEEPHOLE_STORE(fmul,    F1 = DECODE_FLOAT(L1) * DECODE_FLOAT(L2); S1 = ENCODE_FLOAT(F1));
     PEEPHOLE_STORE(fdiv,    F1 = DECODE_FLOAT(L1) / DECODE_FLOAT(L2); S1 = ENCODE_FLOAT(F1));
 
+    // Superinstructions: the local and constant operands come first.
+
+#define LOAD_LOCAL_CONST L1 = LOCAL (READ_PC); L2 = READ_PC
+
+    PEEPHOLE_STORE(add_local_const,    LOAD_LOCAL_CONST; S1 = L1 + L2);
+    PEEPHOLE_STORE(sub_local_const,    LOAD_LOCAL_CONST; S1 = L1 - L2);
+    PEEPHOLE_STORE(aload_local_const,  LOAD_LOCAL_CONST; S1 = memRead32 (L1 + (L2<<2)));
+    PEEPHOLE_STORE(aloadb_local_const, LOAD_LOCAL_CONST; S1 = memRead8  (L1 + L2));
+
 #define PEEPHOLE_LOAD(tag,reg) \
     do_ ## tag ## _ ## reg ## _const: reg = READ_PC; goto do_ ## tag; \
     do_ ## tag ## _ ## reg ## _stack: CHECK_USED(1); reg = POP; goto do_ ## tag; \
@@ -403,6 +419,26 @@ do_enter_function_L1: // Arg count is in L2.
 
 #undef DO_JUMP
 
+    // Superinstructions: the branch address comes first, followed
+    // by the operands for the condition. A relative branch is
+    // measured from the end of the address, so skip back over them.
+
+#define DO_FUSED_JUMP(tag, numOperands, load, cond) \
+    do_ ## tag ## _const: L7 = READ_PC; load; if (cond) goto do_jump_abs_L7; NEXT; \
+    do_ ## tag ## _by:    L7 = READ_PC; load; if (cond) pc += L7 - numOperands; NEXT
+
+    DO_FUSED_JUMP(jz_local,        1, L1 = LOCAL (READ_PC), L1 == 0);
+    DO_FUSED_JUMP(jnz_local,       1, L1 = LOCAL (READ_PC), L1 != 0);
+    DO_FUSED_JUMP(jeq_local_const, 2, LOAD_LOCAL_CONST, L1 == L2);
+    DO_FUSED_JUMP(jne_local_const, 2, LOAD_LOCAL_CONST, L1 != L2);
+    DO_FUSED_JUMP(jlt_local_const, 2, LOAD_LOCAL_CONST, L1 < L2);
+    DO_FUSED_JUMP(jge_local_const, 2, LOAD_LOCAL_CONST, L1 >= L2);
+    DO_FUSED_JUMP(jgt_local_const, 2, LOAD_LOCAL_CONST, L1 > L2);
+    DO_FUSED_JUMP(jle_local_const, 2, LOAD_LOCAL_CONST, L1 <= L2);
+
+#undef DO_FUSED_JUMP
+#undef LOAD_LOCAL_CONST
+
     do_jumpabs: L7 = L1; goto do_jump_abs_L7; NEXT;
 
     do_goto_L4_from_L7: L1 = L4; goto do_goto_L1_from_L7;
@@ -445,6 +481,19 @@ do_enter_function_L1: // Arg count is in L2.
             args [L3] = POP;
         goto do_call_stub_stack;
 
+#define ARGS_CALL_STUB(args, code)                                  \
+    do_ ## args ## _call_stub_discard: code; goto do_call_stub_discard; \
+    do_ ## args ## _call_stub_addr:    code; goto do_call_stub_addr;    \
+    do_ ## args ## _call_stub_local:   code; goto do_call_stub_local;   \
+    do_ ## args ## _call_stub_stack:   code; goto do_call_stub_stack
+
+    ARGS_CALL_STUB(args_0, L2 = 0);
+    ARGS_CALL_STUB(args_1, args [0] = L2; L2 = 1);
+    ARGS_CALL_STUB(args_2, args [0] = L3; args [1] = L2; L2 = 2);
+    ARGS_CALL_STUB(args_3, args [0] = L4; args [1] = L3; args [2] = L2; L2 = 3);
+
+#undef ARGS_CALL_STUB
+
     do_args_3:
         args [0] = L4;
         args [1] = L3;
@@ -502,6 +551,7 @@ finish_undo_stub:
         if (restoreUndo (base, protectPos, protectSize) == 0)
         {
             sp = gStackPointer;
+            accel_verify_unwind (0);
             S1 = -1;
             goto do_pop_call_stub;
         }
@@ -546,6 +596,7 @@ finish_save_stub:
          && restoreFromFile (base, L1, protectPos, protectSize) == 0)
         {
             sp = gStackPointer;
+            accel_verify_unwind (0);
             S1 = -1;
             goto do_pop_call_stub;
         }
@@ -592,6 +643,7 @@ finish_catch_stub_addr_L7:
         if (L2 < 16 || L2 > ((sp-base)*4))
             fatalError ("Invalid catch token in throw");
         sp = base + L2 / 4;
+        accel_verify_unwind (L2);
         goto do_pop_call_stub;
     
 do_call_stub_discard:
@@ -630,6 +682,8 @@ do_tailcall:
         goto do_enter_function_L1;
     
     do_return:
+        if (accel_verifying)
+            accel_verify_return ((frame - base) * 4, L1);
         sp = frame;
         // ...
         // fall through
@@ -1170,6 +1224,7 @@ do_tailcall:
 
         // Reset all the stack pointers.
         frame = locals = values = sp = base;
+        accel_verify_unwind (0);
 
         // Call the first function.
         L1 = startPos; // Initial PC.
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Times Git on one or more story files. Each story is fed the
+# walkthrough next to it (story.walk), if there is one, and is run
+# three times; the fastest run is reported.
+#
+# usage: bench.sh [story ...]
+# With no arguments, runs Alabaster and compute.ulx. Alabaster's
+# walkthrough mostly exercises text output and the parser; compute.ulx
+# (built from compute.inf) is a loop of array work and function calls
+# with no input, so it times the interpreter's dispatch on its own.
+
+TEST_DIR=`dirname $0`
+GIT=${GIT:-${TEST_DIR}/../git}
+
+if [ $# -eq 0 ]; then
+  set -- ${TEST_DIR}/Alabaster.gblorb ${TEST_DIR}/compute.ulx
+fi
+
+for STORY in "$@"; do
+  WALK=${STORY%.*}.walk
+  if [ ! -f "$WALK" ]; then
+    WALK=/dev/null
+  fi
+
+  BEST=
+  for RUN in 1 2 3; do
+    TIME_1=`date +%s%3N`
+    $GIT "$STORY" < "$WALK" > /dev/null
+    TIME_2=`date +%s%3N`
+    TIME_DIFF=`expr $TIME_2 - $TIME_1`
+    if [ -z "$BEST" ] || [ $TIME_DIFF -lt $BEST ]; then
+      BEST=$TIME_DIFF
+    fi
+  done
+
+  echo "`basename "$STORY"`: $BEST milliseconds"
+done
@@ -3,8 +3,11 @@
     http://eblong.com/zarf/glulx/index.html
 */
 
+#include <stdio.h>
+#include <string.h>
 #include "glk.h"
 #include "glulxe.h"
+#include "opcodes.h"
 
 /* Git passes along function arguments in reverse order. To make our lives
    more interesting. */
@@ -36,31 +39,133 @@ static glui32 func_13_op__pr(glui32 argc, glui32 *argv);
 static int obj_in_class(glui32 obj);
 static glui32 get_prop(glui32 obj, glui32 id);
 static glui32 get_prop_new(glui32 obj, glui32 id);
+static int accel_signature_depth(glui32 addr, int depth, glui32 *hashptr,
+    glui32 *numopsptr);
 
 /* Parameters, set by @accelparam. */
-static glui32 classes_table = 0;     /* class object array */
-static glui32 indiv_prop_start = 0;  /* first individual prop ID */
-static glui32 class_metaclass = 0;   /* "Class" class object */
-static glui32 object_metaclass = 0;  /* "Object" class object */
-static glui32 routine_metaclass = 0; /* "Routine" class object */
-static glui32 string_metaclass = 0;  /* "String" class object */
-static glui32 self = 0;              /* address of global "self" */
-static glui32 num_attr_bytes = 0;    /* number of attributes / 8 */
-static glui32 cpv__start = 0;        /* array of common prop defaults */
+static THREAD_LOCAL glui32 classes_table = 0;     /* class object array */
+static THREAD_LOCAL glui32 indiv_prop_start = 0;  /* first individual prop ID */
+static THREAD_LOCAL glui32 class_metaclass = 0;   /* "Class" class object */
+static THREAD_LOCAL glui32 object_metaclass = 0;  /* "Object" class object */
+static THREAD_LOCAL glui32 routine_metaclass = 0; /* "Routine" class object */
+static THREAD_LOCAL glui32 string_metaclass = 0;  /* "String" class object */
+static THREAD_LOCAL glui32 self = 0;              /* address of global "self" */
+static THREAD_LOCAL glui32 num_attr_bytes = 0;    /* number of attributes / 8 */
+static THREAD_LOCAL glui32 cpv__start = 0;        /* array of common prop defaults */
+
+/* The results of property table searches, keyed by the address of the
+   object's property table pointer (which differs between the old and
+   new accel functions) and the property ID. Every word of memory that a
+   cached search read is flagged in accel_watch, and a write to any of
+   them empties the cache (see WatchW in glulxe.h), so the cache never
+   returns a stale answer. */
+typedef struct propcache_struct {
+    glui32 otabptr;   /* 0 if the entry is unused */
+    glui32 id;
+    glui32 prop;
+} propcache_t;
+
+#define PROP_CACHE_SIZE (1024) /* must be a power of two */
+
+static THREAD_LOCAL propcache_t *propcache = NULL;
+static THREAD_LOCAL glui32 propcache_hits = 0;
+static THREAD_LOCAL glui32 propcache_misses = 0;
+static THREAD_LOCAL glui32 propcache_flushes = 0;
+
+/* accel_watch, in vmstate, has one bit per word of memory, for the
+   first accel_watch_words words. */
 
 typedef struct accelentry_struct {
     glui32 addr;
     acceleration_func func;
+    const char *name;
+    /* A signature match that is waiting for @accelparam; see
+       match_signature(). */
+    const struct accelsig_struct *pending;
     struct accelentry_struct *next;
 } accelentry_t;
 
-#define ACCEL_HASH_SIZE (511)
+/* Every function the game calls gets an entry, once its signature has
+   been checked, so this is bigger than the handful of @accelfunc
+   entries alone would need. */
+#define ACCEL_HASH_SIZE (2047)
+
+static THREAD_LOCAL accelentry_t **accelentries = NULL;
+
+/* Names of the functions that accel_find_func() knows, for reporting. */
+static const char *const accel_func_names[] = {
+    NULL, "Z__Region", "CP__Tab", "RA__Pr", "RL__Pr", "OC__Cl", "RV__Pr",
+    "OP__Pr", "CP__Tab", "RA__Pr", "RL__Pr", "OC__Cl", "RV__Pr", "OP__Pr"
+};
+#define NUM_ACCEL_FUNC_NAMES (14)
+
+/* Functions can also be recognised by their signature, as computed by
+   accel_signature(): a hash of the shape of their code, which leaves out
+   addresses and other values that differ from game to game. This lets
+   games that never call @accelfunc (everything built before Inform 7
+   6E59, for instance) use the native versions too.
+
+   To accelerate another routine, write a native version with the same
+   behaviour -- it must not have side effects other than printing error
+   messages, or --verify-accel can't check it -- and add it here with
+   the signature and instruction count that the profiler reports for
+   the routine. Entries that use the @accelparam values are only
+   matched once the game has set them. */
+typedef struct accelsig_struct {
+    const char *name;
+    glui32 hash;
+    glui32 numops;
+    acceleration_func func;
+    int needs_params;
+} accelsig_t;
+
+static const accelsig_t accel_signatures[] = {
+    /* The Inform 6 veneer, as compiled by Inform 6.33. Routines that
+       call RT__Err have two signatures, since its code depends on
+       whether the game was compiled in strict mode. */
+    { "Z__Region", 0xF4F38F4E, 14, func_1_z__region, FALSE },
+    { "CP__Tab",   0x7F815992, 11, func_2_cp__tab,   FALSE },
+    { "CP__Tab",   0x5CBF4FA7, 11, func_2_cp__tab,   FALSE },
+    { "RA__Pr",    0xB5A69F0E, 24, func_3_ra__pr,    TRUE },
+    { "RL__Pr",    0x9A2A6740, 25, func_4_rl__pr,    TRUE },
+    { "OC__Cl",    0x9D1C96B9, 41, func_5_oc__cl,    TRUE },
+    { "OC__Cl",    0xEB0BB396, 41, func_5_oc__cl,    TRUE },
+    { "RV__Pr",    0x4E7437F6, 10, func_6_rv__pr,    TRUE },
+    { "RV__Pr",    0x906AEB91, 10, func_6_rv__pr,    TRUE },
+    { "OP__Pr",    0xC3D5F567, 16, func_7_op__pr,    TRUE },
+    { NULL, 0, 0, NULL, FALSE }
+};
+
+/* Set by --verify-accel. Accelerated functions then run both ways, and
+   any difference in the return value is reported. */
+THREAD_LOCAL int accel_verifying = FALSE;
+
+typedef struct accelcheck_struct {
+    glui32 frame;     /* frameptr of the interpreted call */
+    glui32 addr;
+    glui32 expected;  /* what the native version returned */
+} accelcheck_t;
 
-static accelentry_t **accelentries = NULL;
+static THREAD_LOCAL accelcheck_t *accelchecks = NULL;
+static THREAD_LOCAL int accelchecks_count = 0;
+static THREAD_LOCAL int accelchecks_size = 0;
 
 void init_accel()
 {
     accelentries = NULL;
+
+    if (propcache) {
+        glulx_free(propcache);
+        propcache = NULL;
+    }
+    if (accel_watch) {
+        glulx_free(accel_watch);
+        accel_watch = NULL;
+    }
+    accel_watch_words = 0;
+    propcache_hits = 0;
+    propcache_misses = 0;
+    propcache_flushes = 0;
 }
 
 acceleration_func accel_find_func(glui32 index)
@@ -84,20 +189,76 @@ acceleration_func accel_find_func(glui32 index)
     return NULL;
 }
 
+static void alloc_accel_entries(void)
+{
+    int bucknum;
+
+    accelentries = (accelentry_t **)glulx_malloc(ACCEL_HASH_SIZE 
+        * sizeof(accelentry_t *));
+    if (!accelentries) 
+        fatal_error("Cannot malloc acceleration table.");
+    for (bucknum=0; bucknum<ACCEL_HASH_SIZE; bucknum++)
+        accelentries[bucknum] = NULL;
+}
+
+static accelentry_t *new_accel_entry(glui32 addr)
+{
+    int bucknum = (addr % ACCEL_HASH_SIZE);
+    accelentry_t *ptr = (accelentry_t *)glulx_malloc(sizeof(accelentry_t));
+    if (!ptr)
+        fatal_error("Cannot malloc acceleration entry.");
+    ptr->addr = addr;
+    ptr->func = NULL;
+    ptr->name = NULL;
+    ptr->pending = NULL;
+    ptr->next = accelentries[bucknum];
+    accelentries[bucknum] = ptr;
+    return ptr;
+}
+
+/* Check a function that we haven't seen before against the signature
+   table, and remember the result. If the match needs parameters that
+   the game hasn't set yet, the entry stays unaccelerated until
+   accel_set_param() sets classes_table and fills it in. */
+static acceleration_func match_signature(glui32 addr)
+{
+    accelentry_t *ptr;
+    const accelsig_t *sig;
+    glui32 hash, numops;
+
+    if (!accel_signature(addr, &hash, &numops)) {
+        new_accel_entry(addr);
+        return NULL;
+    }
+
+    for (sig = accel_signatures; sig->name; sig++) {
+        if (sig->hash == hash && sig->numops == numops)
+            break;
+    }
+    ptr = new_accel_entry(addr);
+    if (sig->name && sig->needs_params && !classes_table) {
+        ptr->pending = sig;
+        return NULL;
+    }
+    ptr->func = sig->func;
+    ptr->name = sig->name;
+    return ptr->func;
+}
+
 acceleration_func accel_get_func(glui32 addr)
 {
     int bucknum;
     accelentry_t *ptr;
 
     if (!accelentries)
-        return NULL;
+        alloc_accel_entries();
 
     bucknum = (addr % ACCEL_HASH_SIZE);
     for (ptr = accelentries[bucknum]; ptr; ptr = ptr->next) {
         if (ptr->addr == addr)
             return ptr->func;
     }
-    return NULL;
+    return match_signature(addr);
 }
 
 void accel_set_func(glui32 index, glui32 addr)
@@ -113,14 +274,8 @@ void accel_set_func(glui32 index, glui32 addr)
         fatal_error_i("Attempt to accelerate non-function.", addr);
     }
 
-    if (!accelentries) {
-        accelentries = (accelentry_t **)glulx_malloc(ACCEL_HASH_SIZE 
-            * sizeof(accelentry_t *));
-        if (!accelentries) 
-            fatal_error("Cannot malloc acceleration table.");
-        for (bucknum=0; bucknum<ACCEL_HASH_SIZE; bucknum++)
-            accelentries[bucknum] = NULL;
-    }
+    if (!accelentries)
+        alloc_accel_entries();
 
     new_func = accel_find_func(index);
 
@@ -130,25 +285,46 @@ void accel_set_func(glui32 index, glui32 addr)
             break;
     }
     if (!ptr) {
-        if (!new_func) {
-            return; /* no need for a new entry */
-        }
-        ptr = (accelentry_t *)glulx_malloc(sizeof(accelentry_t));
-        if (!ptr)
-            fatal_error("Cannot malloc acceleration entry.");
-        ptr->addr = addr;
-        ptr->func = NULL;
-        ptr->next = accelentries[bucknum];
-        accelentries[bucknum] = ptr;
+        /* Even if new_func is NULL, the entry stops the function from
+           being accelerated by signature. */
+        ptr = new_accel_entry(addr);
     }
 
     ptr->func = new_func;
+    ptr->name = (new_func && index < NUM_ACCEL_FUNC_NAMES) 
+        ? accel_func_names[index] : NULL;
+    ptr->pending = NULL;
+}
+
+/* Accelerate the functions that match_signature() matched before the
+   game set classes_table. */
+static void resolve_pending_signatures(void)
+{
+    int bucknum;
+    accelentry_t *ptr;
+
+    if (!accelentries)
+        return;
+
+    for (bucknum=0; bucknum<ACCEL_HASH_SIZE; bucknum++) {
+        for (ptr = accelentries[bucknum]; ptr; ptr = ptr->next) {
+            if (ptr->pending) {
+                ptr->func = ptr->pending->func;
+                ptr->name = ptr->pending->name;
+                ptr->pending = NULL;
+            }
+        }
+    }
 }
 
 void accel_set_param(glui32 index, glui32 val)
 {
     switch (index) {
-        case 0: classes_table = val; break;
+        case 0:
+            classes_table = val;
+            if (classes_table)
+                resolve_pending_signatures();
+            break;
         case 1: indiv_prop_start = val; break;
         case 2: class_metaclass = val; break;
         case 3: object_metaclass = val; break;
@@ -160,6 +336,411 @@ void accel_set_param(glui32 index, glui32 val)
     }
 }
 
+/* accel_watch_range():
+   Flag the words of memory in [start, end) as ones that a cache depends
+   on. Returns FALSE if the range isn't in memory, or the flags can't be
+   allocated; the result mustn't be cached then. The string decoding
+   cache in string.c uses this too. */
+int accel_watch_range(glui32 start, glui32 end)
+{
+    glui32 wx;
+
+    if (end > endmem || end < start)
+        return FALSE;
+
+    end = (end + 3) >> 2;
+    if (end > accel_watch_words) {
+        glui32 newwords = (endmem + 3) >> 2;
+        glui32 oldbytes = (accel_watch_words + 7) >> 3;
+        glui32 newbytes = (newwords + 7) >> 3;
+        unsigned char *newwatch = (unsigned char *)glulx_realloc(accel_watch,
+            newbytes);
+        if (!newwatch)
+            return FALSE;
+        memset(newwatch+oldbytes, 0, newbytes-oldbytes);
+        accel_watch = newwatch;
+        accel_watch_words = newwords;
+    }
+
+    for (wx = start >> 2; wx < end; wx++)
+        accel_watch[wx >> 3] |= (1 << (wx & 7));
+    return TRUE;
+}
+
+/* accel_note_write():
+   Called when the game writes to a word that the property cache or the
+   string decoding cache depends on. Everything is thrown away; this
+   happens rarely enough that it isn't worth working out which entries
+   were affected.
+*/
+void accel_note_write()
+{
+    if (propcache)
+        memset(propcache, 0, PROP_CACHE_SIZE * sizeof(propcache_t));
+    if (accel_watch)
+        memset(accel_watch, 0, (accel_watch_words + 7) >> 3);
+    propcache_flushes++;
+    stream_note_write();
+}
+
+/* accel_note_write_range():
+   The same, for code that changes memory in bulk, bypassing MemW. */
+void accel_note_write_range(glui32 start, glui32 end)
+{
+    glui32 wx;
+
+    if (!accel_watch || end <= start)
+        return;
+    end = (end + 3) >> 2;
+    if (end > accel_watch_words)
+        end = accel_watch_words;
+    for (wx = start >> 2; wx < end; wx++) {
+        if (accel_watch[wx >> 3] & (1 << (wx & 7))) {
+            accel_note_write();
+            return;
+        }
+    }
+}
+
+/* accel_prop_cache_stats():
+   Report how well the property cache is doing, for the profiler. */
+void accel_prop_cache_stats(glui32 *hits, glui32 *misses, glui32 *flushes)
+{
+    *hits = propcache_hits;
+    *misses = propcache_misses;
+    *flushes = propcache_flushes;
+}
+
+/* Find property id in the property table whose address is stored at
+   otabptr, as @binarysearch would, going to the cache first. */
+static glui32 search_prop_table(glui32 otabptr, glui32 id)
+{
+    CACHE_VMSTATE;
+    propcache_t *ent;
+    glui32 otab, max, prop;
+
+    if (!propcache) {
+        propcache = (propcache_t *)glulx_malloc(PROP_CACHE_SIZE 
+            * sizeof(propcache_t));
+        if (!propcache)
+            fatal_error("Cannot malloc property cache.");
+        memset(propcache, 0, PROP_CACHE_SIZE * sizeof(propcache_t));
+    }
+
+    ent = &propcache[((otabptr >> 2) ^ (id * 0x9E3779B1)) 
+        & (PROP_CACHE_SIZE-1)];
+    if (ent->otabptr == otabptr && ent->id == id) {
+        propcache_hits++;
+        return ent->prop;
+    }
+    propcache_misses++;
+
+    otab = Mem4(otabptr);
+    if (!otab) {
+        prop = 0;
+        max = 0;
+    }
+    else {
+        max = Mem4(otab);
+        /* @binarysearch id 2 otab 10 max 0 0 res; */
+        prop = binary_search(id, 2, otab + 4, 10, max, 0, 0);
+    }
+
+    if (accel_watch_range(otabptr, otabptr + 4)
+        && (!otab || (otab < endmem && max <= (endmem - otab) / 10
+            && accel_watch_range(otab, otab + 4 + 10 * max)))) {
+        ent->otabptr = otabptr;
+        ent->id = id;
+        ent->prop = prop;
+    }
+    return prop;
+}
+
+/* Number of operands of each opcode, or -1 if we don't know it. */
+static int accel_num_operands(glui32 opcode)
+{
+    switch (opcode) {
+        case op_nop: case op_stkswap: case op_quit: case op_restart:
+            return 0;
+        case op_jump: case op_jumpabs: case op_return: case op_stkcount:
+        case op_stkcopy: case op_streamchar: case op_streamnum:
+        case op_streamstr: case op_streamunichar: case op_getstringtbl:
+        case op_setstringtbl: case op_setrandom: case op_verify:
+        case op_saveundo: case op_restoreundo: case op_debugtrap:
+        case op_getmemsize: case op_mfree:
+            return 1;
+        case op_neg: case op_bitnot: case op_jz: case op_jnz: case op_catch:
+        case op_throw: case op_tailcall: case op_copy: case op_copys:
+        case op_copyb: case op_sexs: case op_sexb: case op_stkpeek:
+        case op_stkroll: case op_getiosys: case op_setiosys: case op_random:
+        case op_save: case op_restore: case op_protect: case op_setmemsize:
+        case op_callf: case op_mzero: case op_malloc: case op_accelfunc:
+        case op_accelparam: case op_numtof: case op_ftonumz:
+        case op_ftonumn: case op_ceil: case op_floor: case op_sqrt:
+        case op_exp: case op_log: case op_sin: case op_cos: case op_tan:
+        case op_asin: case op_acos: case op_atan: case op_jisnan:
+        case op_jisinf:
+            return 2;
+        case op_add: case op_sub: case op_mul: case op_div: case op_mod:
+        case op_bitand: case op_bitor: case op_bitxor: case op_shiftl:
+        case op_sshiftr: case op_ushiftr: case op_jeq: case op_jne:
+        case op_jlt: case op_jge: case op_jgt: case op_jle: case op_jltu:
+        case op_jgeu: case op_jgtu: case op_jleu: case op_call:
+        case op_aload: case op_aloads: case op_aloadb: case op_aloadbit:
+        case op_astore: case op_astores: case op_astoreb:
+        case op_astorebit: case op_gestalt: case op_glk: case op_callfi:
+        case op_mcopy: case op_fadd: case op_fsub: case op_fmul:
+        case op_fdiv: case op_pow: case op_atan2: case op_jflt:
+        case op_jfle: case op_jfgt: case op_jfge:
+            return 3;
+        case op_callfii: case op_fmod: case op_jfeq: case op_jfne:
+            return 4;
+        case op_callfiii:
+            return 5;
+        case op_linkedsearch:
+            return 7;
+        case op_linearsearch: case op_binarysearch:
+            return 8;
+    }
+    return -1;
+}
+
+static int accel_is_branch(glui32 opcode)
+{
+    switch (opcode) {
+        case op_jump: case op_jz: case op_jnz: case op_jeq: case op_jne:
+        case op_jlt: case op_jge: case op_jgt: case op_jle: case op_jltu:
+        case op_jgeu: case op_jgtu: case op_jleu: case op_jfeq:
+        case op_jfne: case op_jflt: case op_jfle: case op_jfgt:
+        case op_jfge: case op_jisnan: case op_jisinf:
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* accel_signature():
+   Compute the signature of the function at addr: an FNV-1a hash of its
+   type byte, its locals format, and for each instruction, the opcode,
+   the addressing modes, and the operands that are constants or locals.
+   Four-byte constants are usually addresses, which move around from
+   game to game, so accel_hash_constant() hashes what they point at
+   instead; memory operands are left out. The function is assumed to end
+   at the first return or unconditional jump that no earlier branch
+   jumps past. Returns FALSE if the function isn't entirely in ROM, or
+   contains an instruction we can't decode.
+*/
+int accel_signature(glui32 addr, glui32 *hashptr, glui32 *numopsptr)
+{
+    return accel_signature_depth(addr, 1, hashptr, numopsptr);
+}
+
+/* accel_hash_constant():
+   Fold a four-byte constant operand into a signature hash. A function
+   in ROM (a call target, or an argument such as RT__Err's) contributes
+   the signature of its own code, down to the given depth, so a routine
+   only matches if it calls the same veneer routines; a string in ROM
+   contributes its type byte, and an address in RAM (an object or an
+   array) just a marker. Anything else is hashed as a number.
+*/
+static glui32 accel_hash_constant(glui32 hash, glui32 val, int depth)
+{
+    glui32 subhash, subnumops;
+    int ix, type;
+
+#define SIG_BYTE(b)  (hash = (hash ^ ((b) & 0xFF)) * 0x01000193)
+
+    type = (val < ramstart) ? Mem1(val) : 0;
+    if (val >= ramstart && val < endmem) {
+        SIG_BYTE('R');
+    }
+    else if (type == 0xC0 || type == 0xC1) {
+        SIG_BYTE(type);
+        if (depth > 0 
+            && accel_signature_depth(val, depth-1, &subhash, &subnumops)) {
+            for (ix=0; ix<4; ix++) {
+                SIG_BYTE(subhash >> (8*ix));
+                SIG_BYTE(subnumops >> (8*ix));
+            }
+        }
+    }
+    else if (type == 0xE0 || type == 0xE1 || type == 0xE2) {
+        SIG_BYTE(type);
+    }
+    else {
+        SIG_BYTE('K');
+        for (ix=0; ix<4; ix++)
+            SIG_BYTE(val >> (8*ix));
+    }
+
+#undef SIG_BYTE
+
+    return hash;
+}
+
+static int accel_signature_depth(glui32 addr, int depth, glui32 *hashptr, 
+    glui32 *numopsptr)
+{
+    glui32 hash = 0x811C9DC5;
+    glui32 pos = addr, maxtarget = 0, numops = 0;
+    glui32 opcode, modeaddr, val;
+    int ix, jx, numargs, mode, size;
+
+#define SIG_BYTE(b)  (hash = (hash ^ ((b) & 0xFF)) * 0x01000193)
+
+    if (pos >= ramstart)
+        return FALSE;
+    SIG_BYTE(Mem1(pos));
+    pos++;
+    do {
+        if (pos + 2 > ramstart)
+            return FALSE;
+        SIG_BYTE(Mem1(pos));
+        SIG_BYTE(Mem1(pos+1));
+        pos += 2;
+    } while (Mem1(pos-2) != 0);
+
+    while (numops < 256) {
+        /* No instruction is longer than 40 bytes. */
+        if (pos + 40 > ramstart)
+            return FALSE;
+
+        opcode = Mem1(pos);
+        if (opcode & 0x80) {
+            if (opcode & 0x40) {
+                opcode = Mem4(pos) & 0x3FFFFFFF;
+                pos += 4;
+            }
+            else {
+                opcode = Mem2(pos) & 0x7FFF;
+                pos += 2;
+            }
+        }
+        else {
+            pos++;
+        }
+
+        numargs = accel_num_operands(opcode);
+        if (numargs < 0)
+            return FALSE;
+        numops++;
+        for (ix=0; ix<4; ix++)
+            SIG_BYTE(opcode >> (8*ix));
+
+        modeaddr = pos;
+        pos += (numargs+1) / 2;
+        val = 0;
+        mode = 0;
+        for (ix=0; ix<numargs; ix++) {
+            mode = (Mem1(modeaddr + ix/2) >> ((ix & 1) ? 4 : 0)) & 0x0F;
+            SIG_BYTE(mode);
+            switch (mode) {
+                case 0x0: case 0x8: size = 0; break;
+                case 0x1: case 0x5: case 0x9: case 0xD: size = 1; break;
+                case 0x2: case 0x6: case 0xA: case 0xE: size = 2; break;
+                case 0x3: case 0x7: case 0xB: case 0xF: size = 4; break;
+                default: return FALSE;
+            }
+            if (mode == 0x1)
+                val = (glsi32)(signed char)Mem1(pos);
+            else if (mode == 0x2)
+                val = (glsi32)(signed short)Mem2(pos);
+            else if (mode == 0x3)
+                val = Mem4(pos);
+            else
+                val = 0;
+            if (mode == 0x1 || mode == 0x2 || (mode >= 0x9 && mode <= 0xB)) {
+                for (jx=0; jx<size; jx++)
+                    SIG_BYTE(Mem1(pos+jx));
+            }
+            else if (mode == 0x3) {
+                hash = accel_hash_constant(hash, val, depth);
+            }
+            pos += size;
+        }
+
+        /* The last operand of a branch is its offset. */
+        if (accel_is_branch(opcode) && mode <= 0x3 && val != 0 && val != 1) {
+            if (pos + val - 2 > maxtarget)
+                maxtarget = pos + val - 2;
+        }
+
+        if ((opcode == op_return || opcode == op_jump || opcode == op_jumpabs
+            || opcode == op_tailcall || opcode == op_throw 
+            || opcode == op_quit || opcode == op_restart)
+            && pos > maxtarget)
+            break;
+    }
+
+#undef SIG_BYTE
+
+    *hashptr = hash;
+    *numopsptr = numops;
+    return TRUE;
+}
+
+/* accel_verify_call():
+   In verification mode, this is called instead of returning the native
+   result of an accelerated function. The function is then interpreted
+   as usual, with its frame at frame, and accel_verify_return() compares
+   the results.
+*/
+void accel_verify_call(glui32 addr, glui32 frame, glui32 expected)
+{
+    if (accelchecks_count >= accelchecks_size) {
+        int newsize = accelchecks_size ? 2 * accelchecks_size : 16;
+        accelcheck_t *newchecks = (accelcheck_t *)glulx_realloc(accelchecks,
+            newsize * sizeof(accelcheck_t));
+        if (!newchecks)
+            fatal_error("Cannot malloc acceleration checks.");
+        accelchecks = newchecks;
+        accelchecks_size = newsize;
+    }
+    accelchecks[accelchecks_count].frame = frame;
+    accelchecks[accelchecks_count].addr = addr;
+    accelchecks[accelchecks_count].expected = expected;
+    accelchecks_count++;
+}
+
+/* accel_verify_return():
+   Called whenever the function with its frame at frame returns val. */
+void accel_verify_return(glui32 frame, glui32 val)
+{
+    accelcheck_t *check;
+    accelentry_t *ptr;
+    const char *name = NULL;
+    char buf[128];
+
+    accel_verify_unwind(frame + 1);
+    if (!accelchecks_count)
+        return;
+    check = &accelchecks[accelchecks_count-1];
+    if (check->frame != frame)
+        return;
+    accelchecks_count--;
+    if (check->expected == val)
+        return;
+
+    for (ptr = accelentries[check->addr % ACCEL_HASH_SIZE]; ptr; ptr = ptr->next) {
+        if (ptr->addr == check->addr) {
+            name = ptr->name;
+            break;
+        }
+    }
+    sprintf(buf, "[** Accelerated %s at $%lx returned %ld, but the game's own code returned %ld **]",
+        (name ? name : "function"), (unsigned long)check->addr, 
+        (long)(glsi32)check->expected, (long)(glsi32)val);
+    accel_error(buf);
+}
+
+/* accel_verify_unwind():
+   Forget the pending checks for all frames at or above frame, because
+   the stack has been unwound past them (by @throw, @restore, etc.) */
+void accel_verify_unwind(glui32 frame)
+{
+    while (accelchecks_count && accelchecks[accelchecks_count-1].frame >= frame)
+        accelchecks_count--;
+}
+
 static void accel_error(char *msg)
 {
     glk_put_char('\n');
@@ -177,6 +758,7 @@ static int obj_in_class(glui32 obj)
 /* Look up a property entry. */
 static glui32 get_prop(glui32 obj, glui32 id)
 {
+    CACHE_VMSTATE;
     glui32 cla = 0;
     glui32 prop;
     glui32 call_argv[2];
@@ -216,6 +798,7 @@ static glui32 get_prop(glui32 obj, glui32 id)
    of func_5 and func_2. */
 static glui32 get_prop_new(glui32 obj, glui32 id)
 {
+    CACHE_VMSTATE;
     glui32 cla = 0;
     glui32 prop;
     glui32 call_argv[2];
@@ -285,7 +868,6 @@ static glui32 func_2_cp__tab(glui32 argc, glui32 *argv)
 {
     glui32 obj;
     glui32 id;
-    glui32 otab, max;
 
     obj = ARG_IF_GIVEN(argv, argc, 0);
     id = ARG_IF_GIVEN(argv, argc, 1);
@@ -295,14 +877,7 @@ static glui32 func_2_cp__tab(glui32 argc, glui32 *argv)
         return 0;
     }
 
-    otab = Mem4(obj + 16);
-    if (!otab)
-        return 0;
-
-    max = Mem4(otab);
-    otab += 4;
-    /* @binarysearch id 2 otab 10 max 0 0 res; */
-    return binary_search(id, 2, otab, 10, max, 0, 0);
+    return search_prop_table(obj + 16, id);
 }
 
 static glui32 func_3_ra__pr(glui32 argc, glui32 *argv)
@@ -339,6 +914,7 @@ static glui32 func_4_rl__pr(glui32 argc, glui32 *argv)
 
 static glui32 func_5_oc__cl(glui32 argc, glui32 *argv)
 {
+    CACHE_VMSTATE;
     glui32 obj;
     glui32 cla;
     glui32 zr, prop, inlist, inlistlen, jx;
@@ -406,6 +982,7 @@ static glui32 func_5_oc__cl(glui32 argc, glui32 *argv)
 
 static glui32 func_6_rv__pr(glui32 argc, glui32 *argv)
 {
+    CACHE_VMSTATE;
     glui32 id;
     glui32 addr;
 
@@ -465,7 +1042,6 @@ static glui32 func_8_cp__tab(glui32 argc, glui32 *argv)
 {
     glui32 obj;
     glui32 id;
-    glui32 otab, max;
 
     obj = ARG_IF_GIVEN(argv, argc, 0);
     id = ARG_IF_GIVEN(argv, argc, 1);
@@ -475,14 +1051,7 @@ static glui32 func_8_cp__tab(glui32 argc, glui32 *argv)
         return 0;
     }
 
-    otab = Mem4(obj + 4*(3+(int)(num_attr_bytes/4)));
-    if (!otab)
-        return 0;
-
-    max = Mem4(otab);
-    otab += 4;
-    /* @binarysearch id 2 otab 10 max 0 0 res; */
-    return binary_search(id, 2, otab, 10, max, 0, 0);
+    return search_prop_table(obj + 4*(3+(int)(num_attr_bytes/4)), id);
 }
 
 static glui32 func_9_ra__pr(glui32 argc, glui32 *argv)
@@ -519,6 +1088,7 @@ static glui32 func_10_rl__pr(glui32 argc, glui32 *argv)
 
 static glui32 func_11_oc__cl(glui32 argc, glui32 *argv)
 {
+    CACHE_VMSTATE;
     glui32 obj;
     glui32 cla;
     glui32 zr, prop, inlist, inlistlen, jx;
@@ -586,6 +1156,7 @@ static glui32 func_11_oc__cl(glui32 argc, glui32 *argv)
 
 static glui32 func_12_rv__pr(glui32 argc, glui32 *argv)
 {
+    CACHE_VMSTATE;
     glui32 id;
     glui32 addr;
 
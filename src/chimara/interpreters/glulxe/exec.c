@@ -3,6 +3,7 @@
     http://eblong.com/zarf/glulx/index.html
 */
 
+#include <string.h>
 #include "glk.h"
 #include "glulxe.h"
 #include "opcodes.h"
@@ -16,6 +17,7 @@
 */
 void execute_loop()
 {
+  CACHE_VMSTATE;
   int done_executing = FALSE;
   int ix;
   glui32 opcode;
@@ -32,6 +34,7 @@ void execute_loop()
   while (!done_executing) {
 
     profile_tick();
+    sample_tick();
     /* Do OS-specific processing, if appropriate. */
     glk_tick();
     
@@ -329,6 +332,8 @@ void execute_loop()
         enter_function(inst[0].value, value, arglist);
         break;
       case op_return:
+        if (accel_verifying)
+          accel_verify_return(frameptr, inst[0].value);
         leave_function();
         if (stackptr == 0) {
           done_executing = TRUE;
@@ -354,6 +359,7 @@ void execute_loop()
         profile_fail("throw");
         value = inst[0].value;
         stackptr = inst[1].value;
+        accel_verify_unwind(stackptr);
         pop_callstub(value);
         break;
 
@@ -648,6 +654,7 @@ void execute_loop()
       case op_restart:
         profile_fail("restart");
         vm_restart();
+        accel_verify_unwind(0);
         break;
 
       case op_protect:
@@ -673,6 +680,7 @@ void execute_loop()
         if (value == 0) {
           /* We've succeeded, and the stack now contains the callstub
              saved during saveundo. Ignore this opcode's operand. */
+          accel_verify_unwind(0);
           value = -1;
           pop_callstub(value);
         }
@@ -695,6 +703,7 @@ void execute_loop()
         if (value == 0) {
           /* We've succeeded, and the stack now contains the callstub
              saved during saveundo. Ignore this opcode's operand. */
+          accel_verify_unwind(0);
           value = -1;
           pop_callstub(value);
         }
@@ -729,6 +738,14 @@ void execute_loop()
         glui32 lx;
         glui32 count = inst[0].value;
         addr = inst[1].value;
+        /* A range which lies wholly in RAM is cleared in one go. Anything
+           else goes a byte at a time, to fail at the same byte it always
+           did. */
+        if (addr >= ramstart && addr < endmem && count <= endmem - addr) {
+          memset(memmap+addr, 0, count);
+          mark_dirty_pages(addr, addr+count);
+          break;
+        }
         for (lx=0; lx<count; lx++, addr++) {
           MemW1(addr, 0);
         }
@@ -739,6 +756,15 @@ void execute_loop()
         glui32 count = inst[0].value;
         glui32 addrsrc = inst[1].value;
         glui32 addrdest = inst[2].value;
+        /* As with mzero; memmove() copies overlapping ranges in whichever
+           direction the byte loops below would. */
+        if (addrsrc < endmem && count <= endmem - addrsrc
+          && addrdest >= ramstart && addrdest < endmem
+          && count <= endmem - addrdest) {
+          memmove(memmap+addrdest, memmap+addrsrc, count);
+          mark_dirty_pages(addrdest, addrdest+count);
+          break;
+        }
         if (addrdest < addrsrc) {
           for (lx=0; lx<count; lx++, addrsrc++, addrdest++) {
             value = Mem1(addrsrc);
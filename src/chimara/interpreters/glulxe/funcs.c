@@ -14,6 +14,7 @@
 */
 void enter_function(glui32 addr, glui32 argc, glui32 *argv)
 {
+  CACHE_VMSTATE;
   int ix, jx;
   acceleration_func accelfunc;
   int locallen;
@@ -21,8 +22,15 @@ void enter_function(glui32 addr, glui32 argc, glui32 *argv)
   glui32 modeaddr, opaddr, val;
   int loctype, locnum;
 
+  sample_call(addr);
+
   accelfunc = accel_get_func(addr);
-  if (accelfunc) {
+  if (accelfunc && accel_verifying) {
+    /* Run the native version now, and check its result against the
+       game's own code when that returns. */
+    accel_verify_call(addr, stackptr, accelfunc(argc, argv));
+  }
+  else if (accelfunc) {
     profile_in(addr, stackptr, TRUE);
     val = accelfunc(argc, argv);
     profile_out(stackptr);
@@ -190,6 +198,7 @@ void enter_function(glui32 addr, glui32 argc, glui32 *argv)
 */
 void leave_function()
 {
+  CACHE_VMSTATE;
   profile_out(stackptr);
   stackptr = frameptr;
 }
@@ -200,6 +209,7 @@ void leave_function()
 */
 void push_callstub(glui32 desttype, glui32 destaddr)
 {
+  CACHE_VMSTATE;
   if (stackptr+16 > stacksize)
     fatal_error("Stack overflow in callstub.");
   StkW4(stackptr+0, desttype);
@@ -216,6 +226,7 @@ void push_callstub(glui32 desttype, glui32 destaddr)
 */
 void pop_callstub(glui32 returnvalue)
 {
+  CACHE_VMSTATE;
   glui32 desttype, destaddr;
   glui32 newpc, newframeptr;
 
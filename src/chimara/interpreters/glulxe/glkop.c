@@ -108,7 +108,7 @@ struct arrayref_struct {
   arrayref_t *next;
 };
 
-static arrayref_t *arrays = NULL;
+static THREAD_LOCAL arrayref_t *arrays = NULL;
 
 /* We maintain a hash table for each opaque Glk class. classref_t are the
     nodes of the table, and classtable_t are the tables themselves. */
@@ -128,8 +128,8 @@ typedef struct classtable_struct {
 } classtable_t;
 
 /* The list of hash tables, for the classes. */
-static int num_classes = 0;
-classtable_t **classes = NULL;
+static THREAD_LOCAL int num_classes = 0;
+THREAD_LOCAL classtable_t **classes = NULL;
 
 static classtable_t *new_classtable(glui32 firstid);
 static void *classes_get(int classid, glui32 objid);
@@ -155,7 +155,7 @@ extern gidispatch_rock_t glulxe_classtable_register_existing(void *obj,
 
 /* The library_select_hook is called every time the VM blocks for input.
    The app might take this opportunity to autosave, for example. */
-static void (*library_select_hook)(glui32) = NULL;
+static THREAD_LOCAL void (*library_select_hook)(glui32) = NULL;
 
 static char *grab_temp_c_array(glui32 addr, glui32 len, int passin);
 static void release_temp_c_array(char *arr, glui32 addr, glui32 len, int passout);
@@ -390,8 +390,8 @@ static char *read_prefix(char *cx, int *isref, int *isarray,
 */
 static void prepare_glk_args(char *proto, dispatch_splot_t *splot)
 {
-  static gluniversal_t *garglist = NULL;
-  static int garglist_size = 0;
+  static THREAD_LOCAL gluniversal_t *garglist = NULL;
+  static THREAD_LOCAL int garglist_size = 0;
 
   int ix;
   int numwanted, numvargswanted, maxargs;
@@ -1487,7 +1487,7 @@ static char *get_game_id()
 {
   /* This buffer gets rewritten on every call, but that's okay -- the caller
      is supposed to copy out the result. */
-  static char buf[2*64+2];
+  static THREAD_LOCAL char buf[2*64+2];
   int ix, jx;
 
   if (!memmap)
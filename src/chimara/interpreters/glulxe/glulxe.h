@@ -54,6 +54,13 @@ typedef int16_t glsi16;
    with no math library. */
 #define FLOAT_SUPPORT (1)
 
+/* Every game runs in a Glk thread of its own, so all the VM state is
+   kept in thread-local storage. This lets one loaded copy of Glulxe
+   run several games at once. */
+#ifndef THREAD_LOCAL
+#define THREAD_LOCAL __thread
+#endif /* THREAD_LOCAL */
+
 /* Some macros to read and write integers to memory, always in big-endian
    format. */
 #define Read4(ptr)    \
@@ -78,9 +85,17 @@ typedef int16_t glsi16;
 #define Write1(ptr, vl)   \
   (((unsigned char *)(ptr))[0] = (vl))
 
+/* The range tests are made in line, where a function may have cached
+   its vmstate pointer (see below); verify_address() and
+   verify_address_write() are only called to report the failure. */
 #if VERIFY_MEMORY_ACCESS
-#define Verify(adr, ln) verify_address(adr, ln)
-#define VerifyW(adr, ln) verify_address_write(adr, ln)
+#define Verify(adr, ln)   \
+  ((((glui32)(adr)) >= endmem || ((glui32)(adr))+((ln)-1) >= endmem)   \
+    ? (verify_address(adr, ln), 0) : 0)
+#define VerifyW(adr, ln)   \
+  ((((glui32)(adr)) < ramstart || ((glui32)(adr)) >= endmem   \
+    || ((glui32)(adr))+((ln)-1) >= endmem)   \
+    ? (verify_address_write(adr, ln), 0) : 0)
 #else
 #define Verify(adr, ln) (0)
 #define VerifyW(adr, ln) (0)
@@ -89,9 +104,30 @@ typedef int16_t glsi16;
 #define Mem1(adr)  (Verify(adr, 1), Read1(memmap+(adr)))
 #define Mem2(adr)  (Verify(adr, 2), Read2(memmap+(adr)))
 #define Mem4(adr)  (Verify(adr, 4), Read4(memmap+(adr)))
-#define MemW1(adr, vl)  (VerifyW(adr, 1), Write1(memmap+(adr), (vl)))
-#define MemW2(adr, vl)  (VerifyW(adr, 2), Write2(memmap+(adr), (vl)))
-#define MemW4(adr, vl)  (VerifyW(adr, 4), Write4(memmap+(adr), (vl)))
+
+/* Every write to main memory also flags the 256-byte page it touches
+   (a multibyte write may straddle two), so that an undo-save only has
+   to look at the pages that changed since the previous one. See
+   serial.c. */
+#define UNDO_PAGE_SHIFT (8)
+#define UNDO_PAGE_SIZE (1 << UNDO_PAGE_SHIFT)
+#define MarkW(adr, ln)   \
+  ((dirtypages[((glui32)(adr)) >> UNDO_PAGE_SHIFT] = 1),   \
+   (dirtypages[((glui32)(adr)+(ln)-1) >> UNDO_PAGE_SHIFT] = 1))
+
+/* accel.c caches property table searches, and string.c caches the
+   string decoding table; both flag the words of memory that they read.
+   A write to a flagged word empties both caches. */
+#define WatchedW(adr)   \
+  ((((glui32)(adr)) >> 2) < accel_watch_words   \
+    && (accel_watch[((glui32)(adr)) >> 5] & (1 << ((((glui32)(adr)) >> 2) & 7))))
+#define WatchW(adr, ln)   \
+  ((accel_watch && (WatchedW(adr) || WatchedW((adr)+(ln)-1)))   \
+    ? (accel_note_write(), 0) : 0)
+
+#define MemW1(adr, vl)  (VerifyW(adr, 1), MarkW(adr, 1), WatchW(adr, 1), Write1(memmap+(adr), (vl)))
+#define MemW2(adr, vl)  (VerifyW(adr, 2), MarkW(adr, 2), WatchW(adr, 2), Write2(memmap+(adr), (vl)))
+#define MemW4(adr, vl)  (VerifyW(adr, 4), MarkW(adr, 4), WatchW(adr, 4), Write4(memmap+(adr), (vl)))
 
 /* Macros to access values on the stack. These *must* be used 
    with proper alignment! (That is, Stk4 and StkW4 must take 
@@ -140,33 +176,72 @@ typedef struct operandlist_struct {
 
 /* Some useful globals */
 
-extern int vm_exited_cleanly;
-extern strid_t gamefile;
-extern glui32 gamefile_start, gamefile_len;
-extern char *init_err, *init_err2;
-
-extern unsigned char *memmap;
-extern unsigned char *stack;
-
-extern glui32 ramstart;
-extern glui32 endgamefile;
-extern glui32 origendmem;
-extern glui32 stacksize;
-extern glui32 startfuncaddr;
-extern glui32 checksum;
-extern glui32 stackptr;
-extern glui32 frameptr;
-extern glui32 pc;
-extern glui32 origstringtable;
-extern glui32 stringtable;
-extern glui32 valstackbase;
-extern glui32 localsbase;
-extern glui32 endmem;
-extern glui32 protectstart, protectend;
-extern glui32 prevpc;
-
-extern void (*stream_char_handler)(unsigned char ch);
-extern void (*stream_unichar_handler)(glui32 ch);
+extern THREAD_LOCAL int vm_exited_cleanly;
+extern THREAD_LOCAL strid_t gamefile;
+extern THREAD_LOCAL glui32 gamefile_start, gamefile_len;
+extern THREAD_LOCAL char *init_err, *init_err2;
+
+/* vmstate_t:
+   The VM registers, and the rest of the state that the main loop
+   touches on nearly every instruction. In a shared object, every
+   access to a thread-local variable costs a call to __tls_get_addr();
+   so these live together in one thread-local structure, and the
+   hottest functions begin with CACHE_VMSTATE, which fetches its address
+   once into a local pointer of the same name. The usual names (pc,
+   stackptr, memmap, and so on) are macros for its fields.
+*/
+typedef struct vmstate_struct {
+  unsigned char *memmap;
+  unsigned char *stack;
+  glui32 ramstart;
+  glui32 endmem;
+  glui32 stacksize;
+  glui32 stackptr;
+  glui32 frameptr;
+  glui32 pc;
+  glui32 prevpc;
+  glui32 valstackbase;
+  glui32 localsbase;
+  glui32 protectstart, protectend;
+  unsigned char *dirtypages; /* serial.c */
+  unsigned char *accel_watch; /* accel.c */
+  glui32 accel_watch_words;
+  glui32 sample_countdown; /* profile.c */
+  operandlist_t *fast_operandlist[0x80]; /* operand.c */
+} vmstate_t;
+
+extern THREAD_LOCAL vmstate_t vmstate[1];
+extern vmstate_t *vmstate_address(void);
+#define CACHE_VMSTATE vmstate_t *const vmstate = vmstate_address()
+
+#define memmap (vmstate->memmap)
+#define stack (vmstate->stack)
+#define ramstart (vmstate->ramstart)
+#define endmem (vmstate->endmem)
+#define stacksize (vmstate->stacksize)
+#define stackptr (vmstate->stackptr)
+#define frameptr (vmstate->frameptr)
+#define pc (vmstate->pc)
+#define prevpc (vmstate->prevpc)
+#define valstackbase (vmstate->valstackbase)
+#define localsbase (vmstate->localsbase)
+#define protectstart (vmstate->protectstart)
+#define protectend (vmstate->protectend)
+#define dirtypages (vmstate->dirtypages)
+#define accel_watch (vmstate->accel_watch)
+#define accel_watch_words (vmstate->accel_watch_words)
+#define sample_countdown (vmstate->sample_countdown)
+#define fast_operandlist (vmstate->fast_operandlist)
+
+extern THREAD_LOCAL glui32 endgamefile;
+extern THREAD_LOCAL glui32 origendmem;
+extern THREAD_LOCAL glui32 startfuncaddr;
+extern THREAD_LOCAL glui32 checksum;
+extern THREAD_LOCAL glui32 origstringtable;
+extern THREAD_LOCAL glui32 stringtable;
+
+extern THREAD_LOCAL void (*stream_char_handler)(unsigned char ch);
+extern THREAD_LOCAL void (*stream_unichar_handler)(glui32 ch);
 
 /* main.c */
 extern void set_library_start_hook(void (*)(void));
@@ -198,7 +273,6 @@ extern void verify_array_addresses(glui32 addr, glui32 count, glui32 size);
 extern void execute_loop(void);
 
 /* operand.c */
-extern operandlist_t *fast_operandlist[0x80];
 extern void init_operands(void);
 extern operandlist_t *lookup_operandlist(glui32 opcode);
 extern void parse_operands(oparg_t *opargs, operandlist_t *oplist);
@@ -218,6 +292,7 @@ extern void stream_num(glsi32 val, int inmiddle, int charnum);
 extern void stream_string(glui32 addr, int inmiddle, int bitnum);
 extern glui32 stream_get_table(void);
 extern void stream_set_table(glui32 addr);
+extern void stream_note_write(void);
 extern void stream_get_iosys(glui32 *mode, glui32 *rock);
 extern void stream_set_iosys(glui32 mode, glui32 rock);
 extern char *make_temp_string(glui32 addr);
@@ -236,13 +311,18 @@ extern int heap_apply_summary(glui32 valcount, glui32 *summary);
 extern void heap_sanity_check(void);
 
 /* serial.c */
-extern int max_undo_level;
+extern THREAD_LOCAL int max_undo_level;
+extern int grow_dirty_pages(glui32 newlen);
+extern void mark_dirty_pages(glui32 start, glui32 end);
 extern int init_serial(void);
 extern void final_serial(void);
 extern glui32 perform_save(strid_t str);
 extern glui32 perform_restore(strid_t str, int fromshell);
 extern glui32 perform_saveundo(void);
 extern glui32 perform_restoreundo(void);
+extern glui32 perform_checkpoint_save(void);
+extern glui32 perform_checkpoint_restore(void);
+extern void perform_checkpoint_discard(void);
 extern glui32 perform_verify(void);
 
 /* search.c */
@@ -282,7 +362,7 @@ extern glui32 find_id_for_schannel(schanid_t schan);
 extern void setup_profile(strid_t stream, char *filename);
 extern int init_profile(void);
 #if VM_PROFILING
-extern glui32 profile_opcount;
+extern THREAD_LOCAL glui32 profile_opcount;
 #define profile_tick() (profile_opcount++)
 extern void profile_in(glui32 addr, glui32 stackuse, int accel);
 extern void profile_out(glui32 stackuse);
@@ -296,6 +376,18 @@ extern void profile_quit(void);
 #define profile_quit()         (0)
 #endif /* VM_PROFILING */
 
+/* The sampling profiler in profile.c is always compiled in; while it is
+   switched off, it costs one test per opcode and one per call. */
+extern THREAD_LOCAL int sample_note_calls;
+extern void sample_start(glui32 interval, char *debugfile, char *outfile);
+extern void sample_stop(void);
+extern void sample_take(void);
+extern void sample_note_function(glui32 addr);
+#define sample_tick()  \
+  ((sample_countdown && !--sample_countdown) ? (sample_take(), 0) : 0)
+#define sample_call(addr)  \
+  (sample_note_calls ? (sample_note_function(addr), 0) : 0)
+
 /* accel.c */
 typedef glui32 (*acceleration_func)(glui32 argc, glui32 *argv);
 extern void init_accel(void);
@@ -303,6 +395,15 @@ extern acceleration_func accel_find_func(glui32 index);
 extern acceleration_func accel_get_func(glui32 addr);
 extern void accel_set_func(glui32 index, glui32 addr);
 extern void accel_set_param(glui32 index, glui32 val);
+extern int accel_signature(glui32 addr, glui32 *hashptr, glui32 *numopsptr);
+extern THREAD_LOCAL int accel_verifying;
+extern void accel_verify_call(glui32 addr, glui32 frame, glui32 expected);
+extern void accel_verify_return(glui32 frame, glui32 val);
+extern void accel_verify_unwind(glui32 frame);
+extern int accel_watch_range(glui32 start, glui32 end);
+extern void accel_note_write(void);
+extern void accel_note_write_range(glui32 start, glui32 end);
+extern void accel_prop_cache_stats(glui32 *hits, glui32 *misses, glui32 *flushes);
 
 #ifdef FLOAT_SUPPORT
 
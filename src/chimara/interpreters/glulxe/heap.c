@@ -12,10 +12,30 @@ typedef struct heapblock_struct {
   int isfree;
   struct heapblock_struct *next;
   struct heapblock_struct *prev;
+  /* A free block is on the list for its size class; an allocated block
+     is on a chain of the address table. (The latter only uses
+     chainnext.) */
+  struct heapblock_struct *chainnext;
+  struct heapblock_struct *chainprev;
 } heapblock_t;
 
-static glui32 heap_start = 0; /* zero for inactive heap */
-static int alloc_count = 0;
+/* Block records are carved out of chunks of this many, rather than
+   being allocated one at a time. */
+#define HEAP_RECORD_CHUNK (256)
+
+typedef struct heapchunk_struct {
+  struct heapchunk_struct *next;
+  heapblock_t records[HEAP_RECORD_CHUNK];
+} heapchunk_t;
+
+/* Free blocks are sorted into size classes: one per 16 bytes below 256,
+   then one per power of two. Any block in a class above the one for len
+   is big enough for len. */
+#define HEAP_SMALL_BINS (16)
+#define HEAP_NUM_BINS (HEAP_SMALL_BINS + 24)
+
+static THREAD_LOCAL glui32 heap_start = 0; /* zero for inactive heap */
+static THREAD_LOCAL int alloc_count = 0;
 
 /* The heap_head/heap_tail is a doubly-linked list of blocks, both
    free and allocated. It is kept in address order. It should be
@@ -26,14 +46,158 @@ static int alloc_count = 0;
    (Heap_start is never the same as end_mem; if there is no heap space,
    then the heap is inactive and heap_start is zero.)
 
-   Adjacent free blocks may be merged at heap_alloc() time.
-
-   ### To make alloc more efficient, we could keep a separate
-   free-list. To make free more efficient, we could keep a hash
-   table of allocations.
+   Adjacent free blocks are merged as soon as the second one is freed,
+   so two free blocks are never next to each other. Each free block is
+   also on the free_bins list for its size class, and each allocated
+   block is in the used_table hash, so that neither heap_alloc() nor
+   heap_free() has to walk the whole heap.
  */
-static heapblock_t *heap_head = NULL;
-static heapblock_t *heap_tail = NULL;
+static THREAD_LOCAL heapblock_t *heap_head = NULL;
+static THREAD_LOCAL heapblock_t *heap_tail = NULL;
+
+static THREAD_LOCAL heapblock_t *free_bins[HEAP_NUM_BINS];
+
+static THREAD_LOCAL heapblock_t **used_table = NULL;
+static THREAD_LOCAL int used_table_shift = 0;
+
+static THREAD_LOCAL heapchunk_t *record_chunks = NULL;
+static THREAD_LOCAL heapblock_t *free_records = NULL;
+
+/* heap_bin():
+   Return the size class for a block of the given length.
+*/
+static int heap_bin(glui32 len)
+{
+  int bin;
+
+  if (len < 256)
+    return len >> 4;
+  bin = HEAP_SMALL_BINS;
+  for (len >>= 9; len; len >>= 1)
+    bin++;
+  return bin;
+}
+
+static heapblock_t *new_record(void)
+{
+  heapblock_t *blo;
+
+  if (!free_records) {
+    heapchunk_t *chunk;
+    int ix;
+
+    chunk = glulx_malloc(sizeof(heapchunk_t));
+    if (!chunk)
+      fatal_error("Unable to allocate record for heap block.");
+    chunk->next = record_chunks;
+    record_chunks = chunk;
+    for (ix=0; ix<HEAP_RECORD_CHUNK; ix++) {
+      chunk->records[ix].next = free_records;
+      free_records = &chunk->records[ix];
+    }
+  }
+
+  blo = free_records;
+  free_records = blo->next;
+  blo->next = NULL;
+  blo->prev = NULL;
+  blo->chainnext = NULL;
+  blo->chainprev = NULL;
+  return blo;
+}
+
+static void release_record(heapblock_t *blo)
+{
+  blo->next = free_records;
+  free_records = blo;
+}
+
+static void bin_insert(heapblock_t *blo)
+{
+  int bin = heap_bin(blo->len);
+
+  blo->chainprev = NULL;
+  blo->chainnext = free_bins[bin];
+  if (blo->chainnext)
+    blo->chainnext->chainprev = blo;
+  free_bins[bin] = blo;
+}
+
+static void bin_remove(heapblock_t *blo)
+{
+  if (blo->chainprev)
+    blo->chainprev->chainnext = blo->chainnext;
+  else
+    free_bins[heap_bin(blo->len)] = blo->chainnext;
+  if (blo->chainnext)
+    blo->chainnext->chainprev = blo->chainprev;
+  blo->chainnext = NULL;
+  blo->chainprev = NULL;
+}
+
+#define USED_HASH(addr)  \
+  ((glui32)((addr) * 0x9E3779B1U) >> (32 - used_table_shift))
+
+/* used_insert():
+   Add an allocated block to the address table, doubling the table
+   when it gets as full as it is long.
+*/
+static void used_insert(heapblock_t *blo)
+{
+  glui32 pos;
+
+  if (!used_table || alloc_count >= (1 << used_table_shift)) {
+    int newshift = (used_table ? used_table_shift+1 : 6);
+    heapblock_t **newtable;
+    glui32 ix, count = (used_table ? (1 << used_table_shift) : 0);
+
+    newtable = glulx_malloc((1 << newshift) * sizeof(heapblock_t *));
+    if (!newtable)
+      fatal_error("Unable to allocate heap address table.");
+    for (ix=0; ix<(1 << newshift); ix++)
+      newtable[ix] = NULL;
+    used_table_shift = newshift;
+    for (ix=0; ix<count; ix++) {
+      heapblock_t *chain = used_table[ix];
+      while (chain) {
+        heapblock_t *nextblo = chain->chainnext;
+        pos = USED_HASH(chain->addr);
+        chain->chainnext = newtable[pos];
+        newtable[pos] = chain;
+        chain = nextblo;
+      }
+    }
+    if (used_table)
+      glulx_free(used_table);
+    used_table = newtable;
+  }
+
+  pos = USED_HASH(blo->addr);
+  blo->chainnext = used_table[pos];
+  used_table[pos] = blo;
+}
+
+/* used_remove():
+   Find the allocated block at addr, take it out of the address table,
+   and return it. Returns NULL if there is no such block.
+*/
+static heapblock_t *used_remove(glui32 addr)
+{
+  heapblock_t **link;
+
+  if (!used_table)
+    return NULL;
+
+  for (link = &used_table[USED_HASH(addr)]; *link; link = &(*link)->chainnext) {
+    heapblock_t *blo = *link;
+    if (blo->addr == addr) {
+      *link = blo->chainnext;
+      blo->chainnext = NULL;
+      return blo;
+    }
+  }
+  return NULL;
+}
 
 /* heap_clear():
    Set the heap state to inactive, and free the block lists. This is
@@ -41,15 +205,25 @@ static heapblock_t *heap_tail = NULL;
 */
 void heap_clear()
 {
-  while (heap_head) {
-    heapblock_t *blo = heap_head;
-    heap_head = blo->next;
-    blo->next = NULL;
-    blo->prev = NULL;
-    glulx_free(blo);
+  int ix;
+
+  while (record_chunks) {
+    heapchunk_t *chunk = record_chunks;
+    record_chunks = chunk->next;
+    glulx_free(chunk);
   }
+  free_records = NULL;
+  heap_head = NULL;
   heap_tail = NULL;
 
+  for (ix=0; ix<HEAP_NUM_BINS; ix++)
+    free_bins[ix] = NULL;
+  if (used_table) {
+    glulx_free(used_table);
+    used_table = NULL;
+  }
+  used_table_shift = 0;
+
   if (heap_start) {
     glui32 res = change_memsize(heap_start, TRUE);
     if (res)
@@ -85,6 +259,7 @@ glui32 heap_get_start() {
 glui32 heap_alloc(glui32 len)
 {
   heapblock_t *blo, *newblo;
+  int bin;
 
 #ifdef FIXED_MEMSIZE
   return 0;
@@ -93,45 +268,21 @@ glui32 heap_alloc(glui32 len)
   if (len <= 0)
     fatal_error("Heap allocation length must be positive.");
 
-  blo = heap_head;
-  while (blo) {
-    if (blo->isfree && blo->len >= len)
+  /* First fit within the block's own size class; failing that, any
+     block from the smallest nonempty class above it. */
+  bin = heap_bin(len);
+  for (blo = free_bins[bin]; blo; blo = blo->chainnext) {
+    if (blo->len >= len)
       break;
-
-    if (!blo->isfree) {
-      blo = blo->next;
-      continue;
-    }
-
-    if (!blo->next || !blo->next->isfree) {
-      blo = blo->next;
-      continue;
-    }
-
-    /* This is a free block, but the next block in the list is also
-       free, so we "advance" by merging rather than by going to
-       blo->next. */
-    newblo = blo->next;
-    blo->len += newblo->len;
-    if (newblo->next) {
-      blo->next = newblo->next;
-      newblo->next->prev = blo;
-    }
-    else {
-      blo->next = NULL;
-      heap_tail = blo;
-    }
-    newblo->next = NULL;
-    newblo->prev = NULL;
-    glulx_free(newblo);
-    newblo = NULL;
-    continue;
+  }
+  for (bin++; !blo && bin<HEAP_NUM_BINS; bin++) {
+    blo = free_bins[bin];
   }
 
   if (!blo) {
-    /* No free area is visible on the list. Try extending memory. How
-       much? Double the heap size, or by 256 bytes, or by the memory
-       length requested -- whichever is greatest. */
+    /* No free area is big enough. Try extending memory. How much?
+       Double the heap size, or by 256 bytes, or by the memory length
+       requested -- whichever is greatest. */
     glui32 res;
     glui32 extension;
     glui32 oldendmem = endmem;
@@ -157,18 +308,16 @@ glui32 heap_alloc(glui32 len)
     if (heap_tail && heap_tail->isfree) {
       /* Append the new space to the last block. */
       blo = heap_tail;
+      bin_remove(blo);
       blo->len += extension;
+      bin_insert(blo);
     }
     else {
       /* Append the new space to the block list, as a new block. */
-      newblo = glulx_malloc(sizeof(heapblock_t));
-      if (!newblo)
-        fatal_error("Unable to allocate record for heap block.");
+      newblo = new_record();
       newblo->addr = oldendmem;
       newblo->len = extension;
       newblo->isfree = TRUE;
-      newblo->next = NULL;
-      newblo->prev = NULL;
 
       if (!heap_tail) {
         heap_head = newblo;
@@ -180,6 +329,7 @@ glui32 heap_alloc(glui32 len)
         blo->next = newblo;
         newblo->prev = blo;
       }
+      bin_insert(newblo);
 
       blo = newblo;
       newblo = NULL;
@@ -194,18 +344,13 @@ glui32 heap_alloc(glui32 len)
 
   /* We now have a free block of size len or longer. */
 
-  if (blo->len == len) {
-    blo->isfree = FALSE;
-  }
-  else {
-    newblo = glulx_malloc(sizeof(heapblock_t));
-    if (!newblo)
-      fatal_error("Unable to allocate record for heap block.");
+  bin_remove(blo);
+  if (blo->len != len) {
+    newblo = new_record();
     newblo->isfree = TRUE;
     newblo->addr = blo->addr + len;
     newblo->len = blo->len - len;
     blo->len = len;
-    blo->isfree = FALSE;
     newblo->next = blo->next;
     if (newblo->next)
       newblo->next->prev = newblo;
@@ -213,8 +358,11 @@ glui32 heap_alloc(glui32 len)
     blo->next = newblo;
     if (heap_tail == blo)
       heap_tail = newblo;
+    bin_insert(newblo);
   }
+  blo->isfree = FALSE;
 
+  used_insert(blo);
   alloc_count++;
   /* heap_sanity_check(); */
   return blo->addr;
@@ -222,6 +370,23 @@ glui32 heap_alloc(glui32 len)
 #endif /* FIXED_MEMSIZE */
 }
 
+/* heap_merge_next():
+   Absorb the block after blo (which must exist) into blo. The absorbed
+   block must already be off its size-class list.
+*/
+static void heap_merge_next(heapblock_t *blo)
+{
+  heapblock_t *nextblo = blo->next;
+
+  blo->len += nextblo->len;
+  blo->next = nextblo->next;
+  if (blo->next)
+    blo->next->prev = blo;
+  else
+    heap_tail = blo;
+  release_record(nextblo);
+}
+
 /* heap_free():
    Free a heap block. If necessary, deactivate the heap.
 */
@@ -229,10 +394,7 @@ void heap_free(glui32 addr)
 {
   heapblock_t *blo;
 
-  for (blo = heap_head; blo; blo = blo->next) { 
-    if (blo->addr == addr)
-      break;
-  };
+  blo = used_remove(addr);
   if (!blo || blo->isfree)
     fatal_error_i("Attempt to free unallocated address from heap.", addr);
 
@@ -240,7 +402,19 @@ void heap_free(glui32 addr)
   alloc_count--;
   if (alloc_count <= 0) {
     heap_clear();
+    return;
+  }
+
+  if (blo->next && blo->next->isfree) {
+    bin_remove(blo->next);
+    heap_merge_next(blo);
+  }
+  if (blo->prev && blo->prev->isfree) {
+    blo = blo->prev;
+    bin_remove(blo);
+    heap_merge_next(blo);
   }
+  bin_insert(blo);
 
   /* heap_sanity_check(); */
 }
@@ -311,6 +485,7 @@ int heap_get_summary(glui32 *valcount, glui32 **summary)
 int heap_apply_summary(glui32 valcount, glui32 *summary)
 {
   glui32 lx, jx, lastend;
+  heapblock_t *blo;
 
   if (heap_start)
     fatal_error("Heap active when heap_apply_summary called");
@@ -336,11 +511,7 @@ int heap_apply_summary(glui32 valcount, glui32 *summary)
   lastend = heap_start;
 
   while (lx < valcount || lastend < endmem) {
-    heapblock_t *blo;
-
-    blo = glulx_malloc(sizeof(heapblock_t));
-    if (!blo)
-      fatal_error("Unable to allocate record for heap block.");
+    blo = new_record();
 
     if (lx >= valcount) {
       blo->addr = lastend;
@@ -360,9 +531,6 @@ int heap_apply_summary(glui32 valcount, glui32 *summary)
       }
     }
 
-    blo->prev = NULL;
-    blo->next = NULL;
-
     if (!heap_head) {
       heap_head = blo;
       heap_tail = blo;
@@ -376,6 +544,19 @@ int heap_apply_summary(glui32 valcount, glui32 *summary)
     lastend = blo->addr + blo->len;
   }
 
+  /* The free blocks all lie between allocated ones (or after the last),
+     so none are adjacent. Now index the lot. */
+  alloc_count = 0;
+  for (blo = heap_head; blo; blo = blo->next) {
+    if (blo->isfree) {
+      bin_insert(blo);
+    }
+    else {
+      used_insert(blo);
+      alloc_count++;
+    }
+  }
+
   /* heap_sanity_check(); */
 
   return 0;
@@ -419,7 +600,7 @@ static void heap_dump()
 void heap_sanity_check()
 {
   heapblock_t *blo, *last;
-  int livecount;
+  int livecount, freecount, ix;
 
   heap_dump();
 
@@ -441,6 +622,7 @@ void heap_sanity_check()
 
   last = NULL;
   livecount = 0;
+  freecount = 0;
 
   for (blo = heap_head; blo; last = blo, blo = blo->next) {
     glui32 lastend;
@@ -454,9 +636,24 @@ void heap_sanity_check()
     if (lastend != blo->addr)
       fatal_error("Heap sanity: addr+len mismatch.");
 
+    if (blo->isfree && last && last->isfree)
+      fatal_error("Heap sanity: adjacent free blocks.");
+
     if (!blo->isfree)
       livecount++;
+    else
+      freecount++;
+  }
+
+  for (ix=0; ix<HEAP_NUM_BINS; ix++) {
+    for (blo = free_bins[ix]; blo; blo = blo->chainnext) {
+      if (!blo->isfree || heap_bin(blo->len) != ix)
+        fatal_error_i("Heap sanity: block in wrong size class.", blo->addr);
+      freecount--;
+    }
   }
+  if (freecount)
+    fatal_error("Heap sanity: free block missing from size classes.");
 
   if (!last) {
     if (heap_start != endmem)
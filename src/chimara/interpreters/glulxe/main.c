@@ -6,24 +6,24 @@
 #include "glk.h"
 #include "glulxe.h"
 
-int vm_exited_cleanly = TRUE;
-strid_t gamefile = NULL; /* The stream containing the Glulx file. */
-glui32 gamefile_start = 0; /* The position within the stream. (This will not 
+THREAD_LOCAL int vm_exited_cleanly = TRUE;
+THREAD_LOCAL strid_t gamefile = NULL; /* The stream containing the Glulx file. */
+THREAD_LOCAL glui32 gamefile_start = 0; /* The position within the stream. (This will not 
     be zero if the Glulx file is a chunk inside a Blorb archive.) */
-glui32 gamefile_len = 0; /* The length within the stream. */
-char *init_err = NULL;
-char *init_err2 = NULL;
+THREAD_LOCAL glui32 gamefile_len = 0; /* The length within the stream. */
+THREAD_LOCAL char *init_err = NULL;
+THREAD_LOCAL char *init_err2 = NULL;
 
 /* The library_start_hook is called at the beginning of glk_main. This
    is not normally necessary -- the library can do all its setup work
    before calling glk_main -- but iosglk has some weird cases which
    require it. */
-static void (*library_start_hook)(void) = NULL;
+static THREAD_LOCAL void (*library_start_hook)(void) = NULL;
 /* The library_autorestore_hook is called right after the VM's initial
    setup. This is an appropriate time to autorestore an initial game
    state, if the library has that capability. (Currently, only iosglk
    does.) */
-static void (*library_autorestore_hook)(void) = NULL;
+static THREAD_LOCAL void (*library_autorestore_hook)(void) = NULL;
 
 static winid_t get_error_win(void);
 static void stream_hexnum(glsi32 val);
@@ -75,6 +75,7 @@ void glk_main()
   vm_exited_cleanly = TRUE;
   
   profile_quit();
+  sample_stop();
   glk_exit();
 }
 
@@ -95,7 +96,7 @@ void set_library_autorestore_hook(void (*func)(void))
 */
 static winid_t get_error_win()
 {
-  static winid_t errorwin = NULL;
+  static THREAD_LOCAL winid_t errorwin = NULL;
 
   if (!errorwin) {
     winid_t rootwin = glk_window_get_root();
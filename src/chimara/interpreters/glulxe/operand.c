@@ -13,9 +13,8 @@
 /* fast_operandlist[]:
    This is a handy array in which to look up operandlists quickly.
    It stores the operandlists for the first 128 opcodes, which are
-   the ones used most frequently.
+   the ones used most frequently. It is kept in vmstate.
 */
-operandlist_t *fast_operandlist[0x80];
 
 /* The actual immutable structures which lookup_operandlist()
    returns. */
@@ -289,6 +288,7 @@ operandlist_t *lookup_operandlist(glui32 opcode)
 */
 void parse_operands(oparg_t *args, operandlist_t *oplist)
 {
+  CACHE_VMSTATE;
   int ix;
   oparg_t *curarg;
   int numops = oplist->num_ops;
@@ -537,6 +537,7 @@ void parse_operands(oparg_t *args, operandlist_t *oplist)
 */
 void store_operand(glui32 desttype, glui32 destaddr, glui32 storeval)
 {
+  CACHE_VMSTATE;
   switch (desttype) {
 
   case 0: /* do nothing; discard the value. */
@@ -567,6 +568,7 @@ void store_operand(glui32 desttype, glui32 destaddr, glui32 storeval)
 
 void store_operand_s(glui32 desttype, glui32 destaddr, glui32 storeval)
 {
+  CACHE_VMSTATE;
   storeval &= 0xFFFF;
 
   switch (desttype) {
@@ -599,6 +601,7 @@ void store_operand_s(glui32 desttype, glui32 destaddr, glui32 storeval)
 
 void store_operand_b(glui32 desttype, glui32 destaddr, glui32 storeval)
 {
+  CACHE_VMSTATE;
   storeval &= 0xFF;
 
   switch (desttype) {
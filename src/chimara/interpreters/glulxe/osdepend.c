@@ -149,8 +149,8 @@ glui32 glulx_random()
 /* Here is a pretty standard random-number generator and seed function. */
 static glui32 lo_random(void);
 static void lo_seed_random(glui32 seed);
-static glui32 rand_table[55]; /* State for the RNG. */
-static int rand_index1, rand_index2;
+static THREAD_LOCAL glui32 rand_table[55]; /* State for the RNG. */
+static THREAD_LOCAL int rand_index1, rand_index2;
 
 static glui32 lo_random()
 {
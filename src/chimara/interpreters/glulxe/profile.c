@@ -46,6 +46,10 @@ program's run. Each function tag includes the following attributes:
     any call. (This is measured when the function returns, so it may
     not capture the peak stack usage. If a function never returns, e.g.
     Main__(), then this value is approximate.)
+  signature=HEX, signature_ops=INT: The function's signature, as
+    computed by accel_signature(), and the number of opcodes it covers.
+    These are what accel.c needs to recognise the function in other
+    games. (Left out for functions in RAM, or that couldn't be decoded.)
 
 Note that if a function does not make any function calls, total_time
 will be the same as self_time (and total_ops the same as self_ops).
@@ -68,6 +72,15 @@ function generated by the compiler. Its total_time is the running time
 of the entire program; its total_ops is the number of opcodes executed
 by the entire program; its max_depth is zero.
 
+After the functions comes one more tag:
+
+  <propcache hits=INT misses=INT flushes=INT />
+
+These count the property table searches by accelerated functions that
+were answered from accel.c's cache, the ones that weren't, and the
+number of times the game wrote to a cached property table so that the
+cache had to be emptied.
+
  */
 
 #include "glk.h"
@@ -80,9 +93,9 @@ by the entire program; its max_depth is zero.
 #include <sys/time.h>
 
 /* Set if the --profile switch is used. */
-static int profiling_active = FALSE;
-static char *profiling_filename = NULL;
-static strid_t profiling_stream = NULL;
+static THREAD_LOCAL int profiling_active = FALSE;
+static THREAD_LOCAL char *profiling_filename = NULL;
+static THREAD_LOCAL strid_t profiling_stream = NULL;
 
 typedef struct function_struct {
   glui32 addr;
@@ -116,12 +129,12 @@ typedef struct frame_struct {
 
 #define FUNC_HASH_SIZE (511)
 
-static function_t **functions = NULL;
-static frame_t *current_frame = NULL;
+static THREAD_LOCAL function_t **functions = NULL;
+static THREAD_LOCAL frame_t *current_frame = NULL;
 
 /* This counter is globally visible, because the profile_tick() macro
    increments it. */
-glui32 profile_opcount = 0;
+THREAD_LOCAL glui32 profile_opcount = 0;
 
 /* This is called from the setup code -- glkunix_startup_code(), for the
    Unix version. If called, the interpreter will keep profiling information,
@@ -330,6 +343,8 @@ void profile_quit()
   int bucknum;
   function_t *func;
   char linebuf[512];
+  glui32 sighash, signumops;
+  glui32 hits, misses, flushes;
   strid_t profstr;
 
   if (!profiling_active)
@@ -367,7 +382,7 @@ void profile_quit()
         func->self_ops,
         timeprint(&func->self_time, self_buf));
       ### */
-      sprintf(linebuf, "  <function addr=\"%lx\" call_count=\"%ld\" accel_count=\"%ld\" total_ops=\"%ld\" total_time=\"%s\" self_ops=\"%ld\" self_time=\"%s\" max_depth=\"%ld\" max_stack_use=\"%ld\" />\n",
+      sprintf(linebuf, "  <function addr=\"%lx\" call_count=\"%ld\" accel_count=\"%ld\" total_ops=\"%ld\" total_time=\"%s\" self_ops=\"%ld\" self_time=\"%s\" max_depth=\"%ld\" max_stack_use=\"%ld\"",
         (unsigned long)func->addr, (long)func->call_count, (long)func->accel_count,
         (long)func->total_ops,
         timeprint(&func->total_time, total_buf),
@@ -375,9 +390,20 @@ void profile_quit()
         timeprint(&func->self_time, self_buf),
         (long)func->max_depth, (long)func->max_stack_use);
       glk_put_string_stream(profstr, linebuf);
+      if (accel_signature(func->addr, &sighash, &signumops)) {
+        sprintf(linebuf, " signature=\"%08lx\" signature_ops=\"%ld\"",
+          (unsigned long)sighash, (long)signumops);
+        glk_put_string_stream(profstr, linebuf);
+      }
+      glk_put_string_stream(profstr, " />\n");
     }
   }
 
+  accel_prop_cache_stats(&hits, &misses, &flushes);
+  sprintf(linebuf, "  <propcache hits=\"%ld\" misses=\"%ld\" flushes=\"%ld\" />\n",
+    (long)hits, (long)misses, (long)flushes);
+  glk_put_string_stream(profstr, linebuf);
+
   glk_put_string_stream(profstr, "</profile>\n");
 
   glk_stream_close(profstr, NULL);
@@ -400,3 +426,445 @@ int init_profile()
 }
 
 #endif /* VM_PROFILING */
+
+/* The sampling profiler.
+
+   This is always compiled in, and is meant to be cheap enough to leave
+   running while playing. Once sample_start() has been called, every
+   interval opcodes execute_loop() calls sample_take(), which walks the
+   VM call stack and counts one hit for the chain of functions it finds.
+   Nothing happens on function entry or exit, so @throw, @restore, and
+   the rest do no harm.
+
+   Program counters are matched to functions using the <routine> records
+   of an Inform 6 debugging information file (see DebugFileFormat.txt in
+   the Inform 6 sources), which also supply the names. Without one, the
+   profiler notes the address of each function as it is called, and
+   functions are named by their address in hex.
+
+   sample_stop() writes the counts out in the "collapsed stack" format
+   read by flame graph tools: one line for each distinct stack, giving
+   the functions from outermost to innermost separated by semicolons,
+   then a space and the number of samples. A last line, starting with
+   "#", gives the property cache counters from accel.c, which flame
+   graph tools skip as malformed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct sample_func_struct {
+  glui32 addr;
+  glui32 end; /* zero if unknown */
+  char *name; /* NULL if unknown */
+} sample_func_t;
+
+typedef struct sample_stack_struct {
+  glui32 hash;
+  glui32 count;
+  int depth;
+  glui32 *frames; /* function addresses, outermost first */
+  struct sample_stack_struct *next;
+} sample_stack_t;
+
+#define SAMPLE_HASH_SIZE (4096)
+#define SAMPLE_MAX_DEPTH (256)
+
+/* These are globally visible, because the sample_tick() and
+   sample_call() macros test them. sample_countdown is in vmstate. */
+THREAD_LOCAL int sample_note_calls = FALSE;
+
+static THREAD_LOCAL glui32 sample_interval = 0;
+static THREAD_LOCAL char *sample_outfile = NULL;
+
+/* The known functions, in address order. */
+static THREAD_LOCAL sample_func_t *sample_funcs = NULL;
+static THREAD_LOCAL int sample_funcs_count = 0;
+static THREAD_LOCAL int sample_funcs_size = 0;
+
+/* Open-addressed set of function addresses noted by
+   sample_note_function(). Zero marks an empty slot. */
+static THREAD_LOCAL glui32 *sample_noted = NULL;
+static THREAD_LOCAL glui32 sample_noted_size = 0;
+
+static THREAD_LOCAL sample_stack_t **sample_stacks = NULL;
+
+static int sample_sort_funcs(void *p1, void *p2)
+{
+  sample_func_t *f1 = (sample_func_t *)p1;
+  sample_func_t *f2 = (sample_func_t *)p2;
+
+  if (f1->addr < f2->addr)
+    return -1;
+  if (f1->addr > f2->addr)
+    return 1;
+  return 0;
+}
+
+/* sample_add_function():
+   Insert a function at index pos of the table.
+*/
+static void sample_add_function(int pos, glui32 addr, glui32 end, char *name)
+{
+  if (sample_funcs_count >= sample_funcs_size) {
+    int newsize = (sample_funcs_size ? 2*sample_funcs_size : 256);
+    sample_func_t *newfuncs = glulx_realloc(sample_funcs,
+      newsize * sizeof(sample_func_t));
+    if (!newfuncs)
+      fatal_error("Profiler: cannot malloc function table.");
+    sample_funcs = newfuncs;
+    sample_funcs_size = newsize;
+  }
+  if (pos < sample_funcs_count)
+    memmove(sample_funcs+pos+1, sample_funcs+pos,
+      (sample_funcs_count-pos) * sizeof(sample_func_t));
+  sample_funcs[pos].addr = addr;
+  sample_funcs[pos].end = end;
+  sample_funcs[pos].name = name;
+  sample_funcs_count++;
+}
+
+/* sample_search():
+   Return the number of known functions which start at or below addr.
+*/
+static int sample_search(glui32 addr)
+{
+  int lo = 0, hi = sample_funcs_count;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (sample_funcs[mid].addr <= addr)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* sample_xml_value():
+   Find the first element with the given tag inside the text, and return
+   a copy of its contents with the five XML entities decoded, or NULL.
+*/
+static char *sample_xml_value(char *text, char *tag)
+{
+  char *pos, *end, *res, *out;
+  int taglen = strlen(tag);
+
+  for (pos = strstr(text, tag); pos; pos = strstr(pos+1, tag)) {
+    if (pos[taglen] == '>' || pos[taglen] == ' ')
+      break;
+  }
+  if (!pos)
+    return NULL;
+  pos = strchr(pos, '>');
+  if (!pos)
+    return NULL;
+  pos++;
+  end = strchr(pos, '<');
+  if (!end)
+    return NULL;
+
+  res = glulx_malloc(end - pos + 1);
+  if (!res)
+    fatal_error("Profiler: cannot malloc function name.");
+  for (out = res; pos < end; pos++) {
+    if (*pos == '&') {
+      if (!strncmp(pos, "&lt;", 4)) { *out++ = '<'; pos += 3; continue; }
+      if (!strncmp(pos, "&gt;", 4)) { *out++ = '>'; pos += 3; continue; }
+      if (!strncmp(pos, "&amp;", 5)) { *out++ = '&'; pos += 4; continue; }
+      if (!strncmp(pos, "&quot;", 6)) { *out++ = '"'; pos += 5; continue; }
+      if (!strncmp(pos, "&apos;", 6)) { *out++ = '\''; pos += 5; continue; }
+    }
+    *out++ = *pos;
+  }
+  *out = '\0';
+  return res;
+}
+
+/* sample_load_debugfile():
+   Read the routine records from an Inform 6 debugging information file.
+   Returns the number of routines found.
+*/
+static int sample_load_debugfile(char *filename)
+{
+  FILE *fl;
+  long len;
+  char *buf, *pos, *end;
+  int found = 0;
+
+  fl = fopen(filename, "rb");
+  if (!fl)
+    return 0;
+  if (fseek(fl, 0, SEEK_END) != 0 || (len = ftell(fl)) <= 0) {
+    fclose(fl);
+    return 0;
+  }
+  rewind(fl);
+  buf = glulx_malloc(len+1);
+  if (!buf) {
+    fclose(fl);
+    return 0;
+  }
+  len = fread(buf, 1, len, fl);
+  fclose(fl);
+  buf[len] = '\0';
+
+  for (pos = strstr(buf, "<routine>"); pos; pos = strstr(end+1, "<routine>")) {
+    char *name, *addrstr, *lenstr;
+
+    end = strstr(pos, "</routine>");
+    if (!end)
+      break;
+    *end = '\0';
+
+    /* The routine's own identifier, address, and byte count come before
+       those of its local variables and sequence points. */
+    name = sample_xml_value(pos, "<identifier");
+    addrstr = sample_xml_value(pos, "<address");
+    lenstr = sample_xml_value(pos, "<byte-count");
+    if (name && addrstr && lenstr) {
+      glui32 addr = strtoul(addrstr, NULL, 10);
+      sample_add_function(sample_funcs_count, addr,
+        addr + strtoul(lenstr, NULL, 10), name);
+      name = NULL;
+      found++;
+    }
+    if (name)
+      glulx_free(name);
+    if (addrstr)
+      glulx_free(addrstr);
+    if (lenstr)
+      glulx_free(lenstr);
+  }
+
+  glulx_free(buf);
+  glulx_sort(sample_funcs, sample_funcs_count, sizeof(sample_func_t),
+    &sample_sort_funcs);
+  return found;
+}
+
+/* sample_note_function():
+   Record that a function exists at addr. This is only called (by the
+   sample_call() macro in enter_function()) when there is no debugging
+   information.
+*/
+void sample_note_function(glui32 addr)
+{
+  glui32 pos, mask;
+
+  if (sample_funcs_count*2 >= sample_noted_size) {
+    glui32 ix, newsize = (sample_noted_size ? 2*sample_noted_size : 1024);
+    glui32 *newset = glulx_malloc(newsize * sizeof(glui32));
+    if (!newset)
+      fatal_error("Profiler: cannot malloc function set.");
+    for (ix=0; ix<newsize; ix++)
+      newset[ix] = 0;
+    for (ix=0; ix<sample_noted_size; ix++) {
+      if (sample_noted[ix]) {
+        pos = (sample_noted[ix] * 0x9E3779B1U) & (newsize-1);
+        while (newset[pos])
+          pos = (pos+1) & (newsize-1);
+        newset[pos] = sample_noted[ix];
+      }
+    }
+    if (sample_noted)
+      glulx_free(sample_noted);
+    sample_noted = newset;
+    sample_noted_size = newsize;
+  }
+
+  mask = sample_noted_size-1;
+  for (pos = (addr * 0x9E3779B1U) & mask; sample_noted[pos];
+       pos = (pos+1) & mask) {
+    if (sample_noted[pos] == addr)
+      return;
+  }
+  sample_noted[pos] = addr;
+  sample_add_function(sample_search(addr), addr, 0, NULL);
+}
+
+/* sample_find_function():
+   Return the address of the function containing addr, or zero if it is
+   not known.
+*/
+static glui32 sample_find_function(glui32 addr)
+{
+  int pos = sample_search(addr);
+  sample_func_t *func;
+
+  if (pos == 0)
+    return 0;
+  func = &sample_funcs[pos-1];
+  if (func->end && addr >= func->end)
+    return 0;
+  return func->addr;
+}
+
+/* sample_take():
+   Record one sample of the call stack. The current function is found
+   from pc, and each caller from the return address in the call stub
+   just below its callee's frame. Stubs which hold a position in a
+   string being printed, rather than a code address, are skipped over;
+   the code address is in the 0x11 stub underneath them.
+*/
+void sample_take()
+{
+  glui32 frames[SAMPLE_MAX_DEPTH];
+  glui32 fp, stub, desttype, hash;
+  int depth, ix;
+  sample_stack_t *stk;
+
+  sample_countdown = sample_interval;
+
+  depth = 0;
+  frames[depth++] = sample_find_function(pc);
+  for (fp = frameptr; fp >= 16 && depth < SAMPLE_MAX_DEPTH; ) {
+    glui32 newfp;
+    for (stub = fp-16; ; stub -= 16) {
+      desttype = Stk4(stub);
+      if (!(desttype == 0x10 || (desttype >= 0x12 && desttype <= 0x14))
+        || stub < 16)
+        break;
+    }
+    frames[depth++] = sample_find_function(Stk4(stub+8));
+    newfp = Stk4(stub+12);
+    if (newfp >= fp)
+      break;
+    fp = newfp;
+  }
+
+  hash = 2166136261U;
+  for (ix=0; ix<depth; ix++)
+    hash = (hash ^ frames[ix]) * 16777619U;
+
+  for (stk = sample_stacks[hash % SAMPLE_HASH_SIZE]; stk; stk = stk->next) {
+    if (stk->hash != hash || stk->depth != depth)
+      continue;
+    for (ix=0; ix<depth; ix++) {
+      if (stk->frames[ix] != frames[depth-1-ix])
+        break;
+    }
+    if (ix == depth)
+      break;
+  }
+
+  if (!stk) {
+    stk = glulx_malloc(sizeof(sample_stack_t));
+    if (stk)
+      stk->frames = glulx_malloc(depth * sizeof(glui32));
+    if (!stk || !stk->frames)
+      fatal_error("Profiler: cannot malloc stack.");
+    stk->hash = hash;
+    stk->count = 0;
+    stk->depth = depth;
+    for (ix=0; ix<depth; ix++)
+      stk->frames[ix] = frames[depth-1-ix];
+    stk->next = sample_stacks[hash % SAMPLE_HASH_SIZE];
+    sample_stacks[hash % SAMPLE_HASH_SIZE] = stk;
+  }
+  stk->count++;
+}
+
+static void sample_print_function(FILE *fl, glui32 addr)
+{
+  int pos = sample_search(addr);
+  sample_func_t *func = (pos ? &sample_funcs[pos-1] : NULL);
+
+  if (func && func->addr == addr && func->name)
+    fputs(func->name, fl);
+  else if (addr)
+    fprintf(fl, "0x%lx", (unsigned long)addr);
+  else
+    fputs("(unknown)", fl);
+}
+
+/* sample_start():
+   Start sampling the call stack every interval opcodes, discarding any
+   samples taken so far. Function names are read from debugfile, which
+   may be NULL. The samples are written to outfile when sampling stops.
+   An interval of zero is the same as sample_stop().
+*/
+void sample_start(glui32 interval, char *debugfile, char *outfile)
+{
+  sample_stop();
+  if (!interval || !outfile)
+    return;
+
+  sample_stacks = glulx_malloc(SAMPLE_HASH_SIZE * sizeof(sample_stack_t *));
+  sample_outfile = glulx_malloc(strlen(outfile)+1);
+  if (!sample_stacks || !sample_outfile)
+    fatal_error("Profiler: cannot malloc sample table.");
+  memset(sample_stacks, 0, SAMPLE_HASH_SIZE * sizeof(sample_stack_t *));
+  strcpy(sample_outfile, outfile);
+
+  if (!debugfile || !sample_load_debugfile(debugfile))
+    sample_note_calls = TRUE;
+
+  sample_interval = interval;
+  sample_countdown = interval;
+}
+
+/* sample_stop():
+   Stop sampling, write the samples out, and free everything. This does
+   nothing if sampling was not started.
+*/
+void sample_stop()
+{
+  FILE *fl;
+  glui32 hits, misses, flushes;
+  int ix;
+
+  if (!sample_stacks)
+    return;
+
+  sample_countdown = 0;
+  sample_interval = 0;
+  sample_note_calls = FALSE;
+
+  fl = fopen(sample_outfile, "w");
+
+  for (ix=0; ix<SAMPLE_HASH_SIZE; ix++) {
+    while (sample_stacks[ix]) {
+      sample_stack_t *stk = sample_stacks[ix];
+      sample_stacks[ix] = stk->next;
+      if (fl) {
+        int jx;
+        for (jx=0; jx<stk->depth; jx++) {
+          if (jx)
+            fputc(';', fl);
+          sample_print_function(fl, stk->frames[jx]);
+        }
+        fprintf(fl, " %lu\n", (unsigned long)stk->count);
+      }
+      glulx_free(stk->frames);
+      glulx_free(stk);
+    }
+  }
+
+  if (fl) {
+    accel_prop_cache_stats(&hits, &misses, &flushes);
+    fprintf(fl, "# property cache: %lu hits, %lu misses, %lu flushes\n",
+      (unsigned long)hits, (unsigned long)misses, (unsigned long)flushes);
+    fclose(fl);
+  }
+
+  glulx_free(sample_stacks);
+  sample_stacks = NULL;
+  glulx_free(sample_outfile);
+  sample_outfile = NULL;
+
+  for (ix=0; ix<sample_funcs_count; ix++) {
+    if (sample_funcs[ix].name)
+      glulx_free(sample_funcs[ix].name);
+  }
+  if (sample_funcs)
+    glulx_free(sample_funcs);
+  sample_funcs = NULL;
+  sample_funcs_count = 0;
+  sample_funcs_size = 0;
+  if (sample_noted)
+    glulx_free(sample_noted);
+  sample_noted = NULL;
+  sample_noted_size = 0;
+}
@@ -6,6 +6,10 @@
 #include "glk.h"
 #include "glulxe.h"
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif /* __SSE2__ && __GNUC__ */
+
 #define serop_KeyIndirect (0x01)
 #define serop_ZeroKeyTerminates (0x02)
 #define serop_ReturnIndex (0x04)
@@ -40,6 +44,20 @@
 static void fetchkey(unsigned char *keybuf, glui32 key, glui32 keysize, 
   glui32 options);
 
+/* A one-, two- or four-byte key which lies wholly inside memory can be
+   fetched with a single load and compared as a number, without checking
+   each byte's address. Keys which run off the end of memory (or have
+   any other size) are still compared byte by byte, so that they fail
+   exactly as they always did. */
+#define FixedKeySize(size) ((size) == 1 || (size) == 2 || (size) == 4)
+#define KeyInMemory(adr, size) ((adr) < endmem && endmem - (adr) >= (size))
+#define ReadKey(ptr, size)  \
+  ((size) == 4 ? Read4(ptr) : ((size) == 2 ? Read2(ptr) : Read1(ptr)))
+
+static glui32 linear_scan_fixed(glui32 keyval, glui32 keysize,
+  unsigned char *keybuf, glui32 *startptr, glui32 structsize,
+  glui32 numstructs, glui32 keyoffset, int zeroterm, int *result);
+
 /* linear_search():
    An array of data structures is stored in memory, beginning at start,
    each structure being structsize bytes. Within each struct, there is
@@ -59,6 +77,7 @@ glui32 linear_search(glui32 key, glui32 keysize,
   glui32 start, glui32 structsize, glui32 numstructs, 
   glui32 keyoffset, glui32 options)
 {
+  CACHE_VMSTATE;
   unsigned char keybuf[4];
   glui32 count;
   int ix;
@@ -67,7 +86,22 @@ glui32 linear_search(glui32 key, glui32 keysize,
 
   fetchkey(keybuf, key, keysize, options);
 
-  for (count=0; count<numstructs; count++, start+=structsize) {
+  count = 0;
+  if (FixedKeySize(keysize)) {
+    int result = 0;
+    count = linear_scan_fixed(ReadKey(keybuf, keysize), keysize, keybuf,
+      &start, structsize, numstructs, keyoffset, zeroterm, &result);
+    if (result > 0) {
+      if (retindex)
+        return count;
+      else
+        return start;
+    }
+    if (result < 0)
+      count = numstructs;
+  }
+
+  for (; count<numstructs; count++, start+=structsize) {
     int match = TRUE;
     if (keysize <= 4) {
       for (ix=0; match && ix<keysize; ix++) {
@@ -120,13 +154,16 @@ glui32 binary_search(glui32 key, glui32 keysize,
   glui32 start, glui32 structsize, glui32 numstructs, 
   glui32 keyoffset, glui32 options)
 {
+  CACHE_VMSTATE;
   unsigned char keybuf[4];
   unsigned char byte, byte2;
-  glui32 top, bot, val, addr;
+  glui32 top, bot, val, addr, keyval, here;
   int ix;
   int retindex = ((options & serop_ReturnIndex) != 0);
+  int fixed = FixedKeySize(keysize);
 
   fetchkey(keybuf, key, keysize, options);
+  keyval = (fixed ? ReadKey(keybuf, keysize) : 0);
   
   bot = 0;
   top = numstructs;
@@ -135,7 +172,14 @@ glui32 binary_search(glui32 key, glui32 keysize,
     val = (top+bot) / 2;
     addr = start + val * structsize;
 
-    if (keysize <= 4) {
+    if (fixed && KeyInMemory(addr + keyoffset, keysize)) {
+      here = ReadKey(memmap + addr + keyoffset, keysize);
+      if (here < keyval)
+        cmp = -1;
+      else if (here > keyval)
+        cmp = 1;
+    }
+    else if (keysize <= 4) {
       for (ix=0; (!cmp) && ix<keysize; ix++) {
         byte = Mem1(addr + keyoffset + ix);
         byte2 = keybuf[ix];
@@ -188,6 +232,7 @@ glui32 binary_search(glui32 key, glui32 keysize,
 glui32 linked_search(glui32 key, glui32 keysize, 
   glui32 start, glui32 keyoffset, glui32 nextoffset, glui32 options)
 {
+  CACHE_VMSTATE;
   unsigned char keybuf[4];
   int ix;
   glui32 val;
@@ -232,6 +277,92 @@ glui32 linked_search(glui32 key, glui32 keysize,
   return 0;
 }
 
+/* linear_scan_fixed():
+   The inner loop of linear_search() for keys of one, two or four bytes,
+   whose value (as a big-endian number) is keyval and whose bytes are in
+   keybuf. This searches from *startptr until it finds a match (setting
+   *result to 1), a zero key when zeroterm is set (setting *result to -1),
+   numstructs structs, or a key it can't load directly (leaving *result
+   zero.) It returns the number of structs it passed over, and leaves
+   *startptr at the first one it didn't.
+*/
+static glui32 linear_scan_fixed(glui32 keyval, glui32 keysize,
+  unsigned char *keybuf, glui32 *startptr, glui32 structsize,
+  glui32 numstructs, glui32 keyoffset, int zeroterm, int *result)
+{
+  glui32 count = 0;
+  glui32 start = *startptr;
+  glui32 addr, here;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+  /* A packed array of keys can be compared sixteen bytes at a time. The
+     comparison is done bytewise, in memory order, so a key matches when
+     all of its bytes do; the first key which matches (or is zero) wins,
+     with a match taking precedence as it does below. */
+  if (structsize == keysize && endmem >= 16) {
+    glui32 lanes = 16 / keysize;
+    glui32 lanebits = (keysize == 4 ? 0x1111 : (keysize == 2 ? 0x5555 : 0xFFFF));
+    unsigned char pattern[16];
+    __m128i keyvec, zerovec;
+    int ix;
+
+    for (ix=0; ix<16; ix++)
+      pattern[ix] = keybuf[ix % keysize];
+    keyvec = _mm_loadu_si128((__m128i *)pattern);
+    zerovec = _mm_setzero_si128();
+
+    while (numstructs - count >= lanes) {
+      __m128i block;
+      unsigned int matches, zeroes, hits;
+      addr = start + keyoffset;
+      if (addr > endmem - 16)
+        break;
+      block = _mm_loadu_si128((__m128i *)(memmap + addr));
+      matches = _mm_movemask_epi8(_mm_cmpeq_epi8(block, keyvec));
+      zeroes = (zeroterm ? _mm_movemask_epi8(_mm_cmpeq_epi8(block, zerovec)) : 0);
+      if (keysize == 4) {
+        matches &= (matches >> 1) & (matches >> 2) & (matches >> 3);
+        zeroes &= (zeroes >> 1) & (zeroes >> 2) & (zeroes >> 3);
+      }
+      else if (keysize == 2) {
+        matches &= (matches >> 1);
+        zeroes &= (zeroes >> 1);
+      }
+      matches &= lanebits;
+      zeroes &= lanebits;
+      hits = matches | zeroes;
+      if (hits) {
+        glui32 lane = __builtin_ctz(hits) / keysize;
+        count += lane;
+        *startptr = start + lane * structsize;
+        *result = ((matches & (1U << (lane * keysize))) ? 1 : -1);
+        return count;
+      }
+      count += lanes;
+      start += 16;
+    }
+  }
+#endif /* __SSE2__ && __GNUC__ */
+
+  for (; count<numstructs; count++, start+=structsize) {
+    addr = start + keyoffset;
+    if (!KeyInMemory(addr, keysize))
+      break;
+    here = ReadKey(memmap + addr, keysize);
+    if (here == keyval) {
+      *result = 1;
+      break;
+    }
+    if (zeroterm && here == 0) {
+      *result = -1;
+      break;
+    }
+  }
+
+  *startptr = start;
+  return count;
+}
+
 /* fetchkey():
    This massages the key into a form that's easier to handle. When it
    returns, the key will be stored in keybuf if keysize <= 4; otherwise,
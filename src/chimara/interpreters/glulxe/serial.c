@@ -29,11 +29,58 @@ typedef struct dest_struct {
 
 /* This can be adjusted before startup by platform-specific startup
    code -- that is, preference code. */
-int max_undo_level = 8;
-
-static int undo_chain_size = 0;
-static int undo_chain_num = 0;
-static unsigned char **undo_chain = NULL;
+THREAD_LOCAL int max_undo_level = 8;
+
+/* Undo-saves keep main memory as a two-level tree of reference-counted
+   pages: a map points to directories of UNDO_DIR_PAGES pages each, and
+   pages (or whole directories) that are the same in two saves are shared
+   between them. Only pages flagged in dirtypages since the last save or
+   restore can differ from current_map, which is the map that memory
+   last matched. */
+#define UNDO_DIR_SHIFT (6)
+#define UNDO_DIR_PAGES (1 << UNDO_DIR_SHIFT)
+
+typedef struct undopage_struct {
+  int refs;
+  unsigned char data[UNDO_PAGE_SIZE];
+} undopage_t;
+
+typedef struct undodir_struct {
+  int refs;
+  undopage_t *pages[UNDO_DIR_PAGES];
+} undodir_t;
+
+typedef struct undomap_struct {
+  int refs;
+  glui32 numpages;
+  glui32 numdirs;
+  undodir_t **dirs;
+} undomap_t;
+
+/* An undo-save: the memory map, plus the heap and stack chunks in the
+   old serialized form. */
+typedef struct undostate_struct {
+  undomap_t *map;
+  unsigned char *rest;
+} undostate_t;
+
+/* dirtypages itself is in vmstate. */
+static THREAD_LOCAL glui32 dirtypages_size = 0;
+static THREAD_LOCAL undomap_t *current_map = NULL;
+
+static THREAD_LOCAL int undo_chain_size = 0;
+static THREAD_LOCAL int undo_chain_num = 0;
+static THREAD_LOCAL undostate_t **undo_chain = NULL;
+
+/* Checkpoints are kept separately from the undo chain, so that the
+   game's own undo is unaffected by a replay. */
+typedef struct checkpoint_struct {
+  glui32 atpc;
+  undostate_t *state;
+  struct checkpoint_struct *next;
+} checkpoint_t;
+
+static THREAD_LOCAL checkpoint_t *checkpoint_chain = NULL;
 
 static glui32 write_memstate(dest_t *dest);
 static glui32 write_heapstate(dest_t *dest, int portable);
@@ -50,6 +97,10 @@ static int read_long(dest_t *dest, glui32 *val);
 static int write_byte(dest_t *dest, unsigned char val);
 static int read_byte(dest_t *dest, unsigned char *val);
 static int reposition_write(dest_t *dest, glui32 pos);
+static undomap_t *snapshot_memory(void);
+static glui32 restore_memory(undomap_t *map);
+static void release_map(undomap_t *map);
+static void free_undostate(undostate_t *state);
 
 /* init_serial():
    Set up the undo chain and anything else that needs to be set up.
@@ -58,10 +109,13 @@ int init_serial()
 {
   undo_chain_num = 0;
   undo_chain_size = max_undo_level;
-  undo_chain = (unsigned char **)glulx_malloc(sizeof(unsigned char *) * undo_chain_size);
+  undo_chain = (undostate_t **)glulx_malloc(sizeof(undostate_t *) * undo_chain_size);
   if (!undo_chain)
     return FALSE;
 
+  if (grow_dirty_pages(endmem))
+    return FALSE;
+
   return TRUE;
 }
 
@@ -73,33 +127,284 @@ void final_serial()
   if (undo_chain) {
     int ix;
     for (ix=0; ix<undo_chain_num; ix++) {
-      glulx_free(undo_chain[ix]);
+      free_undostate(undo_chain[ix]);
     }
     glulx_free(undo_chain);
   }
   undo_chain = NULL;
   undo_chain_size = 0;
   undo_chain_num = 0;
+
+  while (checkpoint_chain)
+    perform_checkpoint_discard();
+
+  if (current_map) {
+    release_map(current_map);
+    current_map = NULL;
+  }
+  if (dirtypages) {
+    glulx_free(dirtypages);
+    dirtypages = NULL;
+  }
+  dirtypages_size = 0;
 }
 
-/* perform_saveundo():
-   Add a state pointer to the undo chain. This returns 0 on success,
-   1 on failure.
+/* grow_dirty_pages():
+   Make sure there is a dirty flag for every page of a memory map newlen
+   bytes long. The array never shrinks. This returns 0 on success, 1 on
+   failure.
 */
-glui32 perform_saveundo()
+int grow_dirty_pages(glui32 newlen)
+{
+  glui32 count = (newlen >> UNDO_PAGE_SHIFT) + 1;
+  unsigned char *newpages;
+
+  if (count <= dirtypages_size)
+    return 0;
+
+  newpages = (unsigned char *)glulx_realloc(dirtypages, count);
+  if (!newpages)
+    return 1;
+  memset(newpages+dirtypages_size, 1, count-dirtypages_size);
+  dirtypages = newpages;
+  dirtypages_size = count;
+  return 0;
+}
+
+/* mark_dirty_pages():
+   Flag every page in the range [start, end) as changed. This is for
+   code that writes to memmap directly rather than through MemW.
+*/
+void mark_dirty_pages(glui32 start, glui32 end)
+{
+  if (end <= start)
+    return;
+  accel_note_write_range(start, end);
+  start >>= UNDO_PAGE_SHIFT;
+  end = ((end-1) >> UNDO_PAGE_SHIFT) + 1;
+  if (end > dirtypages_size)
+    end = dirtypages_size;
+  if (start < end)
+    memset(dirtypages+start, 1, end-start);
+}
+
+static void release_page(undopage_t *page)
+{
+  if (page && --page->refs == 0)
+    glulx_free(page);
+}
+
+static void release_dir(undodir_t *dir)
+{
+  int ix;
+
+  if (!dir || --dir->refs > 0)
+    return;
+  for (ix=0; ix<UNDO_DIR_PAGES; ix++)
+    release_page(dir->pages[ix]);
+  glulx_free(dir);
+}
+
+static void release_map(undomap_t *map)
+{
+  glui32 ix;
+
+  if (!map || --map->refs > 0)
+    return;
+  for (ix=0; ix<map->numdirs; ix++)
+    release_dir(map->dirs[ix]);
+  glulx_free(map->dirs);
+  glulx_free(map);
+}
+
+static void free_undostate(undostate_t *state)
+{
+  release_map(state->map);
+  glulx_free(state->rest);
+  glulx_free(state);
+}
+
+/* map_page():
+   Return the page of the map holding memory page px, or NULL if the map
+   does not reach that far.
+*/
+static undopage_t *map_page(undomap_t *map, glui32 px)
+{
+  if (!map || px >= map->numpages)
+    return NULL;
+  return map->dirs[px >> UNDO_DIR_SHIFT]->pages[px & (UNDO_DIR_PAGES-1)];
+}
+
+/* snapshot_memory():
+   Build a map of RAM as it is now, and make it the current map. Pages
+   which are not dirty, or which are dirty but were written back with
+   the same contents, are shared with the previous current map; so are
+   whole directories with no dirty pages. The caller gets one reference
+   to the result. Returns NULL on allocation failure.
+*/
+static undomap_t *snapshot_memory()
+{
+  undomap_t *old = current_map;
+  undomap_t *map;
+  glui32 firstpage = ramstart >> UNDO_PAGE_SHIFT;
+  glui32 dx, px, pagestart, pageend;
+
+  map = (undomap_t *)glulx_malloc(sizeof(undomap_t));
+  if (!map)
+    return NULL;
+  map->refs = 1;
+  map->numpages = endmem >> UNDO_PAGE_SHIFT;
+  map->numdirs = (map->numpages + UNDO_DIR_PAGES - 1) >> UNDO_DIR_SHIFT;
+  map->dirs = (undodir_t **)glulx_malloc(map->numdirs * sizeof(undodir_t *));
+  if (!map->dirs) {
+    glulx_free(map);
+    return NULL;
+  }
+  for (dx=0; dx<map->numdirs; dx++)
+    map->dirs[dx] = NULL;
+
+  for (dx=0; dx<map->numdirs; dx++) {
+    undodir_t *dir;
+    int changed = FALSE;
+
+    pagestart = dx << UNDO_DIR_SHIFT;
+    pageend = pagestart + UNDO_DIR_PAGES;
+    if (pageend > map->numpages)
+      pageend = map->numpages;
+
+    if (!old || pageend > old->numpages) {
+      changed = TRUE;
+    }
+    else {
+      for (px=pagestart; px<pageend; px++) {
+        if (dirtypages[px] && px >= firstpage) {
+          changed = TRUE;
+          break;
+        }
+      }
+    }
+    if (!changed) {
+      dir = old->dirs[dx];
+      dir->refs++;
+      map->dirs[dx] = dir;
+      continue;
+    }
+
+    dir = (undodir_t *)glulx_malloc(sizeof(undodir_t));
+    if (!dir) {
+      release_map(map);
+      return NULL;
+    }
+    dir->refs = 1;
+    for (px=0; px<UNDO_DIR_PAGES; px++)
+      dir->pages[px] = NULL;
+    map->dirs[dx] = dir;
+
+    for (px=pagestart; px<pageend; px++) {
+      unsigned char *mem = memmap + (px << UNDO_PAGE_SHIFT);
+      undopage_t *page;
+      if (px < firstpage)
+        continue;
+      page = map_page(old, px);
+      if (page && (!dirtypages[px]
+          || !memcmp(page->data, mem, UNDO_PAGE_SIZE))) {
+        page->refs++;
+      }
+      else {
+        page = (undopage_t *)glulx_malloc(sizeof(undopage_t));
+        if (!page) {
+          release_map(map);
+          return NULL;
+        }
+        page->refs = 1;
+        memcpy(page->data, mem, UNDO_PAGE_SIZE);
+      }
+      dir->pages[px - pagestart] = page;
+    }
+  }
+
+  memset(dirtypages, 0, map->numpages);
+  if (old)
+    release_map(old);
+  map->refs++;
+  current_map = map;
+  return map;
+}
+
+/* restore_memory():
+   Copy a map back into RAM, resizing memory to match. Only pages that
+   differ from the current map, or have been written since, are copied.
+   The protected range is left alone. This returns 0 on success, 1 on
+   failure.
+*/
+static glui32 restore_memory(undomap_t *map)
+{
+  glui32 firstpage = ramstart >> UNDO_PAGE_SHIFT;
+  glui32 px, addr, res;
+
+  heap_clear();
+
+  res = change_memsize(map->numpages << UNDO_PAGE_SHIFT, FALSE);
+  if (res)
+    return res;
+
+  for (px=firstpage; px<map->numpages; px++) {
+    undopage_t *page = map_page(map, px);
+    if (!dirtypages[px] && page == map_page(current_map, px))
+      continue;
+    addr = px << UNDO_PAGE_SHIFT;
+    accel_note_write_range(addr, addr+UNDO_PAGE_SIZE);
+    if (addr+UNDO_PAGE_SIZE <= protectstart || addr >= protectend) {
+      memcpy(memmap+addr, page->data, UNDO_PAGE_SIZE);
+    }
+    else {
+      glui32 ix;
+      for (ix=0; ix<UNDO_PAGE_SIZE; ix++) {
+        if (addr+ix >= protectstart && addr+ix < protectend)
+          continue;
+        memmap[addr+ix] = page->data[ix];
+      }
+    }
+  }
+
+  memset(dirtypages, 0, map->numpages);
+  map->refs++;
+  if (current_map)
+    release_map(current_map);
+  current_map = map;
+  /* The protected bytes were not restored, so those pages may not
+     match the map. */
+  mark_dirty_pages(protectstart, protectend);
+  return 0;
+}
+
+/* write_undostate():
+   Capture the memory, heap, and stack state into a newly allocated
+   undo-save. This returns 0 on success, 1 on failure.
+*/
+static glui32 write_undostate(undostate_t **result)
 {
   dest_t dest;
   glui32 res;
-  glui32 memstart, memlen, heapstart, heaplen, stackstart, stacklen;
-
-  /* The format for undo-saves is simpler than for saves on disk. We
-     just have a memory chunk, a heap chunk, and a stack chunk, in
-     that order. We skip the IFF chunk headers (although the size
-     fields are still there.) We also don't bother with IFF's 16-bit
+  glui32 heapstart, heaplen, stackstart, stacklen;
+  undostate_t *state;
+
+  /* Memory goes into a page map, sharing whatever has not changed
+     since the last undo-save. The heap and stack are serialized in a
+     format simpler than for saves on disk: a heap chunk, then a stack
+     chunk. We skip the IFF chunk headers (although the size fields
+     are still there.) We also don't bother with IFF's 16-bit
      alignment. */
 
-  if (undo_chain_size == 0)
+  state = (undostate_t *)glulx_malloc(sizeof(undostate_t));
+  if (!state)
+    return 1;
+  state->map = snapshot_memory();
+  state->rest = NULL;
+  if (!state->map) {
+    glulx_free(state);
     return 1;
+  }
 
   dest.ismem = TRUE;
   dest.size = 0;
@@ -111,14 +416,6 @@ glui32 perform_saveundo()
   if (res == 0) {
     res = write_long(&dest, 0); /* space for chunk length */
   }
-  if (res == 0) {
-    memstart = dest.pos;
-    res = write_memstate(&dest);
-    memlen = dest.pos - memstart;
-  }
-  if (res == 0) {
-    res = write_long(&dest, 0); /* space for chunk length */
-  }
   if (res == 0) {
     heapstart = dest.pos;
     res = write_heapstate(&dest, FALSE);
@@ -139,12 +436,6 @@ glui32 perform_saveundo()
     if (!dest.ptr)
       res = 1;
   }
-  if (res == 0) {
-    res = reposition_write(&dest, memstart-4);
-  }
-  if (res == 0) {
-    res = write_long(&dest, memlen);
-  }
   if (res == 0) {
     res = reposition_write(&dest, heapstart-4);
   }
@@ -159,58 +450,38 @@ glui32 perform_saveundo()
   }
 
   if (res == 0) {
-    /* It worked. */
-    if (undo_chain_num >= undo_chain_size) {
-      glulx_free(undo_chain[undo_chain_num-1]);
-      undo_chain[undo_chain_num-1] = NULL;
-    }
-    if (undo_chain_size > 1)
-      memmove(undo_chain+1, undo_chain, 
-        (undo_chain_size-1) * sizeof(unsigned char *));
-    undo_chain[0] = dest.ptr;
-    if (undo_chain_num < undo_chain_size)
-      undo_chain_num += 1;
-    dest.ptr = NULL;
+    state->rest = dest.ptr;
+    *result = state;
   }
   else {
-    /* It didn't work. */
-    if (dest.ptr) {
+    if (dest.ptr)
       glulx_free(dest.ptr);
-      dest.ptr = NULL;
-    }
+    free_undostate(state);
   }
-    
   return res;
 }
 
-/* perform_restoreundo():
-   Pull a state pointer from the undo chain. This returns 0 on success,
-   1 on failure. Note that if it succeeds, the frameptr, localsbase,
-   and valstackbase registers are invalid; they must be rebuilt from
-   the stack.
+/* read_undostate():
+   Load the memory, heap, and stack state from an undo-save written by
+   write_undostate(). The undo-save is not freed. This returns 0 on
+   success, 1 on failure.
 */
-glui32 perform_restoreundo()
+static glui32 read_undostate(undostate_t *state)
 {
   dest_t dest;
   glui32 res, val;
   glui32 heapsumlen = 0;
   glui32 *heapsumarr = NULL;
 
-  if (undo_chain_size == 0 || undo_chain_num == 0)
-    return 1;
-
   dest.ismem = TRUE;
   dest.size = 0;
   dest.pos = 0;
-  dest.ptr = undo_chain[0];
+  dest.ptr = state->rest;
   dest.str = NULL;
 
   res = 0;
   if (res == 0) {
-    res = read_long(&dest, &val);
-  }
-  if (res == 0) {
-    res = read_memstate(&dest, val);
+    res = restore_memory(state->map);
   }
   if (res == 0) {
     res = read_long(&dest, &val);
@@ -232,23 +503,138 @@ glui32 perform_restoreundo()
       res = heap_apply_summary(heapsumlen, heapsumarr);
   }
 
+  return res;
+}
+
+/* perform_saveundo():
+   Add a state pointer to the undo chain. This returns 0 on success,
+   1 on failure.
+*/
+glui32 perform_saveundo()
+{
+  undostate_t *ptr = NULL;
+  glui32 res;
+
+  if (undo_chain_size == 0)
+    return 1;
+
+  res = write_undostate(&ptr);
+
+  if (res == 0) {
+    /* It worked. */
+    if (undo_chain_num >= undo_chain_size) {
+      free_undostate(undo_chain[undo_chain_num-1]);
+      undo_chain[undo_chain_num-1] = NULL;
+    }
+    if (undo_chain_size > 1)
+      memmove(undo_chain+1, undo_chain, 
+        (undo_chain_size-1) * sizeof(undostate_t *));
+    undo_chain[0] = ptr;
+    if (undo_chain_num < undo_chain_size)
+      undo_chain_num += 1;
+  }
+    
+  return res;
+}
+
+/* perform_restoreundo():
+   Pull a state pointer from the undo chain. This returns 0 on success,
+   1 on failure. Note that if it succeeds, the frameptr, localsbase,
+   and valstackbase registers are invalid; they must be rebuilt from
+   the stack.
+*/
+glui32 perform_restoreundo()
+{
+  undostate_t *ptr;
+  glui32 res;
+
+  if (undo_chain_size == 0 || undo_chain_num == 0)
+    return 1;
+
+  ptr = undo_chain[0];
+  res = read_undostate(ptr);
+
   if (res == 0) {
     /* It worked. */
     if (undo_chain_size > 1)
       memmove(undo_chain, undo_chain+1,
-        (undo_chain_size-1) * sizeof(unsigned char *));
+        (undo_chain_size-1) * sizeof(undostate_t *));
     undo_chain_num -= 1;
-    glulx_free(dest.ptr);
-    dest.ptr = NULL;
+    free_undostate(ptr);
+  }
+
+  return res;
+}
+
+/* perform_checkpoint_save():
+   Push a checkpoint, for the library to restore while replaying a
+   tree of commands. This is called from inside glk_select(), so the
+   call stub records the pc just after the @glk opcode; restoring the
+   checkpoint resumes execution there. This returns 0 on success, 1 on
+   failure.
+*/
+glui32 perform_checkpoint_save()
+{
+  checkpoint_t *chk;
+  glui32 res;
+
+  chk = (checkpoint_t *)glulx_malloc(sizeof(checkpoint_t));
+  if (!chk)
+    return 1;
+  chk->atpc = pc;
+
+  push_callstub(0, 0);
+  res = write_undostate(&chk->state);
+  pop_callstub(0);
+
+  if (res == 0) {
+    chk->next = checkpoint_chain;
+    checkpoint_chain = chk;
   }
   else {
-    /* It didn't work. */
-    dest.ptr = NULL;
+    glulx_free(chk);
   }
+  return res;
+}
 
+/* perform_checkpoint_restore():
+   Go back to the most recent checkpoint, without removing it. This
+   only works if the game is waiting in the same @glk opcode as when
+   the checkpoint was taken; otherwise the pending glk_select() result
+   would be stored in the wrong place. This returns 0 on success, 1 on
+   failure.
+*/
+glui32 perform_checkpoint_restore()
+{
+  glui32 res;
+
+  if (!checkpoint_chain || checkpoint_chain->atpc != pc)
+    return 1;
+
+  res = read_undostate(checkpoint_chain->state);
+  if (res == 0) {
+    /* The stack now contains the call stub pushed in
+       perform_checkpoint_save(). */
+    accel_verify_unwind(0);
+    pop_callstub(0);
+  }
   return res;
 }
 
+/* perform_checkpoint_discard():
+   Remove the most recent checkpoint.
+*/
+void perform_checkpoint_discard()
+{
+  checkpoint_t *chk = checkpoint_chain;
+
+  if (!chk)
+    return;
+  checkpoint_chain = chk->next;
+  free_undostate(chk->state);
+  glulx_free(chk);
+}
+
 /* perform_save():
    Write the state to the output stream. This returns 0 on success,
    1 on failure.
@@ -3,11 +3,12 @@
     http://eblong.com/zarf/glulx/index.html
 */
 
+#include <string.h>
 #include "glk.h"
 #include "glulxe.h"
 
-static glui32 iosys_mode;
-static glui32 iosys_rock;
+static THREAD_LOCAL glui32 iosys_mode;
+static THREAD_LOCAL glui32 iosys_rock;
 /* These constants are defined in the Glulx spec. */
 #define iosys_None (0)
 #define iosys_Filter (1)
@@ -29,9 +30,44 @@ typedef struct cacheblock_struct {
 } cacheblock_t;
 
 /* The current string-decoding tables, broken out into a fast and
-   easy-to-use form. */
-static int tablecache_valid = FALSE;
-static cacheblock_t tablecache;
+   easy-to-use form. A table that lies partly in RAM has its words
+   flagged with accel_watch_range(); if the game writes to one, the
+   cache is dropped (stream_note_write) and rebuilt the next time a
+   compressed string is printed. */
+static THREAD_LOCAL int tablecache_valid = FALSE;
+static THREAD_LOCAL int tablecache_stale = FALSE;
+static THREAD_LOCAL int tablecache_inram = FALSE;
+static THREAD_LOCAL cacheblock_t tablecache;
+
+/* For printing to Glk, the cache is backed by a table that decodes
+   several characters at a time. It is indexed by the next FASTBITS
+   bits of the string, and each entry gives the plain characters that
+   those bits begin with (as many as will fit) and how many bits they
+   take up. The characters are collected in a buffer and passed to
+   glk_put_buffer() together. An entry with no characters means the
+   next node is something else -- a Unicode character, a substring, the
+   end of the string, or a character with a longer code than FASTBITS
+   -- and the ordinary cache handles it. */
+#define FASTBITS (12)
+#define FASTSIZE (1<<FASTBITS)
+#define FASTMASK (FASTSIZE-1)
+#define FASTCHARS (6)
+
+typedef struct fastentry_struct {
+  unsigned char numbits;
+  unsigned char numchars;
+  unsigned char chars[FASTCHARS];
+} fastentry_t;
+
+static THREAD_LOCAL fastentry_t *fasttable = NULL;
+
+#define FAST_BUFSIZE (256)
+
+/* After a fast run that decodes fewer than FASTCHARS characters, the
+   next FASTBACKOFF nodes skip the table. Strings that mix plain
+   characters with other nodes one by one would otherwise pay for a
+   table lookup and a fresh bit read on every node. */
+#define FASTBACKOFF (8)
 
 static void stream_setup_unichar(void);
 
@@ -40,11 +76,14 @@ static void filio_char_han(unsigned char ch);
 static void nopio_unichar_han(glui32 ch);
 static void filio_unichar_han(glui32 ch);
 static void glkio_unichar_nouni_han(glui32 val);
-static void (*glkio_unichar_han_ptr)(glui32 val) = NULL;
+static THREAD_LOCAL void (*glkio_unichar_han_ptr)(glui32 val) = NULL;
 
+static void drop_tablecache(void);
+static void build_tablecache(void);
 static void dropcache(cacheblock_t *cablist);
 static void buildcache(cacheblock_t *cablist, glui32 nodeaddr, int depth,
   int mask);
+static void buildfasttable(glui32 rootaddr);
 static void dumpcache(cacheblock_t *cablist, int count, int indent);
 
 void stream_get_iosys(glui32 *mode, glui32 *rock)
@@ -202,6 +241,7 @@ void stream_num(glsi32 val, int inmiddle, int charnum)
 */
 void stream_string(glui32 addr, int inmiddle, int bitnum)
 {
+  CACHE_VMSTATE;
   int ch;
   int type;
   int alldone = FALSE;
@@ -210,6 +250,9 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
 
   if (!addr)
     fatal_error("Called stream_string with null address.");
+
+  if (tablecache_stale)
+    build_tablecache();
   
   while (!alldone) {
 
@@ -232,6 +275,9 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
         glui32 tmpaddr;
         cacheblock_t *cablist;
         int done = 0;
+        cacheblock_t *rootlist;
+        fastentry_t *fast;
+        int fastskip = 0;
 
         /* bitnum is already set right */
         bits = Mem1(addr); 
@@ -248,10 +294,59 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
           done = 1;
         }
 
-        cablist = tablecache.u.branches;
+        /* Keep these in locals; each mention of a thread-local costs a
+           call in a shared library. */
+        rootlist = tablecache.u.branches;
+        fast = (iosys_mode == iosys_Glk) ? fasttable : NULL;
+
+        cablist = rootlist;
         while (!done) {
           cacheblock_t *cab;
 
+          if (fast && cablist == rootlist) {
+            if (fastskip) {
+              /* The last fast run was short, so this string is mostly
+                 nodes the table can't decode. Let the ordinary cache
+                 take the next few before trying again. */
+              fastskip--;
+            }
+            else {
+              /* Between characters: decode as many as possible through
+                 the fast table. It reads three bytes at a time, so stop
+                 short of the end of memory. */
+              char buf[FAST_BUFSIZE];
+              int buflen = 0;
+              while (addr+3 <= endmem) {
+                glui32 val = (Mem1(addr) | (Mem1(addr+1) << 8)
+                  | (Mem1(addr+2) << 16)) >> bitnum;
+                fastentry_t *fe = &(fast[val & FASTMASK]);
+                if (!fe->numchars)
+                  break;
+                if (buflen + FASTCHARS > FAST_BUFSIZE) {
+                  glk_put_buffer(buf, buflen);
+                  buflen = 0;
+                }
+                memcpy(buf+buflen, fe->chars, FASTCHARS);
+                buflen += fe->numchars;
+                bitnum += fe->numbits;
+                addr += (bitnum >> 3);
+                bitnum &= 7;
+              }
+              if (buflen < FASTCHARS)
+                fastskip = FASTBACKOFF;
+              if (buflen == 1)
+                glk_put_char(buf[0]);
+              else if (buflen)
+                glk_put_buffer(buf, buflen);
+              /* Start reading bits afresh for the ordinary cache. */
+              bits = Mem1(addr);
+              if (bitnum)
+                bits >>= bitnum;
+              numbits = (8 - bitnum);
+              readahead = FALSE;
+            }
+          }
+
           if (numbits < CACHEBITS) {
             /* readahead is certainly false */
             int newbyte = Mem1(addr+1);
@@ -300,7 +395,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               enter_function(iosys_rock, 1, &ival);
               return;
             }
-            cablist = tablecache.u.branches;
+            cablist = rootlist;
             break;
           case 0x04: /* single Unicode character */
             switch (iosys_mode) {
@@ -318,14 +413,14 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               enter_function(iosys_rock, 1, &ival);
               return;
             }
-            cablist = tablecache.u.branches;
+            cablist = rootlist;
             break;
           case 0x03: /* C string */
             switch (iosys_mode) {
             case iosys_Glk:
               for (tmpaddr=cab->u.addr; (ch=Mem1(tmpaddr)) != '\0'; tmpaddr++) 
                 glk_put_char(ch);
-              cablist = tablecache.u.branches; 
+              cablist = rootlist; 
               break;
             case iosys_Filter:
               if (!substring) {
@@ -339,7 +434,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               done = 2;
               break;
             default:
-              cablist = tablecache.u.branches; 
+              cablist = rootlist; 
               break;
             }
             break;
@@ -348,7 +443,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
             case iosys_Glk:
               for (tmpaddr=cab->u.addr; (ival=Mem4(tmpaddr)) != 0; tmpaddr+=4) 
                 glkio_unichar_han_ptr(ival);
-              cablist = tablecache.u.branches; 
+              cablist = rootlist; 
               break;
             case iosys_Filter:
               if (!substring) {
@@ -362,7 +457,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               done = 2;
               break;
             default:
-              cablist = tablecache.u.branches; 
+              cablist = rootlist; 
               break;
             }
             break;
@@ -686,29 +781,67 @@ void stream_set_table(glui32 addr)
   if (stringtable == addr)
     return;
 
-  /* Drop cache. */
+  drop_tablecache();
+
+  stringtable = addr;
+
+  build_tablecache();
+}
+
+/* stream_note_write():
+   Called (by accel_note_write) when the game writes to a word of memory
+   that a cache depends on. That may be the string table, if it's in
+   RAM.
+*/
+void stream_note_write()
+{
+  if (tablecache_inram) {
+    drop_tablecache();
+    tablecache_stale = TRUE;
+  }
+}
+
+static void drop_tablecache()
+{
   if (tablecache_valid) {
     if (tablecache.type == 0)
       dropcache(tablecache.u.branches);
     tablecache.u.branches = NULL;
     tablecache_valid = FALSE;
   }
+  if (fasttable) {
+    glulx_free(fasttable);
+    fasttable = NULL;
+  }
+  tablecache_inram = FALSE;
+  tablecache_stale = FALSE;
+}
 
-  stringtable = addr;
+static void build_tablecache()
+{
+  glui32 tablelen, rootaddr;
 
-  if (stringtable) {
-    /* Build cache. We can only do this if the table is entirely in ROM. */
-    glui32 tablelen = Mem4(stringtable);
-    glui32 rootaddr = Mem4(stringtable+8);
-    int cache_stringtable = (stringtable+tablelen <= ramstart);
-    /* cache_stringtable = TRUE; ...for testing only */
-    /* cache_stringtable = FALSE; ...for testing only */
-    if (cache_stringtable) {
-      buildcache(&tablecache, rootaddr, CACHEBITS, 0);
-      /* dumpcache(&tablecache, 1, 0); */
-      tablecache_valid = TRUE;
-    }
+  tablecache_stale = FALSE;
+
+  if (!stringtable)
+    return;
+
+  tablelen = Mem4(stringtable);
+  rootaddr = Mem4(stringtable+8);
+
+  /* A table in RAM can only be cached if its words can be watched. */
+  if (stringtable+tablelen > ramstart) {
+    if (!accel_watch_range(stringtable, stringtable+tablelen))
+      return;
+    tablecache_inram = TRUE;
   }
+
+  buildcache(&tablecache, rootaddr, CACHEBITS, 0);
+  /* dumpcache(&tablecache, 1, 0); */
+  tablecache_valid = TRUE;
+
+  if (Mem1(rootaddr) == 0x00)
+    buildfasttable(rootaddr);
 }
 
 static void buildcache(cacheblock_t *cablist, glui32 nodeaddr, int depth,
@@ -764,6 +897,40 @@ static void buildcache(cacheblock_t *cablist, glui32 nodeaddr, int depth,
   }
 }
 
+static void buildfasttable(glui32 rootaddr)
+{
+  glui32 ix;
+
+  fasttable = (fastentry_t *)glulx_malloc(sizeof(fastentry_t) * FASTSIZE);
+  if (!fasttable)
+    return;
+
+  for (ix=0; ix<FASTSIZE; ix++) {
+    fastentry_t *fe = &(fasttable[ix]);
+    glui32 node = rootaddr;
+    int bit = 0;
+
+    memset(fe, 0, sizeof(fastentry_t));
+    while (fe->numchars < FASTCHARS) {
+      int type = Mem1(node);
+      if (type == 0x00) {
+        if (bit == FASTBITS)
+          break;
+        node = Mem4(node+1 + (((ix >> bit) & 1) ? 4 : 0));
+        bit++;
+      }
+      else if (type == 0x02) {
+        fe->chars[fe->numchars++] = Mem1(node+1);
+        fe->numbits = bit;
+        node = rootaddr;
+      }
+      else {
+        break;
+      }
+    }
+  }
+}
+
 #if 0
 #include <stdio.h>
 static void dumpcache(cacheblock_t *cablist, int count, int indent)
@@ -814,7 +981,7 @@ static void dropcache(cacheblock_t *cablist)
 /* This misbehaves if a Glk function has more than one S argument. */
 
 #define STATIC_TEMP_BUFSIZE (127)
-static char temp_buf[STATIC_TEMP_BUFSIZE+1];
+static THREAD_LOCAL char temp_buf[STATIC_TEMP_BUFSIZE+1];
 
 char *make_temp_string(glui32 addr)
 {
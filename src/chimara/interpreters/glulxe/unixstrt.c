@@ -23,11 +23,19 @@ glkunix_argumentlist_t glkunix_arguments[] = {
   { "--profile", glkunix_arg_ValueFollows, "Generate profiling information to a file." },
 #endif /* VM_PROFILING */
 
+  { "--verify-accel", glkunix_arg_NoValue, "Check accelerated functions against the game's own code." },
+
   { "", glkunix_arg_ValueFollows, "filename: The game file to load." },
 
   { NULL, glkunix_arg_End, NULL }
 };
 
+#ifdef GLKUNIX_REENTRANT
+/* All of the VM state is THREAD_LOCAL, so several games can share this
+   copy of Glulxe. */
+const int glkunix_reentrant = TRUE;
+#endif /* GLKUNIX_REENTRANT */
+
 int glkunix_startup_code(glkunix_startup_t *data)
 {
   /* It turns out to be more convenient if we return TRUE from here, even 
@@ -46,6 +54,15 @@ int glkunix_startup_code(glkunix_startup_t *data)
   garglk_set_program_info("Glulxe 0.5.2 by Andrew Plotkin");
 #endif
 
+#ifdef GLKUNIX_CHECKPOINTS
+  glkunix_set_checkpoint_functions(perform_checkpoint_save,
+    perform_checkpoint_restore, perform_checkpoint_discard);
+#endif
+
+#ifdef GLKUNIX_PROFILER
+  glkunix_set_profiler_functions(sample_start, sample_stop);
+#endif
+
   /* Parse out the arguments. They've already been checked for validity,
      and the library-specific ones stripped out.
      As usual for Unix, the zeroth argument is the executable name. */
@@ -67,6 +84,11 @@ int glkunix_startup_code(glkunix_startup_t *data)
     }
 #endif /* VM_PROFILING */
 
+    if (!strcmp(data->argv[ix], "--verify-accel")) {
+      accel_verifying = TRUE;
+      continue;
+    }
+
     if (filename) {
       init_err = "You must supply exactly one game file.";
       return TRUE;
@@ -6,36 +6,34 @@
 #include "glk.h"
 #include "glulxe.h"
 
-/* The memory blocks which contain VM main memory and the stack. */
-unsigned char *memmap = NULL;
-unsigned char *stack = NULL;
+/* The memory blocks which contain VM main memory and the stack, the
+   VM registers, and the other state in vmstate_t. (prevpc is not needed
+   for VM operation, but it may be needed for autosave/autorestore.) */
+THREAD_LOCAL vmstate_t vmstate[1];
 
 /* Various memory addresses which are useful. These are loaded in from
-   the game file header. */
-glui32 ramstart;
-glui32 endgamefile;
-glui32 origendmem;
-glui32 stacksize;
-glui32 startfuncaddr;
-glui32 origstringtable;
-glui32 checksum;
-
-/* The VM registers. */
-glui32 stackptr;
-glui32 frameptr;
-glui32 pc;
-glui32 stringtable;
-glui32 valstackbase;
-glui32 localsbase;
-glui32 endmem;
-glui32 protectstart, protectend;
-
-/* This is not needed for VM operation, but it may be needed for
-   autosave/autorestore. */
-glui32 prevpc;
-
-void (*stream_char_handler)(unsigned char ch);
-void (*stream_unichar_handler)(glui32 ch);
+   the game file header. (ramstart and stacksize are in vmstate.) */
+THREAD_LOCAL glui32 endgamefile;
+THREAD_LOCAL glui32 origendmem;
+THREAD_LOCAL glui32 startfuncaddr;
+THREAD_LOCAL glui32 origstringtable;
+THREAD_LOCAL glui32 checksum;
+
+/* The string table register. */
+THREAD_LOCAL glui32 stringtable;
+
+/* vmstate_address():
+   Return the address of this thread's vmstate, for CACHE_VMSTATE. This
+   is not inline, so that the compiler keeps the result rather than
+   looking up the thread-local storage again at every use.
+*/
+vmstate_t *vmstate_address()
+{
+  return vmstate;
+}
+
+THREAD_LOCAL void (*stream_char_handler)(unsigned char ch);
+THREAD_LOCAL void (*stream_unichar_handler)(glui32 ch);
 
 /* setup_vm():
    Read in the game file and build the machine, allocating all the memory
@@ -113,7 +111,8 @@ void setup_vm()
   /* Initialize various other things in the terp. */
   init_operands(); 
   init_accel();
-  init_serial();
+  if (!init_serial())
+    fatal_error("Unable to allocate Glulx undo space.");
 
   /* Set up the initial machine state. */
   vm_restart();
@@ -170,6 +169,8 @@ void vm_restart()
   for (lx=endgamefile; lx<origendmem; lx++) {
     memmap[lx] = 0;
   }
+  /* Those stores bypassed MemW1, so flag the pages by hand. */
+  mark_dirty_pages(ramstart, origendmem);
 
   /* Reset all the registers */
   stackptr = 0;
@@ -217,6 +218,9 @@ glui32 change_memsize(glui32 newlen, int internal)
   if (newlen & 0xFF)
     fatal_error("Can only resize Glulx memory space to a 256-byte boundary.");
   
+  if (grow_dirty_pages(newlen))
+    return 1;
+
   newmemmap = (unsigned char *)glulx_realloc(memmap, newlen);
   if (!newmemmap) {
     /* The old block is still in place, unchanged. */
@@ -228,6 +232,7 @@ glui32 change_memsize(glui32 newlen, int internal)
     for (lx=endmem; lx<newlen; lx++) {
       memmap[lx] = 0;
     }
+    mark_dirty_pages(endmem, newlen);
   }
 
   endmem = newlen;
@@ -250,9 +255,9 @@ glui32 *pop_arguments(glui32 count, glui32 addr)
   glui32 *array;
 
   #define MAXARGS (32)
-  static glui32 statarray[MAXARGS];
-  static glui32 *dynarray = NULL;
-  static glui32 dynarray_size = 0;
+  static THREAD_LOCAL glui32 statarray[MAXARGS];
+  static THREAD_LOCAL glui32 *dynarray = NULL;
+  static THREAD_LOCAL glui32 dynarray_size = 0;
 
   if (count == 0)
     return NULL;
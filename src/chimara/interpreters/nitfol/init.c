@@ -330,6 +330,7 @@ void z_init(strid_t zfile)
   bytes_read = glk_get_buffer_stream(zfile, (char *) z_memory, game_size);
   if(bytes_read != game_size)
     n_show_fatal(E_SYSTEM, "unexpected number of bytes read", bytes_read);
+  forget_dictionaries();
 
   z_checksum = 0;
   if (zversion >= 3) {
@@ -47,11 +47,88 @@ static int cmpdictentry(const void *a, const void *b)
 }
 
 
+/* Tokenising looks up every word in the dictionary, and the smart
+   tokeniser tries many more variations of words it doesn't find.  So
+   the first time a dictionary in static memory is used, its entries are
+   put into a hash table keyed on their encoded text.  Static memory
+   can't change, so the index stays good until another game is loaded.
+   Dictionaries in dynamic memory are searched directly as before. */
+struct dict_index {
+  struct dict_index *next;
+  zword dictionarytable;
+  zword base;
+  int entry_length;
+  unsigned long mask;
+  zword *slots;          /* entry number + 1, or 0 if unused */
+};
+
+static struct dict_index *dict_indices;
+
+void forget_dictionaries(void)
+{
+  while(dict_indices) {
+    struct dict_index *next = dict_indices->next;
+    n_free(dict_indices->slots);
+    n_free(dict_indices);
+    dict_indices = next;
+  }
+}
+
+static unsigned long hash_dictentry(const zbyte *p)
+{
+  unsigned long hash = 2166136261UL;
+  int i;
+  for(i = 0; i < dictentry_len; i++)
+    hash = ((hash ^ p[i]) * 16777619UL) & 0xffffffffUL;
+  return hash;
+}
+
+/* If there are duplicate entries, the first one wins, as it would with
+   n_lfind */
+static struct dict_index *index_dictionary(zword dictionarytable,
+					   zword base, int entry_length,
+					   int num_entries)
+{
+  struct dict_index *d;
+  unsigned long size = 16;
+  int i;
+
+  for(d = dict_indices; d; d=d->next)
+    if(d->dictionarytable == dictionarytable)
+      return d;
+
+  while(size < 2UL * num_entries)
+    size *= 2;
+
+  d = (struct dict_index *) n_malloc(sizeof(*d));
+  d->slots = (zword *) n_calloc(size, sizeof(*d->slots));
+  d->dictionarytable = dictionarytable;
+  d->base = base;
+  d->entry_length = entry_length;
+  d->mask = size - 1;
+
+  for(i = 0; i < num_entries; i++) {
+    const zbyte *entry = z_memory + base + i * entry_length;
+    unsigned long slot = hash_dictentry(entry) & d->mask;
+    while(d->slots[slot]
+	  && cmpdictentry(entry, z_memory + base
+			  + (d->slots[slot] - 1) * entry_length) != 0)
+      slot = (slot + 1) & d->mask;
+    if(!d->slots[slot])
+      d->slots[slot] = i + 1;
+  }
+
+  d->next = dict_indices;
+  dict_indices = d;
+  return d;
+}
+
 static zword find_word(zword dictionarytable, const char *word, int length)
 {
   zbyte zsciibuffer[12];
   int entry_length, word_length;
   int num_entries;
+  zword start = dictionarytable;
   void *p;
 
   entry_length = LOBYTE(dictionarytable);
@@ -67,6 +144,21 @@ static zword find_word(zword dictionarytable, const char *word, int length)
   encodezscii(zsciibuffer, word_length, word_length, word, length);
 
   dictentry_len = word_length;
+
+  if(start >= dynamic_size && num_entries) {
+    struct dict_index *d;
+    unsigned long slot;
+    if(is_neg(num_entries))
+      num_entries = neg(num_entries);
+    d = index_dictionary(start, dictionarytable, entry_length, num_entries);
+    for(slot = hash_dictentry(zsciibuffer) & d->mask; d->slots[slot];
+	slot = (slot + 1) & d->mask) {
+      zword entry = d->base + (d->slots[slot] - 1) * entry_length;
+      if(cmpdictentry(zsciibuffer, z_memory + entry) == 0)
+	return entry;
+    }
+    return 0;
+  }
   
   if(is_neg(num_entries)) {  /* Unordered dictionary */
     num_entries = neg(num_entries);
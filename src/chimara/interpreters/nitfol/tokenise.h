@@ -14,6 +14,7 @@ extern struct Typocorrection * recent_corrections;
 void forget_corrections (void);
 
 #endif
+void forget_dictionaries (void);
 void z_tokenise (const char *text , int length , zword parse_dest , zword dictionarytable , BOOL write_unrecognized );
 void op_tokenise (void);
 
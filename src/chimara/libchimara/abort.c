@@ -2,6 +2,7 @@
 
 #include "abort.h"
 #include "chimara-glk-private.h"
+#include "graphics.h"
 #include "strio.h"
 #include "ui-message.h"
 #include "window.h"
@@ -43,6 +44,9 @@ abort_glk(void)
 	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
 	if(glk_data->interrupt_handler)
 		(*(glk_data->interrupt_handler))();
+	/* The program will not get to finish its profile on the way out */
+	if(glk_data->profiler_stop)
+		glk_data->profiler_stop();
 	shutdown_glk_pre();
 	shutdown_glk_post();
 	/* If program is terminated by g_thread_exit() instead of returning from the
@@ -100,6 +104,7 @@ shutdown_glk_pre(void)
 	}
 	
 	/* Close any open resource files */
+	image_cache_clear(glk_data);
 	if(glk_data->resource_map != NULL) {
 		giblorb_destroy_map(glk_data->resource_map);
 		glk_data->resource_map = NULL;
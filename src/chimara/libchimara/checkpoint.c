@@ -0,0 +1,91 @@
+#include <glib.h>
+
+#include "checkpoint.h"
+#include "chimara-glk-private.h"
+#include "glk.h"
+#include "glkstart.h"
+
+extern GPrivate glk_data_key;
+
+/**
+ * glkunix_set_checkpoint_functions:
+ * @save: Function that takes a snapshot of the program's state, and returns 0
+ * on success or nonzero on failure.
+ * @restore: Function that returns the program to the state in the most recent
+ * snapshot without throwing the snapshot away, and returns 0 on success or
+ * nonzero on failure.
+ * @discard: Function that throws away the most recent snapshot.
+ *
+ * Lets the program take part in checkpointed replays. A program controlling
+ * the Glk library, such as an IDE replaying a tree of commands, can ask for a
+ * snapshot when a command has been processed, and later return to it in order
+ * to try a different command, instead of restarting the program and feeding
+ * it all the commands leading up to that point again.
+ *
+ * The functions are called from inside glk_select(), only while a line input
+ * request is pending, so the program is always stopped in the same place in
+ * its input loop when a snapshot is taken or restored. The state of Glk
+ * objects such as windows and streams is not part of the snapshot, just as
+ * with an undo operation.
+ *
+ * Call this function from glkunix_startup_code(). Passing %NULL for @save
+ * means the program does not support checkpoints, which is the default.
+ *
+ * > # Chimara #
+ * > This function is a Chimara extension.
+ */
+void
+glkunix_set_checkpoint_functions(glui32 (*save)(void), glui32 (*restore)(void), void (*discard)(void))
+{
+	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
+	glk_data->checkpoint_save = save;
+	glk_data->checkpoint_restore = restore;
+	glk_data->checkpoint_discard = discard;
+}
+
+struct CheckpointResult {
+	ChimaraGlk *glk;
+	unsigned action;
+	gboolean success;
+};
+
+static gboolean
+emit_checkpoint_signal(struct CheckpointResult *result)
+{
+	g_signal_emit_by_name(result->glk, "checkpoint", result->action, result->success);
+	g_slice_free(struct CheckpointResult, result);
+	return G_SOURCE_REMOVE;
+}
+
+/* Internal function: carry out a checkpoint action fed to the Glk program with
+chimara_glk_feed_checkpoint(), and report the result to the UI thread. Must be
+called from glk_select() while a line input request is pending. */
+void
+perform_checkpoint_action(unsigned action)
+{
+	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
+	gboolean success = FALSE;
+
+	if(glk_data->checkpoint_save) {
+		switch(action) {
+			case CHIMARA_CHECKPOINT_SAVE:
+				success = glk_data->checkpoint_save() == 0;
+				break;
+			case CHIMARA_CHECKPOINT_RESTORE:
+				success = glk_data->checkpoint_restore() == 0;
+				break;
+			case CHIMARA_CHECKPOINT_DISCARD:
+				glk_data->checkpoint_discard();
+				success = TRUE;
+				break;
+			default:
+				g_assert_not_reached();
+		}
+	}
+
+	struct CheckpointResult *result = g_slice_new0(struct CheckpointResult);
+	result->glk = glk_data->self;
+	result->action = action;
+	result->success = success;
+	gdk_threads_add_idle((GSourceFunc)emit_checkpoint_signal, result);
+}
@@ -0,0 +1,10 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <glib.h>
+
+#include "glk.h"
+
+G_GNUC_INTERNAL void perform_checkpoint_action(unsigned action);
+
+#endif
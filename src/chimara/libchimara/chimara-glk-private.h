@@ -27,8 +27,13 @@ struct _ChimaraGlkPrivate {
     gboolean interactive;
     /* Whether file operations are allowed */
     gboolean protect;
+	/* Whether the plugin is loaded from a private copy */
+	gboolean isolated;
 	/* Spacing between Glk windows */
 	guint spacing;
+	/* Lines kept in text buffer windows, and whether trimmed text goes to disk */
+	guint scrollback_lines;
+	gboolean scrollback_spill;
 	/* The CSS file to read style defaults from */
 	gchar *css_file;
 	/* Hashtable containing the current styles set by CSS and GLK */
@@ -36,11 +41,20 @@ struct _ChimaraGlkPrivate {
 	struct StyleSet *glk_styles;
 	/* Final message displayed when game exits */
 	gchar *final_message;
-	/* Image cache */
-	GSList *image_cache;
+	/* Image cache, see graphics.c; Glk thread only */
+	GHashTable *image_cache;
+	GQueue image_cache_lru;
+	gsize image_cache_bytes;
+	GThreadPool *image_decoder;
 	/* Size allocate flags */
 	gboolean needs_rearrange;
 	gboolean ignore_next_arrange_event;
+	/* Arrange generations: the Glk thread numbers the arranges it asks for,
+	 and the UI thread publishes the number of the last one it has carried out
+	 so that the Glk thread can see whether any are still pending */
+	guint arrange_requested;  /* Glk thread only */
+	guint arrange_received;  /* UI thread only */
+	gint arrange_completed;  /* atomic */
 
 	/* *** Threading data *** */
 	/* Whether program is running */
@@ -49,11 +63,20 @@ struct _ChimaraGlkPrivate {
 	gboolean after_finalize;
     /* Glk program loaded in widget */
     GModule *program;
+	/* Private copy of the plugin file, if isolated */
+	char *program_copy;
     /* Thread in which Glk program is run */
     GThread *thread;
 	/* Pipe through which to schedule updates to the UI */
 	unsigned ui_message_handler_id;
 	GAsyncQueue *ui_message_queue;
+	/* Printed text waiting to be inserted at the end of a batch of messages */
+	struct UiPrintBatch *ui_print_batch;
+	/* Statistics about the UI message queue, logged with g_debug() */
+	gint64 ui_stats_since;
+	unsigned ui_stats_messages;
+	unsigned ui_stats_batches;
+	int ui_stats_max_depth;
     /* Event queue and threading stuff */
     GQueue *event_queue;
 	GMutex event_lock;
@@ -108,6 +131,21 @@ struct _ChimaraGlkPrivate {
 	void (*unregister_obj)(void *, glui32, gidispatch_rock_t);
 	gidispatch_rock_t (*register_arr)(void *, glui32, char *);
 	void (*unregister_arr)(void *, glui32, char *, gidispatch_rock_t);
+	/* Callbacks for taking and restoring checkpoints */
+	glui32 (*checkpoint_save)(void);
+	glui32 (*checkpoint_restore)(void);
+	void (*checkpoint_discard)(void);
+	/* Callbacks for switching the profiler on and off */
+	void (*profiler_start)(glui32, char *, char *);
+	void (*profiler_stop)(void);
+	/* Profiler request not yet seen by the Glk thread; the flag is read
+	atomically so that glk_tick() does not have to take the lock */
+	GMutex profiler_lock;
+	gint profiler_request_pending;
+	gboolean profiler_request_start;
+	guint profiler_interval;
+	gchar *profiler_debug_file;
+	gchar *profiler_output_file;
 
 	/* *** Platform-dependent Glk library data *** */
 	/* Flag for functions to find out if they are being called from startup code */
@@ -124,7 +162,7 @@ G_GNUC_INTERNAL void chimara_glk_push_event(ChimaraGlk *self, uint32_t type, win
 G_GNUC_INTERNAL void chimara_glk_init_textbuffer_styles(ChimaraGlk *self, ChimaraGlkWindowType wintype, GtkTextBuffer *buffer);
 G_GNUC_INTERNAL GtkTextTag *chimara_glk_get_glk_tag(ChimaraGlk *self, ChimaraGlkWindowType window, const char *name);
 G_GNUC_INTERNAL gboolean chimara_glk_needs_rearrange(ChimaraGlk *self);
-G_GNUC_INTERNAL void chimara_glk_queue_arrange(ChimaraGlk *self, gboolean suppress_next_arrange_event);
+G_GNUC_INTERNAL void chimara_glk_queue_arrange(ChimaraGlk *self, gboolean suppress_next_arrange_event, unsigned generation);
 G_GNUC_INTERNAL gboolean chimara_glk_process_queue(ChimaraGlk *self);
 G_GNUC_INTERNAL void chimara_glk_drain_queue(ChimaraGlk *self);
 G_GNUC_INTERNAL void chimara_glk_stop_processing_queue(ChimaraGlk *self);
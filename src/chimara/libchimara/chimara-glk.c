@@ -8,6 +8,7 @@
 #include <sys/types.h>
 
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <gmodule.h>
 #include <gtk/gtk.h>
 
@@ -20,7 +21,9 @@
 #include "init.h"
 #include "magic.h"
 #include "style.h"
+#include "ui-grid.h"
 #include "ui-message.h"
+#include "ui-window.h"
 #include "window.h"
 
 #define CHIMARA_GLK_MIN_WIDTH 0
@@ -28,6 +31,9 @@
 #define CHIMARA_NUM_STYLES 12
 #define EVENT_TIMEOUT_MICROSECONDS 3000000
 #define EVENT_QUEUE_MAX_LENGTH 100
+/* Longest time to spend on UI messages in one idle callback, so that a program
+ * printing a lot does not make the interface unresponsive */
+#define UI_BATCH_MAX_MICROSECONDS 8000
 
 /**
  * SECTION:chimara-glk
@@ -134,7 +140,10 @@ enum {
     PROP_0,
     PROP_INTERACTIVE,
     PROP_PROTECT,
+	PROP_ISOLATED,
 	PROP_SPACING,
+	PROP_SCROLLBACK_LINES,
+	PROP_SCROLLBACK_SPILL,
 	PROP_PROGRAM_NAME,
 	PROP_PROGRAM_INFO,
 	PROP_STORY_NAME,
@@ -149,6 +158,7 @@ enum {
 	LINE_INPUT,
 	TEXT_BUFFER_OUTPUT,
 	ILIAD_SCREEN_UPDATE,
+	CHECKPOINT,
 
 	LAST_SIGNAL
 };
@@ -390,6 +400,7 @@ chimara_glk_init(ChimaraGlk *self)
 	priv->glk_styles = g_new0(StyleSet,1);
 	priv->final_message = g_strdup("[ The game has finished ]");
 	priv->ui_message_queue = g_async_queue_new_full((GDestroyNotify)ui_message_free);
+	priv->ui_print_batch = ui_print_batch_new();
     priv->event_queue = g_queue_new();
 	priv->char_input_queue = g_async_queue_new_full(g_free);
 	priv->line_input_queue = g_async_queue_new_full(g_free);
@@ -399,6 +410,7 @@ chimara_glk_init(ChimaraGlk *self)
 	g_mutex_init(&priv->shutdown_lock);
 	g_mutex_init(&priv->arrange_lock);
 	g_mutex_init(&priv->resource_lock);
+	g_mutex_init(&priv->profiler_lock);
 
 	g_cond_init(&priv->event_queue_not_empty);
 	g_cond_init(&priv->event_queue_not_full);
@@ -422,9 +434,18 @@ chimara_glk_set_property(GObject *object, guint prop_id, const GValue *value, GP
         case PROP_PROTECT:
             chimara_glk_set_protect( glk, g_value_get_boolean(value) );
             break;
+		case PROP_ISOLATED:
+			chimara_glk_set_isolated( glk, g_value_get_boolean(value) );
+			break;
 		case PROP_SPACING:
 			chimara_glk_set_spacing( glk, g_value_get_uint(value) );
 			break;
+		case PROP_SCROLLBACK_LINES:
+			chimara_glk_set_scrollback_lines( glk, g_value_get_uint(value) );
+			break;
+		case PROP_SCROLLBACK_SPILL:
+			chimara_glk_set_scrollback_spill( glk, g_value_get_boolean(value) );
+			break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     }
@@ -443,9 +464,18 @@ chimara_glk_get_property(GObject *object, guint prop_id, GValue *value, GParamSp
         case PROP_PROTECT:
             g_value_set_boolean(value, priv->protect);
             break;
+		case PROP_ISOLATED:
+			g_value_set_boolean(value, priv->isolated);
+			break;
 		case PROP_SPACING:
 			g_value_set_uint(value, priv->spacing);
 			break;
+		case PROP_SCROLLBACK_LINES:
+			g_value_set_uint(value, priv->scrollback_lines);
+			break;
+		case PROP_SCROLLBACK_SPILL:
+			g_value_set_boolean(value, priv->scrollback_spill);
+			break;
 		case PROP_PROGRAM_NAME:
 			g_value_set_string(value, priv->program_name);
 			break;
@@ -463,11 +493,46 @@ chimara_glk_get_property(GObject *object, guint prop_id, GValue *value, GParamSp
     }
 }
 
+/* Copy the plugin file @plugin into a fresh temporary directory, and return
+the path of the copy, or %NULL on error. */
+static char *
+copy_plugin_file(const char *plugin, GError **error)
+{
+	g_autofree char *tmpdir = g_dir_make_tmp("chimara-XXXXXX", error);
+	if(!tmpdir)
+		return NULL;
+
+	g_autofree char *basename = g_path_get_basename(plugin);
+	char *copy_path = g_build_filename(tmpdir, basename, NULL);
+	g_autoptr(GFile) source = g_file_new_for_path(plugin);
+	g_autoptr(GFile) dest = g_file_new_for_path(copy_path);
+	if(!g_file_copy(source, dest, G_FILE_COPY_NONE, NULL, NULL, NULL, error)) {
+		g_rmdir(tmpdir);
+		g_free(copy_path);
+		return NULL;
+	}
+	return copy_path;
+}
+
+/* Whether the plugin @module keeps all its state in thread-local storage, so
+that several widgets can run it at once without a private copy each. */
+static gboolean
+module_is_reentrant(GModule *module)
+{
+	const int *reentrant;
+	return g_module_symbol(module, "glkunix_reentrant", (gpointer *) &reentrant) && *reentrant;
+}
+
+/* Remove the private copy of the plugin made by copy_plugin_file(). */
 static void
-clear_image_cache_iterate(struct image_info *data, gpointer user_data)
+remove_plugin_copy(ChimaraGlkPrivate *priv)
 {
-	g_object_unref(data->pixbuf);
-	g_free(data);
+	if(!priv->program_copy)
+		return;
+	g_autofree char *tmpdir = g_path_get_dirname(priv->program_copy);
+	g_unlink(priv->program_copy);
+	g_rmdir(tmpdir);
+	g_clear_pointer(&priv->program_copy, g_free);
 }
 
 static void
@@ -486,6 +551,7 @@ chimara_glk_finalize(GObject *object)
 	g_hash_table_destroy(priv->glk_styles->text_grid);
 
 	g_async_queue_unref(priv->ui_message_queue);
+	ui_print_batch_free(priv->ui_print_batch);
 
     /* Free the event queue */
     g_mutex_lock(&priv->event_lock);
@@ -519,8 +585,13 @@ chimara_glk_finalize(GObject *object)
 	g_cond_clear(&priv->resource_info_available);
 	g_mutex_unlock(&priv->resource_lock);
 	g_mutex_clear(&priv->resource_lock);
-	g_slist_foreach(priv->image_cache, (GFunc)clear_image_cache_iterate, NULL);
-	g_slist_free(priv->image_cache);
+
+	g_mutex_clear(&priv->profiler_lock);
+	g_free(priv->profiler_debug_file);
+	g_free(priv->profiler_output_file);
+	image_cache_clear(priv);
+	g_clear_pointer(&priv->image_cache, g_hash_table_destroy);
+	remove_plugin_copy(priv);
 
 	/* Unref input queues (this should destroy them since any Glk thread has stopped by now */
 	g_async_queue_unref(priv->char_input_queue);
@@ -779,11 +850,14 @@ allocate_recurse(winid_t win, GtkAllocation *allocation, guint spacing)
 
 				g_free(horizontal_blanks);
 			}
+
+			ui_grid_resize(win, new_width, new_height);
 		}
 	
 		gboolean arrange = !(win->width == new_width && win->height == new_height);
 		win->width = new_width;
 		win->height = new_height;
+		ui_window_publish_size(win);
 
 		g_mutex_unlock(&win->lock);
 
@@ -795,6 +869,7 @@ allocate_recurse(winid_t win, GtkAllocation *allocation, guint spacing)
 	g_mutex_lock(&win->lock);
 	win->width = allocation->width;
 	win->height = allocation->height;
+	ui_window_publish_size(win);
 	g_mutex_unlock(&win->lock);
 	return NULL;
 }
@@ -829,6 +904,10 @@ chimara_glk_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 		else
 			priv->ignore_next_arrange_event = FALSE;
 	}
+
+	/* The window sizes are current as of the last arrange the Glk thread
+	 asked for */
+	g_atomic_int_set(&priv->arrange_completed, priv->arrange_received);
 }
 
 /* Recursively invoke callback() on the GtkWidget of each non-pair window in the
@@ -1016,6 +1095,20 @@ chimara_glk_class_init(ChimaraGlkClass *klass)
 		G_STRUCT_OFFSET(ChimaraGlkClass, iliad_screen_update), NULL, NULL,
 		_chimara_marshal_VOID__BOOLEAN,
 		G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+	/**
+	 * ChimaraGlk::checkpoint:
+	 * @self: The widget that received the signal
+	 * @action: The #ChimaraCheckpointAction that was carried out
+	 * @success: Whether the Glk program was able to carry it out
+	 *
+	 * Emitted when the Glk program has processed a checkpoint action fed to it
+	 * with chimara_glk_feed_checkpoint().
+	 */
+	chimara_glk_signals[CHECKPOINT] = g_signal_new("checkpoint",
+		G_OBJECT_CLASS_TYPE(klass), 0,
+		G_STRUCT_OFFSET(ChimaraGlkClass, checkpoint), NULL, NULL,
+		_chimara_marshal_VOID__UINT_BOOLEAN,
+		G_TYPE_NONE, 2, G_TYPE_UINT, G_TYPE_BOOLEAN);
 
     /* Properties */
     /**
@@ -1048,6 +1141,26 @@ chimara_glk_class_init(ChimaraGlkClass *klass)
         FALSE,
         G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_LAX_VALIDATION | G_PARAM_STATIC_STRINGS) );
 
+	/**
+	 * ChimaraGlk:isolated:
+	 *
+	 * Sets whether the Glk program is loaded from a private copy of its plugin
+	 * file. Interpreter plugins keep their state in global variables, so two
+	 * widgets that load the same plugin normally cannot run at the same time.
+	 * An isolated widget gets its own copy of those variables, which makes it
+	 * possible to run several games side by side in one process.
+	 *
+	 * Plugins that keep all their state in thread-local storage say so by
+	 * defining `glkunix_reentrant`; Glulxe, Git and Bocfel do. Each widget
+	 * runs its program in a thread of its own, so isolated widgets share the
+	 * one loaded copy of such a plugin instead.
+	 */
+	g_object_class_install_property(object_class, PROP_ISOLATED,
+		g_param_spec_boolean("isolated", "Isolated",
+		"Whether the Glk program is loaded from a private copy of its plugin",
+		FALSE,
+		G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_LAX_VALIDATION | G_PARAM_STATIC_STRINGS) );
+
 	/**
 	 * ChimaraGlk:spacing:
 	 *
@@ -1062,6 +1175,35 @@ chimara_glk_class_init(ChimaraGlkClass *klass)
 		0, G_MAXUINT, 0,
 		G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_LAX_VALIDATION | G_PARAM_STATIC_STRINGS) );
 	
+	/**
+	 * ChimaraGlk:scrollback-lines:
+	 *
+	 * The number of lines of text that a text buffer window keeps before it
+	 * starts throwing away the oldest ones, or 0 to keep everything. So that a
+	 * long game does not pay for this on every line it prints, text is only
+	 * removed once the window has grown an eighth past this limit. Text that
+	 * has not been on the screen yet is never removed.
+	 */
+	g_object_class_install_property(object_class, PROP_SCROLLBACK_LINES,
+		g_param_spec_uint("scrollback-lines", "Scrollback lines",
+		"Number of lines to keep in text buffer windows, or 0 for no limit",
+		0, G_MAXUINT, 0,
+		G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_LAX_VALIDATION | G_PARAM_STATIC_STRINGS) );
+
+	/**
+	 * ChimaraGlk:scrollback-spill:
+	 *
+	 * Whether text that is removed from a text buffer window because of
+	 * #ChimaraGlk:scrollback-lines is written to a temporary file instead of
+	 * being thrown away. When the user scrolls to the top of the window, the
+	 * most recently removed text is read back in, without its styles.
+	 */
+	g_object_class_install_property(object_class, PROP_SCROLLBACK_SPILL,
+		g_param_spec_boolean("scrollback-spill", "Scrollback spill",
+		"Whether to keep text removed from text buffer windows on disk",
+		FALSE,
+		G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS) );
+
 	/**
 	 * ChimaraGlk:program-name:
 	 *
@@ -1225,6 +1367,42 @@ chimara_glk_get_protect(ChimaraGlk *self)
     return priv->protect;
 }
 
+/**
+ * chimara_glk_set_isolated:
+ * @self: a #ChimaraGlk widget
+ * @isolated: whether the widget should load a private copy of its plugin
+ *
+ * Sets the #ChimaraGlk:isolated property of @self. The new value takes effect
+ * the next time a plugin is started with chimara_glk_run().
+ */
+void
+chimara_glk_set_isolated(ChimaraGlk *self, gboolean isolated)
+{
+	g_return_if_fail(self || CHIMARA_IS_GLK(self));
+
+	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+	priv->isolated = isolated;
+	g_object_notify(G_OBJECT(self), "isolated");
+}
+
+/**
+ * chimara_glk_get_isolated:
+ * @self: a #ChimaraGlk widget
+ *
+ * Returns whether @self loads a private copy of its plugin. See
+ * #ChimaraGlk:isolated.
+ *
+ * Return value: %TRUE if @self is isolated.
+ */
+gboolean
+chimara_glk_get_isolated(ChimaraGlk *self)
+{
+	g_return_val_if_fail(self || CHIMARA_IS_GLK(self), FALSE);
+
+	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+	return priv->isolated;
+}
+
 /**
  * chimara_glk_set_css_to_default:
  * @glk: a #ChimaraGlk widget
@@ -1340,6 +1518,76 @@ chimara_glk_get_spacing(ChimaraGlk *self)
 	return priv->spacing;
 }
 
+/**
+ * chimara_glk_set_scrollback_lines:
+ * @self: a #ChimaraGlk widget
+ * @lines: the number of lines to keep, or 0 for no limit
+ *
+ * Sets the #ChimaraGlk:scrollback-lines property of @self, which is the number
+ * of lines of text that text buffer windows keep.
+ */
+void
+chimara_glk_set_scrollback_lines(ChimaraGlk *self, guint lines)
+{
+	g_return_if_fail(self || CHIMARA_IS_GLK(self));
+
+	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+	priv->scrollback_lines = lines;
+	g_object_notify(G_OBJECT(self), "scrollback-lines");
+}
+
+/**
+ * chimara_glk_get_scrollback_lines:
+ * @self: a #ChimaraGlk widget
+ *
+ * Gets the value set by chimara_glk_set_scrollback_lines().
+ *
+ * Return value: lines of text kept in text buffer windows, or 0 for no limit
+ */
+guint
+chimara_glk_get_scrollback_lines(ChimaraGlk *self)
+{
+	g_return_val_if_fail(self || CHIMARA_IS_GLK(self), 0);
+
+	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+	return priv->scrollback_lines;
+}
+
+/**
+ * chimara_glk_set_scrollback_spill:
+ * @self: a #ChimaraGlk widget
+ * @spill: whether to keep removed text on disk
+ *
+ * Sets the #ChimaraGlk:scrollback-spill property of @self. See
+ * #ChimaraGlk:scrollback-spill.
+ */
+void
+chimara_glk_set_scrollback_spill(ChimaraGlk *self, gboolean spill)
+{
+	g_return_if_fail(self || CHIMARA_IS_GLK(self));
+
+	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+	priv->scrollback_spill = spill;
+	g_object_notify(G_OBJECT(self), "scrollback-spill");
+}
+
+/**
+ * chimara_glk_get_scrollback_spill:
+ * @self: a #ChimaraGlk widget
+ *
+ * Gets the value set by chimara_glk_set_scrollback_spill().
+ *
+ * Return value: %TRUE if text removed from text buffer windows is kept on disk
+ */
+gboolean
+chimara_glk_get_scrollback_spill(ChimaraGlk *self)
+{
+	g_return_val_if_fail(self || CHIMARA_IS_GLK(self), FALSE);
+
+	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+	return priv->scrollback_spill;
+}
+
 struct StartupData {
 	glk_main_t glk_main;
 	glkunix_startup_code_t glkunix_startup_code;
@@ -1399,8 +1647,36 @@ glk_enter(struct StartupData *startup)
 	return NULL;
 }
 
-/* Private method. Fetches a UI message from the message queue, and if there is
- * one, carries out the instructions therein.
+/* Helper function: keep count of UI messages and log the rate at which they
+ * are processed, at most once a second, with g_debug() */
+static void
+update_ui_statistics(ChimaraGlkPrivate *priv, unsigned processed, int depth)
+{
+	gint64 now = g_get_monotonic_time();
+
+	if (processed > 0) {
+		priv->ui_stats_messages += processed;
+		priv->ui_stats_batches++;
+	}
+	priv->ui_stats_max_depth = MAX(priv->ui_stats_max_depth, depth);
+
+	gint64 elapsed = now - priv->ui_stats_since;
+	if (elapsed < G_USEC_PER_SEC)
+		return;
+	if (priv->ui_stats_messages > 0)
+		g_debug("UI messages: %.0f/s in %u batches, queue depth %d (max %d)",
+			priv->ui_stats_messages * (double)G_USEC_PER_SEC / elapsed,
+			priv->ui_stats_batches, g_async_queue_length(priv->ui_message_queue),
+			priv->ui_stats_max_depth);
+	priv->ui_stats_since = now;
+	priv->ui_stats_messages = 0;
+	priv->ui_stats_batches = 0;
+	priv->ui_stats_max_depth = 0;
+}
+
+/* Private method. Fetches UI messages from the message queue, and carries out
+ * the instructions therein, until the queue is empty or a time limit is
+ * reached. Text printed by consecutive messages is inserted all at once.
  * This function must be called from the UI thread.
  * Always returns %G_SOURCE_CONTINUE (this is meant to be called as an idle
  * function.) */
@@ -1408,12 +1684,22 @@ gboolean
 chimara_glk_process_queue(ChimaraGlk *self)
 {
 	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+	gint64 deadline = g_get_monotonic_time() + UI_BATCH_MAX_MICROSECONDS;
+	int depth = g_async_queue_length(priv->ui_message_queue);
+	unsigned processed = 0;
+
+	UiMessage *msg;
+	while ((msg = g_async_queue_try_pop(priv->ui_message_queue)) != NULL) {
+		/* Nothing may come after the shutdown message */
+		gboolean last = msg->type == UI_MESSAGE_SHUTDOWN;
+		ui_message_perform(self, msg, priv->ui_print_batch);
+		processed++;
+		if (last || g_get_monotonic_time() >= deadline)
+			break;
+	}
+	ui_print_batch_flush(priv->ui_print_batch);
 
-	UiMessage *msg = g_async_queue_try_pop(priv->ui_message_queue);
-	if (msg == NULL)
-		return G_SOURCE_CONTINUE;
-
-	ui_message_perform(self, msg);
+	update_ui_statistics(priv, processed, depth);
 	return G_SOURCE_CONTINUE;
 }
 
@@ -1456,9 +1742,22 @@ chimara_glk_run(ChimaraGlk *self, const gchar *plugin, int argc, char *argv[], G
 	/* If there is already a module loaded, free it first -- you see, we want to
 	 * keep modules loaded as long as possible to avoid crashes in stack unwinding */
 	chimara_glk_unload_plugin(self);
-	/* Open the module to run */
-    priv->program = g_module_open(plugin, G_MODULE_BIND_LAZY);
-    
+	/* Open the module to run. Bind its symbols locally, otherwise a second copy
+	 * of the same plugin would resolve its globals to the first one's. */
+    priv->program = g_module_open(plugin, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+
+	/* An isolated widget runs a private copy of the plugin, so that its global
+	 * variables are not shared with any other widget running the same plugin,
+	 * unless the plugin keeps its state per thread anyway */
+	if(priv->program && priv->isolated && !module_is_reentrant(priv->program)) {
+		g_module_close(priv->program);
+		priv->program = NULL;
+		priv->program_copy = copy_plugin_file(plugin, error);
+		if(!priv->program_copy)
+			return FALSE;
+		priv->program = g_module_open(priv->program_copy, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+	}
+
     if(!priv->program)
     {
 		g_set_error(error, CHIMARA_ERROR, CHIMARA_LOAD_MODULE_ERROR,
@@ -1496,9 +1795,26 @@ chimara_glk_run(ChimaraGlk *self, const gchar *plugin, int argc, char *argv[], G
 	/* Set Glk styles to defaults */
 	chimara_glk_reset_glk_styles(self);
 
+	/* The new plugin registers its own checkpoint functions, if any */
+	priv->checkpoint_save = NULL;
+	priv->checkpoint_restore = NULL;
+	priv->checkpoint_discard = NULL;
+	/* Likewise its profiler functions, and forget any request meant for the
+	previous one */
+	priv->profiler_start = NULL;
+	priv->profiler_stop = NULL;
+	g_mutex_lock(&priv->profiler_lock);
+	g_atomic_int_set(&priv->profiler_request_pending, 0);
+	g_clear_pointer(&priv->profiler_debug_file, g_free);
+	g_clear_pointer(&priv->profiler_output_file, g_free);
+	g_mutex_unlock(&priv->profiler_lock);
+
 	/* Reset arrangement mechanism */
 	priv->needs_rearrange = FALSE;
 	priv->ignore_next_arrange_event = FALSE;
+	priv->arrange_requested = 0;
+	priv->arrange_received = 0;
+	g_atomic_int_set(&priv->arrange_completed, 0);
 
 	/* Start listening for UI messages */
 	priv->ui_message_handler_id = gdk_threads_add_idle((GSourceFunc)chimara_glk_process_queue, self);
@@ -1582,7 +1898,8 @@ chimara_glk_drain_queue(ChimaraGlk *self)
 		if (priv->ui_message_handler_id == 0)
 			return;
 		UiMessage *msg = g_async_queue_pop(priv->ui_message_queue);
-		ui_message_perform (self, msg);
+		ui_message_perform(self, msg, priv->ui_print_batch);
+		ui_print_batch_flush(priv->ui_print_batch);
 		while (gtk_events_pending())
 			gtk_main_iteration();
 	}
@@ -1631,6 +1948,7 @@ chimara_glk_unload_plugin(ChimaraGlk *self)
 	if( priv->program && !g_module_close(priv->program) )
 		g_warning( "Error closing module :%s", g_module_error() );
 	priv->program = NULL;
+	remove_plugin_copy(priv);
 }
 
 /**
@@ -1693,6 +2011,128 @@ chimara_glk_feed_line_input(ChimaraGlk *self, const char *text)
 	chimara_glk_push_event(self, evtype_ForcedLineInput, NULL, 0, 0);
 }
 
+/**
+ * chimara_glk_feed_checkpoint:
+ * @self: a #ChimaraGlk widget
+ * @action: a #ChimaraCheckpointAction
+ *
+ * Asks the Glk program running in @self to take a snapshot of its state, or go
+ * back to one. The action is queued along with any line input fed with
+ * chimara_glk_feed_line_input(), and is carried out the next time the program
+ * waits for line input. The #ChimaraGlk::checkpoint signal is emitted when it
+ * is done.
+ *
+ * If the program does not support checkpoints (see
+ * chimara_glk_get_supports_checkpoints()) then the action fails.
+ */
+void
+chimara_glk_feed_checkpoint(ChimaraGlk *self, ChimaraCheckpointAction action)
+{
+	g_return_if_fail(self || CHIMARA_IS_GLK(self));
+	g_return_if_fail(action <= CHIMARA_CHECKPOINT_DISCARD);
+	chimara_glk_push_event(self, evtype_ForcedCheckpoint, NULL, action, 0);
+}
+
+/**
+ * chimara_glk_get_supports_checkpoints:
+ * @self: a #ChimaraGlk widget
+ *
+ * Use this function to tell whether the Glk program running in @self is able
+ * to take and restore snapshots of its state. Only meaningful after the
+ * #ChimaraGlk::started signal has been emitted.
+ *
+ * Returns: %TRUE if chimara_glk_feed_checkpoint() can succeed.
+ */
+gboolean
+chimara_glk_get_supports_checkpoints(ChimaraGlk *self)
+{
+	g_return_val_if_fail(self || CHIMARA_IS_GLK(self), FALSE);
+	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+	return priv->checkpoint_save != NULL;
+}
+
+static void
+request_profiler_action(ChimaraGlk *self, gboolean start, unsigned interval, const char *debug_file, const char *output_file)
+{
+	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+
+	g_mutex_lock(&priv->profiler_lock);
+	priv->profiler_request_start = start;
+	priv->profiler_interval = interval;
+	g_free(priv->profiler_debug_file);
+	g_free(priv->profiler_output_file);
+	priv->profiler_debug_file = g_strdup(debug_file);
+	priv->profiler_output_file = g_strdup(output_file);
+	g_atomic_int_set(&priv->profiler_request_pending, 1);
+	g_mutex_unlock(&priv->profiler_lock);
+
+	/* The program picks up the request in glk_tick(), but if it is waiting
+	for an event it will not be calling that, so wake it up */
+	chimara_glk_push_event(self, evtype_ForcedProfiler, NULL, 0, 0);
+}
+
+/**
+ * chimara_glk_start_profiling:
+ * @self: a #ChimaraGlk widget
+ * @interval: how many units of work to let pass between samples
+ * @debug_file: (nullable): path to a file with debugging information that
+ * the program can use to name the parts of itself it finds itself in, or
+ * %NULL
+ * @output_file: path to the file to write the profile to
+ *
+ * Asks the Glk program running in @self to start its sampling profiler, if it
+ * has one (see chimara_glk_get_supports_profiling()). Any profile already
+ * being taken is written out first. The request is carried out as soon as the
+ * program next calls glk_tick() or waits for an event.
+ *
+ * What a unit of work is depends on the program; the Glulxe interpreter
+ * counts virtual machine instructions, and reads an Inform debugging
+ * information file to name routines. Smaller values of @interval give more
+ * accurate profiles at the cost of slowing the program down more.
+ */
+void
+chimara_glk_start_profiling(ChimaraGlk *self, unsigned interval, const char *debug_file, const char *output_file)
+{
+	g_return_if_fail(self || CHIMARA_IS_GLK(self));
+	g_return_if_fail(interval > 0);
+	g_return_if_fail(output_file != NULL);
+	request_profiler_action(self, TRUE, interval, debug_file, output_file);
+}
+
+/**
+ * chimara_glk_stop_profiling:
+ * @self: a #ChimaraGlk widget
+ *
+ * Asks the Glk program running in @self to stop the profiler started with
+ * chimara_glk_start_profiling() and write the profile to the output file.
+ * The profile is also written if the program ends while the profiler is on.
+ */
+void
+chimara_glk_stop_profiling(ChimaraGlk *self)
+{
+	g_return_if_fail(self || CHIMARA_IS_GLK(self));
+	request_profiler_action(self, FALSE, 0, NULL, NULL);
+}
+
+/**
+ * chimara_glk_get_supports_profiling:
+ * @self: a #ChimaraGlk widget
+ *
+ * Use this function to tell whether the Glk program running in @self has a
+ * profiler that can be switched on and off with chimara_glk_start_profiling()
+ * and chimara_glk_stop_profiling(). Only meaningful after the
+ * #ChimaraGlk::started signal has been emitted.
+ *
+ * Returns: %TRUE if the program can be profiled.
+ */
+gboolean
+chimara_glk_get_supports_profiling(ChimaraGlk *self)
+{
+	g_return_val_if_fail(self || CHIMARA_IS_GLK(self), FALSE);
+	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
+	return priv->profiler_start != NULL;
+}
+
 /**
  * chimara_glk_is_char_input_pending:
  * @self: a #ChimaraGlk widget
@@ -1942,12 +2382,15 @@ chimara_glk_needs_rearrange(ChimaraGlk *self)
 
 /* Private method. Queues a size reallocation for the entire Glk window
  * hierarchy. If @suppress_next_arrange_event is %TRUE, an %evtype_Arrange event
- * will not be sent back to the Glk thread as a result of this resize. */
+ * will not be sent back to the Glk thread as a result of this resize.
+ * @generation is the number the Glk thread gave this arrange, which is
+ * published once the reallocation has happened. */
 void
-chimara_glk_queue_arrange(ChimaraGlk *self, gboolean suppress_next_arrange_event)
+chimara_glk_queue_arrange(ChimaraGlk *self, gboolean suppress_next_arrange_event, unsigned generation)
 {
 	ChimaraGlkPrivate *priv = chimara_glk_get_instance_private(self);
 	priv->needs_rearrange = TRUE;
+	priv->arrange_received = generation;
 	priv->ignore_next_arrange_event = suppress_next_arrange_event;
 	gtk_widget_queue_resize(GTK_WIDGET(self));
 }
@@ -38,6 +38,7 @@ typedef struct {
 	void(* line_input) (ChimaraGlk *self, guint32 window_rock, char *string_id, char *text);
 	void(* text_buffer_output) (ChimaraGlk *self, guint32 window_rock, char *string_id, char *text);
 	void(* iliad_screen_update) (ChimaraGlk *self, gboolean typing);
+	void(* checkpoint) (ChimaraGlk *self, unsigned action, gboolean success);
 } ChimaraGlkClass;
 
 /**
@@ -53,6 +54,22 @@ typedef enum {
 	CHIMARA_GLK_TEXT_GRID
 } ChimaraGlkWindowType;
 
+/**
+ * ChimaraCheckpointAction:
+ * @CHIMARA_CHECKPOINT_SAVE: Take a snapshot of the Glk program's state.
+ * @CHIMARA_CHECKPOINT_RESTORE: Return to the most recent snapshot, keeping it
+ * so that it can be restored again.
+ * @CHIMARA_CHECKPOINT_DISCARD: Throw away the most recent snapshot.
+ *
+ * Actions that can be fed to a Glk program with
+ * chimara_glk_feed_checkpoint().
+ */
+typedef enum {
+	CHIMARA_CHECKPOINT_SAVE,
+	CHIMARA_CHECKPOINT_RESTORE,
+	CHIMARA_CHECKPOINT_DISCARD
+} ChimaraCheckpointAction;
+
 /**
  * ChimaraError:
  * @CHIMARA_LOAD_MODULE_ERROR: There was an error opening the plugin containing
@@ -116,11 +133,17 @@ void chimara_glk_set_interactive(ChimaraGlk *self, gboolean interactive);
 gboolean chimara_glk_get_interactive(ChimaraGlk *self);
 void chimara_glk_set_protect(ChimaraGlk *self, gboolean protect);
 gboolean chimara_glk_get_protect(ChimaraGlk *self);
+void chimara_glk_set_isolated(ChimaraGlk *self, gboolean isolated);
+gboolean chimara_glk_get_isolated(ChimaraGlk *self);
 void chimara_glk_set_css_to_default(ChimaraGlk *glk);
 gboolean chimara_glk_set_css_from_file(ChimaraGlk *glk, const gchar *filename, GError **error);
 void chimara_glk_set_css_from_string(ChimaraGlk *glk, const gchar *css);
 void chimara_glk_set_spacing(ChimaraGlk *self, guint spacing);
 guint chimara_glk_get_spacing(ChimaraGlk *self);
+void chimara_glk_set_scrollback_lines(ChimaraGlk *self, guint lines);
+guint chimara_glk_get_scrollback_lines(ChimaraGlk *self);
+void chimara_glk_set_scrollback_spill(ChimaraGlk *self, gboolean spill);
+gboolean chimara_glk_get_scrollback_spill(ChimaraGlk *self);
 gboolean chimara_glk_run(ChimaraGlk *self, const gchar *plugin, int argc, char *argv[], GError **error);
 gboolean chimara_glk_run_file(ChimaraGlk *self, GFile *plugin_file, int argc, char *argv[], GError **error);
 void chimara_glk_stop(ChimaraGlk *self);
@@ -131,6 +154,11 @@ void chimara_glk_feed_char_input(ChimaraGlk *self, uint32_t keyval);
 void chimara_glk_feed_line_input(ChimaraGlk *self, const char *text);
 gboolean chimara_glk_is_char_input_pending(ChimaraGlk *self);
 gboolean chimara_glk_is_line_input_pending(ChimaraGlk *self);
+void chimara_glk_feed_checkpoint(ChimaraGlk *self, ChimaraCheckpointAction action);
+gboolean chimara_glk_get_supports_checkpoints(ChimaraGlk *self);
+void chimara_glk_start_profiling(ChimaraGlk *self, unsigned interval, const char *debug_file, const char *output_file);
+void chimara_glk_stop_profiling(ChimaraGlk *self);
+gboolean chimara_glk_get_supports_profiling(ChimaraGlk *self);
 GtkTextTag *chimara_glk_get_tag(ChimaraGlk *self, ChimaraGlkWindowType window, const char *name);
 const char * const *chimara_glk_get_tag_names(ChimaraGlk *glk, unsigned *num_tags);
 void chimara_glk_set_resource_load_callback(ChimaraGlk *self, ChimaraResourceLoadFunc func, void *user_data, GDestroyNotify destroy_user_data);
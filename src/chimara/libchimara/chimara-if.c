@@ -650,9 +650,10 @@ chimara_if_run_game(ChimaraIF *self, const char *game_path, GError **error)
 	g_free(pluginfile);
 
 	/* Decide what arguments to pass to the interpreters; currently only the
-	Z-machine interpreters accept command line arguments other than the game */
+	Z-machine interpreters and Git accept command line arguments other than the
+	game */
 	GSList *args = NULL;
-	gchar *terpnumstr = NULL, *randomstr = NULL;
+	gchar *terpnumstr = NULL, *randomstr = NULL, *cachedir = NULL;
 	args = g_slist_prepend(args, pluginpath);
 	switch(interpreter)
 	{
@@ -698,6 +699,15 @@ chimara_if_run_game(ChimaraIF *self, const char *game_path, GError **error)
 				args = g_slist_prepend(args, randomstr);
 			}
 			break;
+		case CHIMARA_IF_INTERPRETER_GIT:
+			/* Let Git keep the code it compiles, and the size its code cache
+			grew to, between runs of the same game */
+			cachedir = g_build_filename(g_get_user_cache_dir(), "chimara", "git", NULL);
+			if(g_mkdir_with_parents(cachedir, 0700) == 0) {
+				args = g_slist_prepend(args, "-cache");
+				args = g_slist_prepend(args, cachedir);
+			}
+			break;
 		default:
 			;
 	}
@@ -732,6 +742,7 @@ chimara_if_run_game(ChimaraIF *self, const char *game_path, GError **error)
 		g_free(terpnumstr);
 	if(randomstr)
 		g_free(randomstr);
+	g_free(cachedir);
 	g_free(pluginpath);
 
 	/* Set current format and interpreter if plugin was started successfully */
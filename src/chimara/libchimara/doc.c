@@ -3938,6 +3938,15 @@
  * This should return %TRUE if everything initializes properly. If it returns
  * %FALSE, the library will shut down without ever calling your glk_main() 
  * function.
+ *
+ * > # Chimara #
+ * > Chimara runs each program in a thread of its own. If your program keeps
+ * > all of its state in thread-local storage, you can also define
+ * > |[<!--language="C"-->
+ * > const int glkunix_reentrant = 1;
+ * > ]|
+ * > and several #ChimaraGlk widgets will then be able to run it at the same
+ * > time from one loaded copy. See #ChimaraGlk:isolated.
  */
 
 /**
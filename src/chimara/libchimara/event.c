@@ -1,5 +1,7 @@
 #include <string.h>
 
+#include "checkpoint.h"
+#include "profiler.h"
 #include "chimara-glk-private.h"
 #include "event.h"
 #include "glk.h"
@@ -76,6 +78,37 @@ get_appropriate_event(event_t *event)
 			g_mutex_unlock(&glk_data->event_lock);
 		}
 	}
+	else if(retrieved_event->type == evtype_ForcedCheckpoint)
+	{
+		/* Checkpoints are only taken and restored while the program is waiting
+		for line input, so that it is always in the same place */
+		winid_t win;
+		for(win = glk_window_iterate(NULL, NULL); win; win = glk_window_iterate(win, NULL))
+			if(win->input_request_type == INPUT_REQUEST_LINE || win->input_request_type == INPUT_REQUEST_LINE_UNICODE)
+				break;
+		if(win)
+		{
+			perform_checkpoint_action(retrieved_event->val1);
+			g_free(retrieved_event);
+			get_appropriate_event(event);
+		}
+		else
+		{
+			get_appropriate_event(event);
+			g_mutex_lock(&glk_data->event_lock);
+			g_queue_push_tail(glk_data->event_queue, retrieved_event);
+			g_cond_signal(&glk_data->event_queue_not_empty);
+			g_mutex_unlock(&glk_data->event_lock);
+		}
+	}
+	else if(retrieved_event->type == evtype_ForcedProfiler)
+	{
+		/* Only here to wake up glk_select(); the request itself is waiting
+		in the private data */
+		check_for_profiler_request();
+		g_free(retrieved_event);
+		get_appropriate_event(event);
+	}
 	else
 	{
 		if(retrieved_event == NULL)
@@ -209,6 +242,10 @@ glk_select_poll(event_t *event)
 		for(count = 0; (link = g_queue_peek_nth_link(glk_data->event_queue, count)) != NULL; count++)
 		{
 			glui32 type = ((event_t *)link->data)->type;
+			/* Leave Chimara's internal events (negative types) for glk_select();
+			glk_tick() below attends to aborts and profiler requests anyway */
+			if((glsi32)type < 0)
+				continue;
 			if(type != evtype_CharInput && type != evtype_LineInput && type != evtype_MouseInput && type != evtype_Hyperlink)
 			{
 				memcpy(event, link->data, sizeof(event_t));
@@ -8,6 +8,8 @@
 #define evtype_Abort (-1)
 #define evtype_ForcedCharInput (-2)
 #define evtype_ForcedLineInput (-3)
+#define evtype_ForcedCheckpoint (-4)
+#define evtype_ForcedProfiler (-5)
 
 G_GNUC_INTERNAL void event_throw(ChimaraGlk *glk, glui32 type, winid_t win, glui32 val1, glui32 val2);
 
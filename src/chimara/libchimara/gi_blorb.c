@@ -12,8 +12,10 @@
     shown above.
 */
 
+#include <sys/stat.h> /* For giblorb_map_file() */
 #include "glk.h"
 #include "gi_blorb.h"
+#include "stream.h" /* For giblorb_map_file() */
 
 #ifndef NULL
 #define NULL 0
@@ -72,6 +74,11 @@ struct giblorb_map_struct {
     giblorb_resdesc_t *resources; /* list of resource descriptors */
     giblorb_resdesc_t **ressorted; /* list of pointers to descriptors 
         in map->resources -- sorted by usage and resource number. */
+
+    void *mapping; /* platform handle for the file mapped into memory, or
+        NULL if the file could not be mapped */
+    unsigned char *mapdata; /* the mapped file contents */
+    glui32 maplen;
 };
 
 #define giblorb_Inited_Magic (0xB7012BED) 
@@ -88,6 +95,9 @@ static giblorb_resdesc_t *giblorb_bsearch(giblorb_resdesc_t *sample,
 static void *giblorb_malloc(glui32 len);
 static void *giblorb_realloc(void *ptr, glui32 len);
 static void giblorb_free(void *ptr);
+static void *giblorb_map_file(strid_t file, unsigned char **data, 
+    glui32 *len);
+static void giblorb_unmap_file(void *mapping);
 
 static giblorb_err_t giblorb_initialize()
 {
@@ -198,6 +208,11 @@ giblorb_err_t giblorb_create_map(strid_t file, giblorb_map_t **newmap)
     map->numchunks = numchunks;
     map->resources = NULL;
     map->ressorted = NULL;
+
+    /* If the file can be mapped into memory, chunks loaded with
+        giblorb_method_Memory point straight into the mapping instead of
+        being read into a buffer of their own. */
+    map->mapping = giblorb_map_file(file, &map->mapdata, &map->maplen);
     map->numresources = 0;
     /*map->releasenum = 0;
     map->zheader = NULL;
@@ -354,6 +369,13 @@ giblorb_err_t giblorb_destroy_map(giblorb_map_t *map)
     
     map->numresources = 0;
     
+    if (map->mapping) {
+        giblorb_unmap_file(map->mapping);
+        map->mapping = NULL;
+        map->mapdata = NULL;
+        map->maplen = 0;
+    }
+    
     map->file = NULL;
     map->inited = 0;
     
@@ -406,6 +428,13 @@ giblorb_err_t giblorb_load_chunk_by_number(giblorb_map_t *map,
             break;
             
         case giblorb_method_Memory:
+            if (map->mapdata && chu->datpos <= map->maplen
+                && chu->len <= map->maplen - chu->datpos) {
+                /* Hand out a read-only slice of the mapping; there is
+                    nothing to unload. */
+                res->data.ptr = map->mapdata + chu->datpos;
+                break;
+            }
             if (!chu->ptr) {
                 glui32 readlen;
                 void *dat = giblorb_malloc(chu->len);
@@ -609,3 +638,54 @@ static void giblorb_free(void *ptr)
 {
     g_free(ptr);
 }
+
+/* Map the whole of a Blorb file stream into memory, read-only. Returns a
+    handle to pass to giblorb_unmap_file(), or NULL if the stream is not a
+    file stream or the file could not be mapped, in which case chunks are
+    read into memory the usual way. Unlike the rest of this file, this
+    reaches into Chimara's stream internals (file->type and
+    file->file_pointer) to find the file descriptor.
+
+    The mapping lasts as long as the resource map, and pictures and sounds
+    are slices of it. That is only safe if nothing rewrites the file in the
+    meantime: reading a page of a mapped file that has been truncated
+    raises SIGBUS. An IDE rewrites its build output (such as
+    Build/output.gblorb) on every compile, possibly while a game is still
+    running from it, so files that anyone may write to are not mapped;
+    their chunks are copied into memory instead. */
+
+static void *giblorb_map_file(strid_t file, unsigned char **data, 
+    glui32 *len)
+{
+    GMappedFile *mapping;
+    struct stat info;
+    
+    *data = NULL;
+    *len = 0;
+    
+    if (file->type != STREAM_TYPE_FILE || !file->file_pointer)
+        return NULL;
+    
+    if (fstat(fileno(file->file_pointer), &info) != 0
+        || (info.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)))
+        return NULL;
+    
+    mapping = g_mapped_file_new_from_fd(fileno(file->file_pointer), 
+        FALSE, NULL);
+    if (!mapping)
+        return NULL;
+    if (g_mapped_file_get_length(mapping) == 0
+        || (guint64)g_mapped_file_get_length(mapping) > 0xFFFFFFFF) {
+        g_mapped_file_unref(mapping);
+        return NULL;
+    }
+    
+    *data = (unsigned char *)g_mapped_file_get_contents(mapping);
+    *len = g_mapped_file_get_length(mapping);
+    return mapping;
+}
+
+static void giblorb_unmap_file(void *mapping)
+{
+    g_mapped_file_unref(mapping);
+}
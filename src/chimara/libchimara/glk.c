@@ -2,6 +2,7 @@
 
 #include "abort.h"
 #include "chimara-glk-private.h"
+#include "profiler.h"
 #include "strio.h"
 #include "ui-message.h"
 #include "window.h"
@@ -145,6 +146,7 @@ void
 glk_tick()
 {
 	check_for_abort();
+	check_for_profiler_request();
 	g_thread_yield();
 }
 
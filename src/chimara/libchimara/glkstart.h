@@ -55,5 +55,24 @@ extern strid_t glkunix_stream_open_pathname_gen(char *pathname,
 extern strid_t glkunix_stream_open_pathname(char *pathname, glui32 textmode, 
     glui32 rock);
 
+/* Chimara extension: checkpoints for replaying a tree of commands. See
+    glkunix_set_checkpoint_functions(). */
+#define GLKUNIX_CHECKPOINTS (1)
+
+extern void glkunix_set_checkpoint_functions(glui32 (*save)(void),
+    glui32 (*restore)(void), void (*discard)(void));
+
+/* Chimara extension: switching a sampling profiler on and off while the
+    program runs. See glkunix_set_profiler_functions(). */
+#define GLKUNIX_PROFILER (1)
+
+extern void glkunix_set_profiler_functions(void (*start)(glui32 interval,
+    char *debugfile, char *outfile), void (*stop)(void));
+/* Chimara extension: a program that keeps all of its state in thread-local
+    storage defines this as nonzero, so that several widgets can run it at
+    once from a single loaded copy. See ChimaraGlk:isolated. */
+#define GLKUNIX_REENTRANT (1)
+extern const int glkunix_reentrant;
+
 #endif /* GT_START_H */
 
@@ -9,204 +9,357 @@
 #include "ui-message.h"
 #include "window.h"
 
-#define BUFFER_SIZE (1024)
-#define IMAGE_CACHE_MAX_NUM 10
+/* Decoded images, including scaled copies, are kept until together they take
+up more than this many bytes; then the least recently drawn ones are dropped */
+#define IMAGE_CACHE_MAX_BYTES (32 * 1024 * 1024)
+/* Number of threads decoding images in the background */
+#define IMAGE_DECODE_THREADS 2
 
 extern GPrivate glk_data_key;
-void on_size_prepared(GdkPixbufLoader *loader, gint width, gint height, struct image_info *info);
-void on_pixbuf_closed(GdkPixbufLoader *loader, gpointer data);
 glui32 draw_image_common(winid_t win, GdkPixbuf *pixbuf, glsi32 val1, glsi32 val2);
 
-static gboolean image_loaded;
-static gboolean size_determined;
+/* The cache is a hash table keyed by resource number and requested size (0 by 0
+for the image at its own size), in which every entry is also its own key. Once an
+entry has finished decoding and the Glk thread has collected it, it is also on
+the image_cache_lru queue, most recently used first. */
+static guint
+image_info_hash(gconstpointer key)
+{
+	const struct image_info *info = key;
+	return (info->resource_number * 0x9E3779B1u) ^ ((guint)info->key_width << 16) ^ (guint)info->key_height;
+}
 
-static struct image_info*
-load_image_from_blorb(giblorb_result_t resource, glui32 image, gint width, gint height)
+static gboolean
+image_info_equal(gconstpointer a, gconstpointer b)
 {
-	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
-	GError *pixbuf_error = NULL;
-	guchar *buffer;
+	const struct image_info *info_a = a, *info_b = b;
+	return info_a->resource_number == info_b->resource_number
+		&& info_a->key_width == info_b->key_width
+		&& info_a->key_height == info_b->key_height;
+}
 
-	struct image_info *info = g_new0(struct image_info, 1);
-	info->resource_number = image;
+static void
+image_info_free(struct image_info *info)
+{
+	g_clear_object(&info->pixbuf);
+	g_free(info->filename);
+	g_free(info);
+}
 
-	/* Load the resource */
-	GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
-	g_signal_connect( loader, "size-prepared", G_CALLBACK(on_size_prepared), info ); 
-	g_signal_connect( loader, "closed", G_CALLBACK(on_pixbuf_closed), NULL ); 
+/* Data passed to the pixbuf loader's signal handlers in a decoding thread */
+struct decode_job {
+	ChimaraGlkPrivate *glk_data;
+	struct image_info *info;
+};
 
-	/* Scale image if necessary */
-	if(width > 0 && height > 0) {
-		gdk_pixbuf_loader_set_size(loader, width, height);
-		info->scaled = TRUE;
+/* Tells the Glk thread the size of the image as soon as the loader knows it, so
+that glk_image_get_info() doesn't have to wait for the whole image */
+static void
+on_size_prepared(GdkPixbufLoader *loader, gint width, gint height, struct decode_job *job)
+{
+	g_mutex_lock(&job->glk_data->resource_lock);
+	if(job->info->key_width == 0) {
+		job->info->width = width;
+		job->info->height = height;
 	}
+	job->info->size_known = TRUE;
+	g_cond_broadcast(&job->glk_data->resource_info_available);
+	g_mutex_unlock(&job->glk_data->resource_lock);
+}
 
-	glk_stream_set_position(glk_data->resource_file, resource.data.startpos, seekmode_Start);
-	buffer = g_malloc( BUFFER_SIZE * sizeof(guchar) );
-
-	guint32 total_read = 0;
-	image_loaded = FALSE;
-	while(total_read < resource.length && !image_loaded) {
-		guint32 num_read = glk_get_buffer_stream(glk_data->resource_file, (char *) buffer, BUFFER_SIZE);
-
-		if( !gdk_pixbuf_loader_write(loader, buffer, MIN(BUFFER_SIZE, num_read), &pixbuf_error) ) {
-			WARNING_S("Cannot read image", pixbuf_error->message);
-			giblorb_unload_chunk(glk_data->resource_map, image);
-			gdk_pixbuf_loader_close(loader, &pixbuf_error);
-			g_free(buffer);
-			return NULL;
+/* Runs in a decoding thread. Decodes the image described by @info, at the
+requested size if it has one, from the Blorb chunk data or from the file that
+the resource load callback named. */
+static void
+decode_image(struct image_info *info, ChimaraGlkPrivate *glk_data)
+{
+	GError *error = NULL;
+	GdkPixbuf *pixbuf = NULL;
+
+	if(info->filename) {
+		if(info->key_width > 0)
+			pixbuf = gdk_pixbuf_new_from_file_at_scale(info->filename, info->key_width, info->key_height, FALSE, &error);
+		else
+			pixbuf = gdk_pixbuf_new_from_file(info->filename, &error);
+		if(pixbuf == NULL) {
+			IO_WARNING("Error loading resource from alternative location", info->filename, error->message);
+			g_error_free(error);
 		}
-
-		total_read += num_read;
+	} else {
+		struct decode_job job = { glk_data, info };
+		GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+		g_signal_connect(loader, "size-prepared", G_CALLBACK(on_size_prepared), &job);
+		if(info->key_width > 0)
+			gdk_pixbuf_loader_set_size(loader, info->key_width, info->key_height);
+
+		/* The chunk data points straight into the mapped Blorb file if it
+		could be mapped, so the loader reads the image without any copying */
+		gboolean written = gdk_pixbuf_loader_write(loader, info->data, info->length, &error);
+		if(!written) {
+			WARNING_S("Cannot read image", error->message);
+			g_clear_error(&error);
+		}
+		if(gdk_pixbuf_loader_close(loader, written? &error : NULL) && written) {
+			pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+			if(pixbuf)
+				g_object_ref(pixbuf);
+		} else if(error) {
+			WARNING_S("Cannot read image", error->message);
+			g_error_free(error);
+		}
+		g_object_unref(loader);
 	}
-	gdk_pixbuf_loader_close(loader, &pixbuf_error);
-	giblorb_unload_chunk(glk_data->resource_map, resource.chunknum);
-	g_free(buffer);
 
-	/* Wait for the PixbufLoader to finish loading the image */
 	g_mutex_lock(&glk_data->resource_lock);
-	while(!image_loaded) {
-		g_cond_wait(&glk_data->resource_loaded, &glk_data->resource_lock);
+	info->pixbuf = pixbuf;
+	if(pixbuf) {
+		info->width = gdk_pixbuf_get_width(pixbuf);
+		info->height = gdk_pixbuf_get_height(pixbuf);
 	}
+	info->size_known = TRUE;
+	info->decoded = TRUE;
+	g_cond_broadcast(&glk_data->resource_info_available);
+	g_cond_broadcast(&glk_data->resource_loaded);
 	g_mutex_unlock(&glk_data->resource_lock);
+}
 
-	info->pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
-	g_object_ref(info->pixbuf);
+/* Returns the cache entry for @image at the requested size, or at its own size
+if @width and @height are 0, if there is one, whether or not it has finished
+decoding */
+static struct image_info *
+image_cache_lookup(ChimaraGlkPrivate *glk_data, glui32 image, int width, int height)
+{
+	if(glk_data->image_cache == NULL)
+		return NULL;
 
-	g_object_unref(loader);
-	return info;
+	struct image_info key = { 0 };
+	key.resource_number = image;
+	key.key_width = width;
+	key.key_height = height;
+	return g_hash_table_lookup(glk_data->image_cache, &key);
 }
 
-static struct image_info *
-load_image_from_file(const gchar *filename, glui32 image, gint width, gint height)
+/* Returns TRUE if some other entry still being decoded reads the same Blorb
+chunk as @info */
+static gboolean
+image_chunk_in_use(ChimaraGlkPrivate *glk_data, struct image_info *info)
 {
-	GError *err = NULL;
-	
-	struct image_info *info = g_new0(struct image_info, 1);
-	info->resource_number = image;
-	
-	if(width > 0 && height > 0) {
-		info->scaled = TRUE;
-		info->pixbuf = gdk_pixbuf_new_from_file_at_size(filename, width, height, &err);
-	} else {
-		info->pixbuf = gdk_pixbuf_new_from_file(filename, &err);
+	GHashTableIter iter;
+	struct image_info *other;
+	g_hash_table_iter_init(&iter, glk_data->image_cache);
+	while(g_hash_table_iter_next(&iter, (gpointer *)&other, NULL)) {
+		if(other != info && !other->collected && other->chunknum == info->chunknum)
+			return TRUE;
 	}
-	if(!info->pixbuf) {
-		IO_WARNING("Error loading resource from alternative location", filename, err->message);
-		g_error_free(err);
-		g_free(info);
-		return NULL;
+	return FALSE;
+}
+
+/* Drops the least recently used images until the cache is within its budget,
+but never @keep */
+static void
+image_cache_evict(ChimaraGlkPrivate *glk_data, struct image_info *keep)
+{
+	while(glk_data->image_cache_bytes > IMAGE_CACHE_MAX_BYTES) {
+		GList *link = g_queue_peek_tail_link(&glk_data->image_cache_lru);
+		struct image_info *info = link->data;
+		if(info == keep)
+			break;
+		g_queue_unlink(&glk_data->image_cache_lru, link);
+		glk_data->image_cache_bytes -= info->bytes;
+		g_hash_table_remove(glk_data->image_cache, info);
 	}
-	g_object_ref(info->pixbuf);
+}
 
-	return info;
+/* Called once @info has finished decoding. Unloads the chunk it was decoded
+from, if nothing else still needs it, and puts the image on the LRU queue as
+the most recently used one. Returns FALSE, and drops @info from the cache, if
+the image could not be decoded. Doesn't evict anything. */
+static gboolean
+image_collect(ChimaraGlkPrivate *glk_data, struct image_info *info)
+{
+	/* The decoder no longer needs the chunk data */
+	info->collected = TRUE;
+	if(info->chunknum != G_MAXUINT32 && !image_chunk_in_use(glk_data, info))
+		giblorb_unload_chunk(glk_data->resource_map, info->chunknum);
+	info->data = NULL;
+
+	if(info->pixbuf == NULL) {
+		g_hash_table_remove(glk_data->image_cache, info);
+		return FALSE;
+	}
+
+	info->bytes = (gsize)gdk_pixbuf_get_rowstride(info->pixbuf) * gdk_pixbuf_get_height(info->pixbuf);
+	info->lru_link.data = info;
+	g_queue_push_head_link(&glk_data->image_cache_lru, &info->lru_link);
+	glk_data->image_cache_bytes += info->bytes;
+	return TRUE;
 }
 
-static struct image_info*
-load_image_in_cache(glui32 image, gint width, gint height)
+/* Collects every image that has finished decoding but was never drawn, such as
+one that glk_image_get_info() only measured, so that it counts towards the
+budget and its chunk is unloaded; then evicts as needed */
+static void
+image_cache_collect_finished(ChimaraGlkPrivate *glk_data)
 {
-	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
-	struct image_info *info = NULL;
-	
+	if(glk_data->image_cache == NULL)
+		return;
+
+	GHashTableIter iter;
+	struct image_info *info;
+	GSList *finished = NULL;
+	g_mutex_lock(&glk_data->resource_lock);
+	g_hash_table_iter_init(&iter, glk_data->image_cache);
+	while(g_hash_table_iter_next(&iter, (gpointer *)&info, NULL)) {
+		if(!info->collected && info->decoded)
+			finished = g_slist_prepend(finished, info);
+	}
+	g_mutex_unlock(&glk_data->resource_lock);
+
+	GSList *item;
+	for(item = finished; item != NULL; item = g_slist_next(item))
+		image_collect(glk_data, item->data);
+	g_slist_free(finished);
+	image_cache_evict(glk_data, NULL);
+}
+
+/* Adds a cache entry for @image at the requested size and starts decoding it in
+the background. Returns NULL if there is no such image. */
+static struct image_info *
+image_cache_start_decode(ChimaraGlkPrivate *glk_data, glui32 image, int width, int height)
+{
+	/* A new image is about to take up memory, so first bring any images that
+	were only measured into the budget */
+	image_cache_collect_finished(glk_data);
+
+	struct image_info *info = g_new0(struct image_info, 1);
+	info->resource_number = image;
+	info->key_width = width;
+	info->key_height = height;
+	info->width = width;
+	info->height = height;
+	info->scaled = (width > 0);
+	info->chunknum = G_MAXUINT32;
+
 	/* Lookup the proper resource */
 	if(!glk_data->resource_map) {
 		if(!glk_data->resource_load_callback) {
 			WARNING("No resource map has been loaded yet.");
+			g_free(info);
 			return NULL;
 		}
-		gchar *filename = glk_data->resource_load_callback(CHIMARA_RESOURCE_IMAGE, image, glk_data->resource_load_callback_data);
-		if(!filename) {
+		info->filename = glk_data->resource_load_callback(CHIMARA_RESOURCE_IMAGE, image, glk_data->resource_load_callback_data);
+		if(!info->filename) {
 			WARNING("Error loading resource from alternative location");
+			g_free(info);
 			return NULL;
 		}
-		info = load_image_from_file(filename, image, width, height);
-		g_free(filename);
 	} else {
 		giblorb_result_t resource;
-		giblorb_err_t blorb_error = giblorb_load_resource(glk_data->resource_map, giblorb_method_FilePos, &resource, giblorb_ID_Pict, image);
+		giblorb_err_t blorb_error = giblorb_load_resource(glk_data->resource_map, giblorb_method_Memory, &resource, giblorb_ID_Pict, image);
 		if(blorb_error != giblorb_err_None) {
 			WARNING_S( "Error loading resource", giblorb_get_error_message(blorb_error) );
+			g_free(info);
 			return NULL;
 		}
-		info = load_image_from_blorb(resource, image, width, height);
+		info->data = resource.data.ptr;
+		info->length = resource.length;
+		info->chunknum = resource.chunknum;
 	}
 
-	if(info == NULL)
-		return NULL;
-
-	/* Store the image in the cache */
-	if( g_slist_length(glk_data->image_cache) >= IMAGE_CACHE_MAX_NUM ) {
-		struct image_info *head = (struct image_info*) glk_data->image_cache->data;
-		g_object_unref(head->pixbuf);
-		g_free(head);
-		glk_data->image_cache = g_slist_remove_link(glk_data->image_cache, glk_data->image_cache);
+	if(glk_data->image_cache == NULL) {
+		glk_data->image_cache = g_hash_table_new_full(image_info_hash, image_info_equal, NULL, (GDestroyNotify)image_info_free);
+		g_queue_init(&glk_data->image_cache_lru);
 	}
-	info->width = gdk_pixbuf_get_width(info->pixbuf);
-	info->height = gdk_pixbuf_get_height(info->pixbuf);
-	glk_data->image_cache = g_slist_prepend(glk_data->image_cache, info);
+	if(glk_data->image_decoder == NULL)
+		glk_data->image_decoder = g_thread_pool_new((GFunc)decode_image, glk_data, IMAGE_DECODE_THREADS, FALSE, NULL);
 
+	g_hash_table_add(glk_data->image_cache, info);
+	g_thread_pool_push(glk_data->image_decoder, info, NULL);
 	return info;
 }
 
-void
-on_size_prepared(GdkPixbufLoader *loader, gint width, gint height, struct image_info *info)
+/* Waits until the size of @info is known, and stores it in @width and @height.
+Returns FALSE, and drops @info from the cache, if the image could not be
+decoded. */
+static gboolean
+image_wait_for_size(ChimaraGlkPrivate *glk_data, struct image_info *info, int *width, int *height)
 {
-	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
-
+	gboolean failed;
 	g_mutex_lock(&glk_data->resource_lock);
-	info->width = width;
-	info->height = height;
-	size_determined = TRUE;
-	g_cond_broadcast(&glk_data->resource_info_available);
+	while(!info->size_known)
+		g_cond_wait(&glk_data->resource_info_available, &glk_data->resource_lock);
+	failed = info->decoded && info->pixbuf == NULL;
+	/* The decoding thread may still be writing the size it decoded to */
+	*width = info->width;
+	*height = info->height;
 	g_mutex_unlock(&glk_data->resource_lock);
+
+	if(failed) {
+		if(info->chunknum != G_MAXUINT32 && !image_chunk_in_use(glk_data, info))
+			giblorb_unload_chunk(glk_data->resource_map, info->chunknum);
+		g_hash_table_remove(glk_data->image_cache, info);
+		return FALSE;
+	}
+	return TRUE;
 }
 
-void
-on_pixbuf_closed(GdkPixbufLoader *loader, gpointer data)
+/* Waits until @info has finished decoding, and marks it as the most recently
+used image. Returns FALSE, and drops @info from the cache, if the image could
+not be decoded. */
+static gboolean
+image_wait_for_pixbuf(ChimaraGlkPrivate *glk_data, struct image_info *info)
 {
-	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
+	if(!info->collected) {
+		g_mutex_lock(&glk_data->resource_lock);
+		while(!info->decoded)
+			g_cond_wait(&glk_data->resource_loaded, &glk_data->resource_lock);
+		g_mutex_unlock(&glk_data->resource_lock);
 
-	g_mutex_lock(&glk_data->resource_lock);
-	image_loaded = TRUE;
-	g_cond_broadcast(&glk_data->resource_loaded);
-	g_mutex_unlock(&glk_data->resource_lock);
+		if(!image_collect(glk_data, info))
+			return FALSE;
+		image_cache_evict(glk_data, info);
+		return TRUE;
+	}
+
+	g_queue_unlink(&glk_data->image_cache_lru, &info->lru_link);
+	g_queue_push_head_link(&glk_data->image_cache_lru, &info->lru_link);
+	return TRUE;
 }
 
-static struct image_info*
-image_cache_find(struct image_info* to_find)
+/* Internal function: waits for any images still being decoded and empties the
+image cache. Called when the resource map that the images came from goes away,
+and when the widget is finalized. */
+void
+image_cache_clear(ChimaraGlkPrivate *glk_data)
 {
-	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
-	GSList *link = glk_data->image_cache;
-
-	/* Empty cache */
-	if(link == NULL)
-		return NULL;
-
-	/* Iterate over the cache to find the correct image and size */
-	struct image_info *match = NULL;
-	do {
-		struct image_info *info = (struct image_info*) link->data;
-		if(info->resource_number == to_find->resource_number) {
-			/* Check size: are we looking for a scaled version or the original one? */
-			if(to_find->scaled) {
-
-				if(info->width == to_find->width && info->height == to_find->height) {
-					/* Prescaled image found */
-					return info;
-				}
-				else if(info->width >= to_find->width && info->height >= to_find->height) {
-					/* Larger image found, needs to be scaled down in order to work */
-					match = info;
-				}
-			} else {
-				if(!info->scaled) {
-					return info; /* Found a match */
-				}
-			}
-		}
-	} while( (link = g_slist_next(link)) );
+	if(glk_data->image_decoder) {
+		g_thread_pool_free(glk_data->image_decoder, FALSE, TRUE);
+		glk_data->image_decoder = NULL;
+	}
+	if(glk_data->image_cache) {
+		g_hash_table_remove_all(glk_data->image_cache);
+		g_queue_init(&glk_data->image_cache_lru);
+		glk_data->image_cache_bytes = 0;
+	}
+}
 
-	return match;
+/* Sends @pixbuf to the UI thread to be drawn in @win; the message holds a
+reference so that the image may leave the cache before it is drawn */
+static void
+queue_draw_image(winid_t win, GdkPixbuf *pixbuf, glsi32 val1, glsi32 val2)
+{
+	UiMessage *msg;
+	if(win->type == wintype_Graphics) {
+		msg = ui_message_new(UI_MESSAGE_GRAPHICS_DRAW_IMAGE, win);
+		msg->ptrval = g_object_ref(pixbuf);
+		msg->x = val1;
+		msg->y = val2;
+	} else {
+		msg = ui_message_new(UI_MESSAGE_BUFFER_DRAW_IMAGE, win);
+		msg->ptrval = g_object_ref(pixbuf);
+		msg->uintval1 = val1;
+	}
+	ui_message_queue(msg);
 }
 
 /**
@@ -239,21 +392,24 @@ image_cache_find(struct image_info* to_find)
 glui32
 glk_image_get_info(glui32 image, glui32 *width, glui32 *height)
 {
-	struct image_info *to_find = g_new0(struct image_info, 1);
-	struct image_info *found;
-	to_find->resource_number = image;
-	to_find->scaled = FALSE; /* we want the original image size */
+	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
 
-	if( !(found = image_cache_find(to_find)) ) {
-		found = load_image_in_cache(image, 0, 0);
+	/* Games usually ask for the size of an image just before drawing it, so
+	start decoding the whole image now, but only wait for its size */
+	struct image_info *found = image_cache_lookup(glk_data, image, 0, 0);
+	if(found == NULL) {
+		found = image_cache_start_decode(glk_data, image, 0, 0);
 		if(found == NULL)
 			return FALSE;
 	}
+	int found_width, found_height;
+	if(!image_wait_for_size(glk_data, found, &found_width, &found_height))
+		return FALSE;
 
 	if(width != NULL)
-		*width = found->width;
+		*width = found_width;
 	if(height != NULL)
-		*height = found->height;
+		*height = found_height;
 	return TRUE;
 }
 
@@ -291,31 +447,19 @@ glk_image_draw(winid_t win, glui32 image, glsi32 val1, glsi32 val2)
 	VALID_WINDOW(win, return FALSE);
 	g_return_val_if_fail(win->type == wintype_Graphics || win->type == wintype_TextBuffer, FALSE);
 
-	struct image_info *to_find = g_new0(struct image_info, 1);
-	struct image_info *info;
+	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
 
 	/* Lookup the proper resource */
-	to_find->resource_number = image;
-	to_find->scaled = FALSE; /* we want the original image size */
-
-	if( !(info = image_cache_find(to_find)) ) {
-		info = load_image_in_cache(image, 0, 0);
+	struct image_info *info = image_cache_lookup(glk_data, image, 0, 0);
+	if(info == NULL) {
+		info = image_cache_start_decode(glk_data, image, 0, 0);
 		if(info == NULL)
 			return FALSE;
 	}
+	if(!image_wait_for_pixbuf(glk_data, info))
+		return FALSE;
 
-	UiMessage *msg;
-	if(win->type == wintype_Graphics) {
-		msg = ui_message_new(UI_MESSAGE_GRAPHICS_DRAW_IMAGE, win);
-		msg->ptrval = info->pixbuf;
-		msg->x = val1;
-		msg->y = val2;
-	} else {
-		msg = ui_message_new(UI_MESSAGE_BUFFER_DRAW_IMAGE, win);
-		msg->ptrval = info->pixbuf;
-		msg->uintval1 = val1;
-	}
-	ui_message_queue(msg);
+	queue_draw_image(win, info->pixbuf, val1, val2);
 
 	/* There is currently no way for the drawing not to succeed, so we don't
 	have to wait for an answer from the UI thread */
@@ -353,49 +497,37 @@ glk_image_draw_scaled(winid_t win, glui32 image, glsi32 val1, glsi32 val2, glui3
 	g_return_val_if_fail(width != 0 && height != 0, FALSE);
 
 	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
-	struct image_info *to_find = g_new0(struct image_info, 1);
-	struct image_info *info;
-	struct image_info *scaled_info;
 
-	/* Lookup the proper resource */
-	to_find->resource_number = image;
-	to_find->scaled = TRUE; /* any image size equal or larger than requested will do */
-
-	if( !(info = image_cache_find(to_find)) ) {
-		info = load_image_in_cache(image, width, height);
-		if(info == NULL)
-			return FALSE;
-	}
-
-	/* Scale the image if necessary */
-	if(info->width != width || info->height != height) {
-		GdkPixbuf *scaled = gdk_pixbuf_scale_simple(info->pixbuf, width, height, GDK_INTERP_BILINEAR);
-
-		/* Add the scaled image into the image cache */
-		scaled_info = g_new0(struct image_info, 1);
-		scaled_info->resource_number = info->resource_number;
-		scaled_info->width = gdk_pixbuf_get_width(scaled);
-		scaled_info->height = gdk_pixbuf_get_width(scaled);
-		scaled_info->pixbuf = scaled;
-		scaled_info->scaled = TRUE;
-		glk_data->image_cache = g_slist_prepend(glk_data->image_cache, scaled_info);
-
-		/* Continue working with the scaled version */
-		info = scaled_info;
+	/* Scaled copies are cached under the size they were drawn at, so drawing
+	the same image at the same size again doesn't scale it again */
+	struct image_info *info = image_cache_lookup(glk_data, image, width, height);
+	if(info == NULL) {
+		struct image_info *original = image_cache_lookup(glk_data, image, 0, 0);
+		if(original != NULL && image_wait_for_pixbuf(glk_data, original)) {
+			/* Scale the decoded image and add the copy to the cache */
+			info = g_new0(struct image_info, 1);
+			info->resource_number = image;
+			info->key_width = width;
+			info->key_height = height;
+			info->pixbuf = gdk_pixbuf_scale_simple(original->pixbuf, width, height, GDK_INTERP_BILINEAR);
+			info->width = width;
+			info->height = height;
+			info->scaled = TRUE;
+			info->chunknum = G_MAXUINT32;
+			info->size_known = TRUE;
+			info->decoded = TRUE;
+			g_hash_table_add(glk_data->image_cache, info);
+		} else {
+			/* Let the loader decode the image at the requested size */
+			info = image_cache_start_decode(glk_data, image, width, height);
+			if(info == NULL)
+				return FALSE;
+		}
 	}
+	if(!image_wait_for_pixbuf(glk_data, info))
+		return FALSE;
 
-	UiMessage *msg;
-	if(win->type == wintype_Graphics) {
-		msg = ui_message_new(UI_MESSAGE_GRAPHICS_DRAW_IMAGE, win);
-		msg->ptrval = info->pixbuf;
-		msg->x = val1;
-		msg->y = val2;
-	} else {
-		msg = ui_message_new(UI_MESSAGE_BUFFER_DRAW_IMAGE, win);
-		msg->ptrval = info->pixbuf;
-		msg->uintval1 = val1;
-	}
-	ui_message_queue(msg);
+	queue_draw_image(win, info->pixbuf, val1, val2);
 
 	/* There is currently no way for the drawing not to succeed, so we don't
 	have to wait for an answer from the UI thread */
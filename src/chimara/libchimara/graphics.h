@@ -6,12 +6,33 @@
 #include <glib.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
+#include "chimara-glk-private.h"
+
 struct image_info {
 	uint32_t resource_number;
 	int width;
 	int height;
 	GdkPixbuf *pixbuf;
 	gboolean scaled;
+
+	/* Cache key: the size the image was asked for, or 0 by 0 for its own size */
+	int key_width;
+	int key_height;
+	/* What the decoding thread reads: a Blorb chunk, which is unloaded once it
+	is done, or else a file named by the resource load callback */
+	uint32_t chunknum;  /* G_MAXUINT32 if none */
+	const void *data;
+	size_t length;
+	char *filename;
+	/* Progress of decoding, protected by the library's resource_lock */
+	gboolean size_known;
+	gboolean decoded;
+	/* Cache bookkeeping, only touched by the Glk thread once decoding is done */
+	gboolean collected;
+	gsize bytes;
+	GList lru_link;
 };
 
+G_GNUC_INTERNAL void image_cache_clear(ChimaraGlkPrivate *glk_data);
+
 #endif
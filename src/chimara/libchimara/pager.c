@@ -3,6 +3,7 @@
 
 #include "chimara-glk.h"
 #include "glk.h"
+#include "ui-buffer.h"
 #include "window.h"
 
 /* Not sure if necessary, but this is the margin within which the pager will
@@ -90,6 +91,10 @@ pager_on_clicked(GtkButton *pager, winid_t win)
 void
 pager_after_adjustment_changed(GtkAdjustment *adj, winid_t win)
 {
+	/* If the user has reached the top, bring back any text trimmed off it */
+	if(gtk_adjustment_get_value(adj) <= gtk_adjustment_get_lower(adj))
+		ui_buffer_page_in_scrollback(win);
+
 	/* Move the pager, etc. */
 	gint scroll_distance, view_height;
    	move_pager_and_get_scroll_distance( GTK_TEXT_VIEW(win->widget), &view_height, &scroll_distance, TRUE );
@@ -0,0 +1,71 @@
+#include <glib.h>
+
+#include "chimara-glk-private.h"
+#include "glk.h"
+#include "glkstart.h"
+#include "profiler.h"
+
+extern GPrivate glk_data_key;
+
+/**
+ * glkunix_set_profiler_functions:
+ * @start: Function that starts sampling the program every @interval units of
+ * work, names routines using the debugging information file @debugfile if it
+ * is not %NULL, and writes its results to @outfile when stopped.
+ * @stop: Function that stops sampling and writes out the results.
+ *
+ * Lets a program controlling the Glk library, such as an IDE, switch the
+ * program's profiler on and off while it runs, without restarting it. What
+ * one unit of work means is up to the program; an interpreter might count
+ * virtual machine instructions.
+ *
+ * The functions are called from inside glk_tick() or glk_select(), so the
+ * program must be able to start and stop profiling at any point where it
+ * calls those. @debugfile and @outfile are owned by the library and are only
+ * valid for the duration of the call to @start.
+ *
+ * Call this function from glkunix_startup_code(). Passing %NULL for @start
+ * means the program does not support profiling, which is the default.
+ *
+ * > # Chimara #
+ * > This function is a Chimara extension.
+ */
+void
+glkunix_set_profiler_functions(void (*start)(glui32 interval, char *debugfile, char *outfile), void (*stop)(void))
+{
+	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
+	glk_data->profiler_start = start;
+	glk_data->profiler_stop = stop;
+}
+
+/* Internal function: if chimara_glk_start_profiling() or
+chimara_glk_stop_profiling() has been called since the last time, pass the
+request on to the Glk program. Called from the Glk thread only. */
+void
+check_for_profiler_request(void)
+{
+	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
+
+	if(!g_atomic_int_get(&glk_data->profiler_request_pending))
+		return;
+
+	g_mutex_lock(&glk_data->profiler_lock);
+	g_atomic_int_set(&glk_data->profiler_request_pending, 0);
+	gboolean start = glk_data->profiler_request_start;
+	guint interval = glk_data->profiler_interval;
+	char *debug_file = glk_data->profiler_debug_file;
+	char *output_file = glk_data->profiler_output_file;
+	glk_data->profiler_debug_file = NULL;
+	glk_data->profiler_output_file = NULL;
+	g_mutex_unlock(&glk_data->profiler_lock);
+
+	if(glk_data->profiler_start) {
+		if(start)
+			glk_data->profiler_start(interval, debug_file, output_file);
+		else
+			glk_data->profiler_stop();
+	}
+
+	g_free(debug_file);
+	g_free(output_file);
+}
@@ -0,0 +1,8 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glib.h>
+
+G_GNUC_INTERNAL void check_for_profiler_request(void);
+
+#endif
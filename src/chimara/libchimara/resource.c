@@ -2,6 +2,7 @@
 
 #include "chimara-glk-private.h"
 #include "glk.h"
+#include "graphics.h"
 #include "magic.h"
 
 extern GPrivate glk_data_key;
@@ -35,6 +36,7 @@ giblorb_set_resource_map(strid_t file)
 	/* Check if there was already an existing resource map */
 	if(glk_data->resource_map != NULL) {
 		WARNING("Overwriting existing resource map.\n");
+		image_cache_clear(glk_data);
 		giblorb_destroy_map(glk_data->resource_map);
 		glk_stream_close(glk_data->resource_file, NULL);
 	}
@@ -537,11 +537,9 @@ glk_stream_open_resource(glui32 filenum, glui32 rock)
 	our new stream. It's important to not call chunk_unload() until
 	the stream is closed (and we won't).
 
-	This will be memory-hoggish for giant data chunks, but I don't
-	expect giant data chunks at this point. A more efficient model
-	would be to use the file on disk, but this requires some hacking
-	into the file stream code (we'd need to open a new FILE*) and
-	I don't feel like doing that. */
+	When the Blorb file could be mapped into memory, this is a read-only
+	slice of the mapping rather than a copy, so even giant data chunks
+	cost nothing until they are read. */
 
 	if(res.chunktype == giblorb_ID_TEXT)
 		isbinary = FALSE;
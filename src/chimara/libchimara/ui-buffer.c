@@ -268,9 +268,177 @@ ui_buffer_create(winid_t win, ChimaraGlk *glk)
 	gtk_text_buffer_create_mark(screen, "pager_position", &end, TRUE);
 }
 
+/* A text buffer is trimmed only once it has grown this fraction of the
+ * scrollback limit past the limit, so that the cost of deleting from the top of
+ * the buffer is paid once per chunk of text rather than once per line */
+#define SCROLLBACK_CHUNK_DIVISOR 8
+
+/* Text trimmed off the top of a text buffer window, most recent last. Each
+ * trim appends one chunk to the file, and paging back in takes the last chunk
+ * off again, so the file is used as a stack. */
+struct UiBufferSpill {
+	GFile *file;
+	GFileIOStream *stream;
+	goffset length;
+	GArray *chunks;  /* goffset at which each chunk starts */
+};
+
+static struct UiBufferSpill *
+spill_new(void)
+{
+	GError *error = NULL;
+	GFileIOStream *stream;
+	GFile *file = g_file_new_tmp("chimara-scrollback-XXXXXX", &stream, &error);
+	if(file == NULL) {
+		g_warning("Could not create scrollback file: %s", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	struct UiBufferSpill *spill = g_slice_new0(struct UiBufferSpill);
+	spill->file = file;
+	spill->stream = stream;
+	spill->chunks = g_array_new(FALSE, FALSE, sizeof(goffset));
+	return spill;
+}
+
+void
+ui_buffer_spill_free(struct UiBufferSpill *spill)
+{
+	g_io_stream_close(G_IO_STREAM(spill->stream), NULL, NULL);
+	g_file_delete(spill->file, NULL, NULL);
+	g_object_unref(spill->stream);
+	g_object_unref(spill->file);
+	g_array_free(spill->chunks, TRUE);
+	g_slice_free(struct UiBufferSpill, spill);
+}
+
+/* Writes @text, which is about to be trimmed off the top of @win, to the end of
+ * the window's scrollback file as a new chunk */
+static void
+spill_text(winid_t win, const char *text)
+{
+	if(win->spill == NULL)
+		win->spill = spill_new();
+	struct UiBufferSpill *spill = win->spill;
+	if(spill == NULL)
+		return;
+
+	GError *error = NULL;
+	gsize len = strlen(text);
+	GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(spill->stream));
+	if(!g_seekable_seek(G_SEEKABLE(spill->stream), spill->length, G_SEEK_SET, NULL, &error)
+		|| !g_output_stream_write_all(out, text, len, NULL, NULL, &error)) {
+		g_warning("Could not write scrollback file: %s", error->message);
+		g_error_free(error);
+		return;
+	}
+	g_array_append_val(spill->chunks, spill->length);
+	spill->length += len;
+}
+
+/* Takes the most recently trimmed chunk of text out of @win's scrollback file
+ * and puts it back at the top of the window, keeping the text that the user was
+ * looking at in view. Returns FALSE if there was nothing to page in. Called when
+ * the user scrolls to the top of the window. */
+gboolean
+ui_buffer_page_in_scrollback(winid_t win)
+{
+	struct UiBufferSpill *spill = win->spill;
+	if(spill == NULL || spill->chunks->len == 0)
+		return FALSE;
+
+	GError *error = NULL;
+	goffset start = g_array_index(spill->chunks, goffset, spill->chunks->len - 1);
+	gsize len = spill->length - start;
+	char *text = g_malloc(len);
+	GInputStream *in = g_io_stream_get_input_stream(G_IO_STREAM(spill->stream));
+	if(!g_seekable_seek(G_SEEKABLE(spill->stream), start, G_SEEK_SET, NULL, &error)
+		|| !g_input_stream_read_all(in, text, len, NULL, NULL, &error)) {
+		g_warning("Could not read scrollback file: %s", error->message);
+		g_error_free(error);
+		g_free(text);
+		return FALSE;
+	}
+	g_array_set_size(spill->chunks, spill->chunks->len - 1);
+	spill->length = start;
+	g_seekable_truncate(G_SEEKABLE(spill->stream), start, NULL, NULL);
+
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
+	GtkAdjustment *adj = gtk_scrolled_window_get_vadjustment( GTK_SCROLLED_WINDOW(win->scrolledwindow) );
+	GtkTextIter iter;
+	gtk_text_buffer_get_start_iter(buffer, &iter);
+	GtkTextMark *old_top = gtk_text_buffer_create_mark(buffer, NULL, &iter, FALSE);
+
+	/* This is not the player typing, and not the player scrolling either */
+	g_signal_handler_block(buffer, win->insert_text_handler);
+	g_signal_handler_block(adj, win->pager_adjustment_handler);
+	gtk_text_buffer_insert_with_tags_by_name(buffer, &iter, text, len, "uneditable", NULL);
+	gtk_text_view_scroll_to_mark( GTK_TEXT_VIEW(win->widget), old_top, 0.0, TRUE, 0.0, 0.0 );
+	g_signal_handler_unblock(adj, win->pager_adjustment_handler);
+	g_signal_handler_unblock(buffer, win->insert_text_handler);
+
+	gtk_text_buffer_delete_mark(buffer, old_top);
+	g_free(text);
+	return TRUE;
+}
+
+/* Deletes whole lines from the top of @win once it holds more than the
+ * #ChimaraGlk:scrollback-lines limit, writing them to disk first if
+ * #ChimaraGlk:scrollback-spill is set. Leaves the window alone while the user
+ * has scrolled back, and never deletes text they have not seen yet. */
+static void
+trim_scrollback(winid_t win, ChimaraGlk *glk)
+{
+	guint limit = chimara_glk_get_scrollback_lines(glk);
+	if(limit == 0 || win->currently_paging)
+		return;
+
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
+	guint lines = gtk_text_buffer_get_line_count(buffer);
+	if(lines <= limit + MAX(limit / SCROLLBACK_CHUNK_DIVISOR, 1))
+		return;
+
+	GtkTextIter start, cut;
+	gtk_text_buffer_get_start_iter(buffer, &start);
+	gtk_text_buffer_get_iter_at_line(buffer, &cut, lines - limit);
+	if(chimara_glk_get_interactive(glk)) {
+		GtkTextIter pager;
+		GtkTextMark *pager_position = gtk_text_buffer_get_mark(buffer, "pager_position");
+		gtk_text_buffer_get_iter_at_mark(buffer, &pager, pager_position);
+		if(gtk_text_iter_compare(&cut, &pager) > 0) {
+			cut = pager;
+			gtk_text_iter_set_line_offset(&cut, 0);
+		}
+	}
+	if(gtk_text_iter_equal(&start, &cut))
+		return;
+
+	if(chimara_glk_get_scrollback_spill(glk)) {
+		char *text = gtk_text_buffer_get_text(buffer, &start, &cut, FALSE);
+		spill_text(win, text);
+		g_free(text);
+	}
+	gtk_text_buffer_delete(buffer, &start, &cut);
+}
+
 /* Prints @text to the end of the text buffer */
 void
 ui_buffer_print_string(winid_t win, const char *text)
+{
+	UiStyleRun run;
+	run.start = 0;
+	run.end = g_utf8_strlen(text, -1);
+	run.n_tags = ui_style_get_tags(win, run.tags);
+	ui_buffer_print_runs(win, text, &run, 1);
+}
+
+/* Prints @text to the end of the text buffer in one insertion, and styles it
+ * according to @runs, whose offsets count characters from the start of @text.
+ * This is how several consecutive prints in different styles are carried out
+ * together. */
+void
+ui_buffer_print_runs(winid_t win, const char *text, const UiStyleRun *runs, unsigned n_runs)
 {
 	GtkTextBuffer *buffer = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
 	GtkTextIter start, end;
@@ -279,11 +447,20 @@ ui_buffer_print_string(winid_t win, const char *text)
 	gtk_text_buffer_get_end_iter(buffer, &end);
 	start_offset = gtk_text_iter_get_offset(&end);
 	gtk_text_buffer_insert(buffer, &end, text, -1);
+
 	gtk_text_buffer_get_iter_at_offset(buffer, &start, start_offset);
-	ui_style_apply(win, &start, &end);
+	for(unsigned count = 0; count < n_runs; count++) {
+		const UiStyleRun *run = runs + count;
+		gtk_text_iter_set_offset(&start, start_offset + run->start);
+		end = start;
+		gtk_text_iter_forward_chars(&end, run->end - run->start);
+		for(unsigned ix = 0; ix < run->n_tags; ix++)
+			gtk_text_buffer_apply_tag(buffer, run->tags[ix], &start, &end);
+	}
 
 	ChimaraGlk *glk = CHIMARA_GLK(gtk_widget_get_ancestor(win->widget, CHIMARA_TYPE_GLK));
 	g_assert(glk);
+	trim_scrollback(win, glk);
 	g_signal_emit_by_name(glk, "text-buffer-output", win->rock, win->librock, text);
 }
 
@@ -296,6 +473,9 @@ ui_buffer_clear(winid_t win)
 	GtkTextIter start, end;
 	gtk_text_buffer_get_bounds(screen, &start, &end);
 	gtk_text_buffer_delete(screen, &start, &end);
+
+	/* There is nothing above a cleared window to scroll back to */
+	g_clear_pointer(&win->spill, ui_buffer_spill_free);
 }
 
 /* Request either latin-1 or unicode line input, in a text buffer window @win. */
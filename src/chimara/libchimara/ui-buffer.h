@@ -5,13 +5,19 @@
 
 #include "chimara-glk.h"
 #include "glk.h"
+#include "ui-style.h"
+
+struct UiBufferSpill;
 
 G_GNUC_INTERNAL void ui_buffer_create(winid_t win, ChimaraGlk *glk);
 G_GNUC_INTERNAL void ui_buffer_print_string(winid_t win, const char *text);
+G_GNUC_INTERNAL void ui_buffer_print_runs(winid_t win, const char *text, const UiStyleRun *runs, unsigned n_runs);
 G_GNUC_INTERNAL void ui_buffer_clear(winid_t win);
 G_GNUC_INTERNAL void ui_buffer_request_line_event(winid_t win, glui32 maxlen, gboolean insert, const char *inserttext);
 G_GNUC_INTERNAL int ui_buffer_cancel_line_input(winid_t win);
 G_GNUC_INTERNAL int ui_buffer_force_line_input(winid_t win, const char *text);
 G_GNUC_INTERNAL void ui_buffer_draw_image(winid_t win, GdkPixbuf *pixbuf, glui32 alignment);
+G_GNUC_INTERNAL gboolean ui_buffer_page_in_scrollback(winid_t win);
+G_GNUC_INTERNAL void ui_buffer_spill_free(struct UiBufferSpill *spill);
 
 #endif /* UI_BUFFER_H */
@@ -11,6 +11,209 @@
 #include "ui-window.h"
 #include "window.h"
 
+/* One character cell of a text grid: the character and an index into the
+ * model's list of tag sets */
+typedef struct {
+	gunichar ch;
+	unsigned style;
+} UiGridCell;
+
+/* Off-screen contents of a text grid window. Printing, clearing and moving the
+ * cursor only change the cells here and mark the rows they touched; the UI
+ * message batch then calls ui_grid_flush(), which copies just the dirty rows
+ * into the GtkTextBuffer. */
+struct UiGridModel {
+	unsigned width, height;
+	UiGridCell *cells;  /* width * height, row by row */
+	gboolean *dirty;  /* one flag per row */
+	gboolean all_dirty;
+	/* The output cursor; cursor_y == height means it has gone off the end */
+	unsigned cursor_x, cursor_y;
+	/* Sets of tags that cells refer to, UiStyleRuns with only the tags filled
+	 * in. Set 0 is empty, for blanks that no style has been applied to. */
+	GArray *styles;
+};
+
+/* Largest number of tag sets to keep before ui_grid_clear() starts afresh */
+#define GRID_MAX_STYLES 64
+
+static struct UiGridModel *
+grid_model_new(void)
+{
+	struct UiGridModel *model = g_new0(struct UiGridModel, 1);
+	model->styles = g_array_new(FALSE, TRUE, sizeof(UiStyleRun));
+	g_array_set_size(model->styles, 1);
+	return model;
+}
+
+/* Frees the off-screen contents of a text grid. */
+void
+ui_grid_model_free(struct UiGridModel *model)
+{
+	g_free(model->cells);
+	g_free(model->dirty);
+	g_array_free(model->styles, TRUE);
+	g_free(model);
+}
+
+/* Helper function: returns the number of the tag set in @model that text
+ * printed in @win now gets, adding it if it is new */
+static unsigned
+grid_current_style(winid_t win, struct UiGridModel *model)
+{
+	UiStyleRun run;
+	run.n_tags = ui_style_get_tags(win, run.tags);
+	for(unsigned ix = 0; ix < model->styles->len; ix++) {
+		if(ui_style_run_same_tags(&g_array_index(model->styles, UiStyleRun, ix), &run))
+			return ix;
+	}
+	g_array_append_val(model->styles, run);
+	return model->styles->len - 1;
+}
+
+/* A stretch of a grid's text, given as character offsets, whose cells all
+ * have the same tag set */
+typedef struct {
+	int start, end;
+	unsigned style;
+} UiGridRun;
+
+/* Helper function: appends row @row of @model to @text as UTF-8, and the runs
+ * of its tag sets to @runs; @offset is the character offset in the text
+ * buffer at which the row will start */
+static void
+grid_append_row(struct UiGridModel *model, unsigned row, GString *text, GArray *runs, int offset)
+{
+	UiGridCell *cell = model->cells + row * model->width;
+	UiGridRun *last = NULL;
+	for(int col = 0; col < (int)model->width; col++, cell++) {
+		g_string_append_unichar(text, cell->ch);
+		if(last != NULL && last->style == cell->style) {
+			last->end++;
+			continue;
+		}
+		UiGridRun run = { offset + col, offset + col + 1, cell->style };
+		g_array_append_val(runs, run);
+		last = &g_array_index(runs, UiGridRun, runs->len - 1);
+	}
+}
+
+/* Helper function: applies the tag sets of @runs to the text in @buffer */
+static void
+grid_apply_runs(struct UiGridModel *model, GtkTextBuffer *buffer, GArray *runs)
+{
+	for(unsigned ix = 0; ix < runs->len; ix++) {
+		UiGridRun *run = &g_array_index(runs, UiGridRun, ix);
+		UiStyleRun *tags = &g_array_index(model->styles, UiStyleRun, run->style);
+		if(tags->n_tags == 0)
+			continue;
+		GtkTextIter start, end;
+		gtk_text_buffer_get_iter_at_offset(buffer, &start, run->start);
+		gtk_text_buffer_get_iter_at_offset(buffer, &end, run->end);
+		for(unsigned tag = 0; tag < tags->n_tags; tag++)
+			gtk_text_buffer_apply_tag(buffer, tags->tags[tag], &start, &end);
+	}
+}
+
+/* Copies the rows of @win's text grid that have changed since the last flush
+ * into its GtkTextBuffer, and moves the cursor mark to the output cursor.
+ * Called when a batch of UI messages is flushed. */
+void
+ui_grid_flush(winid_t win)
+{
+	struct UiGridModel *model = win->grid_model;
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
+	GString *text = g_string_new("");
+	GArray *runs = g_array_new(FALSE, FALSE, sizeof(UiGridRun));
+	GtkTextIter start, end;
+
+	if(model->all_dirty || gtk_text_buffer_get_line_count(buffer) != (int)MAX(model->height, 1)) {
+		/* Replace the whole text at once. Put newlines at the end of each row
+		 * by hand; manual newlines make resizing the window's grid easier. */
+		for(unsigned row = 0; row < model->height; row++) {
+			if(row > 0)
+				g_string_append_c(text, '\n');
+			grid_append_row(model, row, text, runs, row * (model->width + 1));
+		}
+		gtk_text_buffer_set_text(buffer, text->str, text->len);
+		grid_apply_runs(model, buffer, runs);
+	} else {
+		for(unsigned row = 0; row < model->height; row++) {
+			if(!model->dirty[row])
+				continue;
+
+			gtk_text_buffer_get_iter_at_line(buffer, &start, row);
+			int offset = gtk_text_iter_get_offset(&start);
+			end = start;
+			if(!gtk_text_iter_ends_line(&end))
+				gtk_text_iter_forward_to_line_end(&end);
+			gtk_text_buffer_delete(buffer, &start, &end);
+
+			g_string_truncate(text, 0);
+			g_array_set_size(runs, 0);
+			grid_append_row(model, row, text, runs, offset);
+			gtk_text_buffer_insert(buffer, &start, text->str, text->len);
+
+			/* Inserted text picks up any tags around it, so start from none */
+			gtk_text_buffer_get_iter_at_offset(buffer, &start, offset);
+			gtk_text_buffer_get_iter_at_offset(buffer, &end, offset + model->width);
+			gtk_text_buffer_remove_all_tags(buffer, &start, &end);
+			grid_apply_runs(model, buffer, runs);
+		}
+	}
+
+	g_string_free(text, TRUE);
+	g_array_free(runs, TRUE);
+	memset(model->dirty, 0, model->height * sizeof(gboolean));
+	model->all_dirty = FALSE;
+
+	if(model->cursor_y < model->height)
+		gtk_text_buffer_get_iter_at_line_offset(buffer, &start, model->cursor_y, model->cursor_x);
+	else
+		gtk_text_buffer_get_end_iter(buffer, &start);
+	gtk_text_buffer_move_mark_by_name(buffer, "cursor_position", &start);
+}
+
+/* Changes the size of @win's off-screen grid to @width by @height, keeping the
+ * cells that are still inside it and filling any new ones with blanks. The
+ * GtkTextBuffer must already have been trimmed or expanded to match, so the
+ * cursor is taken from the cursor mark there.
+ * Called from the Glk widget's size allocation, with @win's lock held. */
+void
+ui_grid_resize(winid_t win, unsigned width, unsigned height)
+{
+	struct UiGridModel *model = win->grid_model;
+	UiGridCell *cells = g_new(UiGridCell, width * height);
+	for(unsigned row = 0; row < height; row++) {
+		for(unsigned col = 0; col < width; col++) {
+			UiGridCell *cell = cells + row * width + col;
+			if(row < model->height && col < model->width)
+				*cell = model->cells[row * model->width + col];
+			else {
+				cell->ch = ' ';
+				cell->style = 0;
+			}
+		}
+	}
+	g_free(model->cells);
+	model->cells = cells;
+	g_free(model->dirty);
+	model->dirty = g_new0(gboolean, height);
+	model->width = width;
+	model->height = height;
+
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
+	GtkTextIter cursor;
+	gtk_text_buffer_get_iter_at_mark(buffer, &cursor, gtk_text_buffer_get_mark(buffer, "cursor_position"));
+	if(gtk_text_iter_is_end(&cursor) || (unsigned)gtk_text_iter_get_line(&cursor) >= height) {
+		model->cursor_x = 0;
+		model->cursor_y = height;
+	} else {
+		model->cursor_x = MIN((unsigned)gtk_text_iter_get_line_offset(&cursor), width);
+		model->cursor_y = gtk_text_iter_get_line(&cursor);
+	}
+}
+
 /* Redirect the key press to the line input GtkEntry */
 static gboolean
 on_line_input_key_press_event(GtkWidget *widget, GdkEventKey *event, winid_t win)
@@ -72,6 +275,8 @@ ui_grid_create(winid_t win, ChimaraGlk *glk)
 	gtk_text_buffer_get_start_iter(screen, &begin);
 	gtk_text_buffer_create_mark(screen, "cursor_position", &begin, TRUE);
 
+	win->grid_model = grid_model_new();
+
 	/* Connect signal handlers */
 	win->char_input_keypress_handler = g_signal_connect(win->widget, "key-press-event", G_CALLBACK(ui_window_handle_char_input_key_press), win);
 	g_signal_handler_block(win->widget, win->char_input_keypress_handler);
@@ -83,81 +288,58 @@ ui_grid_create(winid_t win, ChimaraGlk *glk)
 	g_signal_handler_block(win->widget, win->button_press_event_handler);
 }
 
-/* Prints @text at the current cursor position in the text grid */
+/* Prints @text at the current cursor position in the text grid's off-screen
+ * model. Text that reaches the end of a row carries on at the start of the
+ * next one; text that goes past the last row is thrown away. */
 void
 ui_grid_print_string(winid_t win, const char *text)
 {
-	GtkTextBuffer *buffer = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
-	GtkTextMark *cursor = gtk_text_buffer_get_mark(buffer, "cursor_position");
-	/* Number of characters to insert */
-	long length = strlen(text);
-	long chars_left = length;
-	GtkTextIter start, insert;
-	int start_offset;
-
-	/* Get cursor position */
-	gtk_text_buffer_get_iter_at_mark(buffer, &insert, cursor);
-
-	g_mutex_lock(&win->lock);
-
-	while(chars_left > 0 && !gtk_text_iter_is_end(&insert)) {
-		/* Spaces available on this line */
-		int available_space = win->width - gtk_text_iter_get_line_offset(&insert);
-
-		GtkTextIter end = insert;
-		if(chars_left <= available_space)
-			gtk_text_iter_forward_chars(&end, chars_left);
-		else
-			gtk_text_iter_forward_to_line_end(&end);
-
-		gtk_text_buffer_delete(buffer, &insert, &end);
-
-		start_offset = gtk_text_iter_get_offset(&insert);
-		gtk_text_buffer_insert(buffer, &insert, text + (length - chars_left), MIN(chars_left, available_space));
-		gtk_text_buffer_get_iter_at_offset(buffer, &start, start_offset);
-		ui_style_apply(win, &start, &insert);
+	struct UiGridModel *model = win->grid_model;
+	unsigned style = grid_current_style(win, model);
 
-		chars_left -= available_space;
-
-		if(gtk_text_iter_get_line_offset(&insert) >= win->width)
-			gtk_text_iter_forward_line(&insert);
+	for(const char *ptr = text; *ptr != '\0'; ptr = g_utf8_next_char(ptr)) {
+		if(model->cursor_x >= model->width) {
+			model->cursor_x = 0;
+			model->cursor_y++;
+		}
+		if(model->cursor_y >= model->height)
+			break;
+
+		UiGridCell *cell = model->cells + model->cursor_y * model->width + model->cursor_x;
+		cell->ch = g_utf8_get_char(ptr);
+		cell->style = style;
+		model->dirty[model->cursor_y] = TRUE;
+
+		/* Go on to the next row straight away, except from the last one, where
+		 * the cursor stays at the end of the text */
+		if(++model->cursor_x >= model->width && model->cursor_y + 1 < model->height) {
+			model->cursor_x = 0;
+			model->cursor_y++;
+		}
 	}
-
-	g_mutex_unlock(&win->lock);
-
-	gtk_text_buffer_move_mark(buffer, cursor, &insert);
 }
 
-
-/* Clears the text grid window @win by filling it with blanks.
+/* Clears the text grid window @win by filling it with blanks in the current
+ * style.
  * Called as a result of glk_window_clear(). */
 void
 ui_grid_clear(winid_t win)
 {
-	/* Manually put newlines at the end of each row of characters in the buffer;
-	manual newlines make resizing the window's grid easier. */
-	g_mutex_lock(&win->lock);
-	char *blanks = g_strnfill(win->width, ' ');
-	char **blanklines = g_new0(char *, win->height + 1);
-	int count;
-	for(count = 0; count < win->height; count++)
-		blanklines[count] = blanks;
-	blanklines[win->height] = NULL;
-	g_mutex_unlock(&win->lock);
-	char *text = g_strjoinv("\n", blanklines);
-	g_free(blanklines); /* not g_strfreev() */
-	g_free(blanks);
+	struct UiGridModel *model = win->grid_model;
 
-	GtkTextBuffer *screen = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
-	gtk_text_buffer_set_text(screen, text, -1);
-	g_free(text);
+	/* Every cell is about to be overwritten, so tag sets that are no longer
+	 * used can be forgotten */
+	if(model->styles->len > GRID_MAX_STYLES)
+		g_array_set_size(model->styles, 1);
 
-	GtkTextIter start, end;
-	gtk_text_buffer_get_start_iter(screen, &start);
-	gtk_text_buffer_get_end_iter(screen, &end);
-	ui_style_apply(win, &start, &end);
-
-	gtk_text_buffer_move_mark_by_name(screen, "cursor_position", &start);
+	unsigned style = grid_current_style(win, model);
+	for(unsigned ix = 0; ix < model->width * model->height; ix++) {
+		model->cells[ix].ch = ' ';
+		model->cells[ix].style = style;
+	}
+	model->all_dirty = TRUE;
+	model->cursor_x = 0;
+	model->cursor_y = 0;
 }
 
 /* Moves the output cursor to coordinates @xpos, @ypos within the text grid
@@ -167,31 +349,27 @@ ui_grid_clear(winid_t win)
 void
 ui_grid_move_cursor(winid_t win, unsigned xpos, unsigned ypos)
 {
-	GtkTextBuffer *screen = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
-	GtkTextIter newpos;
-	/* There must actually be a character at xpos, or the following function will choke */
-	gtk_text_buffer_get_iter_at_line_offset(screen, &newpos, ypos, xpos);
-	gtk_text_buffer_move_mark_by_name(screen, "cursor_position", &newpos);
+	struct UiGridModel *model = win->grid_model;
+	/* The window may have been resized since the Glk thread looked at it */
+	if(xpos >= model->width || ypos >= model->height)
+		return;
+	model->cursor_x = xpos;
+	model->cursor_y = ypos;
 }
 
 /* Moves the output cursor to the next row and the first column within the text
- * grid window @win.
+ * grid window @win, or to the start of the last row if it is already there.
  * Not called explicitly as the result of any Glk function, but happens when a
  * newline character is printed to a text grid window's window stream, for
  * example. */
 void
 ui_grid_newline_cursor(winid_t win)
 {
-	/* Move cursor position forward to the next line */
-	GtkTextIter cursor_pos;
-	GtkTextView *textview = GTK_TEXT_VIEW(win->widget);
-	GtkTextBuffer *screen = gtk_text_view_get_buffer(textview);
-	GtkTextMark *cursor_mark = gtk_text_buffer_get_mark(screen, "cursor_position");
-
-	gtk_text_buffer_get_iter_at_mark(screen, &cursor_pos, cursor_mark);
-	gtk_text_view_forward_display_line(textview, &cursor_pos);
-	gtk_text_view_backward_display_line_start(textview, &cursor_pos);
-	gtk_text_buffer_move_mark(screen, cursor_mark, &cursor_pos);
+	struct UiGridModel *model = win->grid_model;
+	if(model->height == 0)
+		return;
+	model->cursor_x = 0;
+	model->cursor_y = MIN(model->cursor_y + 1, model->height - 1);
 }
 
 /* Internal function: Retrieves the input of a TextGrid window and stores it in
@@ -224,6 +402,18 @@ ui_grid_finish_line_input(winid_t win, gboolean emit_signal)
 	gchar *text_to_insert = g_strconcat(text, spaces, NULL);
 	g_free(spaces);
 	gtk_text_buffer_insert(buffer, &start, text_to_insert, -1);
+
+	/* Put the same text, unstyled, into the off-screen grid where the input
+	field was, which is at the output cursor */
+	struct UiGridModel *model = win->grid_model;
+	if(model->cursor_y < model->height) {
+		unsigned col = model->cursor_x;
+		UiGridCell *cell = model->cells + model->cursor_y * model->width + col;
+		for(const char *ptr = text_to_insert; *ptr != '\0' && col < model->width; ptr = g_utf8_next_char(ptr), col++, cell++) {
+			cell->ch = g_utf8_get_char(ptr);
+			cell->style = 0;
+		}
+	}
 	g_free(text_to_insert);
 
 	int chars_written = ui_textwin_finish_line_input(win, text, emit_signal);
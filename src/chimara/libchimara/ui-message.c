@@ -19,6 +19,15 @@ struct SyncArrangeCallbackData {
 	unsigned handler_id;
 };
 
+struct UiPrintBatch {
+	winid_t win;  /* NULL if the batch is empty */
+	GString *text;
+	int length;  /* of text, in characters */
+	GArray *runs;  /* of UiStyleRun */
+	GPtrArray *messages;  /* PRINT_STRING messages to respond to when done */
+	GPtrArray *grids;  /* text grid windows whose off-screen grids changed */
+};
+
 #ifdef DEBUG_MESSAGES
 
 static const char *desc[] = {
@@ -213,13 +222,152 @@ respond_after_size_allocate(ChimaraGlk *glk, GtkAllocation *allocation, struct S
 	g_slice_free(struct SyncArrangeCallbackData, data);
 }
 
+/* Creates an empty batch for ui_message_perform() to collect printed text in */
+UiPrintBatch *
+ui_print_batch_new(void)
+{
+	UiPrintBatch *batch = g_slice_new0(UiPrintBatch);
+	batch->text = g_string_new("");
+	batch->runs = g_array_new(FALSE, FALSE, sizeof(UiStyleRun));
+	batch->messages = g_ptr_array_new();
+	batch->grids = g_ptr_array_new();
+	return batch;
+}
+
+/* Frees @batch, which must have been flushed. */
+void
+ui_print_batch_free(UiPrintBatch *batch)
+{
+	g_assert(batch->win == NULL);
+	g_string_free(batch->text, TRUE);
+	g_array_free(batch->runs, TRUE);
+	g_ptr_array_free(batch->messages, TRUE);
+	g_ptr_array_free(batch->grids, TRUE);
+	g_slice_free(UiPrintBatch, batch);
+}
+
+/* Inserts the text collected in @batch into its window, draws the rows of any
+ * text grids that changed, and lets the Glk thread know that the messages they
+ * came from have been carried out.
+ * This function must be called from the UI thread. */
 void
-ui_message_perform(ChimaraGlk *glk, UiMessage *msg)
+ui_print_batch_flush(UiPrintBatch *batch)
+{
+	for (unsigned ix = 0; ix < batch->grids->len; ix++)
+		ui_grid_flush(g_ptr_array_index(batch->grids, ix));
+	g_ptr_array_set_size(batch->grids, 0);
+
+	if (batch->win != NULL) {
+		ui_buffer_print_runs(batch->win, batch->text->str,
+			(UiStyleRun *) batch->runs->data, batch->runs->len);
+		batch->win = NULL;
+		g_string_truncate(batch->text, 0);
+		batch->length = 0;
+		g_array_set_size(batch->runs, 0);
+	}
+
+	for (unsigned ix = 0; ix < batch->messages->len; ix++) {
+		UiMessage *msg = g_ptr_array_index(batch->messages, ix);
+		ui_message_respond(msg, 1);
+		ui_message_free(msg);
+	}
+	g_ptr_array_set_size(batch->messages, 0);
+}
+
+/* Helper function: add the text printed by @msg to @batch, in @msg's window's
+ * current style, extending the last run if the style has not changed */
+static void
+print_batch_append(UiPrintBatch *batch, UiMessage *msg)
+{
+	if (batch->win != msg->win)
+		ui_print_batch_flush(batch);
+	batch->win = msg->win;
+
+	UiStyleRun run;
+	run.start = batch->length;
+	batch->length += g_utf8_strlen(msg->strval, -1);
+	run.end = batch->length;
+	run.n_tags = ui_style_get_tags(msg->win, run.tags);
+	g_string_append(batch->text, msg->strval);
+
+	UiStyleRun *last = batch->runs->len ?
+		&g_array_index(batch->runs, UiStyleRun, batch->runs->len - 1) : NULL;
+	if (last && ui_style_run_same_tags(last, &run))
+		last->end = run.end;
+	else
+		g_array_append_val(batch->runs, run);
+
+	g_ptr_array_add(batch->messages, msg);
+}
+
+/* Helper function: carry out @msg, which prints to, clears or moves the cursor
+ * of a text grid, on the grid's off-screen model, and remember to draw the grid
+ * when @batch is flushed */
+static void
+print_batch_update_grid(UiPrintBatch *batch, UiMessage *msg)
+{
+	switch (msg->type) {
+	case UI_MESSAGE_PRINT_STRING:
+		ui_grid_print_string(msg->win, msg->strval);
+		break;
+	case UI_MESSAGE_CLEAR_WINDOW:
+		ui_grid_clear(msg->win);
+		break;
+	case UI_MESSAGE_MOVE_CURSOR:
+		ui_grid_move_cursor(msg->win, msg->uintval1, msg->uintval2);
+		break;
+	case UI_MESSAGE_GRID_NEWLINE:
+		ui_grid_newline_cursor(msg->win);
+		break;
+	default:
+		g_assert_not_reached();
+	}
+
+	unsigned ix;
+	for (ix = 0; ix < batch->grids->len; ix++) {
+		if (g_ptr_array_index(batch->grids, ix) == msg->win)
+			break;
+	}
+	if (ix == batch->grids->len)
+		g_ptr_array_add(batch->grids, msg->win);
+
+	if (msg->type == UI_MESSAGE_PRINT_STRING)
+		g_ptr_array_add(batch->messages, msg);  /* freed when the batch is flushed */
+	else
+		ui_message_free(msg);
+}
+
+/* Carries out the instructions in @msg, and frees it.
+ * Text printed to a text buffer window is not inserted right away, but
+ * collected in @batch, so that a run of print and style messages for the same
+ * window ends up as a single insertion. Likewise, text grids are drawn from an
+ * off-screen model, and only the rows that changed are copied into the window
+ * when the batch is flushed. Any other message flushes the batch first, so the
+ * Glk program never sees the difference. The caller must also
+ * flush @batch before returning to the main loop.
+ * This function must be called from the UI thread. */
+void
+ui_message_perform(ChimaraGlk *glk, UiMessage *msg, UiPrintBatch *batch)
 {
 #ifdef DEBUG_MESSAGES
 	debug_ui_message(msg, FALSE);
 #endif
 
+	if (msg->type == UI_MESSAGE_PRINT_STRING && msg->win->type == wintype_TextBuffer) {
+		print_batch_append(batch, msg);
+		return;  /* msg is freed when the batch is flushed */
+	}
+	if ((msg->type == UI_MESSAGE_PRINT_STRING || msg->type == UI_MESSAGE_CLEAR_WINDOW
+		|| msg->type == UI_MESSAGE_MOVE_CURSOR || msg->type == UI_MESSAGE_GRID_NEWLINE)
+		&& msg->win->type == wintype_TextGrid) {
+		print_batch_update_grid(batch, msg);
+		return;
+	}
+	/* Setting the style or colors only changes which tags later text gets */
+	if (msg->type != UI_MESSAGE_SET_STYLE && msg->type != UI_MESSAGE_SET_ZCOLORS
+		&& msg->type != UI_MESSAGE_SET_REVERSE_VIDEO)
+		ui_print_batch_flush(batch);
+
 	switch(msg->type) {
 	case UI_MESSAGE_PRINT_STRING:
 		ui_textwin_print_string(msg->win, msg->strval);
@@ -233,10 +381,10 @@ ui_message_perform(ChimaraGlk *glk, UiMessage *msg)
 		gtk_widget_unparent(GTK_WIDGET(msg->ptrval));
 		break;
 	case UI_MESSAGE_ARRANGE:
-		chimara_glk_queue_arrange(glk, FALSE);
+		chimara_glk_queue_arrange(glk, FALSE, msg->uintval1);
 		break;
 	case UI_MESSAGE_ARRANGE_SILENTLY:
-		chimara_glk_queue_arrange(glk, TRUE);
+		chimara_glk_queue_arrange(glk, TRUE, msg->uintval1);
 		break;
 	case UI_MESSAGE_SYNC_ARRANGE:
 		if (!chimara_glk_needs_rearrange(glk)) {
@@ -253,12 +401,6 @@ ui_message_perform(ChimaraGlk *glk, UiMessage *msg)
 	case UI_MESSAGE_CLEAR_WINDOW:
 		ui_window_clear(msg->win);
 		break;
-	case UI_MESSAGE_MOVE_CURSOR:
-		ui_grid_move_cursor(msg->win, msg->uintval1, msg->uintval2);
-		break;
-	case UI_MESSAGE_GRID_NEWLINE:
-		ui_grid_newline_cursor(msg->win);
-		break;
 	case UI_MESSAGE_SET_STYLE:
 		ui_textwin_set_style(msg->win, msg->uintval1);
 		break;
@@ -312,12 +454,14 @@ ui_message_perform(ChimaraGlk *glk, UiMessage *msg)
 		break;
 	case UI_MESSAGE_GRAPHICS_DRAW_IMAGE:
 		ui_graphics_draw_image(msg->win, GDK_PIXBUF(msg->ptrval), msg->x, msg->y);
+		g_object_unref(msg->ptrval);
 		break;
 	case UI_MESSAGE_GRAPHICS_FILL_RECT:
 		ui_graphics_fill_rect(msg->win, msg->uintval1, msg->x, msg->y, msg->uintval2, msg->uintval3);
 		break;
 	case UI_MESSAGE_BUFFER_DRAW_IMAGE:
 		ui_buffer_draw_image(msg->win, GDK_PIXBUF(msg->ptrval), msg->uintval1);
+		g_object_unref(msg->ptrval);
 		break;
 	case UI_MESSAGE_SHUTDOWN:
 		chimara_glk_stop_processing_queue(glk);
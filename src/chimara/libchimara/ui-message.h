@@ -23,11 +23,13 @@ typedef enum {
 	UI_MESSAGE_UNPARENT_WIDGET,
 	/* ARRANGE: Calls for a rearrange of all windows.
 	 * @win: ignored.
+	 * @uintval1: the arrange's generation number (see window_queue_arrange()).
 	 */
 	UI_MESSAGE_ARRANGE,
 	/* ARRANGE_SILENTLY: Same as ARRANGE but does not send the Glk program an
 	 * arrange event.
 	 * @win: ignored.
+	 * @uintval1: the arrange's generation number.
 	 */
 	UI_MESSAGE_ARRANGE_SILENTLY,
 	/* SYNC_ARRANGE: Waits for the window arrangement to become current.
@@ -189,11 +191,18 @@ typedef struct {
 	GVariant *response;
 } UiMessage;
 
+/* Text printed to a text buffer window by consecutive messages, waiting to be
+ * inserted in one go */
+typedef struct UiPrintBatch UiPrintBatch;
+
 G_GNUC_INTERNAL UiMessage *ui_message_new(UiMessageType type, winid_t win);
 G_GNUC_INTERNAL void ui_message_free(UiMessage *msg);
 G_GNUC_INTERNAL void ui_message_queue(UiMessage *msg);
 G_GNUC_INTERNAL gint64 ui_message_queue_and_await(UiMessage *msg);
 G_GNUC_INTERNAL char *ui_message_queue_and_await_string(UiMessage *msg);
-G_GNUC_INTERNAL void ui_message_perform(ChimaraGlk *glk, UiMessage *msg);
+G_GNUC_INTERNAL void ui_message_perform(ChimaraGlk *glk, UiMessage *msg, UiPrintBatch *batch);
+G_GNUC_INTERNAL UiPrintBatch *ui_print_batch_new(void);
+G_GNUC_INTERNAL void ui_print_batch_free(UiPrintBatch *batch);
+G_GNUC_INTERNAL void ui_print_batch_flush(UiPrintBatch *batch);
 
 #endif /* UI_MESSAGE_H */
@@ -492,41 +492,62 @@ ui_style_get_window_colors(winid_t win, GdkRGBA **foreground, GdkRGBA **backgrou
 	}
 }
 
-/* Apply styles to a segment of text in a GtkTextBuffer, combining multiple
- * GtkTextTags.
+/* Look up the tags that text printed to @win in its current style should get,
+ * and store them in @tags, which must have room for UI_STYLE_MAX_TAGS. Returns
+ * the number of tags stored.
  */
-void
-ui_style_apply(winid_t win, GtkTextIter *start, GtkTextIter *end)
+unsigned
+ui_style_get_tags(winid_t win, GtkTextTag **tags)
 {
 	GtkTextBuffer *buffer = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
-	GtkTextTagTable *tags = gtk_text_buffer_get_tag_table(buffer);
-
-	GtkTextTag *default_tag = gtk_text_tag_table_lookup(tags, "default");
-	GtkTextTag *style_tag = gtk_text_tag_table_lookup(tags, win->style_tagname);
-	GtkTextTag *glk_style_tag = gtk_text_tag_table_lookup(tags, win->glk_style_tagname);
+	GtkTextTagTable *table = gtk_text_buffer_get_tag_table(buffer);
+	unsigned n_tags = 0;
 
 	/* Player's style overrides */
-	gtk_text_buffer_apply_tag(buffer, style_tag, start, end);
+	tags[n_tags++] = gtk_text_tag_table_lookup(table, win->style_tagname);
 
 	/* Glk program's style overrides */
-	gtk_text_buffer_apply_tag(buffer, glk_style_tag, start, end);
+	tags[n_tags++] = gtk_text_tag_table_lookup(table, win->glk_style_tagname);
 
 	/* Default style */
-	gtk_text_buffer_apply_tag(buffer, default_tag, start, end);
+	tags[n_tags++] = gtk_text_tag_table_lookup(table, "default");
 
 	/* Link style overrides */
 	if(win->window_stream->hyperlink_mode) {
-		GtkTextTag *link_style_tag = gtk_text_tag_table_lookup(tags, "hyperlink");
-		GtkTextTag *link_tag = win->current_hyperlink->tag;
-		gtk_text_buffer_apply_tag(buffer, link_style_tag, start, end);
-		gtk_text_buffer_apply_tag(buffer, link_tag, start, end);
+		tags[n_tags++] = gtk_text_tag_table_lookup(table, "hyperlink");
+		tags[n_tags++] = win->current_hyperlink->tag;
 	}
 
 	/* Glk program's style overrides using garglk_set_zcolors() */
 	if(win->zcolor != NULL)
-		gtk_text_buffer_apply_tag(buffer, win->zcolor, start, end);
+		tags[n_tags++] = win->zcolor;
 
 	/* Glk program's style overrides using garglk_set_reversevideo() */
 	if(win->zcolor_reversed != NULL)
-		gtk_text_buffer_apply_tag(buffer, win->zcolor_reversed, start, end);
+		tags[n_tags++] = win->zcolor_reversed;
+
+	return n_tags;
+}
+
+/* Returns whether the runs @a and @b have the same tags, so that they could be
+ * merged into one */
+gboolean
+ui_style_run_same_tags(const UiStyleRun *a, const UiStyleRun *b)
+{
+	return a->n_tags == b->n_tags
+		&& memcmp(a->tags, b->tags, a->n_tags * sizeof(GtkTextTag *)) == 0;
+}
+
+/* Apply styles to a segment of text in a GtkTextBuffer, combining multiple
+ * GtkTextTags.
+ */
+void
+ui_style_apply(winid_t win, GtkTextIter *start, GtkTextIter *end)
+{
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer( GTK_TEXT_VIEW(win->widget) );
+	GtkTextTag *tags[UI_STYLE_MAX_TAGS];
+	unsigned n_tags = ui_style_get_tags(win, tags);
+
+	for(unsigned ix = 0; ix < n_tags; ix++)
+		gtk_text_buffer_apply_tag(buffer, tags[ix], start, end);
 }
@@ -8,11 +8,23 @@
 #include "chimara-glk.h"
 #include "glk.h"
 
+/* Largest number of tags ui_style_get_tags() can return */
+#define UI_STYLE_MAX_TAGS 7
+
+/* A stretch of text, given as character offsets, that shares the same tags */
+typedef struct {
+	int start, end;
+	unsigned n_tags;
+	GtkTextTag *tags[UI_STYLE_MAX_TAGS];
+} UiStyleRun;
+
 G_GNUC_INTERNAL void ui_style_set_hint(ChimaraGlk *glk, unsigned wintype, unsigned styl, unsigned hint, int val);
 G_GNUC_INTERNAL void ui_style_clear_hint(ChimaraGlk *glk, unsigned wintype, unsigned styl, unsigned hint);
 G_GNUC_INTERNAL int64_t ui_window_measure_style(winid_t win, ChimaraGlk *glk, unsigned styl, unsigned hint);
 G_GNUC_INTERNAL PangoFontDescription *ui_style_get_current_font(ChimaraGlk *glk, unsigned wintype);
 G_GNUC_INTERNAL void ui_style_get_window_colors(winid_t win, GdkRGBA **foreground, GdkRGBA **background);
+G_GNUC_INTERNAL unsigned ui_style_get_tags(winid_t win, GtkTextTag **tags);
+G_GNUC_INTERNAL gboolean ui_style_run_same_tags(const UiStyleRun *a, const UiStyleRun *b);
 G_GNUC_INTERNAL void ui_style_apply(winid_t win, GtkTextIter *start, GtkTextIter *end);
 
 #endif /* UI_STYLE_H */
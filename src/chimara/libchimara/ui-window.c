@@ -62,6 +62,24 @@ ui_window_clear(winid_t win)
 		ui_graphics_clear(win);
 }
 
+/* Publishes @win's current size, in the units that glk_window_get_size()
+ * returns, for the Glk thread to read without locking.
+ * Must be called with @win's lock held. */
+void
+ui_window_publish_size(winid_t win)
+{
+	glui32 width = win->width, height = win->height;
+	if(win->type == wintype_TextBuffer) {
+		width /= win->unit_width;
+		height /= win->unit_height;
+	}
+
+	g_atomic_int_inc(&win->size_seq);
+	g_atomic_int_set(&win->published_width, width);
+	g_atomic_int_set(&win->published_height, height);
+	g_atomic_int_inc(&win->size_seq);
+}
+
 static const char *
 enum_value_get_nick(GType enum_type, unsigned value)
 {
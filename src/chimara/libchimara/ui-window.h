@@ -9,6 +9,7 @@
 
 G_GNUC_INTERNAL void ui_window_create(winid_t win, ChimaraGlk *glk);
 G_GNUC_INTERNAL void ui_window_clear(winid_t win);
+G_GNUC_INTERNAL void ui_window_publish_size(winid_t win);
 G_GNUC_INTERNAL void ui_window_override_font(winid_t win, GtkWidget *widget, PangoFontDescription *font);
 G_GNUC_INTERNAL void ui_window_override_background_color(winid_t win, GtkWidget *widget, GdkRGBA *color);
 G_GNUC_INTERNAL gboolean ui_window_handle_shutdown_key_press(GtkWidget *widget, GdkEventKey *event, winid_t win);
@@ -10,11 +10,55 @@
 #include "strio.h"
 #include "style.h"
 #include "window.h"
+#include "ui-buffer.h"
+#include "ui-grid.h"
 #include "ui-message.h"
 #include "ui-window.h"
 
 extern GPrivate glk_data_key;
 
+/* Asks the UI thread to rearrange all windows, numbering the request so that
+window_sync_arrange() can tell when it has been carried out. */
+static void
+window_queue_arrange(UiMessageType type)
+{
+	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
+	UiMessage *msg = ui_message_new(type, NULL);
+	msg->uintval1 = ++glk_data->arrange_requested;
+	ui_message_queue(msg);
+}
+
+/* Waits until the window sizes are current. If every arrange the Glk thread has
+asked for has already been carried out, then they are current and there is no
+need for a round trip to the UI thread. */
+static void
+window_sync_arrange(void)
+{
+	ChimaraGlkPrivate *glk_data = g_private_get(&glk_data_key);
+	if((guint)g_atomic_int_get(&glk_data->arrange_completed) == glk_data->arrange_requested)
+		return;
+	ui_message_queue_and_await(ui_message_new(UI_MESSAGE_SYNC_ARRANGE, NULL));
+}
+
+/* Reads the size of @win published by ui_window_publish_size(), without
+locking. */
+static void
+window_get_published_size(winid_t win, glui32 *widthptr, glui32 *heightptr)
+{
+	gint seq;
+	glui32 width, height;
+	do {
+		seq = g_atomic_int_get(&win->size_seq);
+		width = g_atomic_int_get(&win->published_width);
+		height = g_atomic_int_get(&win->published_height);
+	} while((seq & 1) || g_atomic_int_get(&win->size_seq) != seq);
+
+	if(widthptr != NULL)
+		*widthptr = width;
+	if(heightptr != NULL)
+		*heightptr = height;
+}
+
 static winid_t
 window_new_common(glui32 rock)
 {
@@ -78,6 +122,8 @@ window_close_common(winid_t win, gboolean destroy_node)
 	g_hash_table_destroy(win->hyperlinks);
 	g_free(win->current_hyperlink);
 
+	g_clear_pointer(&win->grid_model, ui_grid_model_free);
+	g_clear_pointer(&win->spill, ui_buffer_spill_free);
 	if(win->backing_store)
 		cairo_surface_destroy(win->backing_store);
 	g_clear_object(&win->font_override);
@@ -560,7 +606,7 @@ glk_window_open(winid_t split, glui32 method, glui32 size, glui32 wintype,
 	/* From now on, all access to shared window fields must be protected */
 
 	/* Queue a rearrange but don't trigger an arrange event */
-	ui_message_queue(ui_message_new(UI_MESSAGE_ARRANGE_SILENTLY, NULL));
+	window_queue_arrange(UI_MESSAGE_ARRANGE_SILENTLY);
 
     glk_window_clear(win);
 	return win;
@@ -753,7 +799,7 @@ glk_window_close(winid_t win, stream_result_t *result)
 	g_mutex_unlock(&glk_data->arrange_lock);
 
 	/* Schedule a redraw */
-	ui_message_queue(ui_message_new(UI_MESSAGE_ARRANGE_SILENTLY, NULL));
+	window_queue_arrange(UI_MESSAGE_ARRANGE_SILENTLY);
 }
 
 /**
@@ -810,7 +856,7 @@ glk_window_clear(winid_t win)
 		case wintype_TextGrid:
 		case wintype_Graphics:
 			/* Wait for the window's size to be updated */
-			ui_message_queue_and_await(ui_message_new(UI_MESSAGE_SYNC_ARRANGE, NULL));
+			window_sync_arrange();
 			/* fall through */
 		case wintype_TextBuffer:
 			ui_message_queue(ui_message_new(UI_MESSAGE_CLEAR_WINDOW, win));
@@ -948,27 +994,10 @@ glk_window_get_size(winid_t win, glui32 *widthptr, glui32 *heightptr)
             
         case wintype_TextGrid:
 		case wintype_Graphics:
+		case wintype_TextBuffer:
 			/* Wait until the window's size is current */
-			ui_message_queue_and_await(ui_message_new(UI_MESSAGE_SYNC_ARRANGE, NULL));
-
-			g_mutex_lock(&win->lock);
-            if(widthptr != NULL)
-                *widthptr = win->width;
-            if(heightptr != NULL)
-                *heightptr = win->height;
-			g_mutex_unlock(&win->lock);
-            break;
-            
-        case wintype_TextBuffer:
-			/* Wait until the window's size is current */
-			ui_message_queue_and_await(ui_message_new(UI_MESSAGE_SYNC_ARRANGE, NULL));
-
-			g_mutex_lock(&win->lock);
-            if(widthptr != NULL)
-				*widthptr = (glui32)(win->width / win->unit_width);
-            if(heightptr != NULL)
-				*heightptr = (glui32)(win->height / win->unit_height);
-			g_mutex_unlock(&win->lock);
+			window_sync_arrange();
+			window_get_published_size(win, widthptr, heightptr);
             break;
 
         default:
@@ -1080,7 +1109,7 @@ glk_window_set_arrangement(winid_t win, glui32 method, glui32 size, winid_t keyw
 		win->key_window = keywin;
 	g_mutex_unlock(&glk_data->arrange_lock);
 
-	ui_message_queue(ui_message_new(UI_MESSAGE_ARRANGE_SILENTLY, NULL));
+	window_queue_arrange(UI_MESSAGE_ARRANGE_SILENTLY);
 }
 
 /**
@@ -1150,33 +1179,29 @@ glk_window_move_cursor(winid_t win, glui32 xpos, glui32 ypos)
 	g_return_if_fail(win->type == wintype_TextGrid);
 
 	/* Wait until the window's size is current */
-	ui_message_queue_and_await(ui_message_new(UI_MESSAGE_SYNC_ARRANGE, NULL));
+	window_sync_arrange();
 
-	g_mutex_lock(&win->lock);
+	glui32 width, height;
+	window_get_published_size(win, &width, &height);
 
 	/* Don't do anything if the window is shrunk down to nothing */
-	if(win->width == 0 || win->height == 0)
-	{
-		g_mutex_unlock(&win->lock);
+	if(width == 0 || height == 0)
 		return;
-	}
 
 	/* Calculate actual position if cursor is moved past the right edge */
-	if(xpos >= win->width)
+	if(xpos >= width)
 	{
-	    ypos += xpos / win->width;
-	    xpos %= win->width;
+	    ypos += xpos / width;
+	    xpos %= width;
 	}
 
 	/* Go to the end if the cursor is moved off the bottom edge */
-	if(ypos >= win->height)
+	if(ypos >= height)
 	{
-	    xpos = win->width - 1;
-	    ypos = win->height - 1;
+	    xpos = width - 1;
+	    ypos = height - 1;
 	}
 
-	g_mutex_unlock(&win->lock);
-
 	UiMessage *msg = ui_message_new(UI_MESSAGE_MOVE_CURSOR, win);
 	msg->uintval1 = xpos;
 	msg->uintval2 = ypos;
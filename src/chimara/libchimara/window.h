@@ -50,6 +50,14 @@ struct glk_window_struct
 	int unit_width;   /* ditto */
 	int unit_height;  /* ditto */
 
+	/* The size that get_size() returns, published by the UI thread every time
+	it allocates the window, so that the Glk thread can read it without taking
+	@lock. The UI thread makes @size_seq odd while it is updating the other
+	two, and the reader retries if it sees that or a change of @size_seq. */
+	gint size_seq;
+	gint published_width;
+	gint published_height;
+
 	/* The window tree may be accessed by both the Glk thread and the UI thread,
 	but must be protected by locking the library's arrange_lock. */
 
@@ -112,6 +120,11 @@ struct glk_window_struct
 	GHashTable *hyperlinks;
 	struct hyperlink *current_hyperlink;
 	gboolean hyperlink_event_requested;
+	/* Off-screen contents of a text grid, drawn into the widget in batches */
+	struct UiGridModel *grid_model;
+	/* Text trimmed off the top of a text buffer, kept on disk (see the
+	scrollback-spill property) */
+	struct UiBufferSpill *spill;
 	/* Graphics */
 	glui32 background_color;
 	cairo_surface_t *backing_store;
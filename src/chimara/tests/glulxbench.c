@@ -0,0 +1,115 @@
+/* Microbenchmarks for the Glulx interpreters' memory opcodes. Plays each of
+ memheaptest.ulx (the heap allocator), memcopytest.ulx (@mcopy and @mzero)
+ and arraylimittest.ulx (the search opcodes) up to its first input prompt
+ under Glulxe and under Git, several times each, and prints how long the
+ runs took. --game picks other game files instead. Any further arguments
+ are typed into each game as commands, one per prompt, before the clock
+ stops. */
+
+#include <stdlib.h>
+#include <gtk/gtk.h>
+#include <libchimara/chimara-if.h>
+
+typedef struct {
+	GTimer *timer;
+	char **commands;
+	int next_command;
+} Run;
+
+static void
+on_waiting(ChimaraGlk *glk, Run *run)
+{
+	if(run->commands[run->next_command] != NULL) {
+		chimara_glk_feed_line_input(glk, run->commands[run->next_command++]);
+		return;
+	}
+	g_timer_stop(run->timer);
+	chimara_glk_stop(glk);
+}
+
+static void
+on_stopped(ChimaraGlk *glk, Run *run)
+{
+	g_timer_stop(run->timer);
+	gtk_main_quit();
+}
+
+static double
+time_run(ChimaraIFInterpreter interpreter, const char *game, char **commands)
+{
+	GError *error = NULL;
+	Run run = { g_timer_new(), commands, 0 };
+
+	GtkWidget *window = gtk_offscreen_window_new();
+	GtkWidget *glk = chimara_if_new();
+	gtk_widget_set_size_request(glk, 800, 600);
+	gtk_container_add(GTK_CONTAINER(window), glk);
+	gtk_widget_show_all(window);
+
+	chimara_if_set_preferred_interpreter(CHIMARA_IF(glk), CHIMARA_IF_FORMAT_GLULX, interpreter);
+	g_signal_connect(glk, "waiting", G_CALLBACK(on_waiting), &run);
+	g_signal_connect(glk, "stopped", G_CALLBACK(on_stopped), &run);
+
+	g_timer_start(run.timer);
+	if(!chimara_if_run_game(CHIMARA_IF(glk), game, &error))
+		g_error("Error starting Glk library: %s", error->message);
+	gtk_main();
+	chimara_glk_wait(CHIMARA_GLK(glk));
+
+	double elapsed = g_timer_elapsed(run.timer, NULL);
+	g_timer_destroy(run.timer);
+	gtk_widget_destroy(window);
+	return elapsed;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int repeat = 5;
+	char **games = NULL;
+	char *default_games[] = {
+		PACKAGE_SRC_DIR "/memheaptest.ulx",
+		PACKAGE_SRC_DIR "/memcopytest.ulx",
+		PACKAGE_SRC_DIR "/arraylimittest.ulx",
+		NULL
+	};
+	GOptionEntry entries[] = {
+		{ "repeat", 'n', 0, G_OPTION_ARG_INT, &repeat, "Number of runs per interpreter", "N" },
+		{ "game", 'g', 0, G_OPTION_ARG_FILENAME_ARRAY, &games, "Game file to time (may be repeated)", "FILE" },
+		{ NULL }
+	};
+	GError *error = NULL;
+
+	if(!gtk_init_with_args(&argc, &argv, "[COMMAND...] - time the memory opcodes", entries, NULL, &error)) {
+		g_printerr("%s\n", error->message);
+		return EXIT_FAILURE;
+	}
+
+	const struct {
+		ChimaraIFInterpreter interpreter;
+		const char *name;
+	} interpreters[] = {
+		{ CHIMARA_IF_INTERPRETER_GLULXE, "glulxe" },
+		{ CHIMARA_IF_INTERPRETER_GIT, "git" },
+	};
+
+	if(games == NULL)
+		games = default_games;
+
+	for(char **game = games; *game != NULL; game++) {
+		char *basename = g_path_get_basename(*game);
+		for(unsigned i = 0; i < G_N_ELEMENTS(interpreters); i++) {
+			double total = 0.0, best = G_MAXDOUBLE;
+			for(int count = 0; count < repeat; count++) {
+				double elapsed = time_run(interpreters[i].interpreter, *game, argv + 1);
+				total += elapsed;
+				best = MIN(best, elapsed);
+			}
+			g_print("%s, %s: %d runs, mean %.3f s, best %.3f s\n", basename,
+				interpreters[i].name, repeat, total / repeat, best);
+		}
+		g_free(basename);
+	}
+
+	return EXIT_SUCCESS;
+}
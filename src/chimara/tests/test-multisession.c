@@ -1,5 +1,7 @@
 /* Program for testing multisessionality, i.e. whether two ChimaraGlk widgets
- can run in the same application. */
+ can run in the same application. The top pair runs two different plugins,
+ Frotz and Nitfol; the bottom pair runs the same re-entrant plugin, Bocfel,
+ at the same time from one loaded copy. */
 
 #include <gtk/gtk.h>
 #include <libchimara/chimara-glk.h>
@@ -32,18 +34,20 @@ main(int argc, char **argv)
 	gtk_widget_set_size_request(window, 800, 500);
 	g_signal_connect(window, "delete_event", G_CALLBACK(on_delete_event), NULL);
 
+	GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+
 	GtkWidget *hpaned = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
 	gtk_paned_set_position(GTK_PANED(hpaned), 400);
-	
+
 	GtkWidget *frotz = chimara_glk_new();
 	chimara_glk_set_css_from_string(CHIMARA_GLK(frotz),
 	    "buffer.normal { font-family: 'Lucida Sans'; font-size: 12; }"
 	    "grid.normal { font-family: 'Lucida Console'; font-size: 12; }");
 	g_signal_connect(frotz, "started", G_CALLBACK(on_started), "Frotz");
 	g_signal_connect(frotz, "stopped", G_CALLBACK(on_stopped), "Frotz");
-	
+
 	GtkWidget *nitfol = chimara_glk_new();
-	chimara_glk_set_css_from_string(CHIMARA_GLK(frotz),
+	chimara_glk_set_css_from_string(CHIMARA_GLK(nitfol),
 	    "buffer.normal { font-family: 'Bitstream Charter'; font-size: 12; }"
 	    "grid.normal { font-family: 'Luxi Mono'; font-size: 12; }");
 	g_signal_connect(nitfol, "started", G_CALLBACK(on_started), "Nitfol");
@@ -51,7 +55,25 @@ main(int argc, char **argv)
 
 	gtk_paned_pack1(GTK_PANED(hpaned), frotz, TRUE, TRUE);
 	gtk_paned_pack2(GTK_PANED(hpaned), nitfol, TRUE, TRUE);
-	gtk_container_add(GTK_CONTAINER(window), hpaned);
+	gtk_box_pack_start(GTK_BOX(vbox), hpaned, TRUE, TRUE, 0);
+
+	GtkWidget *bocfel_hpaned = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
+	gtk_paned_set_position(GTK_PANED(bocfel_hpaned), 400);
+
+	GtkWidget *left = chimara_glk_new();
+	chimara_glk_set_isolated(CHIMARA_GLK(left), TRUE);
+	g_signal_connect(left, "started", G_CALLBACK(on_started), "Left Bocfel");
+	g_signal_connect(left, "stopped", G_CALLBACK(on_stopped), "Left Bocfel");
+
+	GtkWidget *right = chimara_glk_new();
+	chimara_glk_set_isolated(CHIMARA_GLK(right), TRUE);
+	g_signal_connect(right, "started", G_CALLBACK(on_started), "Right Bocfel");
+	g_signal_connect(right, "stopped", G_CALLBACK(on_stopped), "Right Bocfel");
+
+	gtk_paned_pack1(GTK_PANED(bocfel_hpaned), left, TRUE, TRUE);
+	gtk_paned_pack2(GTK_PANED(bocfel_hpaned), right, TRUE, TRUE);
+	gtk_box_pack_start(GTK_BOX(vbox), bocfel_hpaned, TRUE, TRUE, 0);
+	gtk_container_add(GTK_CONTAINER(window), vbox);
 
 	gtk_widget_show_all(window);
 
@@ -59,13 +81,17 @@ main(int argc, char **argv)
 		return 1;
 	if(!chimara_glk_run(CHIMARA_GLK(nitfol), "../interpreters/nitfol/.libs/nitfol.so", argc, argv, NULL))
 		return 1;
+	if(!chimara_glk_run(CHIMARA_GLK(left), "../interpreters/bocfel/.libs/bocfel.so", argc, argv, NULL))
+		return 1;
+	if(!chimara_glk_run(CHIMARA_GLK(right), "../interpreters/bocfel/.libs/bocfel.so", argc, argv, NULL))
+		return 1;
 
 	gtk_main();
 
 	chimara_glk_stop(CHIMARA_GLK(frotz));
 	chimara_glk_stop(CHIMARA_GLK(nitfol));
+	chimara_glk_stop(CHIMARA_GLK(left));
+	chimara_glk_stop(CHIMARA_GLK(right));
 
 	return 0;
 }
-	
-	
@@ -210,6 +210,88 @@ extern int file_load_chars(int file_number, char *buffer, int length)
 
 FILE *sf_handle;
 
+#ifdef INFORM6_LIBRARY
+/*  A library build assembles the story file in memory instead, and
+    inform6_compile() (see "inform.c") hands it over to the caller.          */
+
+uchar *library_story;
+int32 library_story_size;
+static int32 library_story_extent, library_story_position;
+#endif
+
+/*  The story file is only ever accessed through these routines, which
+    behave like the stdio functions they are named after.                   */
+
+static int sf_fopen(char *name, char *mode)
+{
+#ifdef INFORM6_LIBRARY
+    free(library_story);
+    library_story = NULL;
+    library_story_size = 0;
+    library_story_extent = 0;
+    library_story_position = 0;
+    return TRUE;
+#else
+    sf_handle = fopen(name, mode);
+    return (sf_handle != NULL);
+#endif
+}
+
+static void sf_fputc(int c)
+{
+#ifdef INFORM6_LIBRARY
+    if (library_story_position == library_story_extent)
+    {   int32 new_extent = (library_story_extent == 0)?
+            0x10000 : 2*library_story_extent;
+        uchar *new_story = realloc(library_story, new_extent);
+        if (new_story == NULL)
+            fatalerror("Couldn't allocate memory for the story file");
+        library_story = new_story;
+        library_story_extent = new_extent;
+    }
+    library_story[library_story_position++] = (uchar) c;
+    if (library_story_position > library_story_size)
+        library_story_size = library_story_position;
+#else
+    fputc(c, sf_handle);
+#endif
+}
+
+static int sf_fgetc(void)
+{
+#ifdef INFORM6_LIBRARY
+    if (library_story_position >= library_story_size) return EOF;
+    return (unsigned char) library_story[library_story_position++];
+#else
+    return fgetc(sf_handle);
+#endif
+}
+
+static void sf_fseek(int32 position)
+{
+#ifdef INFORM6_LIBRARY
+    library_story_position = position;
+#else
+    fseek(sf_handle, position, SEEK_SET);
+#endif
+}
+
+static int sf_ferror(void)
+{
+#ifdef INFORM6_LIBRARY
+    return 0;
+#else
+    return ferror(sf_handle);
+#endif
+}
+
+static void sf_fclose(void)
+{
+#ifndef INFORM6_LIBRARY
+    fclose(sf_handle);
+#endif
+}
+
 static void sf_put(int c)
 {
     if (!glulx_mode) {
@@ -251,7 +333,7 @@ static void sf_put(int c)
       
     }
 
-    fputc(c, sf_handle);
+    sf_fputc(c);
 }
 
 /* Recursive procedure to generate the Glulx compression table. */
@@ -349,8 +431,7 @@ static void output_file_z(void)
 
     translate_out_filename(new_name, Code_Name);
 
-    sf_handle = fopen(new_name,"wb");
-    if (sf_handle == NULL)
+    if (!sf_fopen(new_name,"wb"))
         fatalerror_named("Couldn't open output file", new_name);
 
 #ifdef MAC_MPW
@@ -363,7 +444,7 @@ static void output_file_z(void)
     /*  (1)  Output the paged memory.                                        */
 
     for (i=0;i<64;i++)
-        fputc(zmachine_paged_memory[i], sf_handle);
+        sf_fputc(zmachine_paged_memory[i]);
     size = 64;
     checksum_low_byte = 0;
     checksum_high_byte = 0;
@@ -568,17 +649,17 @@ static void output_file_z(void)
 
     while (blanks>0) { sf_put(0); blanks--; }
 
-    if (ferror(sf_handle))
+    if (sf_ferror())
         fatalerror("I/O failure: couldn't write to story file");
 
-    fseek(sf_handle, 28, SEEK_SET);
-    fputc(checksum_high_byte, sf_handle);
-    fputc(checksum_low_byte, sf_handle);
+    sf_fseek(28);
+    sf_fputc(checksum_high_byte);
+    sf_fputc(checksum_low_byte);
 
-    if (ferror(sf_handle))
+    if (sf_ferror())
       fatalerror("I/O failure: couldn't backtrack on story file for checksum");
 
-    fclose(sf_handle);
+    sf_fclose();
 
     /*  Write a copy of the header into the debugging information file
         (mainly so that it can be used to identify which story file matches
@@ -632,8 +713,7 @@ static void output_file_g(void)
 
     translate_out_filename(new_name, Code_Name);
 
-    sf_handle = fopen(new_name,"wb+");
-    if (sf_handle == NULL)
+    if (!sf_fopen(new_name,"wb+"))
         fatalerror_named("Couldn't open output file", new_name);
 
 #ifdef MAC_MPW
@@ -1104,16 +1184,16 @@ game features require version 0x%08lx", (long)requested_glulx_version, (long)Ver
     {   sf_put(zmachine_paged_memory[i]); size++;
     }
 
-    if (ferror(sf_handle))
+    if (sf_ferror())
         fatalerror("I/O failure: couldn't write to story file");
 
-    fseek(sf_handle, 32, SEEK_SET);
-    fputc((checksum_long >> 24) & 0xFF, sf_handle);
-    fputc((checksum_long >> 16) & 0xFF, sf_handle);
-    fputc((checksum_long >> 8) & 0xFF, sf_handle);
-    fputc((checksum_long) & 0xFF, sf_handle);
+    sf_fseek(32);
+    sf_fputc((checksum_long >> 24) & 0xFF);
+    sf_fputc((checksum_long >> 16) & 0xFF);
+    sf_fputc((checksum_long >> 8) & 0xFF);
+    sf_fputc((checksum_long) & 0xFF);
 
-    if (ferror(sf_handle))
+    if (sf_ferror())
       fatalerror("I/O failure: couldn't backtrack on story file for checksum");
 
     /*  Write a copy of the first 64 bytes into the debugging information file
@@ -1121,22 +1201,22 @@ game features require version 0x%08lx", (long)requested_glulx_version, (long)Ver
         which debugging info file).  */
 
     if (debugfile_switch)
-    {   fseek(sf_handle, 0L, SEEK_SET);
+    {   sf_fseek(0L);
         debug_file_printf("<story-file-prefix>");
         for (i = 0; i < 63; i += 3)
-        {   first_byte_of_triple = fgetc(sf_handle);
-            second_byte_of_triple = fgetc(sf_handle);
-            third_byte_of_triple = fgetc(sf_handle);
+        {   first_byte_of_triple = sf_fgetc();
+            second_byte_of_triple = sf_fgetc();
+            third_byte_of_triple = sf_fgetc();
             debug_file_print_base_64_triple
                 (first_byte_of_triple,
                  second_byte_of_triple,
                  third_byte_of_triple);
         }
-        debug_file_print_base_64_single(fgetc(sf_handle));
+        debug_file_print_base_64_single(sf_fgetc());
         debug_file_printf("</story-file-prefix>");
     }
 
-    fclose(sf_handle);
+    sf_fclose();
 
 #ifdef ARCHIMEDES
     {   char settype_command[PATHLEN];
@@ -1238,11 +1318,21 @@ extern void nullify_debug_file_position(maybe_file_position *position) {
 
 static void close_debug_file(void)
 {   fclose(Debug_fp);
+    Debug_fp = NULL;
 #ifdef MAC_FACE
     InformFiletypes (Debugging_Name, INF_DEBUG_TYPE);
 #endif
 }
 
+#ifdef INFORM6_LIBRARY
+/*  Close the debugging information file after a fatal error, so that a
+    library build doesn't leak it into the next compilation.                 */
+
+extern void abort_debug_file(void)
+{   if (Debug_fp != NULL) close_debug_file();
+}
+#endif
+
 extern void begin_debug_file(void)
 {   open_debug_file();
 
@@ -1759,11 +1849,10 @@ extern void files_free_arrays(void)
 {   my_free(&filename_storage, "filename storage");
     my_free(&InputFiles, "input file storage");
     if (debugfile_switch)
-    {   if (!glulx_mode)
-        {   tear_down_accumulator(&object_backpatch_accumulator);
-        } else
-        {   tear_down_accumulator(&packed_code_backpatch_accumulator);
-        }
+    {   /*  Only one of these two was set up, depending on the target; both
+            can safely be torn down since my_free() ignores null pointers    */
+        tear_down_accumulator(&object_backpatch_accumulator);
+        tear_down_accumulator(&packed_code_backpatch_accumulator);
         tear_down_accumulator(&code_backpatch_accumulator);
         tear_down_accumulator(&global_backpatch_accumulator);
         tear_down_accumulator(&array_backpatch_accumulator);
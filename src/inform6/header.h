@@ -485,6 +485,25 @@ static int32 unique_task_id(void)
 #define V7Code_Extension ".zip"
 #define V8Code_Extension ".zip"
 #endif
+/* ------------------------------------------------------------------------- */
+/*   Library block: for linking the compiler into another program, which     */
+/*   calls inform6_compile() (see "inform6.h") as often as it likes.  The    */
+/*   console output goes to the caller, and exit() returns to the caller     */
+/*   instead of ending the process.                                          */
+/* ------------------------------------------------------------------------- */
+#ifdef INFORM6_LIBRARY
+#define EXTERNAL_SHELL
+#include <setjmp.h>
+extern jmp_buf library_fallback;
+extern int  library_printf(const char *format, ...);
+#ifdef __GNUC__
+extern void library_exit(int status) __attribute__((noreturn));
+#else
+extern void library_exit(int status);
+#endif
+#define printf library_printf
+#define exit   library_exit
+#endif
 /* ========================================================================= */
 /* Default settings:                                                         */
 /* ------------------------------------------------------------------------- */
@@ -2391,6 +2410,12 @@ extern void close_all_source(void);
 
 extern void output_file(void);
 
+#ifdef INFORM6_LIBRARY
+extern uchar *library_story;
+extern int32 library_story_size;
+extern void  abort_debug_file(void);
+#endif
+
 /* ------------------------------------------------------------------------- */
 /*   Extern definitions for "inform"                                         */
 /* ------------------------------------------------------------------------- */
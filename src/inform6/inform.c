@@ -409,6 +409,12 @@ static void begin_pass(void)
     }
 }
 
+#ifdef INFORM6_LIBRARY
+/*  Whether the arrays are currently allocated, so that the clean-up after a
+    fatal error (see inform6_compile() below) only frees them once           */
+static int library_arrays_allocated;
+#endif
+
 extern void allocate_arrays(void)
 {
     arrays_allocate_arrays();
@@ -432,6 +438,9 @@ extern void allocate_arrays(void)
     text_allocate_arrays();
     veneer_allocate_arrays();
     verbs_allocate_arrays();
+#ifdef INFORM6_LIBRARY
+    library_arrays_allocated = TRUE;
+#endif
 }
 
 extern void free_arrays(void)
@@ -440,6 +449,11 @@ extern void free_arrays(void)
         game text until the abbreviations optimiser begins work on it): this
         array (if it was ever allocated) is freed at the top level.          */
 
+#ifdef INFORM6_LIBRARY
+    if (!library_arrays_allocated) return;
+    library_arrays_allocated = FALSE;
+#endif
+
     arrays_free_arrays();
     asm_free_arrays();
     bpatch_free_arrays();
@@ -1739,8 +1753,12 @@ static int sub_main(int argc, char **argv)
 
     banner();
 
+    /*  Switches first: set_memory_sizes() picks the Z-code or Glulx limits
+        according to glulx_mode, which must not be left over from a previous
+        compilation in the same process                                     */
+    reset_switch_settings();
     set_memory_sizes(DEFAULT_MEMORY_SIZE); set_default_paths();
-    reset_switch_settings(); select_version(5);
+    select_version(5);
 
     cli_files_specified = 0; no_compilations = 0;
     cli_file1 = "source"; cli_file2 = "output";
@@ -1761,4 +1779,87 @@ static int sub_main(int argc, char **argv)
     return(0);
 }
 
+/* ------------------------------------------------------------------------- */
+/*   L I B R A R Y:  Compiling from inside another program (see "inform6.h") */
+/* ------------------------------------------------------------------------- */
+
+#ifdef INFORM6_LIBRARY
+
+#include "inform6.h"
+
+jmp_buf library_fallback;
+
+static int library_exit_status;
+static inform6_output_func library_output;
+static void *library_output_data;
+
+extern int library_printf(const char *format, ...)
+{   char buffer[1024]; char *text = buffer;
+    int length;
+    va_list ap;
+
+    va_start(ap, format);
+    length = vsnprintf(buffer, sizeof(buffer), format, ap);
+    va_end(ap);
+    if (length < 0) return length;
+
+    if (length >= (int) sizeof(buffer))
+    {   text = malloc(length + 1);
+        if (text == NULL) return -1;
+        va_start(ap, format);
+        vsnprintf(text, length + 1, format, ap);
+        va_end(ap);
+    }
+
+    if (library_output != NULL) library_output(text, library_output_data);
+
+    if (text != buffer) free(text);
+    return length;
+}
+
+extern void library_exit(int status)
+{   library_exit_status = status;
+    longjmp(library_fallback, 1);
+}
+
+extern int inform6_compile(int argc, char **argv,
+    inform6_output_func output, void *output_data,
+    unsigned char **story, size_t *story_length)
+{   int return_code;
+
+    library_output = output;
+    library_output_data = output_data;
+    *story = NULL;
+    *story_length = 0;
+
+    if (setjmp(library_fallback) == 0)
+        return_code = sub_main(argc, argv);
+    else
+    {   /*  A fatal error or a bad command line: tidy up as the MAC_FACE
+            port does, so that the next compilation starts afresh            */
+
+        if (library_arrays_allocated) close_all_source();
+        if (temporary_files_switch) remove_temp_files();
+        abort_transcript_file();
+        abort_debug_file();
+        free_arrays();
+        if (store_the_text) my_free(&all_text,"transcription text");
+        return_code = library_exit_status;
+    }
+
+    if (return_code == 0 && library_story != NULL)
+    {   *story = (unsigned char *) library_story;
+        *story_length = library_story_size;
+    }
+    else free(library_story);
+    library_story = NULL;
+    library_story_size = 0;
+
+    library_output = NULL;
+    library_output_data = NULL;
+    return return_code;
+}
+
+#endif
+
 /* ========================================================================= */
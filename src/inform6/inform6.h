@@ -0,0 +1,33 @@
+/* ------------------------------------------------------------------------- */
+/*   "inform6.h" : Interface to the compiler built as a library              */
+/*                                                                           */
+/*   The compiler's sources, built with INFORM6_LIBRARY defined, make up     */
+/*   libinform6.a.  A program linked with it can run any number of           */
+/*   compilations one after another, without starting a process for each:   */
+/*   all the compiler's state is reinitialised at the start of each one,     */
+/*   and fatal errors return to the caller instead of exiting.               */
+/*                                                                           */
+/*   The compiler is not reentrant: only one compilation may be running at   */
+/*   any time, in any thread.                                                */
+/* ------------------------------------------------------------------------- */
+
+#ifndef INFORM6_H
+#define INFORM6_H
+
+#include <stddef.h>
+
+/*  Called with each piece of text that the command-line compiler would
+    print to standard output                                                 */
+typedef void (*inform6_output_func)(const char *text, void *data);
+
+/*  Compile with the given command line, which is the same as that of the
+    inform6 program (argv[0] is ignored); the strings in argv must be
+    writable, as the compiler may alter them.  Returns the exit code that
+    the program would have returned.  If this is 0, *story points to the story
+    file, which the caller must free() when done with it; no story file is
+    written to disk, whatever output filename is given.                      */
+extern int inform6_compile(int argc, char **argv,
+    inform6_output_func output, void *output_data,
+    unsigned char **story, size_t *story_length);
+
+#endif
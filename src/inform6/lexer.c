@@ -1800,7 +1800,15 @@ extern void lexer_free_arrays(void)
     my_free(&local_variable_hash_codes, "local variable hash codes");
     my_free(&local_variable_texts, "local variable text pointers");
 
-    cleanup_token_locations(NULL);
+    /*  Unlike cleanup_token_locations(), this ignores reference counts:
+        records still held by a beginning (say, after a fatal error) would
+        otherwise leak when the compiler is run again in the same process    */
+    while (first_token_locations)
+    {   debug_locations*moribund = first_token_locations;
+        first_token_locations = moribund->next;
+        my_free(&moribund, "debug locations of recent tokens");
+    }
+    last_token_location = NULL;
 }
 
 /* ========================================================================= */
@@ -2246,11 +2246,8 @@ extern void objects_free_arrays(void)
 
     my_free(&defined_this_segment,"defined this segment table");
 
-    if (!glulx_mode) {
-        my_free(&full_object_g.props, "object property list");
-        my_free(&full_object_g.propdata, "object property data table");
-    }
-    
+    my_free(&full_object_g.props, "object property list");
+    my_free(&full_object_g.propdata, "object property data table");
 }
 
 /* ========================================================================= */
@@ -60,6 +60,9 @@ typedef struct _I7NodePrivate {
 	gchar *label; /* Author's annotation that appears above this knot */
 	gchar *transcript_text; /* Response produced by the game to this command */
 	gchar *expected_text; /* Response the author thinks should be produced */
+	/* Escaped XML of the above, if they haven't been needed since loading */
+	GBytes *transcript_xml;
+	GBytes *expected_xml;
 	gboolean changed; /* Whether the response changed since last time this knot was played */
 	gboolean blessed; /* Whether this knot has an expected response */
 	gboolean played; /* Whether this knot is currently in the thread being played */
@@ -96,6 +99,90 @@ G_DEFINE_TYPE_WITH_PRIVATE(I7Node, i7_node, GOO_TYPE_CANVAS_GROUP_MODEL);
 
 /* STATIC FUNCTIONS */
 
+/* Change newline separators in @text to \n, in place or by reallocating it */
+static char *
+normalize_newlines(char *text)
+{
+	if(strstr(text, "\r\n")) {
+		char **lines = g_strsplit(text, "\r\n", 0);
+		g_free(text);
+		text = g_strjoinv("\n", lines);
+		g_strfreev(lines);
+	}
+	return g_strdelimit(text, "\r", '\n');
+}
+
+/* Replace the entity and character references in the text content of an XML
+element */
+static char *
+unescape_xml_text(GBytes *xml)
+{
+	gsize len;
+	const char *ptr = g_bytes_get_data(xml, &len);
+	const char *end = ptr + len;
+	GString *text = g_string_sized_new(len);
+
+	while(ptr < end) {
+		const char *amp = memchr(ptr, '&', end - ptr);
+		if(amp == NULL) {
+			g_string_append_len(text, ptr, end - ptr);
+			break;
+		}
+		g_string_append_len(text, ptr, amp - ptr);
+		const char *semi = memchr(amp, ';', end - amp);
+		if(semi == NULL) {
+			g_string_append_len(text, amp, end - amp);
+			break;
+		}
+
+		gsize namelen = semi - amp - 1;
+		const char *name = amp + 1;
+		if(namelen == 2 && strncmp(name, "lt", 2) == 0)
+			g_string_append_c(text, '<');
+		else if(namelen == 2 && strncmp(name, "gt", 2) == 0)
+			g_string_append_c(text, '>');
+		else if(namelen == 3 && strncmp(name, "amp", 3) == 0)
+			g_string_append_c(text, '&');
+		else if(namelen == 4 && strncmp(name, "quot", 4) == 0)
+			g_string_append_c(text, '"');
+		else if(namelen == 4 && strncmp(name, "apos", 4) == 0)
+			g_string_append_c(text, '\'');
+		else if(namelen > 1 && *name == '#') {
+			char *digits_end;
+			gunichar ch;
+			if(name[1] == 'x')
+				ch = g_ascii_strtoull(name + 2, &digits_end, 16);
+			else
+				ch = g_ascii_strtoull(name + 1, &digits_end, 10);
+			if(digits_end == semi && g_unichar_validate(ch))
+				g_string_append_unichar(text, ch);
+			else
+				g_string_append_len(text, amp, semi + 1 - amp);
+		} else
+			g_string_append_len(text, amp, semi + 1 - amp);
+		ptr = semi + 1;
+	}
+
+	return normalize_newlines(g_string_free(text, FALSE));
+}
+
+/* Make sure the transcript and expected text are in memory */
+static void
+load_deferred_text(I7Node *self)
+{
+	I7NodePrivate *priv = i7_node_get_instance_private(self);
+	if(priv->transcript_xml) {
+		g_free(priv->transcript_text);
+		priv->transcript_text = unescape_xml_text(priv->transcript_xml);
+		g_clear_pointer(&priv->transcript_xml, g_bytes_unref);
+	}
+	if(priv->expected_xml) {
+		g_free(priv->expected_text);
+		priv->expected_text = unescape_xml_text(priv->expected_xml);
+		g_clear_pointer(&priv->expected_xml, g_bytes_unref);
+	}
+}
+
 static void
 draw_differs_badge(I7Node *self)
 {
@@ -172,6 +259,7 @@ calculate_diffs(I7Node *self)
 	I7NodeMatchType old_match_status = priv->match;
 	
 	clear_diffs(self);
+	load_deferred_text(self);
 
 	if(!i7_node_get_blessed(self))
 		priv->match = I7_NODE_CANT_COMPARE;
@@ -235,16 +323,8 @@ i7_node_set_expected_text(I7Node *self, const gchar *text)
 	I7NodePrivate *priv = i7_node_get_instance_private(self);
 
 	g_free(priv->expected_text);
-	priv->expected_text = g_strdup(text? text : ""); /* silently accept NULL */
-
-	/* Change newline separators to \n */
-	if(strstr(priv->expected_text, "\r\n")) {
-		gchar **lines = g_strsplit(priv->expected_text, "\r\n", 0);
-		g_free(priv->expected_text);
-		priv->expected_text = g_strjoinv("\n", lines);
-		g_strfreev(lines);
-	}
-	priv->expected_text = g_strdelimit(priv->expected_text, "\r", '\n');
+	g_clear_pointer(&priv->expected_xml, g_bytes_unref);
+	priv->expected_text = normalize_newlines(g_strdup(text? text : "")); /* silently accept NULL */
 	priv->blessed = !(strlen(priv->expected_text) == 0);
 
 	transcript_modified(self);
@@ -286,13 +366,24 @@ create_node_pattern(double r, double g, double b)
 	return retval;
 }
 
+/* IDs of new knots must not clash with IDs of knots that were loaded from a
+skein file written in an earlier session, since those are kept */
+static guint32
+get_session_tag(void)
+{
+	static gsize tag = 0;
+	if(g_once_init_enter(&tag))
+		g_once_init_leave(&tag, g_random_int() | 1);
+	return (guint32)tag;
+}
+
 /* TYPE SYSTEM */
 
 static void
 i7_node_init(I7Node *self)
 {
 	I7NodePrivate *priv = i7_node_get_instance_private(self);
-	priv->id = g_strdup_printf("node-%p", self);
+	priv->id = g_strdup_printf("node-%08x-%p", get_session_tag(), self);
 	self->gnode = g_node_new(self);
 	self->tree_item = NULL;
 	self->tree_points = goo_canvas_points_new(4);
@@ -398,9 +489,11 @@ i7_node_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *
 			g_value_set_string(value, priv->label);
 			break;
 		case PROP_TRANSCRIPT_TEXT:
+			load_deferred_text(self);
 			g_value_set_string(value, priv->transcript_text);
 			break;
 		case PROP_EXPECTED_TEXT:
+			load_deferred_text(self);
 			g_value_set_string(value, priv->expected_text);
 			break;
 		case PROP_CHANGED:
@@ -447,6 +540,8 @@ i7_node_finalize(GObject *object)
 	g_free(priv->label);
 	g_free(priv->transcript_text);
 	g_free(priv->expected_text);
+	g_clear_pointer(&priv->transcript_xml, g_bytes_unref);
+	g_clear_pointer(&priv->expected_xml, g_bytes_unref);
 	g_free(priv->transcript_pango_string);
 	g_free(priv->expected_pango_string);
 	g_free(priv->id);
@@ -589,6 +684,7 @@ gchar *
 i7_node_get_transcript_text(I7Node *self)
 {
 	I7NodePrivate *priv = i7_node_get_instance_private(self);
+	load_deferred_text(self);
 	return g_strdup(priv->transcript_text);
 }
 
@@ -597,19 +693,11 @@ i7_node_set_transcript_text(I7Node *self, const gchar *transcript)
 {
 	I7NodePrivate *priv = i7_node_get_instance_private(self);
 
+	load_deferred_text(self);
 	char *old_transcript_text = g_strdup(priv->transcript_text? priv->transcript_text : "");
 
 	g_free(priv->transcript_text);
-	priv->transcript_text = g_strdup(transcript? transcript : ""); /* silently accept NULL */
-
-	/* Change newline separators to \n */
-	if(strstr(priv->transcript_text, "\r\n")) {
-		gchar **lines = g_strsplit(priv->transcript_text, "\r\n", 0);
-		g_free(priv->transcript_text);
-		priv->transcript_text = g_strjoinv("\n", lines);
-		g_strfreev(lines);
-	}
-	priv->transcript_text = g_strdelimit(priv->transcript_text, "\r", '\n');
+	priv->transcript_text = normalize_newlines(g_strdup(transcript? transcript : "")); /* silently accept NULL */
 
 	if(strcmp(old_transcript_text, priv->transcript_text) != 0)
 		i7_node_set_changed(self, TRUE);
@@ -626,6 +714,7 @@ gchar *
 i7_node_get_expected_text(I7Node *self)
 {
 	I7NodePrivate *priv = i7_node_get_instance_private(self);
+	load_deferred_text(self);
 	return g_strdup(priv->expected_text);
 }
 
@@ -656,6 +745,8 @@ i7_node_get_match_type(I7Node *self)
 {
 	I7NodePrivate *priv = i7_node_get_instance_private(self);
 
+	if(!priv->blessed)
+		return I7_NODE_CANT_COMPARE;
 	if(!priv->expected_pango_string || !priv->transcript_pango_string)
 		calculate_diffs(self);
 
@@ -678,6 +769,8 @@ i7_node_get_different(I7Node *self)
 {
 	I7NodePrivate *priv = i7_node_get_instance_private(self);
 
+	if(!priv->blessed)
+		return FALSE;
 	if(!priv->expected_pango_string || !priv->transcript_pango_string)
 		calculate_diffs(self);
 
@@ -733,6 +826,7 @@ void
 i7_node_bless(I7Node *self)
 {
 	I7NodePrivate *priv = i7_node_get_instance_private(self);
+	load_deferred_text(self);
 	i7_node_set_expected_text(self, priv->transcript_text);
 }
 
@@ -907,15 +1001,65 @@ write_child_pointer(GNode *gnode, GString *string)
 	g_string_append_printf(string, "      <child nodeId=\"%s\"/>\n", priv->id);
 }
 
+/*
+ * i7_node_set_unique_id:
+ * @self: the knot
+ * @id: ID string from a skein file
+ *
+ * Keeps the ID that the knot had in the file it was loaded from, so that later
+ * changes to it can be saved incrementally.
+ */
+void
+i7_node_set_unique_id(I7Node *self, const char *id)
+{
+	I7NodePrivate *priv = i7_node_get_instance_private(self);
+	g_free(priv->id);
+	priv->id = g_strdup(id);
+}
+
+/*
+ * i7_node_set_deferred_text:
+ * @self: the knot
+ * @transcript_xml: the escaped contents of the knot's result element
+ * @expected_xml: the escaped contents of the knot's commentary element
+ *
+ * For use while loading a skein. Sets the transcript text and expected text
+ * without decoding them; that only happens when they are needed, either for
+ * displaying or for comparing them. Since blessed knots must be compared in
+ * order to show whether they differ, only unblessed knots stay undecoded.
+ * Doesn't emit any property notifications.
+ */
+void
+i7_node_set_deferred_text(I7Node *self, GBytes *transcript_xml, GBytes *expected_xml)
+{
+	I7NodePrivate *priv = i7_node_get_instance_private(self);
+
+	g_clear_pointer(&priv->transcript_xml, g_bytes_unref);
+	g_clear_pointer(&priv->expected_xml, g_bytes_unref);
+	priv->transcript_xml = g_bytes_ref(transcript_xml);
+	priv->expected_xml = g_bytes_ref(expected_xml);
+
+	priv->blessed = g_bytes_get_size(expected_xml) > 0;
+	if(priv->blessed)
+		transcript_modified(self);
+	else
+		clear_diffs(self);
+}
+
 gchar *
 i7_node_get_xml(I7Node *self)
 {
 	I7NodePrivate *priv = i7_node_get_instance_private(self);
 
-	/* Escape the following strings if necessary */
+	/* Escape the following strings if necessary; text that was never loaded
+	from the skein file can be written back as it was */
 	gchar *command = g_markup_escape_text(priv->command, -1);
-	gchar *transcript_text = g_markup_escape_text(priv->transcript_text, -1);
-	gchar *expected_text = g_markup_escape_text(priv->expected_text, -1);
+	gchar *transcript_text = priv->transcript_xml?
+		g_strndup(g_bytes_get_data(priv->transcript_xml, NULL), g_bytes_get_size(priv->transcript_xml)) :
+		g_markup_escape_text(priv->transcript_text, -1);
+	gchar *expected_text = priv->expected_xml?
+		g_strndup(g_bytes_get_data(priv->expected_xml, NULL), g_bytes_get_size(priv->expected_xml)) :
+		g_markup_escape_text(priv->expected_text, -1);
 	gchar *label = g_markup_escape_text(priv->label, -1);
 
 	GString *string = g_string_new("");
@@ -96,6 +96,8 @@ I7Node *i7_node_get_next_difference(I7Node *node);
 
 /* Serialization */
 const gchar *i7_node_get_unique_id(I7Node *self);
+void i7_node_set_unique_id(I7Node *self, const char *id);
+void i7_node_set_deferred_text(I7Node *self, GBytes *transcript_xml, GBytes *expected_xml);
 gchar *i7_node_get_xml(I7Node *self);
 
 /* Drawing on a GooCanvas */
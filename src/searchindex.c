@@ -0,0 +1,717 @@
+/* This file is part of GNOME Inform 7.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+#include <pango/pango.h>
+
+#include "searchindex.h"
+
+/* An inverted index over a number of texts, for the Search Files window.
+
+Each text is split into words where Pango finds word boundaries, which is also
+what gtk_text_iter_starts_word() and gtk_text_iter_ends_word() go by. Every
+distinct word, case-folded and normalized as GtkTextIter does for a case
+insensitive search, is a term. For each term the index keeps a list of postings:
+the document it occurs in and the position of the word in that document. For
+each document it keeps the term and byte offsets of every word, so that a phrase
+can be checked by looking at the words following a candidate position, and the
+text itself, so that matches can be confirmed and shown in context.
+
+Searching works in two steps. First the words of the search text are looked up
+among the terms, and the postings of the rarest one yield candidate positions
+where all the words are in the right order. Then the search text is compared
+with the document text at each candidate, which takes care of case sensitivity,
+punctuation and the word boundary rules of the search type, so that the results
+are the same as those of find_no_wrap() in document-search.c.
+
+A document's text and words are kept in a GVariant of type (sauauau), which is
+also its part of the serialized index; so an index loaded from disk reads them
+from the loaded data, without copying. */
+
+/* Characters of context shown before and after a match */
+#define CONTEXT_BEFORE 8
+#define CONTEXT_AFTER 32
+
+typedef struct {
+	guint32 doc;
+	guint32 pos;
+} Posting;
+
+typedef struct {
+	GVariant *variant;      /* holds the data that the other members point to */
+	const char *text;
+	gsize length;
+	const guint32 *starts;  /* byte offset of each word */
+	const guint32 *ends;    /* byte offset just past each word */
+	const guint32 *terms;   /* term number of each word */
+	gsize n_words;
+} IndexDocument;
+
+struct _I7SearchIndex {
+	GPtrArray *documents;     /* of IndexDocument */
+	GPtrArray *vocabulary;    /* of folded words, indexed by term number */
+	GHashTable *term_numbers; /* folded word -> term number + 1 */
+	GPtrArray *postings;      /* of GArray of Posting, indexed by term number */
+};
+
+/* One word of the search text, and how it must match the words in the index */
+typedef struct {
+	char *folded;
+	gboolean left_anchored;  /* must be at the start of a word */
+	gboolean right_anchored; /* must be at the end of a word */
+	guint8 *matches;         /* which terms it matches, indexed by term number */
+	unsigned n_postings;     /* total postings of those terms */
+} QueryWord;
+
+/* HELPER FUNCTIONS */
+
+/* Finds the words of the @length bytes at @text, and appends the byte offsets
+ of their starts and ends to @starts and @ends */
+static void
+find_words(const char *text, gsize length, GArray *starts, GArray *ends)
+{
+	glong n_chars = g_utf8_strlen(text, length);
+	PangoLogAttr *attrs = g_new(PangoLogAttr, n_chars + 1);
+	pango_get_log_attrs(text, length, -1, pango_language_get_default(), attrs, n_chars + 1);
+
+	const char *p = text;
+	gboolean in_word = FALSE;
+	for(glong ix = 0; ix <= n_chars; ix++) {
+		guint32 offset = p - text;
+		if(in_word && attrs[ix].is_word_end) {
+			g_array_append_val(ends, offset);
+			in_word = FALSE;
+		}
+		if(!in_word && attrs[ix].is_word_start && ix < n_chars) {
+			g_array_append_val(starts, offset);
+			in_word = TRUE;
+		}
+		if(ix < n_chars)
+			p = g_utf8_next_char(p);
+	}
+	if(in_word) {
+		guint32 offset = length;
+		g_array_append_val(ends, offset);
+	}
+
+	g_free(attrs);
+}
+
+/* Appends the character at @p to @folded, folded as GtkTextIter does for a case
+ insensitive search: case-folded and then normalized with G_NORMALIZE_NFKD */
+static void
+fold_char(GString *folded, const char *p)
+{
+	if((guchar)*p < 0x80) {
+		g_string_append_c(folded, g_ascii_tolower(*p));
+		return;
+	}
+	g_autofree char *casefolded = g_utf8_casefold(p, g_utf8_next_char(p) - p);
+	g_autofree char *normalized = g_utf8_normalize(casefolded, -1, G_NORMALIZE_NFKD);
+	g_string_append(folded, normalized);
+}
+
+/* Appends the folded version of the @len bytes at @word to @folded */
+static void
+fold_word(GString *folded, const char *word, gsize len)
+{
+	const char *end = word + len;
+	for(const char *p = word; p < end; p = g_utf8_next_char(p))
+		fold_char(folded, p);
+}
+
+/* Whether @offset is in the sorted array @offsets of @n entries */
+static gboolean
+has_offset(const guint32 *offsets, gsize n, guint32 offset)
+{
+	gsize low = 0, high = n;
+	while(low < high) {
+		gsize mid = low + (high - low) / 2;
+		if(offsets[mid] == offset)
+			return TRUE;
+		if(offsets[mid] < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return FALSE;
+}
+
+/* Returns the byte length of the match if @query occurs in @text at @pos, or
+ -1 if it does not. If @ignore_case, @query must already be folded, and @scratch
+ is used for folding the text. */
+static gssize
+match_at(const char *pos, const char *query, gboolean ignore_case, GString *scratch)
+{
+	if(!ignore_case) {
+		size_t len = strlen(query);
+		return strncmp(pos, query, len) == 0? (gssize)len : -1;
+	}
+
+	const char *p = pos, *q = query;
+	while(*q != '\0') {
+		if(*p == '\0')
+			return -1;
+		g_string_truncate(scratch, 0);
+		fold_char(scratch, p);
+		if(strncmp(q, scratch->str, scratch->len) != 0)
+			return -1;
+		p = g_utf8_next_char(p);
+		q += scratch->len;
+	}
+	return p - pos;
+}
+
+/* Whether a match from @start to @end of @doc obeys the word boundary rules of
+ @search_type */
+static gboolean
+match_fits_search_type(IndexDocument *doc, const char *start, const char *end, I7SearchType search_type)
+{
+	switch(search_type) {
+		case I7_SEARCH_FULL_WORD:
+			return has_offset(doc->starts, doc->n_words, start - doc->text)
+				&& has_offset(doc->ends, doc->n_words, end - doc->text);
+		case I7_SEARCH_STARTS_WORD:
+			return has_offset(doc->starts, doc->n_words, start - doc->text);
+		default:
+			return TRUE;
+	}
+}
+
+static void
+add_match(GArray *matches, unsigned doc, const char *text, const char *start, gssize len)
+{
+	I7SearchMatch match = { doc, start - text, start - text + len };
+	g_array_append_val(matches, match);
+}
+
+static int
+compare_matches(const I7SearchMatch *a, const I7SearchMatch *b)
+{
+	if(a->doc != b->doc)
+		return a->doc < b->doc? -1 : 1;
+	if(a->start != b->start)
+		return a->start < b->start? -1 : 1;
+	return 0;
+}
+
+/* Sorts @matches and removes any that overlap an earlier one, since a search
+ continues after the end of the previous match */
+static void
+sort_and_prune_matches(GArray *matches)
+{
+	g_array_sort(matches, (GCompareFunc)compare_matches);
+
+	unsigned kept = 0;
+	for(unsigned ix = 0; ix < matches->len; ix++) {
+		I7SearchMatch *match = &g_array_index(matches, I7SearchMatch, ix);
+		if(kept > 0) {
+			I7SearchMatch *last = &g_array_index(matches, I7SearchMatch, kept - 1);
+			if(last->doc == match->doc && match->start < last->end)
+				continue;
+		}
+		g_array_index(matches, I7SearchMatch, kept++) = *match;
+	}
+	g_array_set_size(matches, kept);
+}
+
+/* Makes a document out of @variant, of type (sauauau), pointing into its data.
+ Returns NULL if the arrays are not all the same length. */
+static IndexDocument *
+document_new(GVariant *variant)
+{
+	g_autoptr(GVariant) text = NULL;
+	g_autoptr(GVariant) starts = NULL;
+	g_autoptr(GVariant) ends = NULL;
+	g_autoptr(GVariant) terms = NULL;
+	g_variant_get(variant, "(@s@au@au@au)", &text, &starts, &ends, &terms);
+
+	IndexDocument *doc = g_slice_new0(IndexDocument);
+	doc->variant = g_variant_ref_sink(variant);
+	doc->text = g_variant_get_string(text, &doc->length);
+
+	gsize n_ends, n_terms;
+	doc->starts = g_variant_get_fixed_array(starts, &doc->n_words, sizeof(guint32));
+	doc->ends = g_variant_get_fixed_array(ends, &n_ends, sizeof(guint32));
+	doc->terms = g_variant_get_fixed_array(terms, &n_terms, sizeof(guint32));
+	if(n_ends != doc->n_words || n_terms != doc->n_words) {
+		g_variant_unref(doc->variant);
+		g_slice_free(IndexDocument, doc);
+		return NULL;
+	}
+	return doc;
+}
+
+static void
+document_free(IndexDocument *doc)
+{
+	g_variant_unref(doc->variant);
+	g_slice_free(IndexDocument, doc);
+}
+
+static void
+postings_free(GArray *postings)
+{
+	g_array_free(postings, TRUE);
+}
+
+/* Returns the term number of @folded, adding it to the vocabulary if it is new */
+static guint32
+intern_term(I7SearchIndex *self, const char *folded)
+{
+	gpointer number = g_hash_table_lookup(self->term_numbers, folded);
+	if(number != NULL)
+		return GPOINTER_TO_UINT(number) - 1;
+
+	guint32 term = self->vocabulary->len;
+	char *word = g_strdup(folded);
+	g_ptr_array_add(self->vocabulary, word);
+	g_ptr_array_add(self->postings, g_array_new(FALSE, FALSE, sizeof(Posting)));
+	g_hash_table_insert(self->term_numbers, word, GUINT_TO_POINTER(term + 1));
+	return term;
+}
+
+static void
+add_posting(I7SearchIndex *self, guint32 term, guint32 doc, guint32 pos)
+{
+	Posting posting = { doc, pos };
+	g_array_append_val(g_ptr_array_index(self->postings, term), posting);
+}
+
+static void
+query_word_free(QueryWord *word)
+{
+	g_free(word->folded);
+	g_free(word->matches);
+}
+
+/* Splits @text into words, and works out whether the words of the document it
+ matches must begin or end with each of them. Word boundaries depend on the
+ surrounding text, so this is only certain next to white space, or at the ends
+ of @text if @search_type requires a word boundary there. Returns an array of
+ QueryWord, and the number of characters before the first word in
+ @prefix_chars. */
+static GArray *
+split_query(const char *text, I7SearchType search_type, unsigned *prefix_chars)
+{
+	GArray *words = g_array_new(FALSE, TRUE, sizeof(QueryWord));
+	g_autoptr(GArray) starts = g_array_new(FALSE, FALSE, sizeof(guint32));
+	g_autoptr(GArray) ends = g_array_new(FALSE, FALSE, sizeof(guint32));
+	GString *folded = g_string_new("");
+	gsize length = strlen(text);
+
+	find_words(text, length, starts, ends);
+
+	for(unsigned ix = 0; ix < starts->len; ix++) {
+		const char *start = text + g_array_index(starts, guint32, ix);
+		const char *end = text + g_array_index(ends, guint32, ix);
+		QueryWord word = { NULL };
+		g_string_truncate(folded, 0);
+		fold_word(folded, start, end - start);
+		word.folded = g_strdup(folded->str);
+		if(start == text)
+			word.left_anchored = search_type != I7_SEARCH_CONTAINS;
+		else
+			word.left_anchored = g_unichar_isspace(g_utf8_get_char(g_utf8_prev_char(start)));
+		if(*end == '\0')
+			word.right_anchored = search_type == I7_SEARCH_FULL_WORD;
+		else
+			word.right_anchored = g_unichar_isspace(g_utf8_get_char(end));
+		g_array_append_val(words, word);
+	}
+
+	*prefix_chars = starts->len > 0? g_utf8_strlen(text, g_array_index(starts, guint32, 0)) : 0;
+
+	g_string_free(folded, TRUE);
+	return words;
+}
+
+/* Marks which terms of the vocabulary @word matches */
+static void
+match_query_word(I7SearchIndex *self, QueryWord *word)
+{
+	word->matches = g_new0(guint8, self->vocabulary->len + 1);
+
+	if(word->left_anchored && word->right_anchored) {
+		gpointer number = g_hash_table_lookup(self->term_numbers, word->folded);
+		if(number != NULL) {
+			guint32 term = GPOINTER_TO_UINT(number) - 1;
+			word->matches[term] = 1;
+			word->n_postings = ((GArray *)g_ptr_array_index(self->postings, term))->len;
+		}
+		return;
+	}
+
+	for(guint32 term = 0; term < self->vocabulary->len; term++) {
+		const char *candidate = g_ptr_array_index(self->vocabulary, term);
+		gboolean found;
+		if(word->left_anchored)
+			found = g_str_has_prefix(candidate, word->folded);
+		else if(word->right_anchored)
+			found = g_str_has_suffix(candidate, word->folded);
+		else
+			found = strstr(candidate, word->folded) != NULL;
+		if(found) {
+			word->matches[term] = 1;
+			word->n_postings += ((GArray *)g_ptr_array_index(self->postings, term))->len;
+		}
+	}
+}
+
+/* Checks the candidate phrase starting at word @first of @doc against the search
+ text, and adds any matches to @matches */
+static void
+verify_candidate(I7SearchIndex *self, unsigned docnum, guint32 first, GArray *words, unsigned prefix_chars, const char *text, gboolean ignore_case, I7SearchType search_type, GString *scratch, GArray *matches)
+{
+	IndexDocument *doc = g_ptr_array_index(self->documents, docnum);
+	QueryWord *first_word = &g_array_index(words, QueryWord, 0);
+	const char *word_start = doc->text + doc->starts[first];
+	/* If the first word of the search text is not anchored, it may start
+	 anywhere inside the word of the document */
+	const char *word_end = first_word->left_anchored? g_utf8_next_char(word_start) : doc->text + doc->ends[first];
+
+	for(; word_start < word_end; word_start = g_utf8_next_char(word_start)) {
+		/* The match starts a fixed number of characters before the word */
+		const char *start = word_start;
+		unsigned count;
+		for(count = 0; count < prefix_chars && start > doc->text; count++)
+			start = g_utf8_prev_char(start);
+		if(count < prefix_chars)
+			continue;
+		gssize len = match_at(start, text, ignore_case, scratch);
+		if(len >= 0 && match_fits_search_type(doc, start, start + len, search_type))
+			add_match(matches, docnum, doc->text, start, len);
+	}
+}
+
+/* Compares the search text with every position in every document; for search
+ texts with no words in them, which the index can't help with */
+static void
+find_by_scanning(I7SearchIndex *self, const char *text, gboolean ignore_case, I7SearchType search_type, GString *scratch, GArray *matches)
+{
+	for(unsigned docnum = 0; docnum < self->documents->len; docnum++) {
+		IndexDocument *doc = g_ptr_array_index(self->documents, docnum);
+		for(const char *p = doc->text; *p != '\0'; p = g_utf8_next_char(p)) {
+			gssize len = match_at(p, text, ignore_case, scratch);
+			if(len >= 0 && match_fits_search_type(doc, p, p + len, search_type))
+				add_match(matches, docnum, doc->text, p, len);
+		}
+	}
+}
+
+/* Adds the postings of the words of @doc, which has just been added as
+ document @docnum, checking that they are valid */
+static gboolean
+index_document(I7SearchIndex *self, IndexDocument *doc, guint32 docnum)
+{
+	for(gsize pos = 0; pos < doc->n_words; pos++) {
+		if(doc->terms[pos] >= self->vocabulary->len
+			|| doc->starts[pos] >= doc->ends[pos]
+			|| doc->ends[pos] > doc->length
+			|| (pos > 0 && doc->starts[pos] < doc->ends[pos - 1]))
+			return FALSE;
+		add_posting(self, doc->terms[pos], docnum, pos);
+	}
+	return TRUE;
+}
+
+/* PUBLIC FUNCTIONS */
+
+/**
+ * i7_search_index_new:
+ *
+ * Creates an empty search index.
+ *
+ * Returns: (transfer full): a new #I7SearchIndex, to be freed with
+ * i7_search_index_free().
+ */
+I7SearchIndex *
+i7_search_index_new(void)
+{
+	I7SearchIndex *self = g_slice_new0(I7SearchIndex);
+	self->documents = g_ptr_array_new_with_free_func((GDestroyNotify)document_free);
+	self->vocabulary = g_ptr_array_new();
+	self->term_numbers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	self->postings = g_ptr_array_new_with_free_func((GDestroyNotify)postings_free);
+	return self;
+}
+
+/**
+ * i7_search_index_new_from_variant:
+ * @variant: a #GVariant of type %I7_SEARCH_INDEX_VARIANT_TYPE
+ *
+ * Recreates an index saved with i7_search_index_to_variant(), without having
+ * to split the documents into words again. The documents' texts and words are
+ * read from @variant's data, which the index keeps a reference to.
+ *
+ * Returns: (transfer full) (nullable): a new #I7SearchIndex, or %NULL if
+ * @variant was not a valid index.
+ */
+I7SearchIndex *
+i7_search_index_new_from_variant(GVariant *variant)
+{
+	g_return_val_if_fail(g_variant_is_of_type(variant, I7_SEARCH_INDEX_VARIANT_TYPE), NULL);
+
+	I7SearchIndex *self = i7_search_index_new();
+	g_autoptr(GVariant) vocabulary = g_variant_get_child_value(variant, 0);
+	g_autoptr(GVariant) documents = g_variant_get_child_value(variant, 1);
+
+	gsize n_terms = g_variant_n_children(vocabulary);
+	for(gsize term = 0; term < n_terms; term++) {
+		g_autoptr(GVariant) word = g_variant_get_child_value(vocabulary, term);
+		if(intern_term(self, g_variant_get_string(word, NULL)) != term)
+			goto invalid; /* duplicate term */
+	}
+
+	gsize n_docs = g_variant_n_children(documents);
+	for(gsize docnum = 0; docnum < n_docs; docnum++) {
+		IndexDocument *doc = document_new(g_variant_get_child_value(documents, docnum));
+		if(doc == NULL)
+			goto invalid;
+		g_ptr_array_add(self->documents, doc);
+		if(!index_document(self, doc, docnum))
+			goto invalid;
+	}
+
+	return self;
+
+invalid:
+	i7_search_index_free(self);
+	return NULL;
+}
+
+/**
+ * i7_search_index_free:
+ * @self: the index
+ *
+ * Frees the index and all the documents in it.
+ */
+void
+i7_search_index_free(I7SearchIndex *self)
+{
+	g_ptr_array_free(self->documents, TRUE);
+	g_ptr_array_free(self->postings, TRUE);
+	g_hash_table_destroy(self->term_numbers); /* owns the vocabulary words */
+	g_ptr_array_free(self->vocabulary, TRUE);
+	g_slice_free(I7SearchIndex, self);
+}
+
+/**
+ * i7_search_index_to_variant:
+ * @self: the index
+ *
+ * Serializes the index, so that it can be saved to disk and loaded again with
+ * i7_search_index_new_from_variant().
+ *
+ * Returns: (transfer floating): a #GVariant of type
+ * %I7_SEARCH_INDEX_VARIANT_TYPE.
+ */
+GVariant *
+i7_search_index_to_variant(I7SearchIndex *self)
+{
+	GVariantBuilder vocabulary, documents;
+
+	g_variant_builder_init(&vocabulary, G_VARIANT_TYPE_STRING_ARRAY);
+	for(unsigned term = 0; term < self->vocabulary->len; term++)
+		g_variant_builder_add(&vocabulary, "s", g_ptr_array_index(self->vocabulary, term));
+
+	g_variant_builder_init(&documents, G_VARIANT_TYPE("a(sauauau)"));
+	for(unsigned docnum = 0; docnum < self->documents->len; docnum++) {
+		IndexDocument *doc = g_ptr_array_index(self->documents, docnum);
+		g_variant_builder_add_value(&documents, doc->variant);
+	}
+
+	return g_variant_new("(asa(sauauau))", &vocabulary, &documents);
+}
+
+/**
+ * i7_search_index_add_document:
+ * @self: the index
+ * @text: UTF-8 text of the document
+ *
+ * Adds a copy of @text to the index.
+ *
+ * Returns: the number of the document, counting from 0 in the order they were
+ * added, which identifies it in the results of i7_search_index_find().
+ */
+unsigned
+i7_search_index_add_document(I7SearchIndex *self, const char *text)
+{
+	guint32 docnum = self->documents->len;
+	gsize length = strlen(text);
+	g_autoptr(GArray) starts = g_array_new(FALSE, FALSE, sizeof(guint32));
+	g_autoptr(GArray) ends = g_array_new(FALSE, FALSE, sizeof(guint32));
+	g_autoptr(GArray) terms = g_array_new(FALSE, FALSE, sizeof(guint32));
+	GString *folded = g_string_new("");
+
+	find_words(text, length, starts, ends);
+	for(unsigned ix = 0; ix < starts->len; ix++) {
+		guint32 start = g_array_index(starts, guint32, ix), end = g_array_index(ends, guint32, ix);
+		g_string_truncate(folded, 0);
+		fold_word(folded, text + start, end - start);
+		guint32 term = intern_term(self, folded->str);
+		g_array_append_val(terms, term);
+	}
+	g_string_free(folded, TRUE);
+
+	IndexDocument *doc = document_new(g_variant_new("(s@au@au@au)", text,
+		g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, starts->data, starts->len, sizeof(guint32)),
+		g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, ends->data, ends->len, sizeof(guint32)),
+		g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, terms->data, terms->len, sizeof(guint32))));
+	g_ptr_array_add(self->documents, doc);
+	index_document(self, doc, docnum);
+	return docnum;
+}
+
+/**
+ * i7_search_index_get_n_documents:
+ * @self: the index
+ *
+ * Returns: the number of documents in the index.
+ */
+unsigned
+i7_search_index_get_n_documents(I7SearchIndex *self)
+{
+	return self->documents->len;
+}
+
+/**
+ * i7_search_index_get_text:
+ * @self: the index
+ * @doc: the number of a document
+ *
+ * Returns: (transfer none): the text of document @doc.
+ */
+const char *
+i7_search_index_get_text(I7SearchIndex *self, unsigned doc)
+{
+	g_return_val_if_fail(doc < self->documents->len, NULL);
+	return ((IndexDocument *)g_ptr_array_index(self->documents, doc))->text;
+}
+
+/**
+ * i7_search_index_find:
+ * @self: the index
+ * @text: the text to search for
+ * @ignore_case: whether to ignore differences in case
+ * @search_type: whether @text may occur anywhere, or only at the start of a
+ * word, or only as whole words
+ *
+ * Finds all the places where @text occurs in the documents in the index.
+ *
+ * Returns: (transfer full): an array of #I7SearchMatch, ordered by document
+ * and then by position.
+ */
+GArray *
+i7_search_index_find(I7SearchIndex *self, const char *text, gboolean ignore_case, I7SearchType search_type)
+{
+	GArray *matches = g_array_new(FALSE, FALSE, sizeof(I7SearchMatch));
+	unsigned prefix_chars;
+
+	if(*text == '\0')
+		return matches;
+
+	/* The text as match_at() wants it */
+	GString *scratch = g_string_new("");
+	g_autofree char *match_text = NULL;
+	if(ignore_case) {
+		fold_word(scratch, text, strlen(text));
+		match_text = g_strdup(scratch->str);
+	} else {
+		match_text = g_strdup(text);
+	}
+
+	GArray *words = split_query(text, search_type, &prefix_chars);
+	if(words->len == 0) {
+		find_by_scanning(self, match_text, ignore_case, search_type, scratch, matches);
+		goto done;
+	}
+
+	/* Drive the search from the word with the fewest postings */
+	unsigned rarest = 0;
+	for(unsigned ix = 0; ix < words->len; ix++) {
+		QueryWord *word = &g_array_index(words, QueryWord, ix);
+		match_query_word(self, word);
+		if(word->n_postings < g_array_index(words, QueryWord, rarest).n_postings)
+			rarest = ix;
+	}
+
+	guint8 *rarest_matches = g_array_index(words, QueryWord, rarest).matches;
+	for(guint32 term = 0; term < self->vocabulary->len; term++) {
+		if(!rarest_matches[term])
+			continue;
+		GArray *postings = g_ptr_array_index(self->postings, term);
+		for(unsigned ix = 0; ix < postings->len; ix++) {
+			Posting *posting = &g_array_index(postings, Posting, ix);
+			IndexDocument *doc = g_ptr_array_index(self->documents, posting->doc);
+
+			/* Check that the other words are in the right places */
+			if(posting->pos < rarest || posting->pos - rarest + words->len > doc->n_words)
+				continue;
+			guint32 first = posting->pos - rarest;
+			gboolean phrase = TRUE;
+			for(unsigned wordnum = 0; wordnum < words->len && phrase; wordnum++) {
+				guint32 doc_term = doc->terms[first + wordnum];
+				phrase = g_array_index(words, QueryWord, wordnum).matches[doc_term];
+			}
+			if(phrase)
+				verify_candidate(self, posting->doc, first, words, prefix_chars, match_text,
+					ignore_case, search_type, scratch, matches);
+		}
+	}
+
+done:
+	for(unsigned ix = 0; ix < words->len; ix++)
+		query_word_free(&g_array_index(words, QueryWord, ix));
+	g_array_free(words, TRUE);
+	g_string_free(scratch, TRUE);
+	sort_and_prune_matches(matches);
+	return matches;
+}
+
+/**
+ * i7_search_index_get_context:
+ * @self: the index
+ * @match: a match returned from i7_search_index_find()
+ *
+ * Extracts some characters of context around @match, with the match itself in
+ * bold, for displaying in the search results.
+ *
+ * Returns: (transfer full): a string of Pango markup.
+ */
+char *
+i7_search_index_get_context(I7SearchIndex *self, const I7SearchMatch *match)
+{
+	const char *text = i7_search_index_get_text(self, match->doc);
+	const char *start = text + match->start, *end = text + match->end;
+	const char *context_start = start, *context_end = end;
+
+	for(int count = 0; count < CONTEXT_BEFORE && context_start > text; count++)
+		context_start = g_utf8_prev_char(context_start);
+	for(int count = 0; count < CONTEXT_AFTER && *context_end != '\0'; count++)
+		context_end = g_utf8_next_char(context_end);
+
+	g_autofree char *before = g_markup_escape_text(context_start, start - context_start);
+	g_autofree char *term = g_markup_escape_text(start, end - start);
+	g_autofree char *after = g_markup_escape_text(end, context_end - end);
+	char *context = g_strconcat(before, "<b>", term, "</b>", after, NULL);
+	g_strdelimit(context, "\n\r\t", ' ');
+	return context;
+}
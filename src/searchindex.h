@@ -0,0 +1,47 @@
+/* This file is part of GNOME Inform 7.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SEARCHINDEX_H
+#define _SEARCHINDEX_H
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "document.h"
+
+typedef struct _I7SearchIndex I7SearchIndex;
+
+typedef struct {
+	unsigned doc;    /* as returned by i7_search_index_add_document() */
+	unsigned start;  /* byte offsets into the document's text */
+	unsigned end;
+} I7SearchMatch;
+
+I7SearchIndex *i7_search_index_new(void);
+I7SearchIndex *i7_search_index_new_from_variant(GVariant *variant);
+void i7_search_index_free(I7SearchIndex *self);
+GVariant *i7_search_index_to_variant(I7SearchIndex *self);
+unsigned i7_search_index_add_document(I7SearchIndex *self, const char *text);
+unsigned i7_search_index_get_n_documents(I7SearchIndex *self);
+const char *i7_search_index_get_text(I7SearchIndex *self, unsigned doc);
+GArray *i7_search_index_find(I7SearchIndex *self, const char *text, gboolean ignore_case, I7SearchType search_type);
+char *i7_search_index_get_context(I7SearchIndex *self, const I7SearchMatch *match);
+
+/* The GVariant type of a serialized index */
+#define I7_SEARCH_INDEX_VARIANT_TYPE G_VARIANT_TYPE("(asa(sauauau))")
+
+#endif /* _SEARCHINDEX_H */
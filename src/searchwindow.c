@@ -17,12 +17,14 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
-#include <gtksourceview/gtksource.h>
 #include <libxml/HTMLparser.h>
 #include <webkit2/webkit2.h>
 
@@ -32,13 +34,27 @@
 #include "error.h"
 #include "file.h"
 #include "extension.h"
+#include "searchindex.h"
 #include "searchwindow.h"
 #include "story.h"
 
 /* An index of the text of the documentation and example pages. Only built
-the first time someone does a documentation search, and freed at the end of the
-main program. */
-static GList *doc_index = NULL;
+the first time someone does a documentation search, after which it is saved in
+the user's cache directory so that it need not be built again until the
+documentation changes. Freed at the end of the main program. The DocTexts are
+in the same order as the documents in the index. */
+static GPtrArray *doc_texts = NULL;
+static I7SearchIndex *doc_index = NULL;
+
+/* Indices of the installed extensions, by path, rebuilt when an extension's
+modification time changes */
+static GHashTable *extension_indices = NULL;
+
+#define DOC_INDEX_FILE_NAME "documentation-index"
+/* Change this if the format of the saved index, or the way the documents are
+split into words, changes */
+#define DOC_INDEX_FORMAT "2"
+#define DOC_INDEX_CACHE_TYPE "(sa(bbmsmsmssmsms)" "(asa(sauauau))" ")"
 
 typedef struct {
 	gboolean is_example;
@@ -46,13 +62,18 @@ typedef struct {
 	gchar *section;
 	gchar *title;
 	gchar *sort;
-	gchar *body;
+	gchar *body; /* only until it is added to the index */
 	GFile *file;
 	char *anchor;
 
 	char *example_title;
 } DocText;
 
+typedef struct {
+	guint64 mtime;
+	I7SearchIndex *index;
+} ExtensionIndex;
+
 /* Columns for the search results tree view */
 typedef enum {
 	I7_RESULT_CONTEXT_COLUMN,
@@ -480,55 +501,142 @@ html_to_ascii(GFile *file, gboolean is_recipebook)
 	return retval;
 }
 
-/* Borrow from document-search.c */
-extern gboolean find_no_wrap(const GtkTextIter *, const gchar *, gboolean, GtkTextSearchFlags, I7SearchType, GtkTextIter *, GtkTextIter *);
+static void
+doc_text_free(DocText *text)
+{
+	g_free(text->section);
+	g_free(text->title);
+	g_free(text->sort);
+	g_free(text->body);
+	g_object_unref(text->file);
+	g_free(text->anchor);
+	g_free(text->example_title);
+	g_slice_free(DocText, text);
+}
+
+static void
+extension_index_free(ExtensionIndex *ext)
+{
+	i7_search_index_free(ext->index);
+	g_slice_free(ExtensionIndex, ext);
+}
 
-/* Helper function: extract some characters of context around the match, with
- the match itself highlighted in bold. String must be freed. */
-static gchar *
-extract_context(GtkTextBuffer *buffer, GtkTextIter *match_start, GtkTextIter *match_end)
+/* Helper function: the file in which the documentation index is cached */
+static char *
+get_doc_index_cache_path(void)
 {
-	GtkTextIter context_start = *match_start, context_end = *match_end;
+	return g_build_filename(g_get_user_cache_dir(), PACKAGE, DOC_INDEX_FILE_NAME, NULL);
+}
 
-	/* Create a larger range to extract the context */
-	gtk_text_iter_backward_chars(&context_start, 8);
-	gtk_text_iter_forward_chars(&context_end, 32);
+/* Helper function: a string identifying the program version and the byte order
+of the machine, since the cache is only valid for the documentation it was made
+from and is not portable */
+static char *
+get_doc_index_stamp(void)
+{
+	return g_strdup_printf("%s %s %d", DOC_INDEX_FORMAT, PACKAGE_VERSION, G_BYTE_ORDER);
+}
 
-	/* Get the surrounding text as context */
-	gchar *before = gtk_text_buffer_get_text(buffer, &context_start, match_start, TRUE);
-	gchar *term = gtk_text_buffer_get_text(buffer, match_start, match_end, TRUE);
-	gchar *after = gtk_text_buffer_get_text(buffer, match_end, &context_end, TRUE);
-	gchar *context = g_strconcat(before, "<b>", term, "</b>", after, NULL);
-	g_strdelimit(context, "\n\r\t", ' ');
-	g_free(before);
-	g_free(term);
-	g_free(after);
+/* Helper function: load the documentation index from the cache, if it is there
+and up to date. Returns TRUE if doc_texts and doc_index were filled in. */
+static gboolean
+load_doc_index_cache(void)
+{
+	g_autofree char *path = get_doc_index_cache_path();
+	GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+	if(mapped == NULL)
+		return FALSE;
+	g_autoptr(GBytes) bytes = g_mapped_file_get_bytes(mapped);
+	g_mapped_file_unref(mapped);
+
+	g_autoptr(GVariant) cache = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(DOC_INDEX_CACHE_TYPE), bytes, FALSE));
+	g_autoptr(GVariant) texts = NULL;
+	g_autoptr(GVariant) index = NULL;
+	const char *stamp;
+	g_variant_get(cache, "(&s@a(bbmsmsmssmsms)@(asa(sauauau)))", &stamp, &texts, &index);
+
+	g_autofree char *expected_stamp = get_doc_index_stamp();
+	if(strcmp(stamp, expected_stamp) != 0)
+		return FALSE;
+
+	doc_index = i7_search_index_new_from_variant(index);
+	if(doc_index == NULL)
+		return FALSE;
+	if(i7_search_index_get_n_documents(doc_index) != g_variant_n_children(texts)) {
+		g_clear_pointer(&doc_index, i7_search_index_free);
+		return FALSE;
+	}
+
+	doc_texts = g_ptr_array_new_with_free_func((GDestroyNotify)doc_text_free);
+	GVariantIter iter;
+	g_variant_iter_init(&iter, texts);
+	DocText doctext;
+	const char *uri;
+	while(g_variant_iter_next(&iter, "(bbmsmsms&smsms)", &doctext.is_example,
+		&doctext.is_recipebook, &doctext.section, &doctext.title, &doctext.sort,
+		&uri, &doctext.anchor, &doctext.example_title))
+	{
+		doctext.body = NULL;
+		doctext.file = g_file_new_for_uri(uri);
+		g_ptr_array_add(doc_texts, g_slice_dup(DocText, &doctext));
+	}
+	return TRUE;
+}
+
+/* Helper function: save the documentation index to the cache. Failure is not
+an error, since the index can always be built again. */
+static void
+save_doc_index_cache(void)
+{
+	GVariantBuilder texts;
+	g_variant_builder_init(&texts, G_VARIANT_TYPE("a(bbmsmsmssmsms)"));
+	for(unsigned ix = 0; ix < doc_texts->len; ix++) {
+		DocText *doctext = g_ptr_array_index(doc_texts, ix);
+		g_autofree char *uri = g_file_get_uri(doctext->file);
+		g_variant_builder_add(&texts, "(bbmsmsmssmsms)", doctext->is_example,
+			doctext->is_recipebook, doctext->section, doctext->title, doctext->sort,
+			uri, doctext->anchor, doctext->example_title);
+	}
+
+	g_autofree char *stamp = get_doc_index_stamp();
+	g_autoptr(GVariant) cache = g_variant_ref_sink(g_variant_new("(s@a(bbmsmsmssmsms)@(asa(sauauau)))",
+		stamp, g_variant_builder_end(&texts), i7_search_index_to_variant(doc_index)));
+
+	g_autofree char *path = get_doc_index_cache_path();
+	g_autofree char *dir = g_path_get_dirname(path);
+	g_autoptr(GError) error = NULL;
+	if(g_mkdir_with_parents(dir, 0755) != 0
+		|| !g_file_set_contents(path, g_variant_get_data(cache), g_variant_get_size(cache), &error))
+		g_warning("Could not save documentation index: %s", error? error->message : g_strerror(errno));
+}
 
-	return context;
+/* Helper function: count the newlines in @text between byte offsets @from and
+@to, for turning match positions into line numbers */
+static unsigned
+count_lines(const char *text, unsigned from, unsigned to)
+{
+	unsigned count = 0;
+	for(const char *p = text + from; p < text + to; p++)
+		if(*p == '\n')
+			count++;
+	return count;
 }
 
-/* Helper function: search one documentation page */
+/* Helper function: add the matches of the search text in the documentation to
+the results */
 static void
-search_documentation(DocText *doctext, I7SearchWindow *self)
+search_documentation(I7SearchWindow *self)
 {
 	I7SearchWindowPrivate *priv = i7_search_window_get_instance_private(self);
 	GtkTreeIter result;
-	GtkTextIter search_from, match_start, match_end;
-	GtkTextBuffer *buffer = GTK_TEXT_BUFFER(gtk_source_buffer_new(NULL));
-	gtk_text_buffer_set_text(buffer, doctext->body, -1);
-	gtk_text_buffer_get_start_iter(buffer, &search_from);
-
-	while(find_no_wrap(&search_from, priv->text, TRUE,
-		GTK_TEXT_SEARCH_TEXT_ONLY | (priv->ignore_case? GTK_TEXT_SEARCH_CASE_INSENSITIVE : 0),
-		priv->algorithm, &match_start, &match_end))
-	{
-		while(gtk_events_pending())
-			gtk_main_iteration();
 
-		search_from = match_end;
+	g_autoptr(GArray) matches = i7_search_index_find(doc_index, priv->text, priv->ignore_case, priv->algorithm);
+	for(unsigned ix = 0; ix < matches->len; ix++) {
+		I7SearchMatch *match = &g_array_index(matches, I7SearchMatch, ix);
+		DocText *doctext = g_ptr_array_index(doc_texts, match->doc);
 
-		gchar *context = extract_context(buffer, &match_start, &match_end);
-		gchar *location = g_strconcat(doctext->section, ": ", doctext->title, NULL);
+		g_autofree char *context = i7_search_index_get_context(doc_index, match);
+		g_autofree char *location = g_strconcat(doctext->section, ": ", doctext->title, NULL);
 
 		gtk_list_store_append(priv->results, &result);
 		gtk_list_store_set(priv->results, &result,
@@ -543,11 +651,41 @@ search_documentation(DocText *doctext, I7SearchWindow *self)
 			I7_RESULT_BACKGROUND_COLOR_COLUMN, doctext->is_recipebook?
 				"#ffffe0" : "#ffffff",
 			-1);
-		g_free(context);
-		g_free(location);
 	}
+}
+
+/* Helper function: add the matches of the search text in @index, which holds
+the text of @file as its only document, to the results. If @basename is not
+NULL, then the results are sorted by it as well as by line number. */
+static void
+search_text_file(I7SearchWindow *self, I7SearchIndex *index, GFile *file, I7ResultType type, const char *basename)
+{
+	I7SearchWindowPrivate *priv = i7_search_window_get_instance_private(self);
+	GtkTreeIter result;
+	const char *text = i7_search_index_get_text(index, 0);
+	unsigned lineno = 1, line_counted_to = 0;
+
+	g_autoptr(GArray) matches = i7_search_index_find(index, priv->text, priv->ignore_case, priv->algorithm);
+	for(unsigned ix = 0; ix < matches->len; ix++) {
+		I7SearchMatch *match = &g_array_index(matches, I7SearchMatch, ix);
+
+		/* Matches are in order, so count lines from the previous one */
+		lineno += count_lines(text, line_counted_to, match->start);
+		line_counted_to = match->start;
+
+		g_autofree char *context = i7_search_index_get_context(index, match);
+		g_autofree char *sort = basename? g_strdup_printf("%s %04i", basename, lineno)
+			: g_strdup_printf("%04i", lineno);
 
-	g_object_unref(buffer);
+		gtk_list_store_append(priv->results, &result);
+		gtk_list_store_set(priv->results, &result,
+			I7_RESULT_CONTEXT_COLUMN, context,
+			I7_RESULT_SORT_STRING_COLUMN, sort,
+			I7_RESULT_FILE_COLUMN, file,
+			I7_RESULT_RESULT_TYPE_COLUMN, type,
+			I7_RESULT_LINE_NUMBER_COLUMN, lineno,
+			-1);
+	}
 }
 
 /* Helper functions: start and stop the spinner, and keep it hidden when it is
@@ -599,26 +737,31 @@ i7_search_window_search_documentation(I7SearchWindow *self)
 {
 	GError *err;
 
-	if(doc_index == NULL) { /* documentation index hasn't been built yet */
+	if(doc_index == NULL && !load_doc_index_cache()) {
+		/* documentation index hasn't been built yet */
 		g_autoptr(GFile) doc_file = g_file_new_for_uri("resource:///com/inform7/IDE/inform");
 
 		GFileEnumerator *docdir;
 		if((docdir = g_file_enumerate_children(doc_file, "standard::*", G_FILE_QUERY_INFO_NONE, NULL, &err)) == NULL) {
 			IO_ERROR_DIALOG(GTK_WINDOW(self), doc_file, err, _("opening documentation directory"));
-			g_object_unref(doc_file);
 			return;
 		}
 
 		start_spinner(self);
 
+		doc_texts = g_ptr_array_new_with_free_func((GDestroyNotify)doc_text_free);
+		doc_index = i7_search_index_new();
+
 		GFileInfo *info;
 		while((info = g_file_enumerator_next_file(docdir, NULL, &err)) != NULL) {
 			const char *basename = g_file_info_get_name(info);
 			const char *displayname = g_file_info_get_display_name(info);
 
 			if(!g_str_has_suffix(basename, ".html") ||
-			   (!g_str_has_prefix(basename, "doc") && !g_str_has_prefix(basename, "Rdoc")))
+			   (!g_str_has_prefix(basename, "doc") && !g_str_has_prefix(basename, "Rdoc"))) {
+				g_object_unref(info);
 				continue;
+			}
 
 			char *label = g_strdup_printf(_("Please be patient, indexing %s..."), displayname);
 			gtk_label_set_text(GTK_LABEL(self->search_text), label);
@@ -630,26 +773,30 @@ i7_search_window_search_documentation(I7SearchWindow *self)
 			GFile *file = g_file_get_child(doc_file, basename);
 			GSList *doctexts = html_to_ascii(file, g_str_has_prefix(basename, "R"));
 			g_object_unref(file);
-			if(doctexts != NULL) {
-				GSList *iter;
-				/* Append the entries to the documentation index and search them
-				right now while we're at it */
-				for(iter = doctexts; iter != NULL; iter = g_slist_next(iter)) {
-					doc_index = g_list_prepend(doc_index, iter->data);
-					search_documentation(iter->data, self);
-				}
-				g_slist_free(doctexts);
+			g_object_unref(info);
+
+			/* Move the bodies into the search index; the document number
+			in the index is the DocText's position in doc_texts */
+			GSList *iter;
+			for(iter = doctexts; iter != NULL; iter = g_slist_next(iter)) {
+				DocText *doctext = iter->data;
+				i7_search_index_add_document(doc_index, doctext->body);
+				g_clear_pointer(&doctext->body, g_free);
+				g_ptr_array_add(doc_texts, doctext);
 			}
+			g_slist_free(doctexts);
 		}
+		g_object_unref(docdir);
+
+		save_doc_index_cache();
 
 		stop_spinner(self);
 		update_label(self);
-	} else {
-		start_spinner(self);
-		g_list_foreach(doc_index, (GFunc)search_documentation, self);
-		stop_spinner(self);
 	}
-	return;
+
+	start_spinner(self);
+	search_documentation(self);
+	stop_spinner(self);
 }
 
 /* Search the project file for the string 'text' */
@@ -657,60 +804,52 @@ void
 i7_search_window_search_project(I7SearchWindow *self)
 {
 	I7SearchWindowPrivate *priv = i7_search_window_get_instance_private(self);
-	GtkTreeIter result;
-	GtkTextIter search_from, match_start, match_end;
+	GtkTextIter start, end;
 	GtkTextBuffer *buffer = GTK_TEXT_BUFFER(i7_document_get_buffer(priv->document));
-	gtk_text_buffer_get_start_iter(buffer, &search_from);
+	gtk_text_buffer_get_bounds(buffer, &start, &end);
 
 	start_spinner(self);
 
-	while(find_no_wrap(&search_from, priv->text, TRUE,
-		GTK_TEXT_SEARCH_TEXT_ONLY | (priv->ignore_case? GTK_TEXT_SEARCH_CASE_INSENSITIVE : 0),
-		priv->algorithm, &match_start, &match_end))
-	{
-		while(gtk_events_pending())
-			gtk_main_iteration();
-
-		search_from = match_end;
+	/* The project text changes all the time, so index it afresh; this is
+	still cheaper than searching the text buffer with iterators */
+	g_autofree char *text = gtk_text_buffer_get_text(buffer, &start, &end, TRUE);
+	I7SearchIndex *index = i7_search_index_new();
+	i7_search_index_add_document(index, text);
 
-		/* Get the line number (counted from 0) */
-		guint lineno = gtk_text_iter_get_line(&match_start) + 1;
+	/* Put the full path to the project in */
+	g_autoptr(GFile) file = i7_document_get_file(priv->document);
+	search_text_file(self, index, file, I7_RESULT_TYPE_PROJECT, NULL);
 
-		gchar *context = extract_context(buffer, &match_start, &match_end);
-
-		/* Make a sort string */
-		gchar *sort = g_strdup_printf("%04i", lineno);
-		/* Put the full path to the project in */
-		GFile *file = i7_document_get_file(priv->document);
-
-		gtk_list_store_append(priv->results, &result);
-		gtk_list_store_set(priv->results, &result,
-			I7_RESULT_CONTEXT_COLUMN, context,
-			I7_RESULT_SORT_STRING_COLUMN, sort,
-			I7_RESULT_FILE_COLUMN, file,
-			I7_RESULT_RESULT_TYPE_COLUMN, I7_RESULT_TYPE_PROJECT,
-			I7_RESULT_LINE_NUMBER_COLUMN, lineno,
-			-1);
-		g_free(context);
-		g_free(sort);
-		g_object_unref(file);
-	}
+	i7_search_index_free(index);
 
 	stop_spinner(self);
 }
 
-static void
-extension_search_result(GFile *parent, GFileInfo *info, gpointer unused, I7SearchWindow *self)
+/* Helper function: get the search index of an installed extension, indexing
+it if it hasn't been indexed yet or has changed since it was indexed. Returns
+NULL on error. */
+static I7SearchIndex *
+get_extension_index(I7SearchWindow *self, GFile *parent, GFileInfo *info, GFile *file)
 {
-	I7SearchWindowPrivate *priv = i7_search_window_get_instance_private(self);
 	GError *err = NULL;
-	const char *basename = g_file_info_get_name(info);
-	GFile *file = g_file_get_child(parent, basename);
-	char *contents;
-	GtkTextBuffer *buffer;
-	GtkTreeIter result;
-	GtkTextIter search_from, match_start, match_end;
+	g_autofree char *path = g_file_get_path(file);
+
+	/* The extension enumerator only asks for standard attributes */
+	guint64 mtime = 0;
+	g_autoptr(GFileInfo) time_info = g_file_query_info(file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+		G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if(time_info != NULL)
+		mtime = g_file_info_get_attribute_uint64(time_info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
 
+	if(extension_indices == NULL)
+		extension_indices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)extension_index_free);
+
+	ExtensionIndex *ext = g_hash_table_lookup(extension_indices, path);
+	if(ext != NULL && mtime != 0 && ext->mtime == mtime)
+		return ext->index;
+
+	char *contents;
 	if(!g_file_load_contents(file, NULL, &contents, NULL, NULL, &err)) {
 		char *author_display_name = file_get_display_name(parent);
 		const char *ext_display_name = g_file_info_get_display_name(info);
@@ -720,55 +859,32 @@ extension_search_result(GFile *parent, GFileInfo *info, gpointer unused, I7Searc
 		  _("Error opening extension '%s' by '%s':"), author_display_name, ext_display_name);
 
 		g_free(author_display_name);
-		g_object_unref(file);
-		return;
+		return NULL;
 	}
-
-	buffer = GTK_TEXT_BUFFER(gtk_source_buffer_new(NULL));
-	gtk_text_buffer_set_text(buffer, contents, -1);
+	g_autofree char *valid_contents = g_utf8_make_valid(contents, -1);
 	g_free(contents);
 
-	gtk_text_buffer_get_start_iter(buffer, &search_from);
-
-	start_spinner(self);
-
-	while(find_no_wrap(&search_from, priv->text, TRUE,
-		GTK_TEXT_SEARCH_TEXT_ONLY | (priv->ignore_case? GTK_TEXT_SEARCH_CASE_INSENSITIVE : 0),
-		priv->algorithm, &match_start, &match_end))
-	{
-		unsigned lineno;
-		char *sort, *context;
-
-		while(gtk_events_pending())
-			gtk_main_iteration();
-
-		search_from = match_end;
-
-		/* Get the line number (counted from 0) */
-		lineno = gtk_text_iter_get_line(&match_start) + 1;
-
-		context = extract_context(buffer, &match_start, &match_end);
+	ext = g_slice_new0(ExtensionIndex);
+	ext->mtime = mtime;
+	ext->index = i7_search_index_new();
+	i7_search_index_add_document(ext->index, valid_contents);
+	g_hash_table_replace(extension_indices, g_steal_pointer(&path), ext);
+	return ext->index;
+}
 
-		/* Make a sort string */
-		sort = g_strdup_printf("%s %04i", basename, lineno);
+static void
+extension_search_result(GFile *parent, GFileInfo *info, gpointer unused, I7SearchWindow *self)
+{
+	const char *basename = g_file_info_get_name(info);
+	g_autoptr(GFile) file = g_file_get_child(parent, basename);
 
-		gtk_list_store_append(priv->results, &result);
-		gtk_list_store_set(priv->results, &result,
-			I7_RESULT_CONTEXT_COLUMN, context,
-			I7_RESULT_SORT_STRING_COLUMN, sort,
-			I7_RESULT_FILE_COLUMN, file,
-			I7_RESULT_RESULT_TYPE_COLUMN, I7_RESULT_TYPE_EXTENSION,
-			I7_RESULT_LINE_NUMBER_COLUMN, lineno,
-			-1);
+	start_spinner(self);
 
-		g_free(context);
-		g_free(sort);
-	}
+	I7SearchIndex *index = get_extension_index(self, parent, info, file);
+	if(index != NULL)
+		search_text_file(self, index, file, I7_RESULT_TYPE_EXTENSION, basename);
 
 	stop_spinner(self);
-
-	g_object_unref(buffer);
-	g_object_unref(file);
 }
 
 /**
@@ -802,21 +918,7 @@ i7_search_window_done_searching(I7SearchWindow *self)
 void
 i7_search_window_free_index(void)
 {
-	if(doc_index == NULL)
-		return;
-
-	GList *iter;
-	for(iter = doc_index; iter != NULL; iter = g_list_next(iter)) {
-		DocText *text = (DocText *)(iter->data);
-		g_free(text->section);
-		g_free(text->title);
-		g_free(text->sort);
-		g_free(text->body);
-		g_object_unref(text->file);
-		g_free(text->anchor);
-		g_free(text->example_title);
-		g_slice_free(DocText, text);
-	}
-	g_list_free(doc_index);
-	doc_index = NULL;
+	g_clear_pointer(&doc_texts, g_ptr_array_unref);
+	g_clear_pointer(&doc_index, i7_search_index_free);
+	g_clear_pointer(&extension_indices, g_hash_table_destroy);
 }
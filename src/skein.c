@@ -18,13 +18,13 @@
 #include "config.h"
 
 #include <errno.h>
+#include <string.h>
 
 #include <gio/gio.h>
 #include <glib/gi18n.h>
 #include <goocanvas.h>
 #include <gtk/gtk.h>
 #include <libxml/parser.h>
-#include <libxml/tree.h>
 
 #include "node.h"
 #include "skein.h"
@@ -42,6 +42,12 @@ typedef struct _I7SkeinPrivate
 	I7Node *played;  /* Node currently played (yellow) */
 	gboolean modified;
 
+	/* Incremental saving */
+	GHashTable *dirty; /* Nodes changed since the last save */
+	GFile *saved_file; /* File last loaded or saved in full, or NULL */
+	goffset saved_size; /* Size of @saved_file */
+	goffset journal_size; /* Size of the journal belonging to @saved_file */
+
 	gdouble hspacing;
 	gdouble vspacing;
 
@@ -84,9 +90,18 @@ G_DEFINE_TYPE_EXTENDED(I7Skein, i7_skein, GOO_TYPE_CANVAS_GROUP_MODEL, 0,
 
 /* SIGNAL HANDLERS */
 
+/* Remember that @node must be written in the next incremental save */
+static void
+mark_dirty(I7Skein *self, I7Node *node)
+{
+	I7SkeinPrivate *priv = i7_skein_get_instance_private(self);
+	g_hash_table_add(priv->dirty, node);
+}
+
 static void
 on_node_other_notify(I7Node *node, GParamSpec *pspec, I7Skein *self)
 {
+	mark_dirty(self, node);
 	g_signal_emit_by_name(self, "modified");
 }
 
@@ -142,6 +157,10 @@ i7_skein_init(I7Skein *self)
 	priv->current = priv->root;
 	priv->played = priv->root;
 	priv->modified = TRUE;
+	/* Nodes are only looked up in this table while they are in the tree, so
+	it doesn't need to hold references */
+	priv->dirty = g_hash_table_new(NULL, NULL);
+	priv->saved_file = NULL;
 	priv->locked_dash = goo_canvas_line_dash_new(0);
 	priv->unlocked_dash = goo_canvas_line_dash_new(2, 5.0, 5.0);
 
@@ -206,6 +225,8 @@ i7_skein_finalize(GObject *self)
 
 	g_object_unref(priv->root);
 	goo_canvas_line_dash_unref(priv->unlocked_dash);
+	g_hash_table_destroy(priv->dirty);
+	g_clear_object(&priv->saved_file);
 
 	G_OBJECT_CLASS(i7_skein_parent_class)->finalize(self);
 }
@@ -698,52 +719,480 @@ i7_skein_set_played_node(I7Skein *self, I7Node *node)
 	g_object_notify(G_OBJECT(self), "played-node");
 }
 
-/* Search an xmlNode's properties for a certain one and return its content.
-String must be freed. Return NULL if not found */
-static gchar *
-get_property_from_node(xmlNode *node, const gchar *propertyname)
+/* Move the played pointer back to @node, which must be the played node or one
+of its ancestors, without restarting the game; for when the interpreter has
+been returned to the state it was in after playing @node. The next command
+will be added below @node. */
+void
+i7_skein_rewind_played_node(I7Skein *self, I7Node *node)
 {
-	xmlAttr *props;
-	for(props = node->properties; props; props = props->next)
-		if(xmlStrEqual(props->name, (const xmlChar *)propertyname))
-			return g_strdup((gchar *)props->children->content);
+	I7SkeinPrivate *priv = i7_skein_get_instance_private(self);
+	g_return_if_fail(node == priv->played || g_node_is_ancestor(node->gnode, priv->played->gnode));
+	i7_skein_set_played_node(self, node);
+}
+
+/* Doesn't actually free the node itself, but removes it from the canvas so that
+ it gets freed. Has reversed arguments and returns FALSE for use in tree
+ traversals. */
+static gboolean
+remove_node_from_canvas(GNode *gnode, I7Skein *self)
+{
+	if(I7_NODE(gnode->data)->tree_item)
+		goo_canvas_item_model_remove(I7_NODE(gnode->data)->tree_item);
+	goo_canvas_item_model_remove(GOO_CANVAS_ITEM_MODEL(gnode->data));
+	return FALSE;
+}
+
+/* One <item> element from a skein file or journal */
+struct SkeinItem {
+	char *command;
+	char *label;
+	GBytes *transcript_xml;
+	GBytes *expected_xml;
+	gboolean unlocked;
+	gboolean changed;
+	int score;
+	GPtrArray *children; /* IDs of the child items */
+};
+
+static void
+skein_item_free(struct SkeinItem *item)
+{
+	g_free(item->command);
+	g_free(item->label);
+	if(item->transcript_xml)
+		g_bytes_unref(item->transcript_xml);
+	if(item->expected_xml)
+		g_bytes_unref(item->expected_xml);
+	g_ptr_array_free(item->children, TRUE);
+	g_slice_free(struct SkeinItem, item);
+}
+
+/* State of the streaming parser; one of these is used for the skein file and
+its journal, so that items in the journal replace items in the file. Items are
+only turned into nodes when both have been read. */
+struct SkeinParser {
+	xmlParserCtxt *ctxt;
+	GBytes *contents;
+	const char *data;
+	gsize length;
+	const char *toplevel; /* Expected name of the top-level element */
+	GError *error;
+
+	GHashTable *items; /* ID -> struct SkeinItem */
+	char *root_id;
+	char *active_id;
+
+	unsigned depth;
+	char *item_id;
+	struct SkeinItem *item;
+	GString *text;
+	gsize content_start; /* Offset of the text of a <result> or <commentary> */
+};
+
+static void
+skein_parser_init(struct SkeinParser *parser, const char *toplevel)
+{
+	memset(parser, 0, sizeof(struct SkeinParser));
+	parser->items = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)skein_item_free);
+	parser->text = g_string_new("");
+	parser->toplevel = toplevel;
+}
+
+static void
+skein_parser_clear(struct SkeinParser *parser)
+{
+	g_hash_table_destroy(parser->items);
+	g_string_free(parser->text, TRUE);
+	g_free(parser->root_id);
+	g_free(parser->active_id);
+}
+
+static void
+skein_parser_bad_format(struct SkeinParser *parser, const char *message)
+{
+	if(parser->error == NULL)
+		parser->error = g_error_new_literal(I7_SKEIN_ERROR, I7_SKEIN_ERROR_BAD_FORMAT, message);
+	xmlStopParser(parser->ctxt);
+}
+
+static char *
+get_attribute(int nb_attributes, const xmlChar **attributes, const char *name)
+{
+	int ix;
+	for(ix = 0; ix < nb_attributes; ix++) {
+		const xmlChar **attribute = attributes + 5 * ix;
+		if(xmlStrEqual(attribute[0], (const xmlChar *)name))
+			return g_strndup((const char *)attribute[3], attribute[4] - attribute[3]);
+	}
 	return NULL;
 }
 
 /* Read the ObjectiveC "YES" and "NO" into a boolean, or return default_val if
  content is malformed */
 static gboolean
-get_boolean_from_content(xmlNode *node, gboolean default_val)
+get_boolean_from_content(const char *content, gboolean default_val)
 {
-	if(xmlStrEqual(node->children->content, (xmlChar *)"YES"))
+	if(strcmp(content, "YES") == 0)
 		return TRUE;
-	else if(xmlStrEqual(node->children->content, (xmlChar *)"NO"))
+	else if(strcmp(content, "NO") == 0)
 		return FALSE;
 	else
 		return default_val;
 }
 
-static gchar *
-get_text_content_from_node(xmlNode *node)
+/* Whether the tag name starting at @tag, possibly with a namespace prefix, is
+@name */
+static gboolean
+tag_has_name(const char *tag, const char *end, const char *name)
 {
-	if(node->children)
-		if(xmlStrEqual(node->children->name, (xmlChar *)"text"))
-			return g_strdup((gchar *)node->children->content);
-	return NULL;
+	const char *name_end = tag;
+	while(name_end < end && !g_ascii_isspace(*name_end) && *name_end != '>' && *name_end != '/')
+		name_end++;
+	size_t len = strlen(name);
+	if((size_t)(name_end - tag) < len || strncmp(name_end - len, name, len) != 0)
+		return FALSE;
+	return (size_t)(name_end - tag) == len || *(name_end - len - 1) == ':';
+}
+
+/* Find where the text of the element that was just opened starts in the file,
+or return G_MAXSIZE if it can't be found */
+static gsize
+find_content_start(struct SkeinParser *parser, const char *name)
+{
+	long consumed = xmlByteConsumed(parser->ctxt);
+	if(consumed < 0 || (gsize)consumed >= parser->length)
+		return G_MAXSIZE;
+
+	const char *data = parser->data;
+	gsize lt = consumed;
+	while(lt > 0 && data[lt] != '<')
+		lt--;
+	if(data[lt] != '<' || !tag_has_name(data + lt + 1, data + parser->length, name))
+		return G_MAXSIZE;
+	gsize gt = lt;
+	while(gt < parser->length && data[gt] != '>')
+		gt++;
+	if(gt == parser->length || data[gt - 1] == '/')
+		return G_MAXSIZE;
+	return gt + 1;
+}
+
+/* Return the escaped text of the <result> or <commentary> element that was
+just closed. If possible, it is a slice of the file, so that it doesn't need to
+be copied or decoded until the node needs it. */
+static GBytes *
+get_element_xml(struct SkeinParser *parser, const char *name)
+{
+	long consumed = xmlByteConsumed(parser->ctxt);
+	gsize start = parser->content_start;
+
+	if(consumed > 0 && (gsize)consumed <= parser->length && start <= (gsize)consumed) {
+		const char *data = parser->data;
+		gsize lt = consumed - 1;
+		while(lt > start && data[lt] != '<')
+			lt--;
+		/* The text can't contain any markup, such as CDATA sections or
+		comments, and it can't be shorter than the text that the parser got
+		out of it */
+		if(data[lt] == '<' && lt + 2 < parser->length && data[lt + 1] == '/'
+			&& tag_has_name(data + lt + 2, data + parser->length, name)
+			&& lt - start >= parser->text->len
+			&& memchr(data + start, '<', lt - start) == NULL
+			&& g_utf8_validate(data + start, lt - start, NULL))
+			return g_bytes_new_from_bytes(parser->contents, start, lt - start);
+	}
+
+	char *escaped = g_markup_escape_text(parser->text->str, parser->text->len);
+	return g_bytes_new_take(escaped, strlen(escaped));
 }
 
-/* Doesn't actually free the node itself, but removes it from the canvas so that
- it gets freed. Has reversed arguments and returns FALSE for use in tree
- traversals. */
+static void
+on_skein_start_element(struct SkeinParser *parser, const xmlChar *localname,
+	const xmlChar *prefix, const xmlChar *uri, int nb_namespaces,
+	const xmlChar **namespaces, int nb_attributes, int nb_defaulted,
+	const xmlChar **attributes)
+{
+	const char *name = (const char *)localname;
+
+	parser->depth++;
+	g_string_truncate(parser->text, 0);
+
+	switch(parser->depth) {
+		case 1:
+			if(strcmp(name, parser->toplevel) != 0) {
+				char *message = g_strdup_printf("<%s> element not found.", parser->toplevel);
+				skein_parser_bad_format(parser, message);
+				g_free(message);
+				return;
+			}
+			if(parser->root_id == NULL) {
+				parser->root_id = get_attribute(nb_attributes, attributes, "rootNode");
+				if(parser->root_id == NULL)
+					skein_parser_bad_format(parser, "rootNode attribute not found.");
+			}
+			break;
+		case 2:
+			if(strcmp(name, "activeNode") == 0) {
+				g_free(parser->active_id);
+				parser->active_id = get_attribute(nb_attributes, attributes, "nodeId");
+			} else if(strcmp(name, "item") == 0) {
+				parser->item_id = get_attribute(nb_attributes, attributes, "nodeId");
+				parser->item = g_slice_new0(struct SkeinItem);
+				parser->item->unlocked = TRUE;
+				parser->item->children = g_ptr_array_new_with_free_func(g_free);
+			}
+			break;
+		case 3:
+			if(parser->item == NULL)
+				break;
+			if(strcmp(name, "result") == 0 || strcmp(name, "commentary") == 0)
+				parser->content_start = find_content_start(parser, name);
+			else if(strcmp(name, "temporary") == 0) {
+				char *score = get_attribute(nb_attributes, attributes, "score");
+				if(score)
+					sscanf(score, "%d", &parser->item->score);
+				g_free(score);
+			}
+			break;
+		case 4:
+			if(parser->item && strcmp(name, "child") == 0) {
+				char *child_id = get_attribute(nb_attributes, attributes, "nodeId");
+				if(child_id)
+					g_ptr_array_add(parser->item->children, child_id);
+			}
+			break;
+	}
+}
+
+static void
+on_skein_end_element(struct SkeinParser *parser, const xmlChar *localname,
+	const xmlChar *prefix, const xmlChar *uri)
+{
+	const char *name = (const char *)localname;
+	struct SkeinItem *item = parser->item;
+
+	if(parser->depth == 3 && item) {
+		/* Ignore "played"; it is calculated */
+		if(strcmp(name, "command") == 0) {
+			g_free(item->command);
+			item->command = g_strdup(parser->text->str);
+		} else if(strcmp(name, "annotation") == 0) {
+			g_free(item->label);
+			item->label = g_strdup(parser->text->str);
+		} else if(strcmp(name, "result") == 0) {
+			if(item->transcript_xml)
+				g_bytes_unref(item->transcript_xml);
+			item->transcript_xml = get_element_xml(parser, name);
+		} else if(strcmp(name, "commentary") == 0) {
+			if(item->expected_xml)
+				g_bytes_unref(item->expected_xml);
+			item->expected_xml = get_element_xml(parser, name);
+		} else if(strcmp(name, "changed") == 0)
+			item->changed = get_boolean_from_content(parser->text->str, FALSE);
+		else if(strcmp(name, "temporary") == 0)
+			item->unlocked = get_boolean_from_content(parser->text->str, TRUE);
+	} else if(parser->depth == 2 && item) {
+		if(parser->item_id)
+			g_hash_table_replace(parser->items, parser->item_id, item);
+		else
+			skein_item_free(item);
+		parser->item_id = NULL;
+		parser->item = NULL;
+	}
+
+	g_string_truncate(parser->text, 0);
+	parser->depth--;
+}
+
+static void
+on_skein_characters(struct SkeinParser *parser, const xmlChar *ch, int len)
+{
+	if(parser->depth == 3 && parser->item)
+		g_string_append_len(parser->text, (const char *)ch, len);
+}
+
+/* Parse @contents, the whole skein file or journal, adding its items to
+@parser. The journal is not a complete XML document, since it is only ever
+appended to; @trailer is parsed after @contents to close it. */
 static gboolean
-remove_node_from_canvas(GNode *gnode, I7Skein *self)
+skein_parser_parse(struct SkeinParser *parser, GBytes *contents, const char *trailer, GError **error)
+{
+	xmlSAXHandler handler;
+	memset(&handler, 0, sizeof(handler));
+	handler.initialized = XML_SAX2_MAGIC;
+	handler.startElementNs = (startElementNsSAX2Func)on_skein_start_element;
+	handler.endElementNs = (endElementNsSAX2Func)on_skein_end_element;
+	handler.characters = (charactersSAXFunc)on_skein_characters;
+	handler.cdataBlock = (cdataBlockSAXFunc)on_skein_characters;
+
+	parser->contents = contents;
+	parser->data = g_bytes_get_data(contents, &parser->length);
+	parser->depth = 0;
+	parser->ctxt = xmlCreatePushParserCtxt(&handler, parser, NULL, 0, NULL);
+	xmlParseChunk(parser->ctxt, parser->data, parser->length, trailer == NULL);
+	if(trailer)
+		xmlParseChunk(parser->ctxt, trailer, strlen(trailer), 1);
+
+	gboolean retval = TRUE;
+	if(parser->error) {
+		g_propagate_error(error, parser->error);
+		parser->error = NULL;
+		retval = FALSE;
+	} else if(!parser->ctxt->wellFormed) {
+		const xmlError *xml_error = xmlCtxtGetLastError(parser->ctxt);
+		g_set_error_literal(error, I7_SKEIN_ERROR, I7_SKEIN_ERROR_XML,
+			xml_error && xml_error->message? xml_error->message : _("Malformed XML"));
+		retval = FALSE;
+	}
+
+	/* An item that wasn't closed */
+	if(parser->item)
+		skein_item_free(parser->item);
+	g_free(parser->item_id);
+	parser->item = NULL;
+	parser->item_id = NULL;
+
+	xmlFreeParserCtxt(parser->ctxt);
+	parser->ctxt = NULL;
+	parser->contents = NULL;
+	return retval;
+}
+
+/* Read @file into memory. The knots' text stays as slices of this copy until
+it is needed, so it is not mapped: another program truncating or rewriting the
+file while the project is open would make reading a mapping crash. */
+static GBytes *
+load_file_contents(GFile *file, goffset *size, GError **error)
 {
-	if(I7_NODE(gnode->data)->tree_item)
-		goo_canvas_item_model_remove(I7_NODE(gnode->data)->tree_item);
-	goo_canvas_item_model_remove(GOO_CANVAS_ITEM_MODEL(gnode->data));
-	return FALSE;
+	char *data;
+	gsize length;
+	if(!g_file_load_contents(file, NULL, &data, &length, NULL, error))
+		return NULL;
+	if(size)
+		*size = length;
+	return g_bytes_new_take(data, length);
+}
+
+/* The journal is kept next to the skein file */
+static GFile *
+get_journal_file(GFile *file)
+{
+	char *path = g_file_get_path(file);
+	char *journal_path = g_strconcat(path, ".journal", NULL);
+	GFile *retval = g_file_new_for_path(journal_path);
+	g_free(path);
+	g_free(journal_path);
+	return retval;
+}
+
+/* A journal only belongs to the skein file that it was started for; if the
+file was rewritten since then, for example by another program, then the journal
+is stale. */
+static char *
+get_journal_base_stamp(GFile *file)
+{
+	GFileInfo *info = g_file_query_info(file, G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+		G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+		G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if(info == NULL)
+		return NULL;
+	char *retval = g_strdup_printf("%" G_GOFFSET_FORMAT ":%" G_GUINT64_FORMAT ":%u",
+		g_file_info_get_size(info),
+		g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+		g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC));
+	g_object_unref(info);
+	return retval;
+}
+
+/* Read the journal belonging to @file into @parser, if there is one that is
+still valid, and return its size */
+static goffset
+apply_journal(struct SkeinParser *parser, GFile *file)
+{
+	GFile *journal_file = get_journal_file(file);
+	goffset size = 0;
+	GBytes *contents = NULL;
+
+	if(g_file_query_exists(journal_file, NULL))
+		contents = load_file_contents(journal_file, &size, NULL);
+	g_object_unref(journal_file);
+	if(contents == NULL)
+		return -1;
+
+	/* Check the stamp in the journal's header against the skein file */
+	char *stamp = get_journal_base_stamp(file);
+	char *header = stamp? g_strdup_printf("<SkeinJournal base=\"%s\"", stamp) : NULL;
+	gboolean valid = header && g_strstr_len(g_bytes_get_data(contents, NULL), MIN(size, 1024), header);
+	g_free(stamp);
+	g_free(header);
+
+	/* Parse into a separate set of items, so that a journal that breaks off
+	partway changes nothing */
+	if(valid) {
+		struct SkeinParser journal;
+		skein_parser_init(&journal, "SkeinJournal");
+		journal.root_id = g_strdup(parser->root_id);
+		valid = skein_parser_parse(&journal, contents, "</SkeinJournal>\n", NULL);
+		if(valid) {
+			GHashTableIter iter;
+			char *id;
+			struct SkeinItem *item;
+			g_hash_table_iter_init(&iter, journal.items);
+			while(g_hash_table_iter_next(&iter, (gpointer *)&id, (gpointer *)&item)) {
+				g_hash_table_iter_steal(&iter);
+				g_hash_table_replace(parser->items, id, item);
+			}
+			if(journal.active_id) {
+				g_free(parser->active_id);
+				parser->active_id = g_steal_pointer(&journal.active_id);
+			}
+		}
+		skein_parser_clear(&journal);
+	}
+	g_bytes_unref(contents);
+	return valid? size : -1;
+}
+
+static I7Node *
+build_node(I7Skein *self, GHashTable *items, GHashTable *nodes, const char *id)
+{
+	struct SkeinItem *item = g_hash_table_lookup(items, id);
+	if(item == NULL || g_hash_table_contains(nodes, id))
+		return NULL; /* Missing, or a cycle */
+
+	I7Node *node = i7_node_new(item->command, item->label, NULL, NULL, FALSE, !item->unlocked, item->changed, item->score, GOO_CANVAS_ITEM_MODEL(self));
+	i7_node_set_unique_id(node, id);
+	if(item->transcript_xml == NULL)
+		item->transcript_xml = g_bytes_new_static("", 0);
+	if(item->expected_xml == NULL)
+		item->expected_xml = g_bytes_new_static("", 0);
+	i7_node_set_deferred_text(node, item->transcript_xml, item->expected_xml);
+	node_listen(self, node);
+	g_hash_table_insert(nodes, (char *)id, node);
+
+	unsigned ix;
+	for(ix = 0; ix < item->children->len; ix++) {
+		I7Node *child = build_node(self, items, nodes, item->children->pdata[ix]);
+		if(child)
+			g_node_append(node->gnode, child->gnode);
+	}
+	return node;
 }
 
+/*
+ * i7_skein_load:
+ * @self: the skein
+ * @file: a Skein.skein file
+ * @error: return location for an error
+ *
+ * Replaces the contents of @self with the skein in @file. The file is read as
+ * a stream, and the knots' transcript text is not decoded until it is needed.
+ * If there is a journal written by i7_skein_save_incremental() for @file, the
+ * changes in it are applied as well.
+ *
+ * Returns: %TRUE on success, %FALSE on failure.
+ */
 gboolean
 i7_skein_load(I7Skein *self, GFile *file, GError **error)
 {
@@ -752,119 +1201,58 @@ i7_skein_load(I7Skein *self, GFile *file, GError **error)
 
 	I7SkeinPrivate *priv = i7_skein_get_instance_private(self);
 
-	char *filename = g_file_get_path(file);
-	xmlDoc *xmldoc = xmlParseFile(filename);
-	g_free(filename);
-	if(!xmldoc) {
-		xmlErrorPtr xml_error = xmlGetLastError();
-		if(error)
-			*error = g_error_new_literal(I7_SKEIN_ERROR, I7_SKEIN_ERROR_XML, g_strdup(xml_error->message));
+	goffset size;
+	GBytes *contents = load_file_contents(file, &size, error);
+	if(contents == NULL)
 		return FALSE;
-	}
 
-	/* Get the top XML node */
-	xmlNode *top = xmlDocGetRootElement(xmldoc);
-	if(!xmlStrEqual(top->name, (xmlChar *)"Skein")) {
-		if(error)
-			*error = g_error_new(I7_SKEIN_ERROR, I7_SKEIN_ERROR_BAD_FORMAT, "<Skein> element not found.");
-		goto fail;
-	}
-
-	/* Get the ID of the root node */
-	gchar *root_id = get_property_from_node(top, "rootNode");
-	if(!root_id) {
-		if(error)
-			*error = g_error_new(I7_SKEIN_ERROR, I7_SKEIN_ERROR_BAD_FORMAT, "rootNode attribute not found.");
-		goto fail;
-	}
-
-	/* Get all the item nodes and the ID of the active node */
-	GHashTable *nodetable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-	gchar *active_id = NULL;
-	xmlNode *item;
-	/* Create a node object for each of the XML item nodes */
-	for(item = top->children; item; item = item->next) {
-		if(xmlStrEqual(item->name, (xmlChar *)"activeNode"))
-			active_id = get_property_from_node(item, "nodeId");
-		else if(xmlStrEqual(item->name, (xmlChar *)"item")) {
-			gchar *id, *command = NULL, *label = NULL;
-			gchar *transcript = NULL, *expected = NULL;
-			gboolean unlocked = TRUE, changed = FALSE;
-			int score = 0;
-
-			xmlNode *child;
-			for(child = item->children; child; child = child->next) {
-				/* Ignore "played" and "changed"; these are calculated */
-				if(xmlStrEqual(child->name, (xmlChar *)"command"))
-					command = get_text_content_from_node(child);
-				else if(xmlStrEqual(child->name, (xmlChar *)"annotation"))
-					label = get_text_content_from_node(child);
-				else if(xmlStrEqual(child->name, (xmlChar *)"result"))
-					transcript = get_text_content_from_node(child);
-				else if(xmlStrEqual(child->name, (xmlChar *)"commentary"))
-					expected = get_text_content_from_node(child);
-				else if(xmlStrEqual(child->name, (xmlChar *)"changed"))
-					changed = get_boolean_from_content(child, FALSE);
-				else if(xmlStrEqual(child->name, (xmlChar *)"temporary")) {
-					unlocked = get_boolean_from_content(child, TRUE);
-					gchar *trash = get_property_from_node(child, "score");
-					sscanf(trash, "%d", &score);
-					g_free(trash);
-				}
-			}
-			id = get_property_from_node(item, "nodeId"); /* freed by table */
-
-			I7Node *skein_node = i7_node_new(command, label, transcript, expected, FALSE, !unlocked, changed, score, GOO_CANVAS_ITEM_MODEL(self));
-			node_listen(self, skein_node);
-			g_hash_table_insert(nodetable, id, skein_node);
-			g_free(command);
-			g_free(label);
-			g_free(transcript);
-			g_free(expected);
+	struct SkeinParser parser;
+	skein_parser_init(&parser, "Skein");
+	gboolean success = skein_parser_parse(&parser, contents, NULL, error);
+	g_bytes_unref(contents);
+	goffset journal_size = -1;
+	if(success)
+		journal_size = apply_journal(&parser, file);
+
+	GHashTable *nodes = g_hash_table_new(g_str_hash, g_str_equal);
+	I7Node *root = NULL;
+	if(success) {
+		root = build_node(self, parser.items, nodes, parser.root_id);
+		if(root == NULL) {
+			g_set_error(error, I7_SKEIN_ERROR, I7_SKEIN_ERROR_BAD_FORMAT, "Root node not found.");
+			success = FALSE;
 		}
 	}
 
-	/* Loop through the item nodes again, adding the children to each parent */
-	for(item = top->children; item; item = item->next) {
-		if(!xmlStrEqual(item->name, (xmlChar *)"item"))
-			continue;
-		gchar *id = get_property_from_node(item, "nodeId");
-		I7Node *parent_node = g_hash_table_lookup(nodetable, id);
-		xmlNode *child;
-		for(child = item->children; child; child = child->next) {
-			if(!xmlStrEqual(child->name, (xmlChar *)"children"))
-				continue;
-			xmlNode *list;
-			for(list = child->children; list; list = list->next) {
-				if(!xmlStrEqual(list->name, (xmlChar *)"child"))
-					continue;
-				gchar *child_id = get_property_from_node(list, "nodeId");
-				g_node_append(parent_node->gnode, I7_NODE(g_hash_table_lookup(nodetable, child_id))->gnode);
-				g_free(child_id);
-			}
+	if(success) {
+		/* Discard the current skein and replace with the new */
+		g_node_traverse(priv->root->gnode, G_POST_ORDER, G_TRAVERSE_ALL, -1, (GNodeTraverseFunc)remove_node_from_canvas, self);
+		priv->root = root;
+		priv->played = NULL;
+		I7Node *active = parser.active_id? g_hash_table_lookup(nodes, parser.active_id) : NULL;
+		i7_skein_set_played_node(self, active? active : root);
+		i7_skein_set_current_node(self, priv->root);
+
+		g_signal_emit_by_name(self, "needs-layout");
+		g_signal_emit_by_name(self, "labels-changed");
+		priv->modified = FALSE;
+
+		/* Changes can be appended to the journal, unless there was a stale
+		one, which the next save must get rid of */
+		g_hash_table_remove_all(priv->dirty);
+		g_clear_object(&priv->saved_file);
+		GFile *journal_file = get_journal_file(file);
+		if(journal_size >= 0 || !g_file_query_exists(journal_file, NULL)) {
+			priv->saved_file = g_object_ref(file);
+			priv->saved_size = size;
+			priv->journal_size = MAX(journal_size, 0);
 		}
-		g_free(id);
+		g_object_unref(journal_file);
 	}
 
-	/* Discard the current skein and replace with the new */
-	g_node_traverse(priv->root->gnode, G_POST_ORDER, G_TRAVERSE_ALL, -1, (GNodeTraverseFunc)remove_node_from_canvas, self);
-	priv->root = I7_NODE(g_hash_table_lookup(nodetable, root_id));
-	priv->played = NULL;
-	i7_skein_set_played_node(self, I7_NODE(g_hash_table_lookup(nodetable, active_id)));
-	i7_skein_set_current_node(self, priv->root);
-
-	g_signal_emit_by_name(self, "needs-layout");
-	g_signal_emit_by_name(self, "labels-changed");
-	priv->modified = FALSE;
-
-	g_free(root_id);
-	g_free(active_id);
-	g_hash_table_destroy(nodetable);
-
-	return TRUE;
-fail:
-	xmlFreeDoc(xmldoc);
-	return FALSE;
+	g_hash_table_destroy(nodes);
+	skein_parser_clear(&parser);
+	return success;
 }
 
 static gboolean
@@ -876,6 +1264,17 @@ node_write_xml(GNode *gnode, GDataOutputStream *stream)
 	return FALSE; /* Do not stop the traversal */
 }
 
+/*
+ * i7_skein_save:
+ * @self: the skein
+ * @file: a Skein.skein file
+ * @error: return location for an error
+ *
+ * Writes the whole skein to @file, and removes any journal that belonged to
+ * it.
+ *
+ * Returns: %TRUE on success, %FALSE on failure.
+ */
 gboolean
 i7_skein_save(I7Skein *self, GFile *file, GError **error)
 {
@@ -907,11 +1306,144 @@ i7_skein_save(I7Skein *self, GFile *file, GError **error)
 	g_object_unref(skein_stream);
 	g_object_unref(fstream);
 
+	GFile *journal_file = get_journal_file(file);
+	g_file_delete(journal_file, NULL, NULL);
+	g_object_unref(journal_file);
+
+	g_hash_table_remove_all(priv->dirty);
+	g_clear_object(&priv->saved_file);
+	GFileInfo *info = g_file_query_info(file, G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if(info) {
+		priv->saved_file = g_object_ref(file);
+		priv->saved_size = g_file_info_get_size(info);
+		priv->journal_size = 0;
+		g_object_unref(info);
+	}
+
 	priv->modified = FALSE;
 
 	return TRUE;
 }
 
+/* One-off data structure for passing variables to node_write_journal() */
+struct JournalData {
+	GHashTable *dirty;
+	GString *buffer;
+};
+
+static gboolean
+node_write_journal(GNode *gnode, struct JournalData *data)
+{
+	if(g_hash_table_contains(data->dirty, gnode->data)) {
+		gchar *xml = i7_node_get_xml(I7_NODE(gnode->data));
+		g_string_append(data->buffer, xml);
+		g_free(xml);
+	}
+	return FALSE; /* Do not stop the traversal */
+}
+
+/*
+ * i7_skein_save_incremental:
+ * @self: the skein
+ * @file: a Skein.skein file
+ * @error: return location for an error
+ *
+ * Saves the skein to @file, by appending only the knots that changed since the
+ * last save to a journal next to @file. The journal is read back by
+ * i7_skein_load(). Until the journal is folded back in, either by a full save or
+ * by i7_skein_fold_journal() when the project is closed, @file on its own is
+ * out of date, and other programs only read @file. The skein is written in full
+ * instead, with i7_skein_save(), if @file is not where the skein was last
+ * loaded from or saved, or if the journal has grown as large as @file.
+ *
+ * Returns: %TRUE on success, %FALSE on failure.
+ */
+gboolean
+i7_skein_save_incremental(I7Skein *self, GFile *file, GError **error)
+{
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	I7SkeinPrivate *priv = i7_skein_get_instance_private(self);
+
+	if(priv->saved_file == NULL || !g_file_equal(priv->saved_file, file)
+		|| priv->journal_size >= priv->saved_size)
+		return i7_skein_save(self, file, error);
+
+	GString *buffer = g_string_new("");
+	if(priv->journal_size == 0) {
+		char *stamp = get_journal_base_stamp(file);
+		if(stamp == NULL) {
+			g_string_free(buffer, TRUE);
+			return i7_skein_save(self, file, error);
+		}
+		g_string_append_printf(buffer,
+			"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			"<SkeinJournal base=\"%s\" "
+			"xmlns=\"http://www.logicalshift.org.uk/IF/Skein\">\n",
+			stamp);
+		g_free(stamp);
+	}
+	struct JournalData data = { priv->dirty, buffer };
+	g_node_traverse(priv->root->gnode, G_PRE_ORDER, G_TRAVERSE_ALL, -1, (GNodeTraverseFunc)node_write_journal, &data);
+	g_string_append_printf(buffer, "  <activeNode nodeId=\"%s\"/>\n",
+		i7_node_get_unique_id(priv->current));
+
+	GFile *journal_file = get_journal_file(file);
+	GFileOutputStream *fstream = g_file_append_to(journal_file, G_FILE_CREATE_NONE, NULL, error);
+	g_object_unref(journal_file);
+	if(!fstream) {
+		g_string_free(buffer, TRUE);
+		return FALSE;
+	}
+	gsize written;
+	gboolean success = g_output_stream_write_all(G_OUTPUT_STREAM(fstream), buffer->str, buffer->len, &written, NULL, error)
+		&& g_output_stream_close(G_OUTPUT_STREAM(fstream), NULL, error);
+	g_object_unref(fstream);
+	priv->journal_size += written;
+	g_string_free(buffer, TRUE);
+
+	if(!success) {
+		/* The journal may now end in the middle of an item */
+		g_clear_object(&priv->saved_file);
+		return FALSE;
+	}
+
+	g_hash_table_remove_all(priv->dirty);
+	priv->modified = FALSE;
+	return TRUE;
+}
+
+/*
+ * i7_skein_fold_journal:
+ * @file: a Skein.skein file
+ * @error: return location for an error
+ *
+ * If there is a journal next to @file, rewrites @file in full with the changes
+ * from the journal included, and removes the journal. Other programs that read
+ * the project, such as the Inform IDEs for other platforms, only see @file, so
+ * this is done when a project is closed. It works from what is on disk, so
+ * changes that the user chose not to save are left out.
+ *
+ * Returns: %TRUE on success or if there was no journal, %FALSE on failure.
+ */
+gboolean
+i7_skein_fold_journal(GFile *file, GError **error)
+{
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	GFile *journal_file = get_journal_file(file);
+	gboolean has_journal = g_file_query_exists(journal_file, NULL);
+	g_object_unref(journal_file);
+	if(!has_journal)
+		return TRUE;
+
+	I7Skein *skein = i7_skein_new();
+	gboolean success = i7_skein_load(skein, file, error)
+		&& i7_skein_save(skein, file, error);
+	g_object_unref(skein);
+	return success;
+}
+
 /* Imports a list of commands into the Skein */
 gboolean
 i7_skein_import(I7Skein *self, GFile *file, GError **error)
@@ -940,6 +1472,8 @@ i7_skein_import(I7Skein *self, GFile *file, GError **error)
 				newnode = i7_node_new(node_command, "", "", "", FALSE, FALSE, FALSE, 0, GOO_CANVAS_ITEM_MODEL(self));
 				node_listen(self, newnode);
 				g_node_append(node->gnode, newnode->gnode);
+				mark_dirty(self, node);
+				mark_dirty(self, newnode);
 				added = TRUE;
 			}
 			g_free(node_command);
@@ -1158,6 +1692,8 @@ i7_skein_new_command(I7Skein *self, const gchar *command)
 		g_node_append(priv->played->gnode, node->gnode);
 		if(remove)
 			reinstate_all_in_model(self);
+		mark_dirty(self, priv->played);
+		mark_dirty(self, node);
 		node_added = TRUE;
 	}
 	g_free(node_command);
@@ -1267,6 +1803,8 @@ i7_skein_add_new(I7Skein *self, I7Node *node)
 	remove_all_from_model(self);
 	g_node_append(node->gnode, newnode->gnode);
 	reinstate_all_in_model(self);
+	mark_dirty(self, node);
+	mark_dirty(self, newnode);
 
 	g_signal_emit_by_name(self, "needs-layout");
 	g_signal_emit_by_name(self, "modified");
@@ -1285,6 +1823,8 @@ i7_skein_add_new_parent(I7Skein *self, I7Node *node)
 	g_node_unlink(node->gnode);
 	g_node_append(newnode->gnode, node->gnode);
 	reinstate_all_in_model(self);
+	mark_dirty(self, newnode->gnode->parent->data);
+	mark_dirty(self, newnode);
 
 	g_signal_emit_by_name(self, "needs-layout");
 	g_signal_emit_by_name(self, "modified");
@@ -1306,6 +1846,7 @@ i7_skein_remove_all(I7Skein *self, I7Node *node)
 	if(i7_skein_is_node_in_current_thread(self, node))
 		i7_skein_set_current_node(self, priv->root);
 	
+	mark_dirty(self, node->gnode->parent->data);
 	remove_all_from_model(self);
 	g_node_unlink(node->gnode);
 	g_node_traverse(node->gnode, G_POST_ORDER, G_TRAVERSE_ALL, -1, (GNodeTraverseFunc)remove_node_from_canvas, self);
@@ -1329,6 +1870,7 @@ i7_skein_remove_single(I7Skein *self, I7Node *node)
 	if(i7_skein_is_node_in_current_thread(self, node))
 		i7_skein_set_current_node(self, priv->root);
 
+	mark_dirty(self, node->gnode->parent->data);
 	remove_all_from_model(self);
 	if(!G_NODE_IS_LEAF(node->gnode)) {
 		int i;
@@ -99,8 +99,11 @@ I7Node *i7_skein_get_current_node(I7Skein *self);
 void i7_skein_set_current_node(I7Skein *self, I7Node *node);
 gboolean i7_skein_is_node_in_current_thread(I7Skein *self, I7Node *node);
 I7Node *i7_skein_get_played_node(I7Skein *self);
+void i7_skein_rewind_played_node(I7Skein *self, I7Node *node);
 gboolean i7_skein_load(I7Skein *self, GFile *file, GError **error);
 gboolean i7_skein_save(I7Skein *self, GFile *file, GError **error);
+gboolean i7_skein_save_incremental(I7Skein *self, GFile *file, GError **error);
+gboolean i7_skein_fold_journal(GFile *file, GError **error);
 gboolean i7_skein_import(I7Skein *self, GFile *file, GError **error);
 void i7_skein_reset(I7Skein *self, gboolean current);
 void i7_skein_draw(I7Skein *self, GooCanvas *canvas);
@@ -19,6 +19,8 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -38,12 +40,14 @@
 #endif
 
 #define INFORM6_COMPILER_NAME "inform6"
+#define STAGE_CACHE_FILE_NAME "Stages.cache"
 
 #include "configfile.h"
 #include "error.h"
 #include "html.h"
 #include "spawn.h"
 #include "story.h"
+#include "inform6/inform6.h"
 
 typedef struct _CompilerData {
 	I7Story *story;
@@ -58,8 +62,27 @@ typedef struct _CompilerData {
 	CompileActionFunc callback;
 	void *callback_data;
 	char *line_remainder;
+	/* Per-stage bookkeeping, see begin_stage() and end_stage() */
+	GKeyFile *stage_cache;
+	char *stage_inputs;
+	gboolean stage_skipped;
+	gint64 stage_start_time;
+	gint64 stage_start_cpu_time;
+	gint64 stage_in_process_cpu_time;
 } CompilerData;
 
+/* The stages of the tool chain. Each stage's inputs are fingerprinted before it
+ runs; if they are the same as the last time the stage succeeded, and its
+ outputs have not been touched since then, the stage is skipped. */
+typedef enum {
+	COMPILE_STAGE_NI,
+	COMPILE_STAGE_I6,
+	COMPILE_STAGE_CBLORB,
+} CompileStage;
+
+/* Group names in the stage cache file */
+static const char * const stage_cache_groups[] = { "ni", "inform6", "cBlorb" };
+
 /* Declare these functions static so they can stay in this order */
 static void prepare_ni_compiler(CompilerData *data);
 static void start_ni_compiler(CompilerData *data);
@@ -91,6 +114,10 @@ i7_story_set_compile_actions_enabled(I7Story *self, bool enabled)
 	CHANGE_SETTING("test-me");
 
 #undef CHANGE_SETTING
+
+	/* Only one background skein test may run at a time */
+	action = G_SIMPLE_ACTION(g_action_map_lookup_action(map, "test-all-blessed"));
+	g_simple_action_set_enabled(action, enabled && !i7_story_get_skein_test_running(self));
 }
 
 /* Start the compiling process. Called from the main thread. */
@@ -128,10 +155,310 @@ i7_story_compile(I7Story *self, gboolean release, gboolean refresh, CompileActio
 	data->output_file = g_file_get_child(data->builddir_file, filename);
 	g_free(filename);
 
+	/* Load the fingerprints of the last successful run of each stage; if there
+	 are none, then every stage runs */
+	data->stage_cache = g_key_file_new();
+	GFile *cache_file = g_file_get_child(data->builddir_file, STAGE_CACHE_FILE_NAME);
+	char *cache_path = g_file_get_path(cache_file);
+	g_key_file_load_from_file(data->stage_cache, cache_path, G_KEY_FILE_NONE, NULL);
+	g_free(cache_path);
+	g_object_unref(cache_file);
+
 	prepare_ni_compiler(data);
 	start_ni_compiler(data);
 }
 
+#define STAGE_STAMP_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+
+static void
+checksum_add_string(GChecksum *checksum, const char *string)
+{
+	/* Include the terminator so that adjacent strings can't run together */
+	g_checksum_update(checksum, (const guchar *)string, strlen(string) + 1);
+}
+
+/* Add the contents of @file to @checksum. A missing file hashes differently
+ from an empty one. */
+static void
+checksum_add_file_contents(GChecksum *checksum, GFile *file)
+{
+	g_autofree char *path = g_file_get_path(file);
+	g_autoptr(GMappedFile) mapped = path? g_mapped_file_new(path, FALSE, NULL) : NULL;
+	if (mapped == NULL) {
+		checksum_add_string(checksum, "\001missing");
+		return;
+	}
+	gsize length = g_mapped_file_get_length(mapped);
+	if (length > 0)
+		g_checksum_update(checksum, (const guchar *)g_mapped_file_get_contents(mapped), length);
+	g_checksum_update(checksum, (const guchar *)&length, sizeof(length));
+}
+
+static void
+checksum_add_file_info(GChecksum *checksum, GFileInfo *info)
+{
+	guint64 stamp[3] = {
+		g_file_info_get_size(info),
+		g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+		g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC),
+	};
+	checksum_add_string(checksum, g_file_info_get_name(info));
+	g_checksum_update(checksum, (const guchar *)stamp, sizeof(stamp));
+}
+
+/* Add the size and modification time of @file to @checksum, rather than its
+ contents. This is used for the compiler binaries and for whole directory trees,
+ where reading every byte on each build would cost more than it saves. */
+static void
+checksum_add_file_stamp(GChecksum *checksum, GFile *file)
+{
+	g_autoptr(GFileInfo) info = g_file_query_info(file, STAGE_STAMP_ATTRIBUTES, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (info == NULL) {
+		checksum_add_string(checksum, "\001missing");
+		return;
+	}
+	checksum_add_file_info(checksum, info);
+}
+
+static int
+compare_file_info_names(GFileInfo **a, GFileInfo **b)
+{
+	return strcmp(g_file_info_get_name(*a), g_file_info_get_name(*b));
+}
+
+/* Add the stamps of everything below @dir to @checksum, in a stable order */
+static void
+checksum_add_tree_stamps(GChecksum *checksum, GFile *dir)
+{
+	g_autoptr(GFileEnumerator) children = g_file_enumerate_children(dir, STAGE_STAMP_ATTRIBUTES, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (children == NULL) {
+		checksum_add_string(checksum, "\001missing");
+		return;
+	}
+
+	g_autoptr(GPtrArray) infos = g_ptr_array_new_with_free_func(g_object_unref);
+	GFileInfo *info;
+	while ((info = g_file_enumerator_next_file(children, NULL, NULL)) != NULL)
+		g_ptr_array_add(infos, info);
+	g_ptr_array_sort(infos, (GCompareFunc)compare_file_info_names);
+
+	for (unsigned ix = 0; ix < infos->len; ix++) {
+		info = g_ptr_array_index(infos, ix);
+		checksum_add_file_info(checksum, info);
+		if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
+			g_autoptr(GFile) child = g_file_get_child(dir, g_file_info_get_name(info));
+			checksum_add_tree_stamps(checksum, child);
+		}
+	}
+	checksum_add_string(checksum, "\001end");
+}
+
+/* Fingerprint everything that @stage reads: the compiler binary, its command
+ line (which carries the project settings), and the files it compiles. Free
+ return value when done. */
+static char *
+get_stage_inputs_fingerprint(CompilerData *data, CompileStage stage, char **commandline)
+{
+	I7App *theapp = I7_APP(g_application_get_default());
+	GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+	g_autoptr(GFile) binary = g_file_new_for_path(commandline[0]);
+	checksum_add_file_stamp(checksum, binary);
+	for (char **arg = commandline; *arg != NULL; arg++)
+		checksum_add_string(checksum, *arg);
+
+	switch (stage) {
+	case COMPILE_STAGE_NI: {
+		g_autoptr(GFile) source_file = g_file_resolve_relative_path(data->input_file, "Source/story.ni");
+		g_autoptr(GFile) settings_file = g_file_get_child(data->input_file, "Settings.plist");
+		g_autoptr(GFile) uuid_file = g_file_get_child(data->input_file, "uuid.txt");
+		g_autoptr(GFile) internal_dir = i7_app_get_internal_dir(theapp);
+		g_autoptr(GFile) builtin_extensions = g_file_get_child(internal_dir, "Extensions");
+		g_autoptr(GFile) user_extensions = i7_app_get_extension_file(theapp, NULL, NULL);
+		g_autoptr(GFile) materials = i7_story_get_materials_file(data->story);
+		checksum_add_file_contents(checksum, source_file);
+		checksum_add_file_contents(checksum, settings_file);
+		checksum_add_file_contents(checksum, uuid_file);
+		checksum_add_tree_stamps(checksum, builtin_extensions);
+		checksum_add_tree_stamps(checksum, user_extensions);
+		checksum_add_tree_stamps(checksum, materials);
+		break;
+	}
+	case COMPILE_STAGE_I6: {
+		g_autoptr(GFile) i6_source = g_file_get_child(data->builddir_file, "auto.inf");
+		checksum_add_file_contents(checksum, i6_source);
+		break;
+	}
+	case COMPILE_STAGE_CBLORB: {
+		g_autofree char *i6out = g_strconcat("output.", i7_story_get_extension(data->story), NULL);
+		g_autoptr(GFile) i6_output = g_file_get_child(data->builddir_file, i6out);
+		g_autoptr(GFile) blurb_file = g_file_get_child(data->input_file, "Release.blurb");
+		g_autoptr(GFile) materials = i7_story_get_materials_file(data->story);
+		checksum_add_file_contents(checksum, i6_output);
+		checksum_add_file_contents(checksum, blurb_file);
+		checksum_add_tree_stamps(checksum, materials);
+		break;
+	}
+	}
+
+	char *retval = g_strdup(g_checksum_get_string(checksum));
+	g_checksum_free(checksum);
+	return retval;
+}
+
+/* Fingerprint what @stage wrote last time, so that a stage is not skipped if
+ its outputs were deleted or overwritten since then, for example by a build with
+ different settings. Free return value when done. */
+static char *
+get_stage_outputs_fingerprint(CompilerData *data, CompileStage stage)
+{
+	GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+	switch (stage) {
+	case COMPILE_STAGE_NI: {
+		g_autoptr(GFile) i6_source = g_file_get_child(data->builddir_file, "auto.inf");
+		g_autoptr(GFile) problems_file = g_file_get_child(data->builddir_file, "Problems.html");
+		g_autoptr(GFile) manifest_file = g_file_get_child(data->input_file, "manifest.plist");
+		g_autoptr(GFile) blurb_file = g_file_get_child(data->input_file, "Release.blurb");
+		checksum_add_file_contents(checksum, i6_source);
+		checksum_add_file_contents(checksum, problems_file);
+		checksum_add_file_contents(checksum, manifest_file);
+		checksum_add_file_contents(checksum, blurb_file);
+		break;
+	}
+	case COMPILE_STAGE_I6: {
+		g_autofree char *i6out = g_strconcat("output.", i7_story_get_extension(data->story), NULL);
+		g_autoptr(GFile) i6_output = g_file_get_child(data->builddir_file, i6out);
+		checksum_add_file_contents(checksum, i6_output);
+		break;
+	}
+	case COMPILE_STAGE_CBLORB: {
+		g_autoptr(GFile) status_file = g_file_get_child(data->builddir_file, "StatusCblorb.html");
+		checksum_add_file_contents(checksum, data->output_file);
+		checksum_add_file_contents(checksum, status_file);
+		break;
+	}
+	}
+
+	char *retval = g_strdup(g_checksum_get_string(checksum));
+	g_checksum_free(checksum);
+	return retval;
+}
+
+/* Return the CPU time, in microseconds, used by all child processes that have
+ been waited for. The child watch reaps each compiler before its callback runs,
+ so the difference across a stage is the CPU time of that stage's compiler. */
+static gint64
+get_children_cpu_time(void)
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_CHILDREN, &usage) != 0)
+		return 0;
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC
+		+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* Start timing @stage and decide whether it has to run at all. Returns TRUE if
+ the stage's inputs are unchanged since it last succeeded and its outputs are
+ still there, in which case the caller should skip straight to the stage's
+ finish function. Called from the main thread. */
+static gboolean
+begin_stage(CompilerData *data, CompileStage stage, char **commandline)
+{
+	const char *group = stage_cache_groups[stage];
+
+	data->stage_start_time = g_get_monotonic_time();
+	data->stage_start_cpu_time = get_children_cpu_time();
+	data->stage_in_process_cpu_time = 0;
+
+	g_free(data->stage_inputs);
+	data->stage_inputs = get_stage_inputs_fingerprint(data, stage, commandline);
+	data->stage_skipped = FALSE;
+
+	g_autofree char *cached_inputs = g_key_file_get_string(data->stage_cache, group, "inputs", NULL);
+	if (cached_inputs == NULL || strcmp(cached_inputs, data->stage_inputs) != 0)
+		return FALSE;
+
+	g_autofree char *cached_outputs = g_key_file_get_string(data->stage_cache, group, "outputs", NULL);
+	g_autofree char *outputs = get_stage_outputs_fingerprint(data, stage);
+	data->stage_skipped = cached_outputs != NULL && strcmp(cached_outputs, outputs) == 0;
+	return data->stage_skipped;
+}
+
+static void
+save_stage_cache(CompilerData *data)
+{
+	/* The cache is only an optimization, so ignore errors writing it */
+	GFile *cache_file = g_file_get_child(data->builddir_file, STAGE_CACHE_FILE_NAME);
+	char *cache_path = g_file_get_path(cache_file);
+	g_key_file_save_to_file(data->stage_cache, cache_path, NULL);
+	g_free(cache_path);
+	g_object_unref(cache_file);
+}
+
+typedef struct {
+	I7Story *story;
+	char *message;
+} StageReportData;
+
+static void
+stage_report_data_free(StageReportData *data)
+{
+	g_object_unref(data->story);
+	g_free(data->message);
+	g_free(data);
+}
+
+static gboolean
+ui_report_stage(StageReportData *data)
+{
+	GtkTextIter iter;
+	GtkTextBuffer *progress_buffer = i7_story_get_progress_buffer(data->story);
+	gtk_text_buffer_get_end_iter(progress_buffer, &iter);
+	gtk_text_buffer_insert(progress_buffer, &iter, data->message, -1);
+	return G_SOURCE_REMOVE;
+}
+
+/* Record the outcome of @stage: report its timing in the Progress tab, and
+ remember its fingerprints if it succeeded, or forget them if it failed. This
+ function is called from a child process watch, so any GUI calls must be done
+ asynchronously from here. */
+static void
+end_stage(CompilerData *data, CompileStage stage, const char *stage_name, int exit_code)
+{
+	const char *group = stage_cache_groups[stage];
+
+	StageReportData *report = g_new0(StageReportData, 1);
+	report->story = g_object_ref(data->story);
+	if (data->stage_skipped) {
+		report->message = g_strdup_printf(_("\n%s: skipped, output is up to date\n"), stage_name);
+	} else {
+		double elapsed = (g_get_monotonic_time() - data->stage_start_time) / (double)G_USEC_PER_SEC;
+		gint64 cpu_time = get_children_cpu_time() - data->stage_start_cpu_time + data->stage_in_process_cpu_time;
+		double cpu = cpu_time / (double)G_USEC_PER_SEC;
+		report->message = g_strdup_printf(_("\n%s: %.2f s elapsed, %.2f s CPU\n"), stage_name, elapsed, cpu);
+	}
+	gdk_threads_add_idle_full(G_PRIORITY_DEFAULT_IDLE, (GSourceFunc)ui_report_stage, report, (GDestroyNotify)stage_report_data_free);
+
+	if (data->stage_skipped)
+		return;
+
+	if (exit_code == 0) {
+		g_autofree char *outputs = get_stage_outputs_fingerprint(data, stage);
+		g_key_file_set_string(data->stage_cache, group, "inputs", data->stage_inputs);
+		g_key_file_set_string(data->stage_cache, group, "outputs", outputs);
+	} else {
+		g_key_file_remove_group(data->stage_cache, group, NULL);
+	}
+
+	save_stage_cache(data);
+}
+
 
 /* Set everything up for using the NI compiler. Called from the main thread. */
 static void
@@ -249,6 +576,14 @@ start_ni_compiler(CompilerData *data)
 
 	char **commandline = (char **)g_ptr_array_free(args, FALSE);
 
+	/* Go straight on to the next stage if nothing changed since the last time;
+	 a status of 0 means the same as a successful exit */
+	if (begin_stage(data, COMPILE_STAGE_NI, commandline)) {
+		g_strfreev(commandline);
+		finish_ni_compiler(0, 0, data);
+		return;
+	}
+
 	/* Run the command and pipe its output to the text buffer. Also pipe stderr
 	through a function that analyzes the progress messages and puts them in the
 	progress bar. */
@@ -332,6 +667,7 @@ finish_ni_compiler(GPid pid, gint status, CompilerData *data)
 {
 	/* Get the ni.exe exit code */
 	int exit_code = WIFEXITED(status)? WEXITSTATUS(status) : -1;
+	end_stage(data, COMPILE_STAGE_NI, _("Inform 7"), exit_code);
 
 	/* Display the appropriate HTML error or success page */
 	GFile *problems_file = NULL;
@@ -486,6 +822,176 @@ display_i6_status(CompilerData *data, gchar *text)
 	}
 }
 
+/* The Inform 6 compiler linked into the IDE (see inform6/inform6.h) keeps its
+ state in globals, so only one compilation can use it at a time. The flag is
+ claimed on the main thread and released on the compiler thread, which a mutex
+ does not allow. */
+static gint i6_library_busy = 0;
+
+typedef struct {
+	CompilerData *data;
+	char **commandline;
+	GFile *output_file;
+	/* Compiler output not yet shown in the Progress tab */
+	GMutex output_lock;
+	GString *output;
+	gboolean output_pending;
+	/* Results */
+	int exit_code;
+	unsigned char *story;
+	size_t story_length;
+	gint64 cpu_time;
+} InProcessI6Data;
+
+static void
+in_process_i6_data_free(InProcessI6Data *idata)
+{
+	g_strfreev(idata->commandline);
+	g_object_unref(idata->output_file);
+	g_mutex_clear(&idata->output_lock);
+	g_string_free(idata->output, TRUE);
+	free(idata->story); /* allocated by the compiler with malloc() */
+	g_free(idata);
+}
+
+/* Show the compiler output collected so far in the Progress tab and look for
+ errors in it, as for a separate process */
+static gboolean
+ui_flush_i6_output(InProcessI6Data *idata)
+{
+	g_mutex_lock(&idata->output_lock);
+	char *text = g_strdup(idata->output->str);
+	g_string_truncate(idata->output, 0);
+	idata->output_pending = FALSE;
+	g_mutex_unlock(&idata->output_lock);
+
+	if (*text != '\0') {
+		GtkTextIter iter;
+		GtkTextBuffer *progress_buffer = i7_story_get_progress_buffer(idata->data->story);
+		gtk_text_buffer_get_end_iter(progress_buffer, &iter);
+		gtk_text_buffer_insert(progress_buffer, &iter, text, -1);
+		display_i6_status(idata->data, text);
+	}
+	g_free(text);
+	return G_SOURCE_REMOVE;
+}
+
+/* Collect the compiler's output. The compiler prints in many small pieces, so
+ they are batched up and shown together the next time the main loop is idle.
+ This function is called from the compiler thread. */
+static void
+on_i6_library_output(const char *text, InProcessI6Data *idata)
+{
+	g_mutex_lock(&idata->output_lock);
+	g_string_append(idata->output, text);
+	if (!idata->output_pending) {
+		idata->output_pending = TRUE;
+		gdk_threads_add_idle((GSourceFunc)ui_flush_i6_output, idata);
+	}
+	g_mutex_unlock(&idata->output_lock);
+}
+
+static gint64
+get_thread_cpu_time(void)
+{
+#ifdef RUSAGE_THREAD
+	struct rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) != 0)
+		return 0;
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC
+		+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#else
+	return 0;
+#endif
+}
+
+/* Write the story file that the compiler produced in memory to the build
+ directory, where the interpreter and cBlorb expect it, and carry on as if a
+ separate compiler process had exited. Called from the main thread. */
+static gboolean
+ui_finish_i6_compiler_in_process(InProcessI6Data *idata)
+{
+	CompilerData *data = idata->data;
+
+	/* Let the last of the output be shown first */
+	g_mutex_lock(&idata->output_lock);
+	gboolean output_pending = idata->output_pending;
+	g_mutex_unlock(&idata->output_lock);
+	if (output_pending)
+		return G_SOURCE_CONTINUE;
+
+	int exit_code = idata->exit_code;
+	if (exit_code == 0) {
+		GError *error = NULL;
+		if (!g_file_replace_contents(idata->output_file, (const char *)idata->story, idata->story_length,
+			NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL, &error)) {
+			g_autofree char *message = g_strdup_printf(_("\nCouldn't write story file: %s\n"), error->message);
+			GtkTextIter iter;
+			GtkTextBuffer *progress_buffer = i7_story_get_progress_buffer(data->story);
+			gtk_text_buffer_get_end_iter(progress_buffer, &iter);
+			gtk_text_buffer_insert(progress_buffer, &iter, message, -1);
+			g_error_free(error);
+			exit_code = 1;
+		}
+	}
+
+	data->stage_in_process_cpu_time = idata->cpu_time;
+	in_process_i6_data_free(idata);
+
+	finish_i6_compiler(0, W_EXITCODE(exit_code, 0), data);
+	return G_SOURCE_REMOVE;
+}
+
+static void *
+compile_i6_in_process_thread(InProcessI6Data *idata)
+{
+	gint64 start_cpu_time = get_thread_cpu_time();
+	idata->exit_code = inform6_compile(g_strv_length(idata->commandline), idata->commandline,
+		(inform6_output_func)on_i6_library_output, idata, &idata->story, &idata->story_length);
+	idata->cpu_time = get_thread_cpu_time() - start_cpu_time;
+	g_atomic_int_set(&i6_library_busy, 0);
+
+	gdk_threads_add_idle((GSourceFunc)ui_finish_i6_compiler_in_process, idata);
+	return NULL;
+}
+
+/* Run the compiler linked into the IDE on a thread of its own, with the same
+ command line as the separate process would get, except that since there is no
+ working directory to rely on, all paths are absolute. The caller must already
+ have claimed i6_library_busy. Called from the main thread. */
+static void
+start_i6_compiler_in_process(CompilerData *data, char **commandline)
+{
+	InProcessI6Data *idata = g_new0(InProcessI6Data, 1);
+	idata->data = data;
+	idata->output_file = g_file_new_for_path(commandline[4]);
+	idata->output = g_string_new("");
+	g_mutex_init(&idata->output_lock);
+
+	g_autoptr(GFile) i6_source = g_file_get_child(data->builddir_file, "auto.inf");
+	g_autoptr(GFile) debug_info = g_file_get_child(data->builddir_file, "gameinfo.dbg");
+	g_autofree char *i6_source_path = g_file_get_path(i6_source);
+	g_autofree char *debug_info_path = g_file_get_path(debug_info);
+
+	idata->commandline = g_new0(char *, 7);
+	idata->commandline[0] = g_strdup(commandline[0]);
+	idata->commandline[1] = g_strdup(commandline[1]);
+	idata->commandline[2] = g_strdup(commandline[2]);
+	idata->commandline[3] = g_strconcat("+debugging_name=", debug_info_path, NULL);
+	idata->commandline[4] = g_strdup(i6_source_path);
+	idata->commandline[5] = g_strdup(commandline[4]);
+
+	/* Echo the command line as run_command_hook() does */
+	g_autofree char *args = g_strjoinv(" ", idata->commandline + 1);
+	g_autofree char *invocation = g_strdup_printf("\n%s \\\n\t%s\n", _("(built-in Inform 6)"), args);
+	GtkTextIter iter;
+	GtkTextBuffer *progress_buffer = i7_story_get_progress_buffer(data->story);
+	gtk_text_buffer_get_end_iter(progress_buffer, &iter);
+	gtk_text_buffer_insert(progress_buffer, &iter, invocation, -1);
+
+	g_thread_unref(g_thread_new("inform6", (GThreadFunc)compile_i6_in_process_thread, idata));
+}
+
 /* Run the I6 compiler. This function is called from a child process watch, so
  the GDK lock is not held and must be acquired for any GUI calls. */
 static void
@@ -509,6 +1015,20 @@ start_i6_compiler(CompilerData *data)
 	g_object_unref(i6_compiler);
 	g_object_unref(i6_output);
 
+	if (begin_stage(data, COMPILE_STAGE_I6, commandline)) {
+		g_strfreev(commandline);
+		finish_i6_compiler(0, 0, data);
+		return;
+	}
+
+	/* Use the compiler linked into the IDE, unless another project is already
+	 using it, in which case run a separate process */
+	if (g_atomic_int_compare_and_exchange(&i6_library_busy, 0, 1)) {
+		start_i6_compiler_in_process(data, commandline);
+		g_strfreev(commandline);
+		return;
+	}
+
 	GPid child_pid = run_command_hook(data->builddir_file, commandline,
 		i7_story_get_progress_buffer(data->story), (IOHookFunc *)display_i6_status,
 		data, TRUE, TRUE);
@@ -521,14 +1041,16 @@ start_i6_compiler(CompilerData *data)
 typedef struct {
 	I7Story *story;
 	int exit_code;
+	gboolean skipped;
 } FinishI6Data;
 
 static FinishI6Data *
-finish_i6_data_new(I7Story *story, int exit_code)
+finish_i6_data_new(I7Story *story, int exit_code, gboolean skipped)
 {
 	FinishI6Data *retval = g_new0(FinishI6Data, 1);
 	retval->story = g_object_ref(story);
 	retval->exit_code = exit_code;
+	retval->skipped = skipped;
 	return retval;
 }
 
@@ -546,6 +1068,9 @@ ui_finish_i6_compiler(FinishI6Data *data)
 	i7_document_remove_status_message(I7_DOCUMENT(data->story), COMPILE_OPERATIONS);
 	i7_document_clear_progress(I7_DOCUMENT(data->story));
 
+	if (data->skipped)
+		return G_SOURCE_REMOVE;
+
 	/* Display the exit status of the I6 compiler in the Progress tab */
 	gchar *statusmsg = g_strdup_printf(_("\nCompiler finished with code %d\n"),
 	  data->exit_code);
@@ -566,13 +1091,14 @@ finish_i6_compiler(GPid pid, gint status, CompilerData *data)
 {
 	/* Get exit code from I6 process */
 	int exit_code = WIFEXITED(status)? WEXITSTATUS(status) : -1;
+	end_stage(data, COMPILE_STAGE_I6, _("Inform 6"), exit_code);
 
 	/* Show the generic error page if the compiler exited with a nonzero code but
 	 no error was detected in the compiler output */
 	if (!data->results_file && exit_code != 0)
 		data->results_file = g_file_new_for_uri("resource:///com/inform7/IDE/inform/en/ErrorI6.html"); /* assumes reference */
 
-	FinishI6Data *ui_data = finish_i6_data_new(data->story, exit_code);
+	FinishI6Data *ui_data = finish_i6_data_new(data->story, exit_code, data->stage_skipped);
 	gdk_threads_add_idle_full(G_PRIORITY_DEFAULT_IDLE, (GSourceFunc)ui_finish_i6_compiler, ui_data, (GDestroyNotify)finish_i6_data_free);
 
 	/* Stop here and show the Results/Report tab if there was an error */
@@ -640,6 +1166,19 @@ start_cblorb_compiler(CompilerData *data)
 
 	g_object_unref(cblorb);
 
+	if (begin_stage(data, COMPILE_STAGE_CBLORB, commandline)) {
+		/* cBlorb would have told us where to copy the blorb file */
+		g_autofree char *copy_blorb_path = g_key_file_get_string(data->stage_cache,
+			stage_cache_groups[COMPILE_STAGE_CBLORB], "copy-blorb-to", NULL);
+		if (copy_blorb_path != NULL) {
+			g_autoptr(GFile) dest_file = g_file_new_for_path(copy_blorb_path);
+			i7_story_set_copy_blorb_dest_file(data->story, dest_file);
+		}
+		g_strfreev(commandline);
+		finish_cblorb_compiler(0, 0, data);
+		return;
+	}
+
 	GPid child_pid = run_command_hook(data->input_file, commandline,
 		i7_story_get_progress_buffer(data->story),
 		(IOHookFunc *)parse_cblorb_output, data->story, TRUE, FALSE);
@@ -666,6 +1205,18 @@ finish_cblorb_compiler(GPid pid, gint status, CompilerData *data)
 
 	/* Get exit code from CBlorb */
 	int exit_code = WIFEXITED(status)? WEXITSTATUS(status) : -1;
+	gboolean skipped = data->stage_skipped;
+	end_stage(data, COMPILE_STAGE_CBLORB, _("cBlorb"), exit_code);
+
+	/* Remember where cBlorb told us to copy the blorb file, in case the stage is
+	 skipped next time */
+	g_autoptr(GFile) copy_blorb_dest_file = i7_story_get_copy_blorb_dest_file(data->story);
+	if (!skipped && exit_code == 0 && copy_blorb_dest_file != NULL) {
+		g_autofree char *copy_blorb_path = g_file_get_path(copy_blorb_dest_file);
+		g_key_file_set_string(data->stage_cache, stage_cache_groups[COMPILE_STAGE_CBLORB],
+			"copy-blorb-to", copy_blorb_path);
+		save_stage_cache(data);
+	}
 
 	/* Display the appropriate HTML page */
 	g_clear_object(&data->results_file);
@@ -722,6 +1273,11 @@ ui_finish_compiling(CompilerData *data)
 	g_object_unref(data->output_file);
 	g_object_unref(data->builddir_file);
 	g_clear_object(&data->results_file);
+	g_key_file_unref(data->stage_cache);
+	g_free(data->stage_inputs);
+	/* A build that stopped in the middle of a line of output leaves the start
+	of that line here */
+	g_free(data->line_remainder);
 	g_slice_free(CompilerData, data);
 
 	return G_SOURCE_REMOVE;
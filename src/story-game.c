@@ -27,6 +27,10 @@
 #include "skein.h"
 #include "story.h"
 
+/* Number of virtual machine instructions between profiler samples; a few
+ * thousand samples a second on a typical machine */
+#define PROFILE_SAMPLE_INTERVAL 10000
+
 /* Methods of I7Story having to do with the Story (formerly called Game) pane:
  - callbacks for when the compiler tool chain is finished
  - methods for communicating with the Chimara interpreter
@@ -190,6 +194,29 @@ struct RunSkeinData {
 	unsigned long started_handler, waiting_handler;
 	gboolean finished; /* don't have to use a GCond because this communication
 	is within the same thread and only one way? */
+
+	/* Used by run_checkpointed_replay() */
+	GArray *steps;
+	unsigned position;
+	I7Node *last_command;
+	GHashTable *reached; /* knots whose response has come back */
+	unsigned long checkpoint_handler, stopped_handler;
+	gboolean awaiting_checkpoint, failed;
+};
+
+/* A checkpointed replay walks the tree of knots depth-first, taking a snapshot
+of the game at every knot where the tree branches, and going back to it for
+each branch after the first one */
+typedef enum {
+	REPLAY_STEP_COMMAND,
+	REPLAY_STEP_SAVE,
+	REPLAY_STEP_RESTORE,
+	REPLAY_STEP_DISCARD
+} ReplayStepType;
+
+struct ReplayStep {
+	ReplayStepType type;
+	I7Node *node; /* the knot to play, or the branching knot */
 };
 
 /* Helper function: stop the interpreter when forced input is done processing;
@@ -270,12 +297,186 @@ finally:
 	g_slist_free(data->commands);
 }
 
+/* Helper function: add the steps for playing all the wanted knots below @node
+to @steps, assuming the game has just played @node. */
+static void
+collect_replay_steps(I7Node *node, GHashTable *wanted, GArray *steps)
+{
+	GSList *children = NULL, *iter;
+	GNode *gnode;
+	for(gnode = g_node_last_child(node->gnode); gnode; gnode = gnode->prev) {
+		if(g_hash_table_contains(wanted, gnode->data))
+			children = g_slist_prepend(children, gnode->data);
+	}
+	gboolean branch = children && children->next;
+
+	struct ReplayStep step = { REPLAY_STEP_SAVE, node };
+	if(branch)
+		g_array_append_val(steps, step);
+	for(iter = children; iter; iter = g_slist_next(iter)) {
+		if(iter != children) {
+			step.type = REPLAY_STEP_RESTORE;
+			step.node = node;
+			g_array_append_val(steps, step);
+		}
+		step.type = REPLAY_STEP_COMMAND;
+		step.node = iter->data;
+		g_array_append_val(steps, step);
+		collect_replay_steps(iter->data, wanted, steps);
+	}
+	if(branch) {
+		step.type = REPLAY_STEP_DISCARD;
+		step.node = node;
+		g_array_append_val(steps, step);
+	}
+	g_slist_free(children);
+}
+
+/* Helper function: feed the next step of a checkpointed replay to the
+interpreter, or stop the interpreter if there are none left. */
+static void
+feed_next_replay_step(struct RunSkeinData *data)
+{
+	if(data->position == data->steps->len) {
+		chimara_glk_stop(data->glk);
+		data->finished = TRUE;
+		return;
+	}
+
+	struct ReplayStep *step = &g_array_index(data->steps, struct ReplayStep, data->position++);
+	switch(step->type) {
+		case REPLAY_STEP_COMMAND:
+		{
+			g_autofree char *skein_command = i7_node_get_command(step->node);
+			g_autofree char *command = g_strcompress(skein_command);
+			data->last_command = step->node;
+			chimara_glk_feed_line_input(data->glk, command);
+			return;
+		}
+		case REPLAY_STEP_SAVE:
+			chimara_glk_feed_checkpoint(data->glk, CHIMARA_CHECKPOINT_SAVE);
+			break;
+		case REPLAY_STEP_RESTORE:
+			/* The next command's response will be added below the branching
+			knot, just as if the game had been restarted and played up to it */
+			i7_skein_rewind_played_node(data->skein, step->node);
+			chimara_glk_feed_checkpoint(data->glk, CHIMARA_CHECKPOINT_RESTORE);
+			break;
+		case REPLAY_STEP_DISCARD:
+			chimara_glk_feed_checkpoint(data->glk, CHIMARA_CHECKPOINT_DISCARD);
+			break;
+	}
+	data->awaiting_checkpoint = TRUE;
+}
+
+/* Helper function: the game has processed a command, or is ready for the first
+one. */
+static void
+on_waiting_replay_next_step(ChimaraGlk *glk, struct RunSkeinData *data)
+{
+	if(data->finished || data->awaiting_checkpoint || chimara_glk_is_line_input_pending(glk))
+		return;
+	if(data->last_command != NULL) {
+		g_hash_table_add(data->reached, data->last_command);
+		data->last_command = NULL;
+	}
+	feed_next_replay_step(data);
+}
+
+/* Helper function: the game has carried out a checkpoint action. If it failed,
+for example because the interpreter doesn't support checkpoints, give up on the
+checkpointed replay. */
+static void
+on_checkpoint_replay_next_step(ChimaraGlk *glk, unsigned action, gboolean success, struct RunSkeinData *data)
+{
+	if(data->finished)
+		return;
+	data->awaiting_checkpoint = FALSE;
+	if(!success) {
+		data->failed = TRUE;
+		chimara_glk_stop(glk);
+		data->finished = TRUE;
+		return;
+	}
+	feed_next_replay_step(data);
+}
+
+/* Helper function: the game ended by itself, so there is nothing left to
+restore. */
+static void
+on_stopped_replay(ChimaraGlk *glk, struct RunSkeinData *data)
+{
+	if(data->finished)
+		return;
+	data->failed = TRUE;
+	data->finished = TRUE;
+}
+
+/* Helper function: play all the knots leading to @blessed_nodes in one run of
+the game, going back to snapshots of the game at the knots where the threads
+diverge, so that each knot is played only once. Returns FALSE if the replay
+could not be finished; the knots that were played before that happened are in
+@data->reached. */
+static gboolean
+run_checkpointed_replay(struct RunSkeinData *data, GSList *blessed_nodes)
+{
+	GError *err = NULL;
+
+	GHashTable *wanted = g_hash_table_new(NULL, NULL);
+	GSList *iter;
+	for(iter = blessed_nodes; iter; iter = g_slist_next(iter)) {
+		GNode *gnode;
+		for(gnode = ((I7Node *)iter->data)->gnode; gnode; gnode = gnode->parent)
+			g_hash_table_add(wanted, gnode->data);
+	}
+	data->steps = g_array_new(FALSE, FALSE, sizeof(struct ReplayStep));
+	collect_replay_steps(i7_skein_get_root_node(data->skein), wanted, data->steps);
+	g_hash_table_destroy(wanted);
+
+	data->position = 0;
+	data->last_command = NULL;
+	data->awaiting_checkpoint = FALSE;
+	data->failed = FALSE;
+	data->finished = FALSE;
+
+	i7_skein_reset(data->skein, TRUE);
+
+	data->waiting_handler = g_signal_connect_after(data->glk, "waiting",
+		G_CALLBACK(on_waiting_replay_next_step), data);
+	data->checkpoint_handler = g_signal_connect(data->glk, "checkpoint",
+		G_CALLBACK(on_checkpoint_replay_next_step), data);
+	data->stopped_handler = g_signal_connect(data->glk, "stopped",
+		G_CALLBACK(on_stopped_replay), data);
+
+	if(chimara_if_run_game_file(CHIMARA_IF(data->glk), data->file_to_run, &err)) {
+		i7_story_show_pane(data->story, I7_PANE_STORY);
+
+		while(!data->finished)
+			gtk_main_iteration_do(FALSE); /* don't block */
+		chimara_glk_wait(data->glk);
+	} else {
+		error_dialog(GTK_WINDOW(data->story), err, _("Could not load interpreter: "));
+		data->failed = TRUE;
+	}
+
+	g_signal_handler_disconnect(data->glk, data->waiting_handler);
+	g_signal_handler_disconnect(data->glk, data->checkpoint_handler);
+	g_signal_handler_disconnect(data->glk, data->stopped_handler);
+	g_array_free(data->steps, TRUE);
+	return !data->failed;
+}
+
 /*
  * i7_story_run_compiler_output_and_entire_skein:
  * @self: the story
  *
  * Callback for when compiling is finished. Plays through as many threads as
  * necessary to visit each blessed knot in the skein at least once.
+ *
+ * If the interpreter supports checkpoints, the game is run only once, and the
+ * commands that the threads have in common are played only once. Otherwise,
+ * or if the game ends before all the threads have been played, the game is
+ * restarted for each remaining thread.
  */
 void
 i7_story_run_compiler_output_and_entire_skein(I7Story *self)
@@ -284,6 +485,7 @@ i7_story_run_compiler_output_and_entire_skein(I7Story *self)
 	data->story = self;
 	data->skein = i7_story_get_skein(self);
 	data->file_to_run = i7_story_get_compiler_output_file(self);
+	data->reached = g_hash_table_new(NULL, NULL);
 
 	/* Make sure the interpreter is non-interactive */
 	I7StoryPanel side = i7_story_choose_panel(self, I7_PANE_STORY);
@@ -291,15 +493,269 @@ i7_story_run_compiler_output_and_entire_skein(I7Story *self)
 	chimara_glk_set_interactive(data->glk, FALSE);
 	
 	GSList *blessed_nodes = i7_skein_get_blessed_thread_ends(data->skein);
-	g_slist_foreach(blessed_nodes, (GFunc)run_entire_skein_loop, data);
+	if(blessed_nodes && !run_checkpointed_replay(data, blessed_nodes)) {
+		GSList *iter;
+		for(iter = blessed_nodes; iter; iter = g_slist_next(iter)) {
+			if(!g_hash_table_contains(data->reached, iter->data))
+				run_entire_skein_loop(iter->data, data);
+		}
+	}
 	g_slist_free(blessed_nodes);
 
 	chimara_glk_set_interactive(data->glk, TRUE);
 
+	g_hash_table_destroy(data->reached);
 	g_object_unref(data->file_to_run);
 	g_slice_free(struct RunSkeinData, data);
 }
 
+/* One-off data structures for running the blessed threads of the skein on a
+pool of off-screen interpreters */
+struct SkeinTestRun {
+	I7Story *story;
+	I7Skein *skein;
+	GFile *file_to_run;
+
+	GQueue *pending; /* thread ends that no worker has picked up yet */
+	GHashTable *recorded; /* nodes whose transcript was already set in this run */
+	GPtrArray *workers;
+	unsigned total, completed, busy;
+};
+
+struct SkeinTestWorker {
+	struct SkeinTestRun *run;
+	GtkWidget *window;
+	ChimaraGlk *glk;
+
+	GPtrArray *thread; /* nodes from the root to the thread end */
+	unsigned position;
+	gboolean stopping;
+};
+
+static void skein_test_worker_start_next(struct SkeinTestWorker *worker);
+gchar *load_blorb_resource(ChimaraResourceType usage, uint32_t resnum, I7Story *self);
+
+/* Helper function: store a transcript for @node, unless another worker already
+did so during this run; threads share their common prefix with other threads,
+and the first result for a knot is as good as any later one. */
+static void
+skein_test_record(struct SkeinTestRun *run, I7Node *node, const char *transcript)
+{
+	if(!g_hash_table_add(run->recorded, node))
+		return;
+	i7_node_set_transcript_text(node, transcript);
+}
+
+/* Helper function: each response from the game belongs to the next knot in the
+worker's thread. */
+static void
+on_skein_test_command(ChimaraIF *glk, char *input, char *response, struct SkeinTestWorker *worker)
+{
+	if(!input) {
+		/* Text printed before the first prompt belongs to the root knot */
+		if(worker->position == 0)
+			skein_test_record(worker->run, worker->thread->pdata[0], response);
+		return;
+	}
+	if(++worker->position < worker->thread->len)
+		skein_test_record(worker->run, worker->thread->pdata[worker->position], response);
+}
+
+/* Helper function: feed the whole thread to the interpreter once it has
+started. */
+static void
+on_skein_test_started(ChimaraGlk *glk, struct SkeinTestWorker *worker)
+{
+	unsigned ix;
+	for(ix = 1; ix < worker->thread->len; ix++) {
+		g_autofree char *skein_command = i7_node_get_command(worker->thread->pdata[ix]);
+		g_autofree char *command = g_strcompress(skein_command);
+		chimara_glk_feed_line_input(glk, command);
+	}
+}
+
+/* Helper function: when the thread is done, wait for the interpreter to shut
+down and pick up the next thread. This runs as an idle function, since
+chimara_glk_wait() can't be called from a signal handler of the same widget. */
+static gboolean
+skein_test_worker_finish_thread(struct SkeinTestWorker *worker)
+{
+	chimara_glk_wait(worker->glk);
+	g_clear_pointer(&worker->thread, g_ptr_array_unref);
+
+	struct SkeinTestRun *run = worker->run;
+	run->completed++;
+	i7_document_display_progress_percentage(I7_DOCUMENT(run->story),
+		(double)run->completed / run->total);
+
+	skein_test_worker_start_next(worker);
+	return G_SOURCE_REMOVE;
+}
+
+/* Helper function: stop the interpreter when all forced input is done
+processing. */
+static void
+on_skein_test_waiting(ChimaraGlk *glk, struct SkeinTestWorker *worker)
+{
+	if(worker->stopping || chimara_glk_is_line_input_pending(glk))
+		return;
+	worker->stopping = TRUE;
+	chimara_glk_stop(glk);
+	g_idle_add((GSourceFunc)skein_test_worker_finish_thread, worker);
+}
+
+static struct SkeinTestWorker *
+skein_test_worker_new(struct SkeinTestRun *run, ChimaraIF *model)
+{
+	struct SkeinTestWorker *worker = g_slice_new0(struct SkeinTestWorker);
+	worker->run = run;
+
+	/* The interpreter is never shown, but it still needs a size allocation in
+	order to arrange its Glk windows */
+	worker->window = gtk_offscreen_window_new();
+	ChimaraIF *glk = CHIMARA_IF(chimara_if_new());
+	worker->glk = CHIMARA_GLK(glk);
+	gtk_widget_set_size_request(GTK_WIDGET(glk), 800, 600);
+	gtk_container_add(GTK_CONTAINER(worker->window), GTK_WIDGET(glk));
+	gtk_widget_show_all(worker->window);
+
+	/* Each worker needs its own copy of the interpreter's state; interpreters
+	that keep their state per thread share one loaded copy */
+	chimara_glk_set_isolated(worker->glk, TRUE);
+	chimara_glk_set_interactive(worker->glk, FALSE);
+	chimara_glk_set_protect(worker->glk, TRUE);
+	ChimaraIFFormat format;
+	for(format = CHIMARA_IF_FORMAT_Z5; format < CHIMARA_IF_NUM_FORMATS; format++)
+		chimara_if_set_preferred_interpreter(glk, format, chimara_if_get_preferred_interpreter(model, format));
+	chimara_glk_set_resource_load_callback(worker->glk, (ChimaraResourceLoadFunc)load_blorb_resource, run->story, NULL);
+
+	g_signal_connect(glk, "started", G_CALLBACK(on_skein_test_started), worker);
+	g_signal_connect_after(glk, "waiting", G_CALLBACK(on_skein_test_waiting), worker);
+	g_signal_connect(glk, "command", G_CALLBACK(on_skein_test_command), worker);
+
+	return worker;
+}
+
+static void
+skein_test_worker_free(struct SkeinTestWorker *worker)
+{
+	chimara_glk_unload_plugin(worker->glk);
+	gtk_widget_destroy(worker->window);
+	g_slice_free(struct SkeinTestWorker, worker);
+}
+
+static void
+skein_test_run_free(struct SkeinTestRun *run)
+{
+	I7Document *document = I7_DOCUMENT(run->story);
+	i7_document_clear_progress(document);
+	g_autofree char *message = g_strdup_printf(ngettext("Tested %u blessed thread.",
+		"Tested %u blessed threads.", run->total), run->total);
+	i7_document_flash_status_message(document, message, "skein-test");
+
+	/* Don't enable the action if a compile has disabled it in the meantime */
+	i7_story_set_skein_test_running(run->story, FALSE);
+	GActionMap *map = G_ACTION_MAP(run->story);
+	GAction *test_all = g_action_map_lookup_action(map, "test-all-blessed");
+	GAction *go = g_action_map_lookup_action(map, "go");
+	g_simple_action_set_enabled(G_SIMPLE_ACTION(test_all), g_action_get_enabled(go));
+
+	g_ptr_array_free(run->workers, TRUE);
+	g_queue_free(run->pending);
+	g_hash_table_destroy(run->recorded);
+	g_object_unref(run->file_to_run);
+	g_object_unref(run->story);
+	g_slice_free(struct SkeinTestRun, run);
+}
+
+/* Helper function: give the worker the next thread that has not been tested
+yet, or retire it if there are none left. The last worker to retire frees the
+whole run. */
+static void
+skein_test_worker_start_next(struct SkeinTestWorker *worker)
+{
+	GError *err = NULL;
+	struct SkeinTestRun *run = worker->run;
+
+	I7Node *thread_end;
+	while((thread_end = g_queue_pop_head(run->pending)) != NULL) {
+		worker->thread = g_ptr_array_new();
+		GNode *gnode;
+		for(gnode = thread_end->gnode; gnode; gnode = gnode->parent)
+			g_ptr_array_insert(worker->thread, 0, gnode->data);
+		worker->position = 0;
+		worker->stopping = FALSE;
+
+		if(chimara_if_run_game_file(CHIMARA_IF(worker->glk), run->file_to_run, &err))
+			return;
+
+		/* The other threads would fail in the same way */
+		error_dialog(GTK_WINDOW(run->story), err, _("Could not load interpreter: "));
+		err = NULL;
+		g_clear_pointer(&worker->thread, g_ptr_array_unref);
+		run->completed += 1 + g_queue_get_length(run->pending);
+		g_queue_clear(run->pending);
+	}
+
+	if(--run->busy == 0)
+		skein_test_run_free(run);
+}
+
+/*
+ * i7_story_test_compiler_output_and_entire_skein:
+ * @self: the story
+ *
+ * Callback for when compiling is finished. Plays through every blessed thread
+ * in the skein without showing the game, on as many interpreters at once as
+ * there are processors. Each knot's transcript is updated as soon as the
+ * interpreter running its thread has produced it.
+ */
+void
+i7_story_test_compiler_output_and_entire_skein(I7Story *self)
+{
+	if(i7_story_get_skein_test_running(self))
+		return;
+
+	I7Skein *skein = i7_story_get_skein(self);
+	GSList *blessed_nodes = i7_skein_get_blessed_thread_ends(skein);
+	if(blessed_nodes == NULL)
+		return;
+
+	struct SkeinTestRun *run = g_slice_new0(struct SkeinTestRun);
+	/* The workers' callbacks use the story, so keep it alive until the run is
+	over even if its window is closed */
+	run->story = g_object_ref(self);
+	run->skein = skein;
+	run->file_to_run = i7_story_get_compiler_output_file(self);
+	run->pending = g_queue_new();
+	run->recorded = g_hash_table_new(NULL, NULL);
+
+	GSList *iter;
+	for(iter = blessed_nodes; iter; iter = g_slist_next(iter))
+		g_queue_push_tail(run->pending, iter->data);
+	g_slist_free(blessed_nodes);
+	run->total = g_queue_get_length(run->pending);
+
+	i7_story_set_skein_test_running(self, TRUE);
+	GAction *test_all = g_action_map_lookup_action(G_ACTION_MAP(self), "test-all-blessed");
+	g_simple_action_set_enabled(G_SIMPLE_ACTION(test_all), FALSE);
+	i7_document_display_progress_percentage(I7_DOCUMENT(self), 0.0);
+
+	/* Interpreter settings are copied from the visible Story pane */
+	I7StoryPanel side = i7_story_choose_panel(self, I7_PANE_STORY);
+	ChimaraIF *model = CHIMARA_IF(self->panel[side]->tabs[I7_PANE_STORY]);
+
+	unsigned n_workers = MIN((unsigned)g_get_num_processors(), run->total);
+	run->workers = g_ptr_array_new_full(n_workers, (GDestroyNotify)skein_test_worker_free);
+	unsigned count;
+	for(count = 0; count < n_workers; count++)
+		g_ptr_array_add(run->workers, skein_test_worker_new(run, model));
+
+	run->busy = n_workers;
+	for(count = 0; count < n_workers; count++)
+		skein_test_worker_start_next(run->workers->pdata[count]);
+}
+
 /* Helper function: stop the game in @panel if it is running */
 static void
 panel_stop_running_game(I7Story *story, I7Panel *panel)
@@ -325,6 +781,58 @@ i7_story_get_game_running(I7Story *story)
 		|| chimara_glk_get_running(CHIMARA_GLK(story->panel[RIGHT]->tabs[I7_PANE_STORY]));
 }
 
+struct ProfileRequest {
+	gboolean on;
+	unsigned count; /* number of games the request went to */
+};
+
+/* Helper function: switch the profiler on or off in @panel if a game that can
+ * be profiled is running there */
+static void
+panel_set_profiling(I7Story *story, I7Panel *panel, struct ProfileRequest *request)
+{
+	ChimaraGlk *glk = CHIMARA_GLK(panel->tabs[I7_PANE_STORY]);
+	if(!chimara_glk_get_running(glk) || !chimara_glk_get_supports_profiling(glk))
+		return;
+
+	if(request->on) {
+		GFile *file = i7_document_get_file(I7_DOCUMENT(story));
+		GFile *build_file = g_file_get_child(file, "Build");
+		GFile *debug_file = g_file_get_child(build_file, "gameinfo.dbg");
+		GFile *profile_file = g_file_get_child(build_file, "Profile.txt");
+		g_autofree char *debug_path = g_file_get_path(debug_file);
+		g_autofree char *profile_path = g_file_get_path(profile_file);
+		chimara_glk_start_profiling(glk, PROFILE_SAMPLE_INTERVAL, debug_path, profile_path);
+		g_object_unref(profile_file);
+		g_object_unref(debug_file);
+		g_object_unref(build_file);
+		g_object_unref(file);
+	} else {
+		chimara_glk_stop_profiling(glk);
+	}
+	request->count++;
+}
+
+/* Start or stop sampling the running game, and tell the user where to find the
+ * results. Returns FALSE if the game's interpreter cannot be profiled. */
+gboolean
+i7_story_set_profiling(I7Story *story, gboolean profiling)
+{
+	struct ProfileRequest request = { profiling, 0 };
+	i7_story_foreach_panel(story, (I7PanelForeachFunc)panel_set_profiling, &request);
+
+	if(request.count == 0) {
+		i7_document_flash_status_message(I7_DOCUMENT(story),
+			_("The interpreter running this story cannot be profiled."),
+			"profiler");
+		return FALSE;
+	}
+	i7_document_flash_status_message(I7_DOCUMENT(story),
+		profiling? _("Profiling the story...") : _("Profile written to Build/Profile.txt in the project folder."),
+		"profiler");
+	return TRUE;
+}
+
 /* Helper function: set the Chimara interpreter in @panel to prefer Git for
  * Glulx games */
 static void
@@ -381,20 +889,27 @@ load_blorb_resource(ChimaraResourceType usage, uint32_t resnum, I7Story *self)
 
 /* SIGNAL HANDLERS */
 
-/* Set the "stop" action to be sensitive when the game starts */
+/* Set the "stop" and "profile" actions to be sensitive when the game starts */
 void
 on_game_started(ChimaraGlk *game, I7Story *self)
 {
 	GAction *stop = g_action_map_lookup_action(G_ACTION_MAP(self), "stop");
 	g_simple_action_set_enabled(G_SIMPLE_ACTION(stop), TRUE);
+	GAction *profile = g_action_map_lookup_action(G_ACTION_MAP(self), "profile");
+	g_simple_action_set_enabled(G_SIMPLE_ACTION(profile), TRUE);
 }
 
-/* Set the "stop" action to be insensitive when the game finishes */
+/* Set the "stop" and "profile" actions to be insensitive when the game
+ * finishes */
 void
 on_game_stopped(ChimaraGlk *game, I7Story *self)
 {
 	GAction *stop = g_action_map_lookup_action(G_ACTION_MAP(self), "stop");
 	g_simple_action_set_enabled(G_SIMPLE_ACTION(stop), FALSE);
+	/* The interpreter writes out any profile as it stops */
+	GAction *profile = g_action_map_lookup_action(G_ACTION_MAP(self), "profile");
+	g_simple_action_set_state(G_SIMPLE_ACTION(profile), g_variant_new_boolean(FALSE));
+	g_simple_action_set_enabled(G_SIMPLE_ACTION(profile), FALSE);
 }
 
 /* Grab commands entered by the user and store them in the skein */
@@ -75,6 +75,7 @@ typedef struct {
 	I7Skein *skein;
 	GSettings *skein_settings;
 	gboolean test_me;
+	gboolean skein_test_running;
 } I7StoryPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(I7Story, i7_story, I7_TYPE_DOCUMENT);
@@ -122,6 +123,23 @@ save_storywindow_size(I7Story *self)
 	g_settings_set(state, PREFS_STATE_NOTEPAD_POS, "(ii)", x, y);
 }
 
+/* The skein file in the project has to be complete once the project is closed,
+since other programs don't know about the journal */
+static void
+on_storywindow_destroy(GtkWidget *window)
+{
+	GFile *file = i7_document_get_file(I7_DOCUMENT(window));
+	if(file == NULL)
+		return;
+	GFile *skein_file = g_file_get_child(file, "Skein.skein");
+	GError *err = NULL;
+	if(!i7_skein_fold_journal(skein_file, &err)) {
+		error_dialog(NULL, err, _("There was an error saving the Skein. Problem: "));
+	}
+	g_object_unref(skein_file);
+	g_object_unref(file);
+}
+
 static gboolean
 on_storywindow_delete_event(GtkWidget *window, GdkEvent *event)
 {
@@ -448,7 +466,7 @@ i7_story_save_as(I7Document *document, GFile *file)
 
 	/* Save the skein */
 	GFile *skein_file = g_file_get_child(file, "Skein.skein");
-	if(!i7_skein_save(priv->skein, skein_file, &err)) {
+	if(!i7_skein_save_incremental(priv->skein, skein_file, &err)) {
 		error_dialog(GTK_WINDOW(document), err, _("There was an error saving the Skein. Your story will still be saved. Problem: "));
 		err = NULL;
 	}
@@ -850,9 +868,11 @@ create_story_actions(I7Story *self)
 		{ "go", (ActionCallback)action_go },
 		{ "test-me", (ActionCallback)action_test_me },
 		{ "stop", (ActionCallback)action_stop },
+		{ "profile", NULL, NULL, "false", (ActionCallback)action_profile_toggled },
 		{ "refresh-index", (ActionCallback)action_refresh_index },
 		{ "replay", (ActionCallback)action_replay },
 		{ "play-all-blessed", (ActionCallback)action_play_all_blessed },
+		{ "test-all-blessed", (ActionCallback)action_test_all_blessed },
 		{ "show-last-command", (ActionCallback)action_show_last_command },
 		{ "show-last-command-skein", (ActionCallback)action_show_last_command_skein },
 		{ "previous-changed-command", (ActionCallback)action_previous_changed_command },
@@ -894,6 +914,8 @@ i7_story_init(I7Story *self)
 	create_story_actions(self);
 	GAction *stop = g_action_map_lookup_action(G_ACTION_MAP(self), "stop");
 	g_simple_action_set_enabled(G_SIMPLE_ACTION(stop), FALSE);
+	GAction *profile = g_action_map_lookup_action(G_ACTION_MAP(self), "profile");
+	g_simple_action_set_enabled(G_SIMPLE_ACTION(profile), FALSE);
 
 	/* Build the toolbars */
 	I7_DOCUMENT(self)->toolbar = GTK_WIDGET(gtk_builder_get_object(builder, "main-toolbar"));
@@ -943,6 +965,7 @@ i7_story_init(I7Story *self)
 	priv->copy_blorb_dest_file = NULL;
 	priv->compiler_output_file = NULL;
 	priv->test_me = FALSE;
+	priv->skein_test_running = FALSE;
 	priv->manifest = NULL;
 	
 	/* Set up the Skein */
@@ -1024,6 +1047,7 @@ i7_story_init(I7Story *self)
 	
 	/* Create a callback for the delete event */
 	g_signal_connect(self, "delete-event", G_CALLBACK(on_storywindow_delete_event), NULL);
+	g_signal_connect(self, "destroy", G_CALLBACK(on_storywindow_destroy), NULL);
 }
 
 static void
@@ -1660,3 +1684,17 @@ i7_story_get_skein_settings(I7Story *self)
 	I7StoryPrivate *priv = i7_story_get_instance_private(self);
 	return priv->skein_settings;
 }
+
+gboolean
+i7_story_get_skein_test_running(I7Story *self)
+{
+	I7StoryPrivate *priv = i7_story_get_instance_private(self);
+	return priv->skein_test_running;
+}
+
+void
+i7_story_set_skein_test_running(I7Story *self, gboolean running)
+{
+	I7StoryPrivate *priv = i7_story_get_instance_private(self);
+	priv->skein_test_running = running;
+}
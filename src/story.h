@@ -108,6 +108,8 @@ PlistObject *i7_story_get_settings(I7Story *self);
 GtkTextBuffer *i7_story_get_progress_buffer(I7Story *self);
 I7Skein *i7_story_get_skein(I7Story *self);
 GSettings *i7_story_get_skein_settings(I7Story *self);
+gboolean i7_story_get_skein_test_running(I7Story *self);
+void i7_story_set_skein_test_running(I7Story *self, gboolean running);
 
 /* Source pane, story-source.c */
 void on_panel_paste_code(I7Panel *panel, char *code, I7Story *self);
@@ -149,9 +151,11 @@ void i7_story_run_compiler_output_and_replay(I7Story *self);
 void i7_story_run_compiler_output_and_play_to_node(I7Story *self, I7Node *node);
 void i7_story_run_commands_from_node(I7Story *self, I7Node *node);
 void i7_story_run_compiler_output_and_entire_skein(I7Story *self);
+void i7_story_test_compiler_output_and_entire_skein(I7Story *self);
 void i7_story_stop_running_game(I7Story *self);
 gboolean i7_story_get_game_running(I7Story *self);
 void i7_story_set_use_git(I7Story *self, gboolean use_git);
+gboolean i7_story_set_profiling(I7Story *self, gboolean profiling);
 
 /* Transcript pane, story-transcript.c */
 void i7_story_previous_changed(I7Story *self);
@@ -0,0 +1,75 @@
+/* This file is part of GNOME Inform 7.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "inform6/inform6.h"
+
+static void
+discard_output(const char *text, void *data)
+{
+}
+
+/* Compile @source_path with the built-in compiler, passing @version_switch, and
+ check that it produced a story file starting with @magic */
+static void
+compile_and_check(const char *version_switch, const char *source_path, const char *magic, size_t magic_length)
+{
+	char *argv[] = {
+		g_strdup("inform6"),
+		g_strdup(version_switch),
+		g_strdup(source_path),
+		g_strdup("output"),
+		NULL
+	};
+	unsigned char *story;
+	size_t story_length;
+
+	int exit_code = inform6_compile(4, argv, discard_output, NULL, &story, &story_length);
+	g_assert_cmpint(exit_code, ==, 0);
+	g_assert_nonnull(story);
+	g_assert_cmpuint(story_length, >, magic_length);
+	g_assert_cmpmem(story, magic_length, magic, magic_length);
+
+	free(story);
+	for(unsigned ix = 0; argv[ix] != NULL; ix++)
+		g_free(argv[ix]);
+}
+
+/* Settings from one compilation must not carry over into the next one: Glulx
+ allows a larger DICT_WORD_SIZE than Z-code does, so compiling Z-code after
+ Glulx used to fail. */
+void
+test_inform6_glulx_then_zcode(void)
+{
+	GError *error = NULL;
+	char *source_path;
+	int fd = g_file_open_tmp("inform6-test-XXXXXX.inf", &source_path, &error);
+	g_assert_no_error(error);
+	g_close(fd, NULL);
+	g_file_set_contents(source_path, "[ Main; print \"Hello^\"; ];\n", -1, &error);
+	g_assert_no_error(error);
+
+	compile_and_check("-G", source_path, "Glul", 4);
+	compile_and_check("-v5", source_path, "\5", 1);
+	compile_and_check("-G", source_path, "Glul", 4);
+
+	g_unlink(source_path);
+	g_free(source_path);
+}
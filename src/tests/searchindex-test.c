@@ -0,0 +1,104 @@
+/* This file is part of GNOME Inform 7.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+#include "searchindex.h"
+
+static const char *documents[] = {
+	"The Lickable Wallpaper is a room. \"Stripes of fruit flavours.\"",
+	"Instead of licking the wallpaper: say \"Tasty!\"; now the wallpaper is licked.",
+	"A candy is a kind of thing. Some square candies are in the Lickable Wallpaper.",
+	"The STRASSE is a room. The printed name of the STRASSE is Straße.",
+};
+
+/* Count the matches of @text, checking that each one really is @text */
+static unsigned
+count_matches(I7SearchIndex *index, const char *text, gboolean ignore_case, I7SearchType type)
+{
+	g_autoptr(GArray) matches = i7_search_index_find(index, text, ignore_case, type);
+	for(unsigned ix = 0; ix < matches->len; ix++) {
+		I7SearchMatch *match = &g_array_index(matches, I7SearchMatch, ix);
+		const char *doc = i7_search_index_get_text(index, match->doc);
+		g_autofree char *found = g_strndup(doc + match->start, match->end - match->start);
+		if(ignore_case) {
+			g_autofree char *found_folded = g_utf8_casefold(found, -1);
+			g_autofree char *text_folded = g_utf8_casefold(text, -1);
+			g_assert_cmpstr(found_folded, ==, text_folded);
+		} else {
+			g_assert_cmpstr(found, ==, text);
+		}
+	}
+	return matches->len;
+}
+
+static I7SearchIndex *
+make_index(void)
+{
+	I7SearchIndex *index = i7_search_index_new();
+	for(unsigned ix = 0; ix < G_N_ELEMENTS(documents); ix++)
+		g_assert_cmpuint(i7_search_index_add_document(index, documents[ix]), ==, ix);
+	return index;
+}
+
+static void
+check_index(I7SearchIndex *index)
+{
+	g_assert_cmpuint(count_matches(index, "wallpaper", FALSE, I7_SEARCH_CONTAINS), ==, 2);
+	g_assert_cmpuint(count_matches(index, "wallpaper", TRUE, I7_SEARCH_CONTAINS), ==, 4);
+	g_assert_cmpuint(count_matches(index, "lick", TRUE, I7_SEARCH_CONTAINS), ==, 4);
+	g_assert_cmpuint(count_matches(index, "lick", TRUE, I7_SEARCH_STARTS_WORD), ==, 4);
+	g_assert_cmpuint(count_matches(index, "lick", TRUE, I7_SEARCH_FULL_WORD), ==, 0);
+	g_assert_cmpuint(count_matches(index, "ickable", TRUE, I7_SEARCH_CONTAINS), ==, 2);
+	g_assert_cmpuint(count_matches(index, "ickable", TRUE, I7_SEARCH_STARTS_WORD), ==, 0);
+	g_assert_cmpuint(count_matches(index, "the lickable wallpaper", TRUE, I7_SEARCH_FULL_WORD), ==, 2);
+	g_assert_cmpuint(count_matches(index, "\"Tasty!\";", FALSE, I7_SEARCH_CONTAINS), ==, 1);
+	g_assert_cmpuint(count_matches(index, "\"", FALSE, I7_SEARCH_CONTAINS), ==, 4);
+	g_assert_cmpuint(count_matches(index, "chocolate", TRUE, I7_SEARCH_CONTAINS), ==, 0);
+	/* Case is folded as GtkTextIter does, so ß matches SS */
+	g_assert_cmpuint(count_matches(index, "straße", TRUE, I7_SEARCH_FULL_WORD), ==, 3);
+	g_assert_cmpuint(count_matches(index, "Straße", FALSE, I7_SEARCH_FULL_WORD), ==, 1);
+
+	g_autoptr(GArray) matches = i7_search_index_find(index, "tasty", TRUE, I7_SEARCH_FULL_WORD);
+	g_assert_cmpuint(matches->len, ==, 1);
+	g_autofree char *context = i7_search_index_get_context(index, &g_array_index(matches, I7SearchMatch, 0));
+	g_assert_nonnull(strstr(context, "<b>Tasty</b>"));
+}
+
+void
+test_search_index_find(void)
+{
+	I7SearchIndex *index = make_index();
+	check_index(index);
+	i7_search_index_free(index);
+}
+
+void
+test_search_index_serialize(void)
+{
+	I7SearchIndex *index = make_index();
+	g_autoptr(GVariant) variant = g_variant_ref_sink(i7_search_index_to_variant(index));
+	i7_search_index_free(index);
+
+	g_assert_true(g_variant_is_of_type(variant, I7_SEARCH_INDEX_VARIANT_TYPE));
+	index = i7_search_index_new_from_variant(variant);
+	g_assert_nonnull(index);
+	g_assert_cmpuint(i7_search_index_get_n_documents(index), ==, G_N_ELEMENTS(documents));
+	g_assert_cmpstr(i7_search_index_get_text(index, 1), ==, documents[1]);
+	check_index(index);
+	i7_search_index_free(index);
+}
@@ -15,6 +15,8 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+
 #include <glib.h>
 #include "skein.h"
 #include "node.h"
@@ -54,4 +56,79 @@ test_skein_import(void)
 
 	g_object_unref(commands_file);
 	g_object_unref(skein);
-}
\ No newline at end of file
+}
+
+void
+test_skein_journal(void)
+{
+	GError *err = NULL;
+	char *tmpdir = g_dir_make_tmp("skein-test-XXXXXX", &err);
+	g_assert_no_error(err);
+	GFile *dir = g_file_new_for_path(tmpdir);
+	GFile *skein_file = g_file_get_child(dir, "Skein.skein");
+	GFile *journal_file = g_file_get_child(dir, "Skein.skein.journal");
+	GFile *original = g_file_new_for_path(TEST_DATA_DIR "Hereafter.inform/Skein.skein");
+	g_assert(g_file_copy(original, skein_file, G_FILE_COPY_NONE, NULL, NULL, NULL, &err));
+	g_assert_no_error(err);
+
+	I7Skein *skein = i7_skein_new();
+	g_assert(i7_skein_load(skein, skein_file, &err));
+	g_assert_no_error(err);
+	I7Node *node = i7_skein_new_command(skein, "look at wallpaper");
+	i7_node_set_transcript_text(node, "It's <lickable> & \"tasty\".");
+
+	/* The changes go into the journal, and the skein file is left alone */
+	g_assert(i7_skein_save_incremental(skein, skein_file, &err));
+	g_assert_no_error(err);
+	g_assert(g_file_query_exists(journal_file, NULL));
+	char *contents;
+	g_assert(g_file_load_contents(skein_file, NULL, &contents, NULL, NULL, &err));
+	g_assert_no_error(err);
+	g_assert(strstr(contents, "wallpaper") == NULL);
+	g_free(contents);
+
+	I7Skein *reloaded = i7_skein_new();
+	g_assert(i7_skein_load(reloaded, skein_file, &err));
+	g_assert_no_error(err);
+	GNode *child_gnode = i7_skein_get_root_node(reloaded)->gnode->children;
+	g_assert(child_gnode);
+	char *command = i7_node_get_command(child_gnode->data);
+	g_assert_cmpstr(command, ==, "look at wallpaper");
+	g_free(command);
+	char *transcript = i7_node_get_transcript_text(child_gnode->data);
+	g_assert_cmpstr(transcript, ==, "It's <lickable> & \"tasty\".");
+	g_free(transcript);
+
+	/* Closing the project folds the journal back into the skein file */
+	g_assert(i7_skein_fold_journal(skein_file, &err));
+	g_assert_no_error(err);
+	g_assert(!g_file_query_exists(journal_file, NULL));
+	g_assert(g_file_load_contents(skein_file, NULL, &contents, NULL, NULL, &err));
+	g_assert_no_error(err);
+	g_assert(strstr(contents, "wallpaper") != NULL);
+	g_free(contents);
+
+	/* A full save folds the journal back into the skein file too */
+	I7Skein *refolded = i7_skein_new();
+	g_assert(i7_skein_load(refolded, skein_file, &err));
+	g_assert_no_error(err);
+	i7_skein_new_command(refolded, "lick wallpaper");
+	g_assert(i7_skein_save_incremental(refolded, skein_file, &err));
+	g_assert_no_error(err);
+	g_assert(g_file_query_exists(journal_file, NULL));
+	g_assert(i7_skein_save(refolded, skein_file, &err));
+	g_assert_no_error(err);
+	g_assert(!g_file_query_exists(journal_file, NULL));
+
+	g_object_unref(refolded);
+
+	g_object_unref(reloaded);
+	g_object_unref(skein);
+	g_file_delete(skein_file, NULL, NULL);
+	g_file_delete(dir, NULL, NULL);
+	g_object_unref(original);
+	g_object_unref(journal_file);
+	g_object_unref(skein_file);
+	g_object_unref(dir);
+	g_free(tmpdir);
+}
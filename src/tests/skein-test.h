@@ -24,6 +24,7 @@
 G_BEGIN_DECLS
 
 void test_skein_import(void);
+void test_skein_journal(void);
 
 G_END_DECLS
 
@@ -19,6 +19,8 @@
 #include <gtk/gtk.h>
 #include "app.h"
 #include "app-test.h"
+#include "inform6-test.h"
+#include "searchindex-test.h"
 #include "skein-test.h"
 #include "story-test.h"
 
@@ -36,7 +38,13 @@ main(int argc, char **argv)
 	g_test_add_func("/app/colorscheme/install-remove", test_app_colorscheme_install_remove);
 	g_test_add_func("/app/colorscheme/get-current", test_app_colorscheme_get_current);
 
+	g_test_add_func("/inform6/glulx-then-zcode", test_inform6_glulx_then_zcode);
+
+	g_test_add_func("/searchindex/find", test_search_index_find);
+	g_test_add_func("/searchindex/serialize", test_search_index_serialize);
+
 	g_test_add_func("/skein/import", test_skein_import);
+	g_test_add_func("/skein/journal", test_skein_journal);
 
 	g_test_add_func("/story/util/files-are-siblings", test_files_are_siblings);
 	g_test_add_func("/story/util/files-are-not-siblings", test_files_are_not_siblings);